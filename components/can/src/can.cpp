@@ -42,16 +42,20 @@ static const char *TAG = "can";
 #include "dbc.h"
 #include "dbc_app.h"
 #include <algorithm>
+#include <new>
 #include <ctype.h>
 #include <string.h>
 #include <iomanip>
+#include <sstream>
+#include <esp_timer.h>
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "metrics_standard.h"
 
 #if defined(CONFIG_OVMS_COMP_ESP32CAN) || \
     defined(CONFIG_OVMS_COMP_MCP2515) || \
-    defined(CONFIG_OVMS_COMP_EXTERNAL_SWCAN)
+    defined(CONFIG_OVMS_COMP_EXTERNAL_SWCAN) || \
+    defined(CONFIG_OVMS_COMP_VCAN)
 static const bool includeCAN = true;
 #else
 static const bool includeCAN = false;
@@ -345,6 +349,8 @@ void can_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
                                    ((sbus->m_mode==CAN_MODE_LISTEN)?"Listen":"Active"));
   writer->printf("Speed:     %d\n",MAP_CAN_SPEED(sbus->m_speed));
   writer->printf("DBC:       %s\n",(sbus->GetDBC())?sbus->GetDBC()->GetName().c_str():"none");
+  if (!sbus->m_rxfilter_info.empty())
+    writer->printf("HW filter: %s\n",sbus->m_rxfilter_info.c_str());
 
   writer->printf("\nInterrupts:%20" PRId32 "\n",sbus->m_status.interrupts);
   writer->printf("Rx pkt:    %20" PRId32 "\n",sbus->m_status.packets_rx);
@@ -364,27 +370,13 @@ void can_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
     writer->printf("Wdg Timer: %20" PRId32 " sec(s)\n",monotonictime-sbus->m_watchdog_timer);
     }
   writer->printf("Err Resets:%20d\n",sbus->m_status.error_resets);
-  }
 
-void can_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
-  {
-  for (int k=1;k<5;k++)
-    {
-    static const char* name[4] = {"can1", "can2", "can3", "can4"};
-    canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(name[k-1]);
-    if (sbus != NULL)
-      {
-      writer->printf("%s: %s/%d dbc %s\n",
-        sbus->GetName(),
-        (sbus->m_mode==CAN_MODE_OFF)?"Off":
-          ((sbus->m_mode==CAN_MODE_LISTEN)?"Listen":"Active"),
-        MAP_CAN_SPEED(sbus->m_speed),
-        (sbus->GetDBC())?sbus->GetDBC()->GetName().c_str():"none");
-      }
-    }
+  std::string driverstatus = sbus->GetDriverStatus();
+  if (!driverstatus.empty())
+    writer->printf("\n%s", driverstatus.c_str());
   }
 
-void can_clearstatus(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+void can_rxfilter(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char* bus = cmd->GetParent()->GetName();
   canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
@@ -394,11 +386,20 @@ void can_clearstatus(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
     return;
     }
 
-  sbus->ClearStatus();
-  writer->puts("Status cleared");
+  CAN_filter_range_list_t std_ranges, ext_ranges;
+  if (!can::instance(TAG).GetRxInterest(sbus, std_ranges, ext_ranges))
+    writer->puts("Interest:  none declared (accept all)");
+  for (const CAN_filter_range_t& range : std_ranges)
+    writer->printf("Standard:  %03" PRIx32 "-%03" PRIx32 "\n", range.id_from, range.id_to);
+  for (const CAN_filter_range_t& range : ext_ranges)
+    writer->printf("Extended:  %08" PRIx32 "-%08" PRIx32 "\n", range.id_from, range.id_to);
+  writer->printf("HW filter: %s%s%s\n",
+    sbus->m_rxfilter_info.empty() ? "not supported" : sbus->m_rxfilter_info.c_str(),
+    sbus->m_rxfilter_pending ? " (pending)" : "",
+    (sbus->m_rxfilter_narrow || sbus->m_rxfilter_info.empty()) ? "" : " (open)");
   }
 
-void can_view_registers(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+void can_stats(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char* bus = cmd->GetParent()->GetName();
   canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
@@ -407,14 +408,14 @@ void can_view_registers(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int
     writer->puts("Error: Cannot find named CAN bus");
     return;
     }
-
-  if (sbus->ViewRegisters() == ESP_ERR_NOT_SUPPORTED)
-    writer->puts("Error: Not implemented");
-  else
-    writer->puts("See logs for details");
+  int maxids = (argc > 0) ? atoi(argv[0]) : -1;
+  if (sbus->m_rxfilter_narrow && !sbus->m_rxfilter_info.empty())
+    writer->printf("Note:      HW filter active, load of accepted frames only\n"
+                   "           (config set can rxfilter.%s no for the full bus load)\n", bus);
+  writer->puts(sbus->m_traffic.GetStats(maxids).c_str());
   }
 
-void can_set_register(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+void can_cache(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   const char* bus = cmd->GetParent()->GetName();
   canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
@@ -423,456 +424,2944 @@ void can_set_register(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int a
     writer->puts("Error: Cannot find named CAN bus");
     return;
     }
-  if (argc<2)
+  int maxids = (argc > 0) ? atoi(argv[0]) : -1;
+  writer->puts(sbus->m_framecache.GetStats(maxids).c_str());
+  }
+
+static canbus* can_txqueue_bus(OvmsWriter* writer, OvmsCommand* cmd)
+  {
+  // find the bus command level above "txqueue":
+  while (cmd && strcmp(cmd->GetName(), "txqueue") != 0)
+    cmd = cmd->GetParent();
+  canbus* sbus = (cmd) ? (canbus*)pcpapp::instance().FindDeviceByName(cmd->GetParent()->GetName()) : NULL;
+  if (sbus == NULL)
+    writer->puts("Error: Cannot find named CAN bus");
+  return sbus;
+  }
+
+void can_txqueue_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  canbus* sbus = can_txqueue_bus(writer, cmd);
+  if (sbus == NULL) return;
+  writer->puts(sbus->m_txqueue.GetStats().c_str());
+  }
+
+void can_txqueue_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  canbus* sbus = can_txqueue_bus(writer, cmd);
+  if (sbus == NULL) return;
+  sbus->m_txqueue.ClearStats();
+  writer->puts("TX queue statistics cleared");
+  }
+
+void can_txqueue_order(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  canbus* sbus = can_txqueue_bus(writer, cmd);
+  if (sbus == NULL) return;
+  sbus->m_txqueue.SetOrderById(strcmp(cmd->GetName(), "id") == 0);
+  writer->printf("TX queue order within priority class: %s\n",
+    sbus->m_txqueue.GetOrderById() ? "arbitration ID" : "FIFO");
+  }
+
+void can_txqueue_rule_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  canbus* sbus = can_txqueue_bus(writer, cmd);
+  if (sbus == NULL) return;
+
+  CAN_txprio_t prio = CAN_TXPRIO_COUNT;
+  for (int k=0; k<CAN_TXPRIO_COUNT; k++)
     {
-    writer->puts("Error: register address and value must be given");
+    if (strcmp(argv[0], CAN_txprio_name((CAN_txprio_t)k)) == 0)
+      prio = (CAN_txprio_t)k;
+    }
+  if (prio == CAN_TXPRIO_COUNT)
+    {
+    writer->printf("Error: Invalid priority class \"%s\" (control/normal/diag)\n", argv[0]);
     return;
     }
-  uint32_t addr = (int)strtol(argv[0],NULL,16);
-  uint32_t value = (int)strtol(argv[1],NULL,16);
-  if (addr > 255)
+
+  CAN_frame_format_t format;
+  uint32_t idmax;
+  if (strcmp(argv[1], "std") == 0)
     {
-    writer->puts("Error: Register address out of range");
+    format = CAN_frame_std;
+    idmax = (1 << 11) - 1;
+    }
+  else if (strcmp(argv[1], "ext") == 0)
+    {
+    format = CAN_frame_ext;
+    idmax = (1 << 29) - 1;
+    }
+  else
+    {
+    writer->printf("Error: Invalid frame format \"%s\" (std/ext)\n", argv[1]);
     return;
     }
-  if (value > 255)
+
+  char* ep;
+  uint32_t id_from = strtoul(argv[2], &ep, 16);
+  uint32_t id_to = id_from;
+  if (*ep != '\0' || id_from > idmax)
     {
-    writer->puts("Error: Register value out of range");
+    writer->printf("Error: Invalid CAN ID \"%s\" (0x%" PRIx32 " max)\n", argv[2], idmax);
     return;
     }
+  if (argc > 3)
+    {
+    id_to = strtoul(argv[3], &ep, 16);
+    if (*ep != '\0' || id_to > idmax || id_to < id_from)
+      {
+      writer->printf("Error: Invalid CAN ID \"%s\"\n", argv[3]);
+      return;
+      }
+    }
+  uint32_t deadline_ms = (argc > 4) ? atoi(argv[4]) : 0;
 
-  sbus->WriteReg(addr,value);
+  sbus->m_txqueue.AddRule(format, id_from, id_to, prio, deadline_ms);
+  writer->puts("TX queue rule added");
   }
 
-////////////////////////////////////////////////////////////////////////
-// CAN Filtering (software based filter)
-// The canfilter object encapsulates the filtering of CAN frames
-////////////////////////////////////////////////////////////////////////
-
-canfilter::canfilter()
+void can_txqueue_rule_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
+  canbus* sbus = can_txqueue_bus(writer, cmd);
+  if (sbus == NULL) return;
+  sbus->m_txqueue.ClearRules();
+  writer->puts("TX queue rules reset to defaults");
   }
 
-canfilter::~canfilter()
+static canbus* can_periodic_bus(OvmsWriter* writer, OvmsCommand* cmd)
   {
-  ClearFilters();
+  // find the bus command level above "periodic":
+  while (cmd && strcmp(cmd->GetName(), "periodic") != 0)
+    cmd = cmd->GetParent();
+  canbus* sbus = (cmd) ? (canbus*)pcpapp::instance().FindDeviceByName(cmd->GetParent()->GetName()) : NULL;
+  if (sbus == NULL)
+    writer->puts("Error: Cannot find named CAN bus");
+  return sbus;
   }
 
-void canfilter::ClearFilters()
+void can_periodic_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  for (CAN_filter_t* filter : m_filters)
-    {
-    delete filter;
-    }
-  m_filters.clear();
+  canbus* sbus = can_periodic_bus(writer, cmd);
+  if (sbus == NULL) return;
+  writer->puts(can::instance(TAG).m_periodic.GetList(sbus).c_str());
   }
 
-void canfilter::AddFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
+void can_periodic_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  CAN_filter_t* f = new CAN_filter_t;
-  f->bus = bus;
-  f->id_from = id_from;
-  f->id_to = id_to;
-  m_filters.push_back(f);
-  }
+  canbus* sbus = can_periodic_bus(writer, cmd);
+  if (sbus == NULL) return;
+  const char* mode = cmd->GetName();
 
-void canfilter::AddFilter(const char* filterstring)
-  {
-  char* fs = (char*)filterstring;
-  if (fs[1] == 0)
+  char* ep;
+  uint32_t period_ms = strtoul(argv[0], &ep, 10);
+  if (*ep != '\0' || period_ms == 0)
     {
-    AddFilter((uint8_t)fs[0]);
+    writer->printf("Error: Invalid period \"%s\"\n", argv[0]);
+    return;
     }
-  else
+
+  CAN_frame_t frame = {};
+  frame.origin = sbus;
+  frame.FIR.U = 0;
+  bool dbcsource = (strcmp(mode, "dbc") == 0);
+
+  if (dbcsource)
     {
-    uint8_t bus = 0;
-    uint32_t id_from = 0;
-    uint32_t id_to = UINT32_MAX;
-    if (fs[1] == ':')
+    dbcfile* dbc = sbus->GetDBC();
+    if (dbc == NULL)
       {
-      bus = fs[0];
-      fs += 2;
+      writer->puts("Error: No DBC file attached to this CAN bus");
+      return;
       }
-    id_from = strtol(fs, &fs, 16);
-    if (*fs)
-      id_to = strtol(fs+1, NULL, 16); // id range
-    else
-      id_to = id_from; // single id
-    AddFilter(bus,id_from,id_to);
+    uint32_t id = strtoul(argv[1], &ep, 16);
+    dbcMessage* msg = NULL;
+    if (*ep == '\0')
+      {
+      msg = dbc->m_messages.FindMessage(CAN_frame_std, id);
+      if (msg == NULL)
+        msg = dbc->m_messages.FindMessage(CAN_frame_ext, id);
+      }
+    if (msg == NULL)
+      {
+      writer->printf("Error: Message \"%s\" not found in DBC file\n", argv[1]);
+      return;
+      }
+    frame.FIR.B.FF = msg->GetFormat();
+    frame.FIR.B.DLC = std::min(msg->GetSize(), 8);
+    frame.MsgID = msg->GetID() & 0x1fffffff;
     }
-  }
-
-bool canfilter::RemoveFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
-  {
-  for (CAN_filter_t* filter : m_filters)
+  else
     {
-    if ((filter->bus == bus)&&
-        (filter->id_from == id_from)&&
-        (filter->id_to == id_to))
+    uint32_t idmax = (1 << 11) - 1;
+    frame.FIR.B.FF = CAN_frame_std;
+    if (strcmp(mode, "extended") == 0)
       {
-      delete filter;
-      return true;
+      frame.FIR.B.FF = CAN_frame_ext;
+      idmax = (1 << 29) - 1;
+      }
+    uint32_t uv = strtoul(argv[1], &ep, 16);
+    if (*ep != '\0' || uv > idmax)
+      {
+      writer->printf("Error: Invalid CAN ID \"%s\" (0x%" PRIx32 " max)\n", argv[1], idmax);
+      return;
+      }
+    frame.MsgID = uv;
+    frame.FIR.B.DLC = argc-2;
+    for (int k=0; k<(argc-2); k++)
+      {
+      uv = strtoul(argv[k+2], &ep, 16);
+      if (*ep != '\0' || uv > 0xff)
+        {
+        writer->printf("Error: Invalid CAN octet \"%s\"\n", argv[k+2]);
+        return;
+        }
+      frame.data.u8[k] = uv;
       }
     }
-  return false;
+
+  uint32_t handle = sbus->AddPeriodic("cmd", &frame, period_ms, -1, NULL, dbcsource);
+  if (handle)
+    writer->printf("Periodic frame #%" PRIu32 " added\n", handle);
+  else
+    writer->puts("Error: Periodic frame could not be added");
   }
 
-bool canfilter::IsFiltered(const CAN_frame_t* p_frame)
+void can_periodic_remove(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  if (m_filters.size() == 0) return true;
-  if (! p_frame) return false;
+  canbus* sbus = can_periodic_bus(writer, cmd);
+  if (sbus == NULL) return;
 
-  char buskey = '0';
-  if (p_frame->origin) buskey = p_frame->origin->m_busnumber + '1';
-
-  for (CAN_filter_t* filter : m_filters)
+  if (strcmp(argv[0], "all") == 0)
     {
-    if ((filter->bus)&&(filter->bus != buskey)) continue;
-    if ((p_frame->MsgID >= filter->id_from) && (p_frame->MsgID <= filter->id_to))
-      return true;
+    int cnt = sbus->RemovePeriodics("cmd");
+    writer->printf("%d periodic frame(s) removed\n", cnt);
+    return;
     }
 
-  return false;
+  uint32_t handle = strtoul((argv[0][0] == '#') ? argv[0]+1 : argv[0], NULL, 10);
+  if (sbus->RemovePeriodic(handle))
+    writer->printf("Periodic frame #%" PRIu32 " removed\n", handle);
+  else
+    writer->printf("Error: Periodic frame \"%s\" not found\n", argv[0]);
   }
 
-bool canfilter::IsFiltered(canbus* bus)
+void can_periodic_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  if (m_filters.size() == 0) return true;
-  if (bus == NULL) return true;
-
-  char buskey = bus->GetName()[3];
+  canbus* sbus = can_periodic_bus(writer, cmd);
+  if (sbus == NULL) return;
+  can::instance(TAG).m_periodic.ClearStats(sbus);
+  writer->puts("Periodic frame statistics cleared");
+  }
 
-  for (CAN_filter_t* filter : m_filters)
+void can_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  for (int k=1;k<=CAN_MAXBUSES;k++)
     {
-    if ((filter->bus)&&(filter->bus == buskey)) return true;
+    static const char* name[CAN_MAXBUSES] = {"can1", "can2", "can3", "can4", "can5"};
+    canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(name[k-1]);
+    if (sbus != NULL)
+      {
+      writer->printf("%s: %s/%d dbc %s\n",
+        sbus->GetName(),
+        (sbus->m_mode==CAN_MODE_OFF)?"Off":
+          ((sbus->m_mode==CAN_MODE_LISTEN)?"Listen":"Active"),
+        MAP_CAN_SPEED(sbus->m_speed),
+        (sbus->GetDBC())?sbus->GetDBC()->GetName().c_str():"none");
+      }
     }
+  }
 
-  return false;
+void can_ring_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  writer->puts(can::instance(TAG).m_ring.GetStats().c_str());
   }
 
-std::string canfilter::Info()
+void can_ring_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  std::ostringstream buf;
+  can::instance(TAG).m_ring.ClearStats();
+  writer->puts("Ring statistics cleared");
+  }
 
-  for (CAN_filter_t* filter : m_filters)
+void can_rxtask_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  can &canctl = can::instance(TAG);
+  writer->printf("Mode: %s\n",
+    OvmsConfig::instance(TAG).GetParamValue("can", "rxtask.mode", "shared").c_str());
+  writer->puts("Task                Core  Messages  Highwater    CPU ms  CPU %  Max us");
+  writer->puts(canctl.m_rxtask->GetStats().c_str());
+  for (int k=0; k<CAN_MAXBUSES; k++)
     {
-    if (filter->bus > 0) buf << std::setfill(' ') << std::dec << filter->bus << ':';
-    buf << std::setfill('0') << std::setw(3) << std::hex;
-    if (filter->id_from == filter->id_to)
-      { buf << filter->id_from << ' '; }
-    else
-      { buf << filter->id_from << '-' << filter->id_to << ' '; }
+    canbus* bus = canctl.GetBus(k);
+    if (bus && bus->m_rxtask)
+      {
+      writer->printf("%s%s\n", bus->m_rxtask->GetStats().c_str(),
+        (bus->m_rxqueue == bus->m_rxtask->m_queue) ? "" : " (inactive)");
+      }
     }
-
-  return buf.str();
   }
 
-////////////////////////////////////////////////////////////////////////
-// CAN logging and tracing
-// These structures are involved in formatting, logging and tracing of
-// CAN messages (both frames and status/control messages)
-////////////////////////////////////////////////////////////////////////
-
-static const char* const CAN_log_type_names[] = {
-  "-",
-  "RX",
-  "TX",
-  "TX_Queue",
-  "TX_Fail",
-  "Error",
-  "Status",
-  "Comment",
-  "Info",
-  "Event",
-  "Metric"
-  };
-
-const char* GetCanLogTypeName(CAN_log_type_t type)
+void can_rxtask_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  return CAN_log_type_names[type];
+  can &canctl = can::instance(TAG);
+  canctl.m_rxtask->ClearStats();
+  for (int k=0; k<CAN_MAXBUSES; k++)
+    {
+    canbus* bus = canctl.GetBus(k);
+    if (bus && bus->m_rxtask)
+      bus->m_rxtask->ClearStats();
+    }
+  writer->puts("RX task statistics cleared");
   }
 
-void can::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame)
+// Parse up to 8 payload bytes given as hex digits, byte 0 first:
+static bool can_gateway_parse_bytes(const char* hex, uint64_t* value)
   {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
-
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
+  size_t len = strlen(hex);
+  if (len == 0 || len > 16 || (len & 1)) return false;
+  *value = 0;
+  for (size_t k=0; k<len; k+=2)
     {
-    it->second->LogFrame(bus, type, frame);
+    char byte[3] = { hex[k], hex[k+1], 0 };
+    char* ep;
+    uint64_t bv = strtoul(byte, &ep, 16);
+    if (*ep != '\0') return false;
+    *value |= bv << (k*4);
     }
+  return true;
   }
 
-void can::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status)
+void can_gateway_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
+  CAN_gateway_route_t route = {};
+  route.dlc = -1;
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
+  route.src = (canbus*)pcpapp::instance().FindDeviceByName(argv[0]);
+  route.dst = (canbus*)pcpapp::instance().FindDeviceByName(argv[3]);
+  if (route.src == NULL || route.dst == NULL || route.src == route.dst)
     {
-    it->second->LogStatus(bus, type, status);
+    writer->puts("Error: Invalid source / destination CAN bus");
+    return;
     }
-  }
-
-void can::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
-  {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
+  uint32_t idmax;
+  if (strcmp(argv[1], "std") == 0)
     {
-    it->second->LogInfo(bus, type, text);
+    route.format = CAN_frame_std;
+    idmax = 0x7ff;
+    }
+  else if (strcmp(argv[1], "ext") == 0)
+    {
+    route.format = CAN_frame_ext;
+    idmax = 0x1fffffff;
+    }
+  else
+    {
+    writer->printf("Error: Invalid frame format \"%s\" (std/ext)\n", argv[1]);
+    return;
     }
-  }
 
-void canbus::LogFrame(CAN_log_type_t type, const CAN_frame_t* frame)
-  {
-  can::instance(TAG).LogFrame(this, type, frame);
-  }
+  char* ep;
+  route.id = strtoul(argv[2], &ep, 16);
+  route.mask = idmax;
+  if (*ep == '/')
+    route.mask = strtoul(ep+1, &ep, 16);
+  if (*ep != '\0' || route.id > idmax || route.mask > idmax)
+    {
+    writer->printf("Error: Invalid CAN ID/mask \"%s\"\n", argv[2]);
+    return;
+    }
 
-void canbus::LogStatus(CAN_log_type_t type)
-  {
-  if (type==CAN_LogStatus_Error)
+  for (int k=4; k<argc; k++)
     {
-    if (!StatusChanged())
+    const char* arg = argv[k];
+    bool valid = false;
+    if (strncmp(arg, "id=", 3) == 0)
+      {
+      route.rewrite = true;
+      route.newid = strtoul(arg+3, &ep, 16);
+      valid = (*ep == '\0' && arg[3] && route.newid <= idmax);
+      }
+    else if (strncmp(arg, "map=", 4) == 0 && strlen(arg+4) == 8)
+      {
+      route.permute = true;
+      valid = true;
+      for (int b=0; b<8; b++)
+        {
+        char c = arg[4+b];
+        if (c >= '0' && c <= '7')
+          route.map[b] = c - '0';
+        else if (c == '-')
+          route.map[b] = 0xff;
+        else
+          valid = false;
+        }
+      }
+    else if (strncmp(arg, "merge=", 6) == 0)
+      {
+      const char* sep = strchr(arg+6, ':');
+      if (sep)
+        {
+        std::string mask(arg+6, sep-(arg+6));
+        valid = can_gateway_parse_bytes(mask.c_str(), &route.mergemask)
+             && can_gateway_parse_bytes(sep+1, &route.mergevalue);
+        }
+      }
+    else if (strncmp(arg, "dlc=", 4) == 0)
+      {
+      int dlc = strtol(arg+4, &ep, 10);
+      valid = (*ep == '\0' && arg[4] && dlc >= 0 && dlc <= 8);
+      route.dlc = dlc;
+      }
+    if (!valid)
+      {
+      writer->printf("Error: Invalid option \"%s\"\n", arg);
       return;
-    ESP_LOGE(TAG,
-      "%s: intr=%" PRId32 " rxpkt=%" PRId32 " txpkt=%" PRId32 " errflags=%#" PRIx32 " rxerr=%d txerr=%d rxinval=%d"
-      " rxovr=%d txovr=%d txdelay=%" PRId32 " txfail=%" PRId32 " wdgreset=%d errreset=%d",
-      m_name, m_status.interrupts, m_status.packets_rx, m_status.packets_tx,
-      m_status.error_flags, m_status.errors_rx, m_status.errors_tx,
-      m_status.invalid_rx, m_status.rxbuf_overflow, m_status.txbuf_overflow,
-      m_status.txbuf_delay, m_status.tx_fails, m_status.watchdog_resets,
-      m_status.error_resets);
+      }
     }
-  if (can::instance(TAG).HasLogger())
-    can::instance(TAG).LogStatus(this, type, &m_status);
-  }
 
-void canbus::LogInfo(CAN_log_type_t type, const char* text)
-  {
-  can::instance(TAG).LogInfo(this, type, text);
+  uint32_t handle = can::instance(TAG).m_gateway.AddRoute(route);
+  if (handle)
+    writer->printf("Gateway route #%" PRIu32 " added\n", handle);
+  else
+    writer->puts("Error: Gateway route could not be added");
   }
 
-bool canbus::StatusChanged()
+void can_gateway_remove(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  // simple checksum to prevent log flooding:
-  uint32_t chksum = m_status.errors_rx + m_status.errors_tx
-    + m_status.invalid_rx + m_status.rxbuf_overflow + m_status.txbuf_overflow
-    + m_status.error_flags + m_status.txbuf_delay + m_status.tx_fails
-    + m_status.watchdog_resets + m_status.error_resets;
-  if (chksum != m_status_chksum)
+  if (strcmp(argv[0], "all") == 0)
     {
-    m_status_chksum = chksum;
-    return true;
+    int cnt = can::instance(TAG).m_gateway.RemoveRoutes();
+    writer->printf("%d gateway route(s) removed\n", cnt);
+    return;
     }
-  return false;
+  uint32_t handle = strtoul((argv[0][0] == '#') ? argv[0]+1 : argv[0], NULL, 10);
+  if (can::instance(TAG).m_gateway.RemoveRoute(handle))
+    writer->printf("Gateway route #%" PRIu32 " removed\n", handle);
+  else
+    writer->printf("Error: Gateway route \"%s\" not found\n", argv[0]);
   }
 
-static const char* const CAN_errorstate_names[] = {
-  "none",
-  "active",
-  "warning",
-  "passive",
-  "busoff"
-  };
+void can_gateway_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  writer->puts(can::instance(TAG).m_gateway.GetList().c_str());
+  }
 
-const char* GetCanErrorStateName(CAN_errorstate_t error_state)
+void can_gateway_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  return CAN_errorstate_names[error_state];
+  can::instance(TAG).m_gateway.ClearStats();
+  writer->puts("Gateway statistics cleared");
   }
 
-CAN_errorstate_t canbus::GetErrorState()
+#define CAN_BENCH_MAXREADERS  8
+
+void can_bench_fanout(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  if (m_status.errors_tx == 0 && m_status.errors_rx == 0)
-    return CAN_errorstate_none;
-  else if (m_status.errors_tx < 96 && m_status.errors_rx < 96)
-    return CAN_errorstate_active;
-  else if (m_status.errors_tx < 128 && m_status.errors_rx < 128)
-    return CAN_errorstate_warning;
-  else if (m_status.errors_tx < 256 && m_status.errors_rx < 256)
+  // Compare per-listener queue copies against the shared frame ring
+  // for a fan-out of <frames> frames to <readers> consumers:
+  const int batch = 16;
+  uint32_t frames = (argc > 0) ? strtoul(argv[0], NULL, 10) : 10000;
+  int readers = (argc > 1) ? atoi(argv[1]) : 3;
+  if (readers < 1 || readers > CAN_BENCH_MAXREADERS)
+    {
+    writer->printf("Error: readers must be 1..%d\n", CAN_BENCH_MAXREADERS);
+    return;
+    }
+  canbus* bus = can::instance(TAG).GetBus(0);
+  if (bus == NULL)
+    {
+    writer->puts("Error: can1 not available");
+    return;
+    }
+
+  CAN_frame_t frame = {};
+  frame.origin = bus;
+  frame.FIR.B.DLC = 8;
+  frame.MsgID = 0x100;
+
+  // Queue fan-out (one xQueueSend + xQueueReceive copy per listener):
+  QueueHandle_t queues[CAN_BENCH_MAXREADERS];
+  for (int k=0; k<readers; k++)
+    queues[k] = xQueueCreate(batch, sizeof(CAN_frame_t));
+  CAN_frame_t rxframe;
+  uint32_t copies = 0;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t n=0; n<frames; n+=batch)
+    {
+    for (int b=0; b<batch; b++)
+      {
+      frame.data.u32[0] = n+b;
+      for (int k=0; k<readers; k++)
+        if (xQueueSend(queues[k], &frame, 0) == pdTRUE) copies++;
+      }
+    for (int k=0; k<readers; k++)
+      {
+      while (xQueueReceive(queues[k], &rxframe, 0) == pdTRUE)
+        copies++;
+      }
+    }
+  int64_t queuetime = esp_timer_get_time() - start;
+  uint32_t queuecopies = copies;
+  for (int k=0; k<readers; k++)
+    vQueueDelete(queues[k]);
+
+  // Shared ring fan-out (one compact record in the ring, readers expand it):
+  canring ring;
+  if (!ring.Init(batch * 2))
+    {
+    writer->puts("Error: out of memory");
+    return;
+    }
+  canringreader* rd[CAN_BENCH_MAXREADERS];
+  for (int k=0; k<readers; k++)
+    {
+    rd[k] = new canringreader("bench", CAN_RING_RX);
+    rd[k]->Attach(&ring);
+    }
+  uint32_t checksum = 0;
+  start = esp_timer_get_time();
+  for (uint32_t n=0; n<frames; n+=batch)
+    {
+    for (int b=0; b<batch; b++)
+      {
+      frame.data.u32[0] = n+b;
+      ring.Write(bus, CAN_LogFrame_RX, &frame);
+      }
+    for (int k=0; k<readers; k++)
+      {
+      CAN_log_message_t* entry;
+      while ((entry = rd[k]->Read(0)) != NULL)
+        checksum += entry->frame.data.u32[0];
+      }
+    }
+  int64_t ringtime = esp_timer_get_time() - start;
+  uint32_t ringcopies = ring.m_writecount;
+  uint32_t ringlost = 0;
+  for (int k=0; k<readers; k++)
+    {
+    ringcopies += rd[k]->m_readcount;
+    ringlost += rd[k]->m_overflowcount;
+    delete rd[k];
+    }
+
+  writer->printf("Fan-out of %" PRIu32 " frames to %d readers:\n", frames, readers);
+  writer->printf("  Queues: %7.2f us/frame, %5.2f copies/frame\n",
+    (float)queuetime / frames, (float)queuecopies / frames);
+  writer->printf("  Ring:   %7.2f us/frame, %5.2f copies/frame, %" PRIu32 " lost (checksum %08" PRIx32 ")\n",
+    (float)ringtime / frames, (float)ringcopies / frames, ringlost, checksum);
+  }
+
+void can_bench_filter(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  // Compare the compiled canfilter lookup against a list scan
+  // for 1, 10 and 100 filter ranges:
+  uint32_t frames = (argc > 0) ? strtoul(argv[0], NULL, 10) : 10000;
+  canbus* bus = can::instance(TAG).GetBus(0);
+  if (bus == NULL)
+    {
+    writer->puts("Error: can1 not available");
+    return;
+    }
+
+  CAN_frame_t* testframes = (CAN_frame_t*)malloc(256 * sizeof(CAN_frame_t));
+  if (!testframes)
+    {
+    writer->puts("Error: out of memory");
+    return;
+    }
+  uint32_t rnd = 0x12345678;
+  for (int k=0; k<256; k++)
+    {
+    rnd = rnd * 1103515245 + 12345;
+    memset(&testframes[k], 0, sizeof(CAN_frame_t));
+    testframes[k].origin = bus;
+    testframes[k].FIR.B.FF = (k & 3) ? CAN_frame_std : CAN_frame_ext;
+    testframes[k].MsgID = (k & 3) ? ((rnd >> 8) & 0x7ff) : ((rnd >> 3) & 0x1fffffff);
+    }
+
+  writer->printf("Ranges   List scan   Compiled   (us/frame, %" PRIu32 " frames)\n", frames);
+  static const int rangecounts[] = { 1, 10, 100 };
+  for (int rangecount : rangecounts)
+    {
+    canfilter filter;
+    CAN_filter_list_t list;
+    for (int k=0; k<rangecount; k++)
+      {
+      rnd = rnd * 1103515245 + 12345;
+      CAN_filter_t* f = new CAN_filter_t;
+      f->bus = (k & 1) ? '1' : 0;
+      f->id_from = (k & 3) ? ((rnd >> 8) & 0x7ff) : ((rnd >> 3) & 0x1fffffff);
+      f->id_to = f->id_from + (rnd & 0x0f);
+      list.push_back(f);
+      filter.AddFilter(f->bus, f->id_from, f->id_to);
+      }
+
+    uint32_t listmatches = 0, compiledmatches = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t n=0; n<frames; n++)
+      {
+      const CAN_frame_t* frame = &testframes[n & 255];
+      char buskey = frame->origin->m_busnumber + '1';
+      for (CAN_filter_t* f : list)
+        {
+        if ((f->bus)&&(f->bus != buskey)) continue;
+        if ((frame->MsgID >= f->id_from) && (frame->MsgID <= f->id_to))
+          {
+          listmatches++;
+          break;
+          }
+        }
+      }
+    int64_t listtime = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t n=0; n<frames; n++)
+      {
+      if (filter.IsFiltered(&testframes[n & 255]))
+        compiledmatches++;
+      }
+    int64_t compiledtime = esp_timer_get_time() - start;
+
+    writer->printf("%6d  %10.3f  %9.3f%s\n", rangecount,
+      (float)listtime / frames, (float)compiledtime / frames,
+      (listmatches != compiledmatches) ? "  (MISMATCH)" : "");
+
+    for (CAN_filter_t* f : list)
+      delete f;
+    }
+
+  free(testframes);
+  }
+
+void can_bench_format(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  // Compare the buffer based canformat::get() against the std::string
+  // wrapper for all registered formats:
+  uint32_t frames = (argc > 0) ? strtoul(argv[0], NULL, 10) : 10000;
+  canbus* bus = can::instance(TAG).GetBus(0);
+  if (bus == NULL)
+    {
+    writer->puts("Error: can1 not available");
+    return;
+    }
+  if (frames == 0) frames = 1;
+
+  CAN_log_message_t* testmsgs = (CAN_log_message_t*)malloc(256 * sizeof(CAN_log_message_t));
+  if (!testmsgs)
+    {
+    writer->puts("Error: out of memory");
+    return;
+    }
+  uint32_t rnd = 0x12345678;
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  for (int k=0; k<256; k++)
+    {
+    rnd = rnd * 1103515245 + 12345;
+    memset(&testmsgs[k], 0, sizeof(CAN_log_message_t));
+    testmsgs[k].type = (k & 7) ? CAN_LogFrame_RX : CAN_LogFrame_TX;
+    testmsgs[k].timestamp = tv;
+    testmsgs[k].timestamp.tv_usec = (tv.tv_usec + k * 997) % 1000000;
+    testmsgs[k].frame.origin = bus;
+    testmsgs[k].frame.FIR.B.FF = (k & 3) ? CAN_frame_std : CAN_frame_ext;
+    testmsgs[k].frame.FIR.B.DLC = (rnd >> 24) % 9;
+    testmsgs[k].frame.MsgID = (k & 3) ? ((k * 7) & 0x7ff) : ((rnd >> 3) & 0x1fffffff);
+    testmsgs[k].frame.data.u64 = ((uint64_t)rnd << 32) | (rnd ^ 0x5a5a5a5a);
+    }
+
+  uint8_t buf[CANFORMAT_GET_MAXLEN];
+  writer->printf("Format          Buffer        String        (frames/s, %" PRIu32 " frames)\n", frames);
+  OvmsCanFormatFactory& factory = OvmsCanFormatFactory::instance(TAG);
+  for (auto& it : factory.m_fmap)
+    {
+    canformat* fmt = factory.NewFormat(it.first);
+    if (fmt == NULL) continue;
+
+    size_t bytes = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t n=0; n<frames; n++)
+      bytes += fmt->get(&testmsgs[n & 255], buf, sizeof(buf));
+    int64_t buftime = esp_timer_get_time() - start;
+
+    // Start over with a fresh formatter, stateful formats (i.e. compact)
+    // shall produce the same output again:
+    delete fmt;
+    fmt = factory.NewFormat(it.first);
+    if (fmt == NULL) continue;
+
+    size_t strbytes = 0;
+    start = esp_timer_get_time();
+    for (uint32_t n=0; n<frames; n++)
+      strbytes += fmt->get(&testmsgs[n & 255]).size();
+    int64_t strtime = esp_timer_get_time() - start;
+
+    writer->printf("%-14s %9.0f     %9.0f     %5.1f bytes/frame%s\n", it.first,
+      (buftime > 0) ? (float)frames * 1000000 / buftime : 0.0f,
+      (strtime > 0) ? (float)frames * 1000000 / strtime : 0.0f,
+      (float)bytes / frames,
+      (bytes != strbytes) ? "  (MISMATCH)" : "");
+    delete fmt;
+    }
+
+  free(testmsgs);
+  }
+
+void can_clearstatus(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetName();
+  canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+
+  sbus->ClearStatus();
+  writer->puts("Status cleared");
+  }
+
+void can_view_registers(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetName();
+  canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+
+  if (sbus->ViewRegisters() == ESP_ERR_NOT_SUPPORTED)
+    writer->puts("Error: Not implemented");
+  else
+    writer->puts("See logs for details");
+  }
+
+void can_set_register(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* bus = cmd->GetParent()->GetName();
+  canbus* sbus = (canbus*)pcpapp::instance().FindDeviceByName(bus);
+  if (sbus == NULL)
+    {
+    writer->puts("Error: Cannot find named CAN bus");
+    return;
+    }
+  if (argc<2)
+    {
+    writer->puts("Error: register address and value must be given");
+    return;
+    }
+  uint32_t addr = (int)strtol(argv[0],NULL,16);
+  uint32_t value = (int)strtol(argv[1],NULL,16);
+  if (addr > 255)
+    {
+    writer->puts("Error: Register address out of range");
+    return;
+    }
+  if (value > 255)
+    {
+    writer->puts("Error: Register value out of range");
+    return;
+    }
+
+  sbus->WriteReg(addr,value);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN timestamps
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * CAN_time_expand: restore a 32 bit esp_timer time (as carried by
+ *  CAN_queue_msg_t) to 64 bit, valid for times up to ~71 minutes ago
+ */
+int64_t CAN_time_expand(uint32_t time)
+  {
+  int64_t now = esp_timer_get_time();
+  return now - (uint32_t)((uint32_t)now - time);
+  }
+
+static portMUX_TYPE CAN_wallclock_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t CAN_wallclock_offset = 0;            // wall clock - esp_timer [us]
+static int64_t CAN_wallclock_sampled = INT64_MIN;   // esp_timer time of last offset sample
+
+/**
+ * CAN_wallclock: convert an esp_timer time [us] to wall clock time
+ *  The offset between both clocks is sampled once per second to follow
+ *  clock adjustments, so a conversion is a simple addition.
+ */
+void CAN_wallclock(struct timeval* tv, int64_t time)
+  {
+  int64_t now = esp_timer_get_time();
+  if (time == 0) time = now;
+
+  portENTER_CRITICAL(&CAN_wallclock_mux);
+  bool sample = (now - CAN_wallclock_sampled > 1000000);
+  int64_t offset = CAN_wallclock_offset;
+  portEXIT_CRITICAL(&CAN_wallclock_mux);
+
+  if (sample)
+    {
+    struct timeval tvnow;
+    gettimeofday(&tvnow, NULL);
+    offset = (int64_t)tvnow.tv_sec * 1000000 + tvnow.tv_usec - now;
+    portENTER_CRITICAL(&CAN_wallclock_mux);
+    CAN_wallclock_offset = offset;
+    CAN_wallclock_sampled = now;
+    portEXIT_CRITICAL(&CAN_wallclock_mux);
+    }
+
+  int64_t wall = time + offset;
+  tv->tv_sec = wall / 1000000;
+  tv->tv_usec = wall % 1000000;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN hardware acceptance filter
+// Pattern utilities for the drivers: the union of the declared frame
+// interests is reduced to the number of code/mask pairs the controller
+// offers, accepting as few additional IDs as possible. The result is a
+// superset of the interest; exact filtering is still done in software.
+////////////////////////////////////////////////////////////////////////
+
+uint64_t CAN_acceptance_size(uint32_t dontcare)
+  {
+  return 1ULL << __builtin_popcount(dontcare);
+  }
+
+CAN_acceptance_t CAN_acceptance_merge(const CAN_acceptance_t& a, const CAN_acceptance_t& b)
+  {
+  CAN_acceptance_t m;
+  m.dontcare = a.dontcare | b.dontcare | (a.code ^ b.code);
+  m.code = a.code & ~m.dontcare;
+  return m;
+  }
+
+static inline bool CAN_acceptance_covers(const CAN_acceptance_t& outer, const CAN_acceptance_t& inner)
+  {
+  return ((inner.dontcare & ~outer.dontcare) == 0) &&
+         ((inner.code & ~outer.dontcare) == outer.code);
+  }
+
+/**
+ * CAN_acceptance_cover: cover a sorted & merged range list by at most
+ *  <maxpatterns> acceptance patterns.
+ *  The ranges are split into exact power-of-two aligned blocks first, then
+ *  the neighbour pair with the least acceptance growth is merged until the
+ *  limit is met.
+ */
+void CAN_acceptance_cover(const CAN_filter_range_list_t& ranges, CAN_acceptance_list_t& patterns,
+                          size_t maxpatterns)
+  {
+  patterns.clear();
+  if (maxpatterns == 0) return;
+
+  for (const CAN_filter_range_t& range : ranges)
+    {
+    uint32_t id = range.id_from;
+    while (id <= range.id_to)
+      {
+      // Largest aligned block starting at id and ending within the range:
+      uint64_t size = id ? (id & (~id + 1)) : (1ULL << 32);
+      while (size > 1 && id + size - 1 > range.id_to) size >>= 1;
+      patterns.push_back({ id, (uint32_t)(size - 1) });
+      if (id + size > range.id_to) break;
+      id += size;
+      }
+    }
+
+  while (patterns.size() > maxpatterns)
+    {
+    size_t best = 0;
+    int64_t bestgrowth = INT64_MAX;
+    for (size_t k=0; k+1 < patterns.size(); k++)
+      {
+      CAN_acceptance_t m = CAN_acceptance_merge(patterns[k], patterns[k+1]);
+      int64_t growth = (int64_t)CAN_acceptance_size(m.dontcare)
+        - (int64_t)CAN_acceptance_size(patterns[k].dontcare)
+        - (int64_t)CAN_acceptance_size(patterns[k+1].dontcare);
+      if (growth < bestgrowth)
+        {
+        bestgrowth = growth;
+        best = k;
+        }
+      }
+    patterns[best] = CAN_acceptance_merge(patterns[best], patterns[best+1]);
+    patterns.erase(patterns.begin() + best + 1);
+
+    // Drop neighbours now covered by the merged pattern:
+    while (best+1 < patterns.size() && CAN_acceptance_covers(patterns[best], patterns[best+1]))
+      patterns.erase(patterns.begin() + best + 1);
+    while (best > 0 && CAN_acceptance_covers(patterns[best], patterns[best-1]))
+      {
+      patterns.erase(patterns.begin() + best - 1);
+      best--;
+      }
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN logging and tracing
+// These structures are involved in formatting, logging and tracing of
+// CAN messages (both frames and status/control messages)
+////////////////////////////////////////////////////////////////////////
+
+static const char* const CAN_log_type_names[] = {
+  "-",
+  "RX",
+  "TX",
+  "TX_Queue",
+  "TX_Fail",
+  "Error",
+  "Status",
+  "Comment",
+  "Info",
+  "Event",
+  "Metric"
+  };
+
+const char* GetCanLogTypeName(CAN_log_type_t type)
+  {
+  return CAN_log_type_names[type];
+  }
+
+void can::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame, int64_t time)
+  {
+  // Frames are distributed to vehicle, loggers & ring listeners by the
+  // shared frame ring (each reader applies its own type mask & filter):
+  if (m_ring.HasReaders())
+    m_ring.Write(bus, type, frame, time);
+  }
+
+void can::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status)
+  {
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+
+  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
+    {
+    it->second->LogStatus(bus, type, status);
+    }
+  }
+
+void can::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
+  {
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+
+  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end(); ++it)
+    {
+    it->second->LogInfo(bus, type, text);
+    }
+  }
+
+void canbus::LogFrame(CAN_log_type_t type, const CAN_frame_t* frame, int64_t time)
+  {
+  can::instance(TAG).LogFrame(this, type, frame, time);
+  }
+
+void canbus::LogStatus(CAN_log_type_t type)
+  {
+  if (type==CAN_LogStatus_Error)
+    {
+    if (!StatusChanged())
+      return;
+    ESP_LOGE(TAG,
+      "%s: intr=%" PRId32 " rxpkt=%" PRId32 " txpkt=%" PRId32 " errflags=%#" PRIx32 " rxerr=%d txerr=%d rxinval=%d"
+      " rxovr=%d txovr=%d txdelay=%" PRId32 " txfail=%" PRId32 " wdgreset=%d errreset=%d",
+      m_name, m_status.interrupts, m_status.packets_rx, m_status.packets_tx,
+      m_status.error_flags, m_status.errors_rx, m_status.errors_tx,
+      m_status.invalid_rx, m_status.rxbuf_overflow, m_status.txbuf_overflow,
+      m_status.txbuf_delay, m_status.tx_fails, m_status.watchdog_resets,
+      m_status.error_resets);
+    }
+  if (can::instance(TAG).HasLogger())
+    can::instance(TAG).LogStatus(this, type, &m_status);
+  }
+
+void canbus::LogInfo(CAN_log_type_t type, const char* text)
+  {
+  can::instance(TAG).LogInfo(this, type, text);
+  }
+
+bool canbus::StatusChanged()
+  {
+  // simple checksum to prevent log flooding:
+  uint32_t chksum = m_status.errors_rx + m_status.errors_tx
+    + m_status.invalid_rx + m_status.rxbuf_overflow + m_status.txbuf_overflow
+    + m_status.error_flags + m_status.txbuf_delay + m_status.tx_fails
+    + m_status.watchdog_resets + m_status.error_resets;
+  if (chksum != m_status_chksum)
+    {
+    m_status_chksum = chksum;
+    return true;
+    }
+  return false;
+  }
+
+static const char* const CAN_errorstate_names[] = {
+  "none",
+  "active",
+  "warning",
+  "passive",
+  "busoff"
+  };
+
+const char* GetCanErrorStateName(CAN_errorstate_t error_state)
+  {
+  return CAN_errorstate_names[error_state];
+  }
+
+CAN_errorstate_t canbus::GetErrorState()
+  {
+  if (m_status.errors_tx == 0 && m_status.errors_rx == 0)
+    return CAN_errorstate_none;
+  else if (m_status.errors_tx < 96 && m_status.errors_rx < 96)
+    return CAN_errorstate_active;
+  else if (m_status.errors_tx < 128 && m_status.errors_rx < 128)
+    return CAN_errorstate_warning;
+  else if (m_status.errors_tx < 256 && m_status.errors_rx < 256)
     return CAN_errorstate_passive;
   else
-    return CAN_errorstate_busoff;
+    return CAN_errorstate_busoff;
+  }
+
+const char* canbus::GetErrorStateName()
+  {
+  return GetCanErrorStateName(GetErrorState());
+  }
+
+
+uint32_t can::AddLogger(canlog* logger, int filterc, const char* const* filterv)
+  {
+  if (filterc>0)
+    {
+    canfilter *filter = new canfilter();
+    for (int k=0;k<filterc;k++)
+      {
+      filter->AddFilter(filterv[k]);
+      }
+    logger->SetFilter(filter);
+    }
+
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+  uint32_t id = m_logger_id++;
+  m_loggermap[id] = logger;
+
+  // Declare the logger's frame interest, unfiltered loggers are promiscuous:
+  char owner[20];
+  snprintf(owner, sizeof(owner), "canlog:%" PRIu32, id);
+  if (filterc > 0)
+    {
+    for (int k=0; k<CAN_MAXBUSES; k++)
+      {
+      canbus* bus = GetBus(k);
+      if (!bus) continue;
+      for (const CAN_filter_range_t& range : logger->m_filter->GetRanges(k+1))
+        {
+        AddRxInterest(owner, bus, CAN_frame_std, range.id_from, range.id_to, false);
+        AddRxInterest(owner, bus, CAN_frame_ext, range.id_from, range.id_to, false);
+        }
+      }
+    UpdateRxFilters();
+    }
+  else
+    {
+    AddRxInterestAll(owner);
+    }
+
+  return id;
+  }
+
+bool can::HasLogger()
+  {
+  return (m_loggermap.size() != 0);
+  }
+
+canlog* can::GetLogger(uint32_t id)
+  {
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+
+  auto k = m_loggermap.find(id);
+  if (k != m_loggermap.end())
+    return k->second;
+  else
+    return NULL;
+  }
+
+bool can::RemoveLogger(uint32_t id)
+  {
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+
+  auto k = m_loggermap.find(id);
+  if (k != m_loggermap.end())
+    {
+    k->second->Close();
+    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
+    delete k->second;
+    m_loggermap.erase(k);
+    char owner[20];
+    snprintf(owner, sizeof(owner), "canlog:%" PRIu32, id);
+    RemoveRxInterest(owner);
+    return true;
+    }
+  return false;
+  }
+
+void can::RemoveLoggers()
+  {
+  OvmsRecMutexLock lock(&m_loggermap_mutex);
+
+  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end();)
+    {
+    it->second->Close();
+    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
+    delete it->second;
+    char owner[20];
+    snprintf(owner, sizeof(owner), "canlog:%" PRIu32, it->first);
+    RemoveRxInterest(owner, NULL, false);
+    it = m_loggermap.erase(it);
+    }
+  UpdateRxFilters();
+  }
+
+uint32_t can::AddPlayer(canplay* player, int filterc, const char* const* filterv)
+  {
+  if (filterc>0)
+    {
+    canfilter *filter = new canfilter();
+    for (int k=0;k<filterc;k++)
+      {
+      filter->AddFilter(filterv[k]);
+      }
+    player->SetFilter(filter);
+    }
+
+  OvmsMutexLock lock(&m_playermap_mutex);
+  uint32_t id = m_player_id++;
+  m_playermap[id] = player;
+  player->Start();
+
+  return id;
+  }
+
+bool can::HasPlayer()
+  {
+  OvmsMutexLock lock(&m_playermap_mutex);
+
+  return (m_playermap.size() > 0);
+  }
+
+canplay* can::GetPlayer(uint32_t id)
+  {
+  OvmsMutexLock lock(&m_playermap_mutex);
+
+  auto k = m_playermap.find(id);
+  if (k != m_playermap.end())
+    return k->second;
+  else
+    return NULL;
+  }
+
+bool can::RemovePlayer(uint32_t id)
+  {
+  OvmsMutexLock lock(&m_playermap_mutex);
+
+  auto k = m_playermap.find(id);
+  if (k != m_playermap.end())
+    {
+    k->second->Close();
+    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
+    delete k->second;
+    m_playermap.erase(k);
+    return true;
+    }
+  return false;
+  }
+
+void can::RemovePlayers()
+  {
+  OvmsMutexLock lock(&m_playermap_mutex);
+
+  for (canplay_map_t::iterator it=m_playermap.begin(); it!=m_playermap.end();)
+    {
+    it->second->Close();
+    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
+    delete it->second;
+    it = m_playermap.erase(it);
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN frame ring
+// The ring is written by the framework (single writer, serialized by
+// m_writemutex) and read by all attached readers. Readers copy the
+// 20 byte record out under the spinlock and expand it to a full log
+// message outside, so the writer never waits for a reader. A lagging
+// reader loses its oldest unread entries (counted as overflows).
+////////////////////////////////////////////////////////////////////////
+
+canring::canring()
+  {
+  m_entries = NULL;
+  m_size = 0;
+  m_head = 0;
+  m_readercount = 0;
+  m_spinlock = portMUX_INITIALIZER_UNLOCKED;
+  m_writecount = 0;
+  }
+
+canring::~canring()
+  {
+  if (m_entries)
+    {
+    free(m_entries);
+    m_entries = NULL;
+    }
+  }
+
+bool canring::Init(uint32_t size)
+  {
+  if (m_entries) return true;
+  if (size < 4) size = 4;
+  m_entries = (CAN_log_frame_t*)calloc(size, sizeof(CAN_log_frame_t));
+  if (!m_entries)
+    {
+    ESP_LOGE(TAG, "canring: cannot allocate %" PRIu32 " entries", size);
+    return false;
+    }
+  m_size = size;
+  return true;
+  }
+
+/**
+ * AddReader: attach a reader, positioned at the ring head
+ *  The reader table grows as needed; it is only accessed by the writer,
+ *  so changing it under m_writemutex needs no further locking.
+ */
+bool canring::AddReader(canringreader* reader)
+  {
+  OvmsMutexLock lock(&m_writemutex);
+  if (std::find(m_readers.begin(), m_readers.end(), reader) != m_readers.end())
+    return true;
+  m_readers.push_back(reader);
+  portENTER_CRITICAL(&m_spinlock);
+  reader->m_cursor = m_head;
+  reader->m_waiting = false;
+  reader->m_wakeup = false;
+  reader->m_ring = this;
+  m_readercount++;
+  portEXIT_CRITICAL(&m_spinlock);
+  return true;
+  }
+
+void canring::RemoveReader(canringreader* reader)
+  {
+  OvmsMutexLock lock(&m_writemutex);
+  auto it = std::find(m_readers.begin(), m_readers.end(), reader);
+  if (it == m_readers.end())
+    return;
+  m_readers.erase(it);
+  portENTER_CRITICAL(&m_spinlock);
+  m_readercount--;
+  reader->m_ring = NULL;
+  portEXIT_CRITICAL(&m_spinlock);
+  }
+
+bool canring::Write(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame, int64_t time)
+  {
+  if (!m_entries || !bus || !frame) return false;
+
+  // Readers convert to wall clock time, see canringreader::Read():
+  uint32_t stamp = (time) ? (uint32_t)time : (uint32_t)esp_timer_get_time();
+  uint32_t id = (frame->MsgID & CAN_LOGFRAME_IDMASK)
+    | ((frame->FIR.B.FF == CAN_frame_ext) ? CAN_LOGFRAME_EXT : 0)
+    | ((frame->FIR.B.RTR == CAN_RTR) ? CAN_LOGFRAME_RTR : 0);
+  uint32_t typebit = BIT(type);
+  bool wakeup = false;
+
+  OvmsMutexLock lock(&m_writemutex);
+  portENTER_CRITICAL(&m_spinlock);
+
+  uint32_t seq = m_head;
+
+  // Advance lagging readers past the slot:
+  for (canringreader* reader : m_readers)
+    {
+    if ((seq - reader->m_cursor) >= m_size)
+      {
+      reader->m_overflowcount += (seq - reader->m_cursor) - m_size + 1;
+      reader->m_cursor = seq - m_size + 1;
+      }
+    }
+
+  CAN_log_frame_t* entry = &m_entries[seq % m_size];
+  entry->time = stamp;
+  entry->id = id;
+  entry->bus = bus->m_busnumber;
+  entry->type = type;
+  entry->dlc = frame->FIR.B.DLC;
+  entry->data.u32[0] = frame->data.u32[0];
+  entry->data.u32[1] = frame->data.u32[1];
+  m_head = seq + 1;
+  m_writecount++;
+
+  for (canringreader* reader : m_readers)
+    {
+    if (reader->m_waiting && (reader->m_typemask & typebit))
+      {
+      reader->m_waiting = false;
+      reader->m_wakeup = wakeup = true;
+      }
+    }
+
+  portEXIT_CRITICAL(&m_spinlock);
+
+  // Signal outside the critical section (the table is stable while we
+  // hold m_writemutex):
+  if (wakeup)
+    {
+    for (canringreader* reader : m_readers)
+      {
+      if (reader->m_wakeup)
+        {
+        reader->m_wakeup = false;
+        xSemaphoreGive(reader->m_sem);
+        }
+      }
+    }
+
+  return true;
+  }
+
+std::string canring::GetStats()
+  {
+  std::ostringstream buf;
+
+  buf << "Ring: Size:" << m_size
+    << " (" << (m_size * sizeof(CAN_log_frame_t)) << " bytes)"
+    << " Written:" << m_writecount
+    << " Readers:" << m_readercount << "\n";
+
+  OvmsMutexLock lock(&m_writemutex);
+  for (canringreader* reader : m_readers)
+    {
+    buf << "  " << reader->m_name
+      << ": Read:" << reader->m_readcount
+      << " Pending:" << reader->Pending()
+      << " Overflows:" << reader->m_overflowcount << "\n";
+    }
+
+  return buf.str();
+  }
+
+void canring::ClearStats()
+  {
+  OvmsMutexLock lock(&m_writemutex);
+  m_writecount = 0;
+  for (canringreader* reader : m_readers)
+    reader->ClearStats();
+  }
+
+canringreader::canringreader(const char* name, uint32_t typemask)
+  {
+  m_name = name;
+  m_typemask = typemask;
+  m_ring = NULL;
+  m_sem = xSemaphoreCreateBinary();
+  m_cursor = 0;
+  m_waiting = false;
+  m_wakeup = false;
+  memset(&m_msg, 0, sizeof(m_msg));
+  ClearStats();
+  }
+
+canringreader::~canringreader()
+  {
+  Detach();
+  vSemaphoreDelete(m_sem);
+  }
+
+bool canringreader::Attach(canring* ring)
+  {
+  if (m_ring) return true;
+  if (ring == NULL) ring = &can::instance(TAG).m_ring;
+  return ring->AddReader(this);
+  }
+
+void canringreader::Detach()
+  {
+  if (m_ring) m_ring->RemoveReader(this);
+  }
+
+CAN_log_message_t* canringreader::Read(TickType_t maxwait)
+  {
+  canring* ring = m_ring;
+  if (!ring) return NULL;
+
+  CAN_log_frame_t rec;
+  for (int pass=0; pass<2; pass++)
+    {
+    portENTER_CRITICAL(&ring->m_spinlock);
+    while (m_cursor != ring->m_head)
+      {
+      const CAN_log_frame_t* entry = &ring->m_entries[m_cursor++ % ring->m_size];
+      if (m_typemask & BIT(entry->type))
+        {
+        rec = *entry;
+        m_readcount++;
+        portEXIT_CRITICAL(&ring->m_spinlock);
+
+        // Expand the record; the 32 bit time is resolved against the
+        // current time, valid for entries up to ~71 minutes old:
+        int64_t now = esp_timer_get_time();
+        m_msg.type = (CAN_log_type_t)rec.type;
+        CAN_wallclock(&m_msg.timestamp, now - (uint32_t)((uint32_t)now - rec.time));
+        m_msg.frame.origin = can::instance(TAG).GetBus(rec.bus);
+        m_msg.frame.callback = NULL;
+        m_msg.frame.FIR.U = 0;
+        m_msg.frame.FIR.B.FF = (rec.id & CAN_LOGFRAME_EXT) ? CAN_frame_ext : CAN_frame_std;
+        m_msg.frame.FIR.B.RTR = (rec.id & CAN_LOGFRAME_RTR) ? CAN_RTR : CAN_no_RTR;
+        m_msg.frame.FIR.B.DLC = rec.dlc;
+        m_msg.frame.MsgID = rec.id & CAN_LOGFRAME_IDMASK;
+        m_msg.frame.data.u32[0] = rec.data.u32[0];
+        m_msg.frame.data.u32[1] = rec.data.u32[1];
+        return &m_msg;
+        }
+      }
+    m_waiting = (maxwait != 0);
+    portEXIT_CRITICAL(&ring->m_spinlock);
+
+    if (pass > 0 || maxwait == 0 || xSemaphoreTake(m_sem, maxwait) != pdTRUE)
+      break;
+    }
+
+  return NULL;
+  }
+
+void canringreader::Signal()
+  {
+  xSemaphoreGive(m_sem);
+  }
+
+uint32_t canringreader::Pending()
+  {
+  canring* ring = m_ring;
+  return (ring) ? (ring->m_head - m_cursor) : 0;
+  }
+
+void canringreader::ClearStats()
+  {
+  m_readcount = 0;
+  m_overflowcount = 0;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN TX queue
+// Entries are kept unsorted, the next frame to send is selected on
+// dequeue by priority class, then (optionally) by arbitration ID, then
+// by queueing order. Expired and displaced frames are reported to the
+// application as TX failures via the CAN task, bypassing the driver
+// TxCallback (no hardware TX buffer has been freed by a drop).
+////////////////////////////////////////////////////////////////////////
+
+const char* CAN_txprio_name(CAN_txprio_t prio)
+  {
+  switch (prio)
+    {
+    case CAN_TXPRIO_CONTROL:  return "control";
+    case CAN_TXPRIO_NORMAL:   return "normal";
+    case CAN_TXPRIO_DIAG:     return "diag";
+    default:                  return "unknown";
+    }
+  }
+
+// Arbitration order key: standard frames win over extended
+// frames with the same 11 bit base ID (RTR vs. SRR bit)
+static inline uint32_t CAN_arbitration_key(const CAN_frame_t* frame)
+  {
+  if (frame->FIR.B.FF == CAN_frame_std)
+    return (frame->MsgID << 19);
+  else
+    return (frame->MsgID << 1) | 1;
+  }
+
+cantxqueue::cantxqueue(canbus* bus)
+  {
+  m_bus = bus;
+  m_size = CONFIG_OVMS_HW_CAN_TX_QUEUE_SIZE;
+  m_entries = (CAN_txentry_t*)calloc(m_size, sizeof(CAN_txentry_t));
+  if (!m_entries)
+    {
+    ESP_LOGE(TAG, "cantxqueue: cannot allocate %" PRIu32 " entries", m_size);
+    m_size = 0;
+    }
+  m_count = 0;
+  m_seq = 0;
+  m_order_id = false;
+  m_space = xSemaphoreCreateBinary();
+  ClearRules();
+  ClearStats();
+  }
+
+cantxqueue::~cantxqueue()
+  {
+  if (m_entries)
+    {
+    free(m_entries);
+    m_entries = NULL;
+    }
+  vSemaphoreDelete(m_space);
+  }
+
+void cantxqueue::Classify(CAN_txentry_t* entry)
+  {
+  entry->prio = CAN_TXPRIO_NORMAL;
+  entry->deadline = 0;
+  for (const CAN_txrule_t& rule : m_rules)
+    {
+    if (rule.format == entry->frame.FIR.B.FF &&
+        entry->frame.MsgID >= rule.id_from && entry->frame.MsgID <= rule.id_to)
+      {
+      entry->prio = rule.prio;
+      if (rule.deadline_ms)
+        entry->deadline = entry->queued + (int64_t)rule.deadline_ms * 1000;
+      return;
+      }
+    }
+  }
+
+bool cantxqueue::Before(const CAN_txentry_t* a, const CAN_txentry_t* b)
+  {
+  if (a->prio != b->prio)
+    return a->prio < b->prio;
+  if (m_order_id)
+    {
+    uint32_t ka = CAN_arbitration_key(&a->frame);
+    uint32_t kb = CAN_arbitration_key(&b->frame);
+    if (ka != kb)
+      return ka < kb;
+    }
+  return (int32_t)(a->seq - b->seq) < 0;
+  }
+
+/**
+ * Drop: remove an entry without sending it, report TX failure to the application
+ *  - caller must hold m_mutex
+ */
+void cantxqueue::Drop(uint32_t index)
+  {
+  CAN_queue_msg_t msg;
+  msg.type = CAN_txdroppedcallback;
+  msg.time = 0;
+  msg.body.frame = m_entries[index].frame;
+  msg.body.bus = m_bus;
+  m_entries[index] = m_entries[--m_count];
+  xQueueSend(m_bus->m_rxqueue, &msg, 0);
+  }
+
+void cantxqueue::Expire(int64_t now)
+  {
+  uint32_t k = 0;
+  while (k < m_count)
+    {
+    CAN_txentry_t* entry = &m_entries[k];
+    if (entry->deadline && entry->deadline <= now)
+      {
+      m_stats[entry->prio].expired++;
+      Drop(k);
+      }
+    else
+      {
+      k++;
+      }
+    }
+  }
+
+/**
+ * Push: queue a frame for transmission
+ *  - if the queue is full, the lowest ranking frame is displaced by a higher ranking one
+ *  - else waits up to maxqueuewait for a dequeue
+ *  - returns false on overflow
+ */
+bool cantxqueue::Push(const CAN_frame_t* frame, TickType_t maxqueuewait /*=0*/)
+  {
+  if (!m_size) return false;
+
+  CAN_txentry_t entry;
+  entry.frame = *frame;
+  TickType_t start = xTaskGetTickCount();
+
+  while (true)
+    {
+    m_mutex.Lock();
+    entry.queued = esp_timer_get_time();
+    Classify(&entry);
+    Expire(entry.queued);
+
+    if (m_count == m_size)
+      {
+      uint32_t last = 0;
+      for (uint32_t k=1; k<m_count; k++)
+        {
+        if (Before(&m_entries[last], &m_entries[k]))
+          last = k;
+        }
+      entry.seq = m_seq;
+      if (Before(&entry, &m_entries[last]))
+        {
+        m_stats[m_entries[last].prio].displaced++;
+        Drop(last);
+        }
+      }
+
+    if (m_count < m_size)
+      {
+      entry.seq = m_seq++;
+      m_entries[m_count++] = entry;
+      m_stats[entry.prio].queued++;
+      m_mutex.Unlock();
+      return true;
+      }
+
+    m_mutex.Unlock();
+
+    TickType_t waited = xTaskGetTickCount() - start;
+    if (waited >= maxqueuewait || xSemaphoreTake(m_space, maxqueuewait - waited) != pdTRUE)
+      break;
+    }
+
+  m_mutex.Lock();
+  m_stats[entry.prio].overflows++;
+  m_mutex.Unlock();
+  return false;
+  }
+
+/**
+ * Pop: fetch the next frame to send, dropping expired frames
+ *  - returns false if the queue is empty
+ */
+bool cantxqueue::Pop(CAN_frame_t* frame)
+  {
+  if (m_count == 0) return false;
+
+  m_mutex.Lock();
+  int64_t now = esp_timer_get_time();
+  Expire(now);
+  if (m_count == 0)
+    {
+    m_mutex.Unlock();
+    xSemaphoreGive(m_space);
+    return false;
+    }
+
+  uint32_t next = 0;
+  for (uint32_t k=1; k<m_count; k++)
+    {
+    if (Before(&m_entries[k], &m_entries[next]))
+      next = k;
+    }
+
+  CAN_txentry_t* entry = &m_entries[next];
+  CAN_txprio_stats_t* stats = &m_stats[entry->prio];
+  uint32_t delay = now - entry->queued;
+  stats->sent++;
+  stats->delay_sum += delay;
+  if (delay > stats->delay_max) stats->delay_max = delay;
+  *frame = entry->frame;
+  m_entries[next] = m_entries[--m_count];
+  m_mutex.Unlock();
+
+  xSemaphoreGive(m_space);
+  return true;
+  }
+
+void cantxqueue::Clear()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  m_count = 0;
+  }
+
+void cantxqueue::AddRule(CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                         CAN_txprio_t prio, uint32_t deadline_ms /*=0*/)
+  {
+  CAN_txrule_t rule;
+  rule.format = format;
+  rule.id_from = id_from;
+  rule.id_to = id_to;
+  rule.prio = prio;
+  rule.deadline_ms = deadline_ms;
+  OvmsMutexLock lock(&m_mutex);
+  m_rules.insert(m_rules.begin(), rule);
+  }
+
+/**
+ * ClearRules: reset to the default rules, i.e. the ISO 15765-4 OBD/UDS
+ *  request IDs (11 bit 7DF & 7E0-7E7, 29 bit 18DAxxxx/18DBxxxx) in the
+ *  diagnostic class. Other 7xx IDs are used for application frames
+ *  (e.g. CANopen NMT), vehicle modules polling vendor specific ECU IDs
+ *  need to add rules for these.
+ */
+void cantxqueue::ClearRules()
+  {
+    {
+    OvmsMutexLock lock(&m_mutex);
+    m_rules.clear();
+    }
+  AddRule(CAN_frame_std, 0x7df, 0x7df, CAN_TXPRIO_DIAG);
+  AddRule(CAN_frame_std, 0x7e0, 0x7e7, CAN_TXPRIO_DIAG);
+  AddRule(CAN_frame_ext, 0x18da0000, 0x18dbffff, CAN_TXPRIO_DIAG);
+  }
+
+CAN_txrule_list_t cantxqueue::GetRules()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  return m_rules;
+  }
+
+std::string cantxqueue::GetStats()
+  {
+  std::ostringstream buf;
+  OvmsMutexLock lock(&m_mutex);
+
+  buf << "TX queue: Size:" << m_size
+    << " Pending:" << m_count
+    << " Order:" << (m_order_id ? "id" : "fifo") << "\n";
+
+  for (int k=0; k<CAN_TXPRIO_COUNT; k++)
+    {
+    CAN_txprio_stats_t* stats = &m_stats[k];
+    buf << "  " << std::left << std::setw(8) << CAN_txprio_name((CAN_txprio_t)k) << std::right
+      << " Queued:" << stats->queued
+      << " Sent:" << stats->sent
+      << " Expired:" << stats->expired
+      << " Displaced:" << stats->displaced
+      << " Overflows:" << stats->overflows
+      << " Delay avg:" << (stats->sent ? (uint32_t)(stats->delay_sum / stats->sent) : 0)
+      << "us max:" << stats->delay_max << "us\n";
+    }
+
+  buf << "Rules:\n";
+  for (const CAN_txrule_t& rule : m_rules)
+    {
+    buf << "  " << std::left << std::setw(8) << CAN_txprio_name(rule.prio) << std::right
+      << std::hex << std::setfill('0');
+    if (rule.format == CAN_frame_std)
+      buf << " std " << std::setw(3) << rule.id_from << "-" << std::setw(3) << rule.id_to;
+    else
+      buf << " ext " << std::setw(8) << rule.id_from << "-" << std::setw(8) << rule.id_to;
+    buf << std::dec << std::setfill(' ');
+    if (rule.deadline_ms)
+      buf << " deadline:" << rule.deadline_ms << "ms";
+    buf << "\n";
+    }
+
+  return buf.str();
+  }
+
+void cantxqueue::ClearStats()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  memset(m_stats, 0, sizeof(m_stats));
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN periodic TX
+// Update callbacks are called by the periodic task with the entry list
+// locked, so they must not add or remove periodic frames themselves.
+////////////////////////////////////////////////////////////////////////
+
+#define CAN_PERIODIC_SLACK_US   100   // send frames due within this time
+
+static uint32_t CAN_gcd(uint32_t a, uint32_t b)
+  {
+  while (b)
+    {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+    }
+  return a;
+  }
+
+canperiodic::canperiodic()
+  {
+  m_task = NULL;
+  m_timer = NULL;
+  m_epoch = 0;
+  m_nexthandle = 1;
+  }
+
+canperiodic::~canperiodic()
+  {
+  if (m_task)
+    {
+    vTaskDelete(m_task);
+    m_task = NULL;
+    }
+  if (m_timer)
+    {
+    esp_timer_stop(m_timer);
+    esp_timer_delete(m_timer);
+    m_timer = NULL;
+    }
+  for (CAN_periodic_t* entry : m_entries)
+    delete entry;
+  m_entries.clear();
+  }
+
+/**
+ * Add: register a periodic frame
+ *  - phase_ms: offset on the common time base, -1 = choose automatically
+ *  - update: optional callback to modify the frame before each transmission
+ *  - dbcsource: encode signals from their assigned metrics using the bus DBC
+ *  - returns the entry handle, 0 = failed
+ */
+uint32_t canperiodic::Add(const char* owner, canbus* bus, const CAN_frame_t* frame,
+                          uint32_t period_ms, int32_t phase_ms /*=-1*/,
+                          CanPeriodicCallback update /*=NULL*/, bool dbcsource /*=false*/)
+  {
+  if (!bus || !frame || period_ms == 0)
+    return 0;
+
+  OvmsMutexLock lock(&m_mutex);
+
+  if (!m_timer)
+    {
+    esp_timer_create_args_t args = {};
+    args.callback = TimerCallback;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "can periodic";
+    if (esp_timer_create(&args, &m_timer) != ESP_OK)
+      {
+      ESP_LOGE(TAG, "canperiodic: cannot create timer");
+      m_timer = NULL;
+      return 0;
+      }
+    }
+  if (!m_task)
+    {
+    m_epoch = esp_timer_get_time();
+    xTaskCreatePinnedToCore(PeriodicTask, "OVMS CanPeriodic", 4096, (void*)this, 22, &m_task, CORE(1));
+    if (!m_task)
+      {
+      ESP_LOGE(TAG, "canperiodic: cannot create task");
+      return 0;
+      }
+    }
+
+  CAN_periodic_t* entry = new CAN_periodic_t;
+  entry->handle = m_nexthandle++;
+  entry->owner = owner ? owner : "";
+  entry->bus = bus;
+  entry->frame = *frame;
+  entry->frame.origin = bus;
+  entry->frame.callback = NULL;
+  entry->period_ms = period_ms;
+  entry->phase_ms = (phase_ms < 0) ? AutoPhase(bus, period_ms) : (phase_ms % period_ms);
+  entry->update = update;
+  entry->dbcsource = dbcsource;
+  entry->due = 0;
+  entry->sent = 0;
+  entry->fails = 0;
+  entry->missed = 0;
+  entry->jitter_sum = 0;
+  entry->jitter_max = 0;
+  Schedule(entry, esp_timer_get_time());
+  m_entries.push_back(entry);
+
+  Wakeup();
+  return entry->handle;
+  }
+
+bool canperiodic::Remove(uint32_t handle, canbus* bus /*=NULL*/)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  for (auto it = m_entries.begin(); it != m_entries.end(); it++)
+    {
+    CAN_periodic_t* entry = *it;
+    if (entry->handle == handle && (bus == NULL || entry->bus == bus))
+      {
+      m_entries.erase(it);
+      delete entry;
+      Wakeup();
+      return true;
+      }
+    }
+  return false;
+  }
+
+int canperiodic::Remove(const char* owner, canbus* bus /*=NULL*/)
+  {
+  int cnt = 0;
+  OvmsMutexLock lock(&m_mutex);
+  for (auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+    CAN_periodic_t* entry = *it;
+    if ((owner == NULL || entry->owner == owner) && (bus == NULL || entry->bus == bus))
+      {
+      it = m_entries.erase(it);
+      delete entry;
+      cnt++;
+      }
+    else
+      {
+      it++;
+      }
+    }
+  if (cnt) Wakeup();
+  return cnt;
+  }
+
+/**
+ * AutoPhase: choose the phase with the least coincidences with the
+ *  frames already scheduled on the bus. Two frames coincide if their
+ *  phase difference is a multiple of the GCD of their periods, weighted
+ *  by the coincidence frequency.
+ *  - caller must hold m_mutex
+ */
+uint32_t canperiodic::AutoPhase(canbus* bus, uint32_t period_ms)
+  {
+  uint32_t range = 1;
+  for (CAN_periodic_t* entry : m_entries)
+    {
+    if (entry->bus == bus)
+      range = std::max(range, CAN_gcd(period_ms, entry->period_ms));
+    }
+
+  uint32_t best = 0;
+  double bestcost = 0;
+  for (uint32_t phase = 0; phase < range; phase++)
+    {
+    double cost = 0;
+    for (CAN_periodic_t* entry : m_entries)
+      {
+      if (entry->bus != bus) continue;
+      uint32_t gcd = CAN_gcd(period_ms, entry->period_ms);
+      if ((phase + gcd - (entry->phase_ms % gcd)) % gcd == 0)
+        cost += (double)gcd / entry->period_ms;
+      }
+    if (phase == 0 || cost < bestcost)
+      {
+      best = phase;
+      bestcost = cost;
+      if (cost == 0) break;
+      }
+    }
+  return best;
+  }
+
+/**
+ * Schedule: determine the next due time of an entry after now,
+ *  counting skipped cycles if the entry has fallen behind
+ */
+void canperiodic::Schedule(CAN_periodic_t* entry, int64_t now)
+  {
+  int64_t period = (int64_t)entry->period_ms * 1000;
+  if (entry->due == 0)
+    {
+    int64_t base = m_epoch + (int64_t)entry->phase_ms * 1000;
+    entry->due = (now <= base) ? base : base + ((now - base) / period + 1) * period;
+    }
+  else
+    {
+    entry->due += period;
+    if (entry->due <= now)
+      {
+      int64_t skip = (now - entry->due) / period + 1;
+      entry->missed += skip;
+      entry->due += skip * period;
+      }
+    }
+  }
+
+void canperiodic::Transmit(CAN_periodic_t* entry, int64_t now)
+  {
+  canbus* bus = entry->bus;
+  if (bus->m_mode != CAN_MODE_ACTIVE)
+    return;
+
+  CAN_frame_t frame = entry->frame;
+
+  if (entry->dbcsource)
+    {
+    dbcfile* dbc = bus->GetDBC();
+    dbcMessage* msg = (dbc) ? dbc->m_messages.FindMessage((CAN_frame_format_t)frame.FIR.B.FF, frame.MsgID) : NULL;
+    if (msg)
+      {
+      for (dbcSignal* sig : msg->m_signals)
+        {
+        OvmsMetric* metric = sig->GetMetric();
+        if (metric && metric->IsDefined())
+          {
+          dbcNumber value((double)metric->AsFloat());
+          sig->Encode(&value, &frame);
+          }
+        }
+      }
+    }
+
+  if (entry->update && !entry->update(&frame))
+    return;
+
+  // Frames within the slack time are sent early, count these as on time:
+  int64_t late = esp_timer_get_time() - entry->due;
+  uint32_t jitter = (late > 0) ? (uint32_t)late : 0;
+  if (bus->Write(&frame) == ESP_FAIL)
+    {
+    entry->fails++;
+    }
+  else
+    {
+    entry->sent++;
+    entry->jitter_sum += jitter;
+    if (jitter > entry->jitter_max) entry->jitter_max = jitter;
+    }
+  }
+
+void canperiodic::Run()
+  {
+  while (true)
+    {
+    int64_t next = INT64_MAX;
+
+    m_mutex.Lock();
+    for (CAN_periodic_t* entry : m_entries)
+      {
+      int64_t now = esp_timer_get_time();
+      if (entry->due <= now + CAN_PERIODIC_SLACK_US)
+        {
+        Transmit(entry, now);
+        Schedule(entry, now);
+        }
+      if (entry->due < next)
+        next = entry->due;
+      }
+    m_mutex.Unlock();
+
+    if (next != INT64_MAX)
+      {
+      int64_t delay = next - esp_timer_get_time();
+      if (delay <= CAN_PERIODIC_SLACK_US)
+        continue;
+      esp_timer_stop(m_timer);
+      esp_timer_start_once(m_timer, delay);
+      }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+
+void canperiodic::PeriodicTask(void *pvParameters)
+  {
+  canperiodic* me = (canperiodic*)pvParameters;
+  me->Run();
+  }
+
+void canperiodic::TimerCallback(void* arg)
+  {
+  canperiodic* me = (canperiodic*)arg;
+  if (me->m_task) xTaskNotifyGive(me->m_task);
+  }
+
+void canperiodic::Wakeup()
+  {
+  if (m_task) xTaskNotifyGive(m_task);
+  }
+
+std::string canperiodic::GetList(canbus* bus /*=NULL*/)
+  {
+  std::ostringstream buf;
+  int cnt = 0;
+  OvmsMutexLock lock(&m_mutex);
+
+  for (CAN_periodic_t* entry : m_entries)
+    {
+    if (bus && entry->bus != bus) continue;
+    cnt++;
+    buf << "#" << entry->handle << " " << entry->bus->GetName() << " "
+      << std::hex << std::setfill('0') << std::setw((entry->frame.FIR.B.FF == CAN_frame_std) ? 3 : 8)
+      << entry->frame.MsgID;
+    for (int k=0; k<entry->frame.FIR.B.DLC && k<8; k++)
+      buf << " " << std::setw(2) << (int)entry->frame.data.u8[k];
+    buf << std::dec << std::setfill(' ')
+      << "\n    Period:" << entry->period_ms << "ms"
+      << " Phase:" << entry->phase_ms << "ms"
+      << (entry->dbcsource ? " Source:dbc" : "")
+      << (entry->update ? " Update:callback" : "")
+      << " Owner:" << (entry->owner.empty() ? "-" : entry->owner)
+      << "\n    Sent:" << entry->sent
+      << " Fails:" << entry->fails
+      << " Missed:" << entry->missed
+      << " Jitter avg:" << (entry->sent ? (uint32_t)(entry->jitter_sum / entry->sent) : 0)
+      << "us max:" << entry->jitter_max << "us\n";
+    }
+
+  if (cnt == 0)
+    buf << "No periodic frames\n";
+  return buf.str();
+  }
+
+void canperiodic::ClearStats(canbus* bus /*=NULL*/)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  for (CAN_periodic_t* entry : m_entries)
+    {
+    if (bus && entry->bus != bus) continue;
+    entry->sent = 0;
+    entry->fails = 0;
+    entry->missed = 0;
+    entry->jitter_sum = 0;
+    entry->jitter_max = 0;
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN traffic statistics
+// The table is read by GetStats() without locking, so a listing may
+// show an entry in the middle of an update.
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * CAN_frame_bits: worst case number of bits on the wire for a frame,
+ *  including bit stuffing of the stuffed section (SOF to CRC),
+ *  delimiters, ACK, EOF and interframe space
+ */
+uint32_t CAN_frame_bits(const CAN_frame_t* frame)
+  {
+  uint32_t data = (frame->FIR.B.RTR == CAN_RTR) ? 0 : 8 * std::min((int)frame->FIR.B.DLC, 8);
+  uint32_t stuffed = ((frame->FIR.B.FF == CAN_frame_std) ? 34 : 54) + data;
+  return stuffed + (stuffed - 1) / 4 + 13;
+  }
+
+cantraffic::cantraffic()
+  {
+  m_ids = NULL;
+  m_size = 0;
+  m_spinlock = portMUX_INITIALIZER_UNLOCKED;
+  Clear();
+  }
+
+cantraffic::~cantraffic()
+  {
+  if (m_ids)
+    {
+    free(m_ids);
+    m_ids = NULL;
+    }
+  }
+
+bool cantraffic::Init(uint32_t size)
+  {
+  if (m_ids) return true;
+  uint32_t pow2 = 16;
+  while (pow2 < size) pow2 <<= 1;
+  CAN_traffic_id_t* ids = (CAN_traffic_id_t*)malloc(pow2 * sizeof(CAN_traffic_id_t));
+  if (!ids)
+    {
+    ESP_LOGE(TAG, "cantraffic: cannot allocate %" PRIu32 " entries", pow2);
+    return false;
+    }
+  for (uint32_t k=0; k<pow2; k++)
+    ids[k].key = CAN_TRAFFIC_EMPTY;
+  portENTER_CRITICAL(&m_spinlock);
+  m_ids = ids;
+  m_size = pow2;
+  m_used = 0;
+  portEXIT_CRITICAL(&m_spinlock);
+  return true;
+  }
+
+/**
+ * Lookup: find or insert the table entry for a key (linear probing)
+ *  - returns NULL if the table is full
+ *  - caller must hold m_spinlock
+ */
+CAN_traffic_id_t* cantraffic::Lookup(uint32_t key)
+  {
+  uint32_t mask = m_size - 1;
+  uint32_t slot = (key * 2654435761u) & mask;
+  for (uint32_t probe=0; probe<m_size; probe++)
+    {
+    CAN_traffic_id_t* entry = &m_ids[(slot + probe) & mask];
+    if (entry->key == key)
+      return entry;
+    if (entry->key == CAN_TRAFFIC_EMPTY)
+      {
+      // keep a quarter of the table free to bound probe lengths:
+      if (m_used >= m_size - m_size / 4)
+        return NULL;
+      memset(entry, 0, sizeof(*entry));
+      entry->key = key;
+      entry->period_min = UINT32_MAX;
+      m_used++;
+      return entry;
+      }
+    }
+  return NULL;
+  }
+
+void cantraffic::Count(const CAN_frame_t* frame, bool tx, int64_t time /*=0*/)
+  {
+  uint32_t bits = CAN_frame_bits(frame);
+  uint32_t key = frame->MsgID
+    | ((frame->FIR.B.FF == CAN_frame_ext) ? CAN_TRAFFIC_KEY_EXT : 0)
+    | (tx ? CAN_TRAFFIC_KEY_TX : 0);
+  if (!time) time = esp_timer_get_time();
+
+  portENTER_CRITICAL(&m_spinlock);
+  if (tx)
+    m_bits_tx += bits;
+  else
+    m_bits_rx += bits;
+  m_frames++;
+
+  CAN_traffic_id_t* entry = (m_ids) ? Lookup(key) : NULL;
+  if (entry)
+    {
+    if (entry->count > 0)
+      {
+      uint32_t period = time - entry->last;
+      entry->period_sum += period;
+      if (period < entry->period_min) entry->period_min = period;
+      if (period > entry->period_max) entry->period_max = period;
+      }
+    entry->count++;
+    entry->last = time;
+    entry->dlc = frame->FIR.B.DLC;
+    }
+  else
+    {
+    m_untracked++;
+    }
+  portEXIT_CRITICAL(&m_spinlock);
+  }
+
+/**
+ * Integrate: calculate the bus load of the interval since the last call
+ */
+void cantraffic::Integrate(uint32_t bitrate)
+  {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&m_spinlock);
+  uint32_t bits_rx = m_bits_rx;
+  uint32_t bits_tx = m_bits_tx;
+  uint32_t frames = m_frames;
+  m_bits_rx = m_bits_tx = m_frames = 0;
+  portEXIT_CRITICAL(&m_spinlock);
+
+  int64_t elapsed = now - m_last;
+  m_last = now;
+  if (elapsed <= 0 || bitrate == 0)
+    return;
+
+  double capacity = (double)bitrate * elapsed / 1000000;
+  m_load = 100.0 * (bits_rx + bits_tx) / capacity;
+  m_load_tx = 100.0 * bits_tx / capacity;
+  if (m_load > m_load_peak) m_load_peak = m_load;
+  m_fps = (uint64_t)frames * 1000000 / elapsed;
+
+  m_total_bits_rx += bits_rx;
+  m_total_bits_tx += bits_tx;
+  m_total_frames += frames;
+  m_total_capacity += (uint64_t)capacity;
+  }
+
+std::string cantraffic::GetStats(int maxids /*=-1*/)
+  {
+  std::ostringstream buf;
+
+  buf << std::fixed << std::setprecision(1)
+    << "Load:      " << m_load << "% (TX " << m_load_tx << "%), peak " << m_load_peak << "%"
+    << ", avg " << (m_total_capacity ? 100.0 * (m_total_bits_rx + m_total_bits_tx) / m_total_capacity : 0.0) << "%\n"
+    << "Frames/s:  " << m_fps << "\n"
+    << "Bits:      RX " << m_total_bits_rx << " TX " << m_total_bits_tx
+    << " in " << ((esp_timer_get_time() - m_start) / 1000000) << " s\n"
+    << "IDs:       " << m_used << " of " << m_size << " tracked, " << m_untracked << " frames untracked\n";
+
+  if (!m_ids || m_used == 0 || maxids == 0)
+    return buf.str();
+
+  // Copy & sort by ID:
+  std::vector<CAN_traffic_id_t> ids;
+  ids.reserve(m_used);
+  for (uint32_t k=0; k<m_size; k++)
+    {
+    if (m_ids[k].key != CAN_TRAFFIC_EMPTY)
+      ids.push_back(m_ids[k]);
+    }
+  std::sort(ids.begin(), ids.end(), [](const CAN_traffic_id_t& a, const CAN_traffic_id_t& b)
+    {
+    return a.key < b.key;
+    });
+
+  buf << "\nDir ID       DLC      Count  Period ms avg/min/max\n";
+  int cnt = 0;
+  for (const CAN_traffic_id_t& entry : ids)
+    {
+    if (maxids > 0 && cnt++ >= maxids)
+      {
+      buf << "(" << ids.size() - maxids << " more)\n";
+      break;
+      }
+    uint32_t id = entry.key & ~(CAN_TRAFFIC_KEY_EXT|CAN_TRAFFIC_KEY_TX);
+    buf << ((entry.key & CAN_TRAFFIC_KEY_TX) ? "TX  " : "RX  ")
+      << std::hex << std::setfill('0') << std::setw((entry.key & CAN_TRAFFIC_KEY_EXT) ? 8 : 3) << id
+      << std::dec << std::setfill(' ') << std::setw((entry.key & CAN_TRAFFIC_KEY_EXT) ? 2 : 7) << ""
+      << std::setw(3) << (int)entry.dlc
+      << std::setw(11) << entry.count;
+    if (entry.count > 1)
+      {
+      buf << std::setprecision(1)
+        << std::setw(10) << (double)entry.period_sum / (entry.count - 1) / 1000
+        << " / " << (double)entry.period_min / 1000
+        << " / " << (double)entry.period_max / 1000;
+      }
+    buf << "\n";
+    }
+
+  return buf.str();
   }
 
-const char* canbus::GetErrorStateName()
+void cantraffic::Clear()
   {
-  return GetCanErrorStateName(GetErrorState());
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&m_spinlock);
+  for (uint32_t k=0; k<m_size; k++)
+    m_ids[k].key = CAN_TRAFFIC_EMPTY;
+  m_used = 0;
+  m_untracked = 0;
+  m_bits_rx = m_bits_tx = m_frames = 0;
+  portEXIT_CRITICAL(&m_spinlock);
+  m_load = m_load_tx = m_load_peak = 0;
+  m_fps = 0;
+  m_total_bits_rx = m_total_bits_tx = m_total_frames = 0;
+  m_total_capacity = 0;
+  m_start = m_last = now;
   }
 
+////////////////////////////////////////////////////////////////////////
+// CAN frame cache
+////////////////////////////////////////////////////////////////////////
 
-uint32_t can::AddLogger(canlog* logger, int filterc, const char* const* filterv)
+canframecache::canframecache()
   {
-  if (filterc>0)
+  m_entries = NULL;
+  m_size = 0;
+  m_used = 0;
+  m_updates = 0;
+  m_changes = 0;
+  m_untracked = 0;
+  m_spinlock = portMUX_INITIALIZER_UNLOCKED;
+  }
+
+canframecache::~canframecache()
+  {
+  if (m_entries)
     {
-    canfilter *filter = new canfilter();
-    for (int k=0;k<filterc;k++)
+    delete [] m_entries;
+    m_entries = NULL;
+    }
+  }
+
+bool canframecache::Init(uint32_t size)
+  {
+  if (m_entries) return true;
+  uint32_t pow2 = 16;
+  while (pow2 < size) pow2 <<= 1;
+  CAN_cache_entry_t* entries = new (std::nothrow) CAN_cache_entry_t[pow2];
+  if (!entries)
+    {
+    ESP_LOGE(TAG, "canframecache: cannot allocate %" PRIu32 " entries", pow2);
+    return false;
+    }
+  for (uint32_t k=0; k<pow2; k++)
+    {
+    entries[k].key.store(CAN_CACHE_EMPTY, std::memory_order_relaxed);
+    entries[k].lock.store(0, std::memory_order_relaxed);
+    }
+  m_size = pow2;
+  std::atomic_thread_fence(std::memory_order_release);
+  m_entries = entries;
+  return true;
+  }
+
+/**
+ * Find: locate the entry for a key (linear probing), NULL if not cached
+ */
+CAN_cache_entry_t* canframecache::Find(uint32_t key)
+  {
+  CAN_cache_entry_t* entries = m_entries;
+  if (!entries) return NULL;
+  uint32_t mask = m_size - 1;
+  uint32_t slot = (key * 2654435761u) & mask;
+  for (uint32_t probe=0; probe<m_size; probe++)
+    {
+    CAN_cache_entry_t* entry = &entries[(slot + probe) & mask];
+    uint32_t k = entry->key.load(std::memory_order_acquire);
+    if (k == key)
+      return entry;
+    if (k == CAN_CACHE_EMPTY)
+      return NULL;
+    }
+  return NULL;
+  }
+
+/**
+ * Update: store a received frame
+ *  - returns the payload bits changed vs. the cached frame,
+ *    all bits set for the first frame, a DLC change or an untracked ID
+ *  - writers are serialized, so a new key gets one slot and the sequence
+ *    lock of an entry is only taken by one writer at a time
+ */
+uint64_t canframecache::Update(const CAN_frame_t* frame, int64_t time /*=0*/)
+  {
+  if (!m_entries) return UINT64_MAX;
+
+  uint32_t key = frame->MsgID | ((frame->FIR.B.FF == CAN_frame_ext) ? CAN_CACHE_KEY_EXT : 0);
+  uint8_t dlc = std::min((int)frame->FIR.B.DLC, 8);
+  uint64_t data = (dlc == 8) ? frame->data.u64 : (frame->data.u64 & ((1ULL << (dlc*8)) - 1));
+  if (!time) time = esp_timer_get_time();
+
+  portENTER_CRITICAL(&m_spinlock);
+  m_updates++;
+
+  CAN_cache_entry_t* entry = Find(key);
+  if (entry == NULL)
+    {
+    // keep a quarter of the table free to bound probe lengths:
+    if (m_used >= m_size - m_size / 4)
       {
-      filter->AddFilter(filterv[k]);
+      m_untracked++;
+      m_changes++;
+      portEXIT_CRITICAL(&m_spinlock);
+      return UINT64_MAX;
       }
-    logger->SetFilter(filter);
+    uint32_t mask = m_size - 1;
+    uint32_t slot = (key * 2654435761u) & mask;
+    while (m_entries[slot].key.load(std::memory_order_relaxed) != CAN_CACHE_EMPTY)
+      slot = (slot + 1) & mask;
+    entry = &m_entries[slot];
+    entry->seq = 1;
+    entry->changes = 1;
+    entry->time = time;
+    entry->data = data;
+    entry->dlc = dlc;
+    entry->changed = true;
+    entry->key.store(key, std::memory_order_release);
+    m_used++;
+    m_changes++;
+    portEXIT_CRITICAL(&m_spinlock);
+    return UINT64_MAX;
     }
 
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
-  uint32_t id = m_logger_id++;
-  m_loggermap[id] = logger;
+  uint64_t changed = (entry->dlc != dlc) ? UINT64_MAX : (entry->data ^ data);
 
-  return id;
+  uint32_t lock = entry->lock.load(std::memory_order_relaxed);
+  entry->lock.store(lock + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  entry->seq++;
+  entry->time = time;
+  entry->changed = (changed != 0);
+  if (changed)
+    {
+    entry->changes++;
+    entry->data = data;
+    entry->dlc = dlc;
+    }
+  entry->lock.store(lock + 2, std::memory_order_release);
+
+  if (changed) m_changes++;
+  portEXIT_CRITICAL(&m_spinlock);
+  return changed;
   }
 
-bool can::HasLogger()
+void canframecache::Read(CAN_cache_entry_t* entry, CAN_cached_frame_t* out)
   {
-  return (m_loggermap.size() != 0);
+  uint32_t key = entry->key.load(std::memory_order_acquire);
+  out->format = (key & CAN_CACHE_KEY_EXT) ? CAN_frame_ext : CAN_frame_std;
+  out->id = key & ~CAN_CACHE_KEY_EXT;
+
+  uint32_t lock1, lock2;
+  do
+    {
+    lock1 = entry->lock.load(std::memory_order_acquire);
+    out->seq = entry->seq;
+    out->changes = entry->changes;
+    out->time = entry->time;
+    out->data.u64 = entry->data;
+    out->dlc = entry->dlc;
+    out->changed = entry->changed;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    lock2 = entry->lock.load(std::memory_order_relaxed);
+    } while ((lock1 & 1) || lock1 != lock2);
   }
 
-canlog* can::GetLogger(uint32_t id)
+/**
+ * Get: fetch the latest frame of an ID
+ *  - returns false if no frame has been received for the ID
+ */
+bool canframecache::Get(CAN_frame_format_t format, uint32_t id, CAN_cached_frame_t* out)
   {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
-
-  auto k = m_loggermap.find(id);
-  if (k != m_loggermap.end())
-    return k->second;
-  else
-    return NULL;
+  uint32_t key = id | ((format == CAN_frame_ext) ? CAN_CACHE_KEY_EXT : 0);
+  CAN_cache_entry_t* entry = Find(key);
+  if (!entry) return false;
+  Read(entry, out);
+  return true;
   }
 
-bool can::RemoveLogger(uint32_t id)
+std::string canframecache::GetStats(int maxids /*=-1*/)
   {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
+  std::ostringstream buf;
 
-  auto k = m_loggermap.find(id);
-  if (k != m_loggermap.end())
+  buf << "Frames:    " << m_updates << ", " << m_changes << " changed";
+  if (m_updates)
+    buf << " (" << std::fixed << std::setprecision(1) << 100.0 * m_changes / m_updates << "%)";
+  buf << "\nIDs:       " << m_used << " of " << m_size << " cached, "
+    << m_untracked << " frames untracked\n";
+
+  if (!m_entries || m_used == 0 || maxids == 0)
+    return buf.str();
+
+  std::vector<CAN_cached_frame_t> frames;
+  frames.reserve(m_used);
+  for (uint32_t k=0; k<m_size; k++)
     {
-    k->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    delete k->second;
-    m_loggermap.erase(k);
-    return true;
+    if (m_entries[k].key.load(std::memory_order_acquire) == CAN_CACHE_EMPTY)
+      continue;
+    CAN_cached_frame_t frame;
+    Read(&m_entries[k], &frame);
+    frames.push_back(frame);
     }
-  return false;
+  std::sort(frames.begin(), frames.end(), [](const CAN_cached_frame_t& a, const CAN_cached_frame_t& b)
+    {
+    return (a.format != b.format) ? (a.format < b.format) : (a.id < b.id);
+    });
+
+  int64_t now = esp_timer_get_time();
+  buf << "\nID            Frames  Changes   Age ms  Data\n";
+  int cnt = 0;
+  for (const CAN_cached_frame_t& frame : frames)
+    {
+    if (maxids > 0 && cnt++ >= maxids)
+      {
+      buf << "(" << frames.size() - maxids << " more)\n";
+      break;
+      }
+    buf << std::hex << std::setfill('0') << std::setw((frame.format == CAN_frame_ext) ? 8 : 3) << frame.id
+      << std::dec << std::setfill(' ') << std::setw((frame.format == CAN_frame_ext) ? 2 : 7) << ""
+      << std::setw(10) << frame.seq
+      << std::setw(9) << frame.changes
+      << std::setw(9) << (now - frame.time) / 1000 << " "
+      << std::hex << std::setfill('0');
+    for (int k=0; k<frame.dlc; k++)
+      buf << " " << std::setw(2) << (int)frame.data.u8[k];
+    buf << std::dec << std::setfill(' ') << "\n";
+    }
+
+  return buf.str();
   }
 
-void can::RemoveLoggers()
+////////////////////////////////////////////////////////////////////////
+// CAN gateway
+////////////////////////////////////////////////////////////////////////
+
+cangateway::cangateway()
   {
-  OvmsRecMutexLock lock(&m_loggermap_mutex);
+  m_count = 0;
+  m_nexthandle = 1;
+  }
 
-  for (canlog_map_t::iterator it=m_loggermap.begin(); it!=m_loggermap.end();)
+cangateway::~cangateway()
+  {
+  }
+
+/**
+ * SetRxInterest: declare/remove the source frame interest of a route.
+ *  Masks with contiguous high bits translate to an ID range, other
+ *  masks need all frames of the format.
+ */
+void cangateway::SetRxInterest(const CAN_gateway_route_t& route, bool add)
+  {
+  char owner[24];
+  snprintf(owner, sizeof(owner), "gateway:%" PRIu32, route.handle);
+  if (!add)
     {
-    it->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    delete it->second;
-    it = m_loggermap.erase(it);
+    can::instance(TAG).RemoveRxInterest(owner, route.src);
+    return;
     }
+  uint32_t idmax = (route.format == CAN_frame_std) ? 0x7ff : 0x1fffffff;
+  uint32_t free = ~route.mask & idmax;
+  if ((free & (free + 1)) == 0)
+    can::instance(TAG).AddRxInterest(owner, route.src, route.format, route.id & route.mask, (route.id & route.mask) | free);
+  else
+    can::instance(TAG).AddRxInterest(owner, route.src, route.format, 0, idmax);
   }
 
-uint32_t can::AddPlayer(canplay* player, int filterc, const char* const* filterv)
+/**
+ * AddRoute: add a forwarding route
+ *  - returns the route handle, 0 = invalid route
+ */
+uint32_t cangateway::AddRoute(const CAN_gateway_route_t& route)
   {
-  if (filterc>0)
+  if (!route.src || !route.dst || route.src == route.dst)
+    return 0;
+
+  CAN_gateway_route_t entry = route;
+  entry.id &= entry.mask;
+  entry.forwarded = 0;
+  entry.fails = 0;
+  entry.latency_sum = 0;
+  entry.latency_max = 0;
+
+  m_mutex.Lock();
+  entry.handle = m_nexthandle++;
+  m_routes.push_back(entry);
+  m_count = m_routes.size();
+  m_mutex.Unlock();
+
+  SetRxInterest(entry, true);
+  return entry.handle;
+  }
+
+bool cangateway::RemoveRoute(uint32_t handle)
+  {
+  m_mutex.Lock();
+  for (auto it = m_routes.begin(); it != m_routes.end(); it++)
     {
-    canfilter *filter = new canfilter();
-    for (int k=0;k<filterc;k++)
+    if (it->handle == handle)
       {
-      filter->AddFilter(filterv[k]);
+      CAN_gateway_route_t route = *it;
+      m_routes.erase(it);
+      m_count = m_routes.size();
+      m_mutex.Unlock();
+      SetRxInterest(route, false);
+      return true;
       }
-    player->SetFilter(filter);
     }
+  m_mutex.Unlock();
+  return false;
+  }
 
-  OvmsMutexLock lock(&m_playermap_mutex);
-  uint32_t id = m_player_id++;
-  m_playermap[id] = player;
+int cangateway::RemoveRoutes(canbus* bus /*=NULL*/)
+  {
+  CAN_gateway_route_list_t removed;
+  m_mutex.Lock();
+  for (auto it = m_routes.begin(); it != m_routes.end(); )
+    {
+    if (bus == NULL || it->src == bus || it->dst == bus)
+      {
+      removed.push_back(*it);
+      it = m_routes.erase(it);
+      }
+    else
+      {
+      it++;
+      }
+    }
+  m_count = m_routes.size();
+  m_mutex.Unlock();
 
-  return id;
+  for (const CAN_gateway_route_t& route : removed)
+    SetRxInterest(route, false);
+  return removed.size();
   }
 
-bool can::HasPlayer()
+/**
+ * Forward: apply all routes matching a received frame
+ *  - time: reception time (esp_timer) for the latency statistics, 0 = now
+ *  - returns the number of frames forwarded
+ */
+int cangateway::Forward(const CAN_frame_t* frame, int64_t time /*=0*/)
   {
-  OvmsMutexLock lock(&m_playermap_mutex);
+  if (m_count == 0) return 0;
+  if (!time) time = esp_timer_get_time();
 
-  return (m_playermap.size() > 0);
+  int cnt = 0;
+  OvmsMutexLock lock(&m_mutex);
+  for (CAN_gateway_route_t& route : m_routes)
+    {
+    if (route.src != frame->origin || route.format != frame->FIR.B.FF ||
+        (frame->MsgID & route.mask) != route.id)
+      continue;
+    if (route.dst->m_mode != CAN_MODE_ACTIVE)
+      {
+      route.fails++;
+      continue;
+      }
+
+    CAN_frame_t out = *frame;
+    out.origin = route.dst;
+    out.callback = NULL;
+    if (route.rewrite)
+      out.MsgID = (frame->MsgID & ~route.mask) | (route.newid & route.mask);
+    if (route.permute)
+      {
+      for (int k=0; k<8; k++)
+        out.data.u8[k] = (route.map[k] < 8) ? frame->data.u8[route.map[k]] : 0;
+      }
+    out.data.u64 = (out.data.u64 & ~route.mergemask) | (route.mergevalue & route.mergemask);
+    if (route.dlc >= 0)
+      out.FIR.B.DLC = route.dlc;
+
+    if (route.dst->Write(&out) == ESP_FAIL)
+      {
+      route.fails++;
+      }
+    else
+      {
+      uint32_t latency = esp_timer_get_time() - time;
+      route.forwarded++;
+      route.latency_sum += latency;
+      if (latency > route.latency_max) route.latency_max = latency;
+      cnt++;
+      }
+    }
+  return cnt;
   }
 
-canplay* can::GetPlayer(uint32_t id)
+std::string cangateway::GetList()
   {
-  OvmsMutexLock lock(&m_playermap_mutex);
+  std::ostringstream buf;
+  OvmsMutexLock lock(&m_mutex);
 
-  auto k = m_playermap.find(id);
-  if (k != m_playermap.end())
-    return k->second;
-  else
-    return NULL;
+  if (m_routes.empty())
+    return "No gateway routes\n";
+
+  for (const CAN_gateway_route_t& route : m_routes)
+    {
+    int idw = (route.format == CAN_frame_std) ? 3 : 8;
+    buf << "#" << route.handle << " " << route.src->GetName()
+      << " " << ((route.format == CAN_frame_std) ? "std" : "ext")
+      << " " << std::hex << std::setfill('0') << std::setw(idw) << route.id
+      << "/" << std::setw(idw) << route.mask
+      << " -> " << route.dst->GetName();
+    if (route.rewrite)
+      buf << " id " << std::setw(idw) << route.newid;
+    if (route.permute)
+      {
+      buf << " map ";
+      for (int k=0; k<8; k++)
+        {
+        if (route.map[k] < 8)
+          buf << (int)route.map[k];
+        else
+          buf << "-";
+        }
+      }
+    if (route.mergemask)
+      {
+      buf << " merge ";
+      for (int k=0; k<8; k++)
+        buf << std::setw(2) << (int)((route.mergemask >> (k*8)) & 0xff);
+      buf << ":";
+      for (int k=0; k<8; k++)
+        buf << std::setw(2) << (int)((route.mergevalue >> (k*8)) & 0xff);
+      }
+    buf << std::dec << std::setfill(' ');
+    if (route.dlc >= 0)
+      buf << " dlc " << (int)route.dlc;
+    buf << "\n    Forwarded:" << route.forwarded
+      << " Fails:" << route.fails
+      << " Latency avg:" << (route.forwarded ? (uint32_t)(route.latency_sum / route.forwarded) : 0)
+      << "us max:" << route.latency_max << "us\n";
+    }
+
+  return buf.str();
   }
 
-bool can::RemovePlayer(uint32_t id)
+void cangateway::ClearStats()
   {
-  OvmsMutexLock lock(&m_playermap_mutex);
-
-  auto k = m_playermap.find(id);
-  if (k != m_playermap.end())
+  OvmsMutexLock lock(&m_mutex);
+  for (CAN_gateway_route_t& route : m_routes)
     {
-    k->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    delete k->second;
-    m_playermap.erase(k);
-    return true;
+    route.forwarded = 0;
+    route.fails = 0;
+    route.latency_sum = 0;
+    route.latency_max = 0;
     }
-  return false;
   }
 
-void can::RemovePlayers()
+////////////////////////////////////////////////////////////////////////
+// CAN frame callback delegate
+////////////////////////////////////////////////////////////////////////
+
+CanFrameDelegate::CanFrameDelegate(const CanFrameCallback& fn)
   {
-  OvmsMutexLock lock(&m_playermap_mutex);
+  m_invoke = NULL;
+  m_manage = NULL;
+  if (!fn) return;
+  CanFrameCallback* target = new CanFrameCallback(fn);
+  memcpy(m_data, &target, sizeof(target));
+  m_invoke = InvokeStdFunction;
+  m_manage = ManageStdFunction;
+  }
 
-  for (canplay_map_t::iterator it=m_playermap.begin(); it!=m_playermap.end();)
+void CanFrameDelegate::Copy(const CanFrameDelegate& other)
+  {
+  m_invoke = other.m_invoke;
+  m_manage = other.m_manage;
+  if (m_manage)
+    m_manage(this, &other);
+  else
+    memcpy(m_data, other.m_data, sizeof(m_data));
+  }
+
+void CanFrameDelegate::Reset()
+  {
+  if (m_manage)
+    m_manage(this, NULL);
+  m_invoke = NULL;
+  m_manage = NULL;
+  }
+
+void CanFrameDelegate::InvokeStdFunction(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success)
+  {
+  CanFrameCallback* target;
+  memcpy(&target, d->m_data, sizeof(target));
+  (*target)(frame, success);
+  }
+
+void CanFrameDelegate::ManageStdFunction(CanFrameDelegate* dst, const CanFrameDelegate* src)
+  {
+  CanFrameCallback* target;
+  if (src)
     {
-    it->second->Close();
-    vTaskDelay(pdMS_TO_TICKS(100)); // give logger task time to finish
-    delete it->second;
-    it = m_playermap.erase(it);
+    memcpy(&target, src->m_data, sizeof(target));
+    target = new CanFrameCallback(*target);
+    memcpy(dst->m_data, &target, sizeof(target));
+    }
+  else
+    {
+    memcpy(&target, dst->m_data, sizeof(target));
+    delete target;
     }
   }
 
 ////////////////////////////////////////////////////////////////////////
-// CAN controller task
+// CAN RX dispatch task
 ////////////////////////////////////////////////////////////////////////
 
-void can::CAN_rxtask(void *pvParameters)
+canrxtask::canrxtask(const char* name)
+  {
+  m_name = name;
+  m_queue = xQueueCreate(CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE,sizeof(CAN_queue_msg_t));
+  m_task = NULL;
+  m_core = -1;
+  ClearStats();
+  }
+
+canrxtask::~canrxtask()
+  {
+  if (m_task)
+    vTaskDelete(m_task);
+  if (m_queue)
+    vQueueDelete(m_queue);
+  }
+
+bool canrxtask::Start(int core)
   {
-  can *me = (can*)pvParameters;
+  if (m_task) return true;
+  if (!m_queue) return false;
+  m_core = core;
+  if (xTaskCreatePinnedToCore(RxTask, m_name.c_str(), 2*2048, (void*)this, 23, &m_task, core) != pdPASS)
+    {
+    ESP_LOGE(TAG, "%s: task creation failed", m_name.c_str());
+    m_task = NULL;
+    return false;
+    }
+  return true;
+  }
+
+void canrxtask::RxTask(void *pvParameters)
+  {
+  canrxtask *me = (canrxtask*)pvParameters;
+  can &canctl = can::instance(TAG);
   CAN_queue_msg_t msg;
 
   while(1)
     {
-    if (xQueueReceive(me->m_rxqueue,&msg, (portTickType)portMAX_DELAY)==pdTRUE)
+    if (xQueueReceive(me->m_queue,&msg, (portTickType)portMAX_DELAY)==pdTRUE)
       {
-      switch(msg.type)
-        {
-        case CAN_frame:
-          me->IncomingFrame(&msg.body.frame);
-          break;
-        case CAN_asyncinterrupthandler:
-          {
-          bool loop;
-          // Loop until all interrupts are handled
-          do {
-            uint32_t receivedFrames;
-            loop = msg.body.bus->AsynchronousInterruptHandler(&msg.body.frame, &receivedFrames);
-            } while (loop);
-          break;
-          }
-        case CAN_txcallback:
-          msg.body.bus->TxCallback(&msg.body.frame, true);
-          break;
-        case CAN_txfailedcallback:
-          msg.body.bus->TxCallback(&msg.body.frame, false);
-          break;
-        case CAN_logerror:
-          msg.body.bus->LogStatus(CAN_LogStatus_Error);
-          break;
-        case CAN_logstatus:
-          msg.body.bus->LogStatus(CAN_LogStatus_Statistics);
-          break;
-        default:
-          break;
-        }
+      uint32_t fill = uxQueueMessagesWaiting(me->m_queue) + 1;
+      if (fill > me->m_highwater) me->m_highwater = fill;
+      int64_t t0 = esp_timer_get_time();
+      canctl.DispatchMessage(&msg);
+      uint32_t busy = esp_timer_get_time() - t0;
+      me->m_busytime += busy;
+      if (busy > me->m_busymax) me->m_busymax = busy;
+      me->m_messages++;
+      }
+    }
+  }
+
+std::string canrxtask::GetStats()
+  {
+  std::ostringstream buf;
+  int64_t elapsed = esp_timer_get_time() - m_start;
+  buf << std::setw(20) << std::left << m_name << std::right;
+  if (m_core < 0)
+    buf << "   -";
+  else
+    buf << std::setw(4) << m_core;
+  buf << std::setw(10) << m_messages
+      << std::setw(7) << m_highwater << "/" << std::setw(3) << std::left << CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE << std::right
+      << std::setw(10) << (m_busytime / 1000)
+      << std::setw(7) << std::fixed << std::setprecision(2)
+      << ((elapsed > 0) ? (float)m_busytime * 100 / elapsed : 0.0f)
+      << std::setw(8) << m_busymax;
+  return buf.str();
+  }
+
+void canrxtask::ClearStats()
+  {
+  m_messages = 0;
+  m_highwater = 0;
+  m_busytime = 0;
+  m_busymax = 0;
+  m_start = esp_timer_get_time();
+  }
+
+/**
+ * DispatchMessage: process a driver message from an RX dispatch queue
+ */
+void can::DispatchMessage(CAN_queue_msg_t* msg)
+  {
+  switch(msg->type)
+    {
+    case CAN_frame:
+      IncomingFrame(&msg->body.frame, msg->time ? CAN_time_expand(msg->time) : 0);
+      break;
+    case CAN_asyncinterrupthandler:
+      {
+      bool loop;
+      // Loop until all interrupts are handled
+      do {
+        uint32_t receivedFrames;
+        loop = msg->body.bus->AsynchronousInterruptHandler(&msg->body.frame, &receivedFrames);
+        } while (loop);
+      break;
       }
+    case CAN_txcallback:
+      msg->body.bus->TxCallback(&msg->body.frame, true);
+      break;
+    case CAN_txfailedcallback:
+      msg->body.bus->TxCallback(&msg->body.frame, false);
+      break;
+    case CAN_txdroppedcallback:
+      // Bypass the driver override: the frame never reached the
+      // controller, so no TX buffer has been freed
+      msg->body.bus->canbus::TxCallback(&msg->body.frame, false);
+      break;
+    case CAN_logerror:
+      msg->body.bus->LogStatus(CAN_LogStatus_Error);
+      break;
+    case CAN_logstatus:
+      msg->body.bus->LogStatus(CAN_LogStatus_Statistics);
+      break;
+    case CAN_rxfilterupdate:
+      msg->body.bus->ApplyAcceptanceFilter();
+      break;
+    default:
+      break;
     }
   }
 
@@ -893,6 +3382,9 @@ can &can::instance(const char* caller) {
 
 can::can()
   {
+  m_rxdispatch = new CanFrameDispatchSnapshot();
+  m_rxdispatch_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
   if (!includeCAN) return;
 
   ESP_LOGI(TAG, "Initialising CAN");
@@ -906,9 +3398,9 @@ can::can()
 
   for (int k=0;k<CAN_MAXBUSES;k++) m_buslist[k] = NULL;
 
-  for (int k=1;k<5;k++)
+  for (int k=1;k<=CAN_MAXBUSES;k++)
     {
-    static const char* name[4] = {"can1", "can2", "can3", "can4"};
+    static const char* name[CAN_MAXBUSES] = {"can1", "can2", "can3", "can4", "can5"};
     OvmsCommand* cmd_canx = cmd_can->RegisterCommand(name[k-1],"CANx framework");
     OvmsCommand* cmd_canstart = cmd_canx->RegisterCommand("start","CAN start framework");
     cmd_canstart->RegisterCommand("listen","Start CAN bus in listen mode",can_start,"<baud> [<dbc>]", 1, 2);
@@ -928,15 +3420,62 @@ can::can()
     cmd_cantesttx->RegisterCommand("standard","Transmit test standard CAN frames",can_testtx,"<id> <count> <delayms>", 3, 3);
     cmd_cantesttx->RegisterCommand("extended","Transmit test extended CAN frames",can_testtx,"<id> <count> <delayms>", 3, 3);
     cmd_canx->RegisterCommand("status","Show CAN status",can_status);
+    cmd_canx->RegisterCommand("stats","Show CAN bus load & per ID traffic statistics (of frames passing the HW filter)",can_stats,"[<maxids>]", 0, 1);
+    cmd_canx->RegisterCommand("cache","Show latest frame per ID cache",can_cache,"[<maxids>]", 0, 1);
+    cmd_canx->RegisterCommand("rxfilter","Show CAN frame interest & hardware acceptance filter",can_rxfilter);
+    OvmsCommand* cmd_cantxq = cmd_canx->RegisterCommand("txqueue","CAN TX queue framework");
+    cmd_cantxq->RegisterCommand("status","Show TX queue priority class statistics & rules",can_txqueue_status);
+    cmd_cantxq->RegisterCommand("clear","Clear TX queue statistics",can_txqueue_clear);
+    OvmsCommand* cmd_cantxqorder = cmd_cantxq->RegisterCommand("order","Set TX queue order within priority class");
+    cmd_cantxqorder->RegisterCommand("fifo","Send in queueing order",can_txqueue_order);
+    cmd_cantxqorder->RegisterCommand("id","Send in arbitration ID order",can_txqueue_order);
+    OvmsCommand* cmd_cantxqrule = cmd_cantxq->RegisterCommand("rule","TX queue priority rules");
+    cmd_cantxqrule->RegisterCommand("add","Add TX priority rule",can_txqueue_rule_add,
+      "<control|normal|diag> <std|ext> <id_from> [<id_to> [<deadline_ms>]]", 3, 5);
+    cmd_cantxqrule->RegisterCommand("clear","Reset TX priority rules to defaults",can_txqueue_rule_clear);
+    OvmsCommand* cmd_canper = cmd_canx->RegisterCommand("periodic","CAN periodic TX framework");
+    cmd_canper->RegisterCommand("list","List periodic frames & jitter statistics",can_periodic_list);
+    OvmsCommand* cmd_canperadd = cmd_canper->RegisterCommand("add","Add periodic frame");
+    cmd_canperadd->RegisterCommand("standard","Add periodic standard frame",can_periodic_add,"<period_ms> <id> <data...>", 2, 10);
+    cmd_canperadd->RegisterCommand("extended","Add periodic extended frame",can_periodic_add,"<period_ms> <id> <data...>", 2, 10);
+    cmd_canperadd->RegisterCommand("dbc","Add periodic frame encoded from DBC signal metrics",can_periodic_add,"<period_ms> <id>", 2, 2);
+    cmd_canper->RegisterCommand("remove","Remove periodic frame",can_periodic_remove,"<handle>|all", 1, 1);
+    cmd_canper->RegisterCommand("clear","Clear periodic frame statistics",can_periodic_clear);
     cmd_canx->RegisterCommand("clear","Clear CAN status",can_clearstatus);
     cmd_canx->RegisterCommand("viewregisters","view can controller registers",can_view_registers);
     cmd_canx->RegisterCommand("setregister","set can controller register",can_set_register,"<reg> <value>",2,2);
     }
 
   cmd_can->RegisterCommand("list", "List CAN buses", can_list);
-
-  m_rxqueue = xQueueCreate(CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE,sizeof(CAN_queue_msg_t));
-  xTaskCreatePinnedToCore(CAN_rxtask, "OVMS CanRx", 2*2048, (void*)this, 23, &m_rxtask, CORE(0));
+  OvmsCommand* cmd_canring = cmd_can->RegisterCommand("ring", "CAN frame ring framework");
+  cmd_canring->RegisterCommand("status", "Show CAN frame ring status", can_ring_status);
+  cmd_canring->RegisterCommand("clear", "Clear CAN frame ring statistics", can_ring_clear);
+  OvmsCommand* cmd_canrxtask = cmd_can->RegisterCommand("rxtask", "CAN RX dispatch task framework");
+  cmd_canrxtask->RegisterCommand("status", "Show RX dispatch task CPU time & queue statistics", can_rxtask_status);
+  cmd_canrxtask->RegisterCommand("clear", "Clear RX dispatch task statistics", can_rxtask_clear);
+  OvmsCommand* cmd_cangw = cmd_can->RegisterCommand("gateway", "CAN gateway framework");
+  cmd_cangw->RegisterCommand("list", "List gateway routes & statistics", can_gateway_list);
+  cmd_cangw->RegisterCommand("add", "Add gateway route", can_gateway_add,
+    "<srcbus> <std|ext> <id>[/<mask>] <dstbus> [id=<newid>] [map=<bytemap>] [merge=<mask>:<value>] [dlc=<n>]\n"
+    "  id=<newid>           replace the masked ID bits\n"
+    "  map=<bytemap>        8 source byte indexes for output bytes 0-7, '-' = zero, e.g. map=10325476\n"
+    "  merge=<mask>:<value> merge constant payload bits, hex bytes 0-7, e.g. merge=ff00:0100\n"
+    "  dlc=<n>              set output DLC", 4, 8);
+  cmd_cangw->RegisterCommand("remove", "Remove gateway route", can_gateway_remove, "<handle>|all", 1, 1);
+  cmd_cangw->RegisterCommand("clear", "Clear gateway statistics", can_gateway_clear);
+  OvmsCommand* cmd_canbench = cmd_can->RegisterCommand("bench", "CAN framework benchmarks");
+  cmd_canbench->RegisterCommand("fanout", "Benchmark frame fan-out: listener queues vs. frame ring",
+    can_bench_fanout, "[<frames>] [<readers>]", 0, 2);
+  cmd_canbench->RegisterCommand("filter", "Benchmark canfilter lookup with 1, 10 and 100 ranges",
+    can_bench_filter, "[<frames>]", 0, 1);
+  cmd_canbench->RegisterCommand("format", "Benchmark canformat get() into a buffer vs. std::string",
+    can_bench_format, "[<frames>]", 0, 1);
+
+  m_ring.Init(CONFIG_OVMS_HW_CAN_RING_SIZE);
+
+  m_rxtask = new canrxtask("OVMS CanRx");
+  m_rxqueue = m_rxtask->m_queue;
+  m_rxtask->Start(CORE(0));
   }
 
 canbus* can::GetBus(int busnumber)
@@ -958,19 +3497,31 @@ canbus* can::GetBus(int busnumber)
   return found;
   }
 
-void can::IncomingFrame(CAN_frame_t* p_frame)
+/**
+ * IncomingFrame: process a received frame
+ *  time: esp_timer time of reception as taken by the driver (0 = now)
+ */
+void can::IncomingFrame(CAN_frame_t* p_frame, int64_t time)
   {
   p_frame->origin->m_status.packets_rx++;
   p_frame->origin->m_watchdog_timer = monotonictime;
+  m_gateway.Forward(p_frame, time);
+  p_frame->origin->m_traffic.Count(p_frame, false, time);
+  uint64_t changed = p_frame->origin->m_framecache.Update(p_frame, time);
 
-  ExecuteCallbacks(p_frame, false, true /*ignored*/);
-  p_frame->origin->LogFrame(CAN_LogFrame_RX, p_frame);
+  ExecuteCallbacks(p_frame, false, true /*ignored*/, changed);
+  p_frame->origin->LogFrame(CAN_LogFrame_RX, p_frame, time);
   NotifyListeners(p_frame, false);
   }
 
 void can::RegisterListener(QueueHandle_t queue, bool txfeedback)
   {
   m_listeners[queue] = txfeedback;
+
+  // Listeners receive all frames:
+  char owner[24];
+  snprintf(owner, sizeof(owner), "listener:%p", queue);
+  AddRxInterestAll(owner);
   }
 
 void can::DeregisterListener(QueueHandle_t queue)
@@ -978,6 +3529,10 @@ void can::DeregisterListener(QueueHandle_t queue)
   auto it = m_listeners.find(queue);
   if (it != m_listeners.end())
     m_listeners.erase(it);
+
+  char owner[24];
+  snprintf(owner, sizeof(owner), "listener:%p", queue);
+  RemoveRxInterest(owner);
   }
 
 void can::NotifyListeners(const CAN_frame_t* frame, bool tx)
@@ -989,22 +3544,176 @@ void can::NotifyListeners(const CAN_frame_t* frame, bool tx)
     }
   }
 
-void can::RegisterCallback(const char* caller, CanFrameCallback callback, bool txfeedback)
+void can::RegisterCallback(const char* caller, const CanFrameDelegate& callback, bool txfeedback)
   {
+  m_rxdispatch_mutex.Lock();
   if (txfeedback)
     m_txcallbacks.push_back(new CanFrameCallbackEntry(caller, callback));
   else
     m_rxcallbacks.push_back(new CanFrameCallbackEntry(caller, callback));
+  CanFrameDispatchSnapshot* previous = PublishDispatch();
+  m_rxdispatch_mutex.Unlock();
+  CanFrameDispatchSnapshot::Release(previous);
+
+  if (!txfeedback)
+    AddRxInterestAll(caller);
+  }
+
+/**
+ * RegisterCallback: subscribe to received frames of a bus (NULL = any),
+ *  frame format and ID range (inclusive). Only matching frames are
+ *  dispatched to the callback, via the compiled m_rxdispatch table.
+ */
+void can::RegisterCallback(const char* caller, const CanFrameDelegate& callback, canbus* bus,
+                           CAN_frame_format_t format, uint32_t id_from, uint32_t id_to)
+  {
+  uint32_t id_max = (format == CAN_frame_std) ? 0x7ff : 0x1fffffff;
+  if (id_to > id_max) id_to = id_max;
+  if (id_from > id_to)
+    {
+    ESP_LOGE(TAG, "RegisterCallback: %s: invalid ID range %" PRIx32 "-%" PRIx32, caller, id_from, id_to);
+    return;
+    }
+
+  m_rxdispatch_mutex.Lock();
+  m_rxsubscriptions.push_back(new CanFrameSubscription(caller, callback, bus, format, id_from, id_to));
+  CanFrameDispatchSnapshot* previous = PublishDispatch();
+  m_rxdispatch_mutex.Unlock();
+  CanFrameDispatchSnapshot::Release(previous);
+
+  AddRxInterest(caller, bus, format, id_from, id_to);
+  }
+
+/**
+ * RegisterChangeCallback: subscribe to frames of an ID range, delivered only
+ *  if their payload differs from the previous frame of the ID in the bits
+ *  set in mask (applied to data.u64, i.e. byte 0 = bits 0-7).
+ *  The first frame of an ID and DLC changes are always delivered.
+ */
+void can::RegisterChangeCallback(const char* caller, const CanFrameDelegate& callback, canbus* bus,
+                                 CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                                 uint64_t mask /*=UINT64_MAX*/)
+  {
+  uint32_t id_max = (format == CAN_frame_std) ? 0x7ff : 0x1fffffff;
+  if (id_to > id_max) id_to = id_max;
+  if (id_from > id_to)
+    {
+    ESP_LOGE(TAG, "RegisterChangeCallback: %s: invalid ID range %" PRIx32 "-%" PRIx32, caller, id_from, id_to);
+    return;
+    }
+
+  m_rxdispatch_mutex.Lock();
+  m_rxsubscriptions.push_back(new CanFrameSubscription(caller, callback, bus, format, id_from, id_to, true, mask));
+  CanFrameDispatchSnapshot* previous = PublishDispatch();
+  m_rxdispatch_mutex.Unlock();
+  CanFrameDispatchSnapshot::Release(previous);
+
+  AddRxInterest(caller, bus, format, id_from, id_to);
   }
 
 void can::DeregisterCallback(const char* caller)
   {
-  m_rxcallbacks.remove_if([caller](CanFrameCallbackEntry* entry){ return strcmp(entry->m_caller, caller)==0; });
-  m_txcallbacks.remove_if([caller](CanFrameCallbackEntry* entry){ return strcmp(entry->m_caller, caller)==0; });
+  auto match = [caller](CanFrameCallbackEntry* entry)
+    {
+    if (strcmp(entry->m_caller, caller) != 0) return false;
+    delete entry;
+    return true;
+    };
+
+  // Callbacks are dispatched from copies in the snapshots, so the entries can
+  // be freed right away. Subscriptions are referenced by the snapshot tables,
+  // so they are retired to the previous snapshot and freed along with it:
+  CanFrameSubscriptionList_t retired;
+  m_rxdispatch_mutex.Lock();
+  m_rxcallbacks.remove_if(match);
+  m_txcallbacks.remove_if(match);
+  for (auto it = m_rxsubscriptions.begin(); it != m_rxsubscriptions.end(); )
+    {
+    if (strcmp((*it)->m_caller, caller) == 0)
+      {
+      retired.push_back(*it);
+      it = m_rxsubscriptions.erase(it);
+      }
+    else
+      ++it;
+    }
+  CanFrameDispatchSnapshot* previous = PublishDispatch(&retired);
+  m_rxdispatch_mutex.Unlock();
+
+  // The caller may free the callback context after returning:
+  SyncDispatch(previous);
+
+  RemoveRxInterest(caller);
+  }
+
+// ExecuteCallbacks() nesting level of the current task:
+static thread_local int can_dispatch_depth = 0;
+
+/**
+ * PublishDispatch: build a snapshot of the current registrations & make it
+ *  the current one. Call with m_rxdispatch_mutex held.
+ *  - retired: subscriptions removed, freed with the previous snapshot
+ *  Returns the previous snapshot, referenced: pass it to Release() or SyncDispatch()
+ */
+CanFrameDispatchSnapshot* can::PublishDispatch(CanFrameSubscriptionList_t* retired /*=NULL*/)
+  {
+  CanFrameDispatchSnapshot* snapshot = new CanFrameDispatchSnapshot();
+  for (auto entry : m_rxcallbacks)
+    if (entry->m_callback) snapshot->m_rxcallbacks.push_back(entry->m_callback);
+  for (auto entry : m_txcallbacks)
+    if (entry->m_callback) snapshot->m_txcallbacks.push_back(entry->m_callback);
+  snapshot->m_table.Build(m_rxsubscriptions);
+
+  // The previous snapshot is kept by our reference until the swap is done,
+  // after that it is only referenced by tasks still dispatching through it:
+  CanFrameDispatchSnapshot* previous = m_rxdispatch.load();
+  if (retired)
+    previous->m_retired.splice(previous->m_retired.end(), *retired);
+  snapshot->m_refs++;
+  previous->m_next = snapshot;
+
+  portENTER_CRITICAL(&m_rxdispatch_spinlock);
+  m_rxdispatch.store(snapshot);
+  portEXIT_CRITICAL(&m_rxdispatch_spinlock);
+  return previous;
+  }
+
+/**
+ * SyncDispatch: wait for callbacks still running from outdated snapshots,
+ *  then release the previous snapshot returned by PublishDispatch().
+ *  Doesn't wait if called from a callback, as that holds a snapshot itself.
+ */
+void can::SyncDispatch(CanFrameDispatchSnapshot* previous)
+  {
+  if (can_dispatch_depth == 0)
+    {
+    // previous->m_refs includes our reference and one per older snapshot:
+    int waited = 0;
+    while (previous->m_refs.load() > 1 && waited < 1000)
+      {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      waited += 10;
+      }
+    if (previous->m_refs.load() > 1)
+      ESP_LOGW(TAG, "DeregisterCallback: callbacks still running after %d ms", waited);
+    }
+  CanFrameDispatchSnapshot::Release(previous);
   }
 
-int can::ExecuteCallbacks(const CAN_frame_t* frame, bool tx, bool success)
+/**
+ * ExecuteCallbacks: call the callbacks & subscriptions for a frame
+ *  - changed: RX payload bits changed vs. the frame cache, for change subscriptions
+ *  The callbacks are called from the current snapshot without holding a lock,
+ *  so they may run concurrently for different buses (per bus RX tasks).
+ */
+int can::ExecuteCallbacks(const CAN_frame_t* frame, bool tx, bool success, uint64_t changed /*=UINT64_MAX*/)
   {
+  portENTER_CRITICAL(&m_rxdispatch_spinlock);
+  CanFrameDispatchSnapshot* snapshot = m_rxdispatch.load();
+  snapshot->m_refs++;
+  portEXIT_CRITICAL(&m_rxdispatch_spinlock);
+
+  can_dispatch_depth++;
   int cnt = 0;
   if (tx)
     {
@@ -1014,52 +3723,391 @@ int can::ExecuteCallbacks(const CAN_frame_t* frame, bool tx, bool success)
       (*(frame->callback))(frame, success);
       cnt++;
       }
-    for (auto entry : m_txcallbacks)
+    for (const CanFrameDelegate& callback : snapshot->m_txcallbacks)
       {
       // invoke generic tx callbacks
-      entry->m_callback(frame, success);
+      callback(frame, success);
       cnt++;
       }
     }
   else
     {
-    for (auto entry : m_rxcallbacks)
+    for (const CanFrameDelegate& callback : snapshot->m_rxcallbacks)
+      {
+      callback(frame, success);
+      cnt++;
+      }
+    cnt += snapshot->m_table.Execute(frame, changed);
+    }
+  can_dispatch_depth--;
+
+  CanFrameDispatchSnapshot::Release(snapshot);
+  return cnt;
+  }
+
+/**
+ * AddRxInterest: declare frames needed from a bus (NULL = any bus)
+ *  The owner name identifies the declaration for RemoveRxInterest().
+ *  Use update=false to add multiple ranges, then call UpdateRxFilters().
+ */
+void can::AddRxInterest(const char* owner, canbus* bus, CAN_frame_format_t format,
+                        uint32_t id_from, uint32_t id_to, bool update)
+  {
+  uint32_t id_max = (format == CAN_frame_std) ? 0x7ff : 0x1fffffff;
+  if (id_to > id_max) id_to = id_max;
+  if (id_from > id_to) return;
+
+  bool added = false;
+  m_rxinterest_mutex.Lock();
+  auto it = std::find_if(m_rxinterests.begin(), m_rxinterests.end(),
+    [=](const CAN_rxinterest_t& i)
+      {
+      return i.bus == bus && i.format == format && i.id_from == id_from
+        && i.id_to == id_to && i.owner == owner;
+      });
+  if (it == m_rxinterests.end())
+    {
+    m_rxinterests.push_back({ owner, bus, format, id_from, id_to });
+    added = true;
+    }
+  m_rxinterest_mutex.Unlock();
+
+  if (added && update)
+    UpdateRxFilters(bus);
+  }
+
+/**
+ * AddRxInterestAll: declare a promiscuous consumer (all frames of the bus)
+ */
+void can::AddRxInterestAll(const char* owner, canbus* bus, bool update)
+  {
+  AddRxInterest(owner, bus, CAN_frame_std, 0, 0x7ff, false);
+  AddRxInterest(owner, bus, CAN_frame_ext, 0, 0x1fffffff, update);
+  }
+
+/**
+ * RemoveRxInterest: remove the declarations of an owner for a bus
+ *  (NULL = all declarations of the owner)
+ */
+void can::RemoveRxInterest(const char* owner, canbus* bus, bool update)
+  {
+  m_rxinterest_mutex.Lock();
+  size_t cnt = m_rxinterests.size();
+  m_rxinterests.erase(std::remove_if(m_rxinterests.begin(), m_rxinterests.end(),
+    [=](const CAN_rxinterest_t& i) { return (bus == NULL || i.bus == bus) && i.owner == owner; }),
+    m_rxinterests.end());
+  bool removed = (m_rxinterests.size() != cnt);
+  m_rxinterest_mutex.Unlock();
+
+  if (removed && update)
+    UpdateRxFilters(bus);
+  }
+
+/**
+ * SetRxInterest: replace the declarations of an owner for a bus by the
+ *  given ranges (empty = remove). The filter of the bus is only updated
+ *  if the declarations change. Returns true if they changed.
+ */
+bool can::SetRxInterest(const char* owner, canbus* bus, CAN_filter_range_list_t std_ranges,
+                        CAN_filter_range_list_t ext_ranges, bool update)
+  {
+  CAN_filter_range_merge(std_ranges);
+  CAN_filter_range_merge(ext_ranges);
+  CAN_rxinterest_list_t decl;
+  for (const CAN_filter_range_t& range : std_ranges)
+    {
+    if (range.id_from > 0x7ff) break;
+    decl.push_back({ owner, bus, CAN_frame_std, range.id_from, std::min(range.id_to, (uint32_t)0x7ff) });
+    }
+  for (const CAN_filter_range_t& range : ext_ranges)
+    {
+    if (range.id_from > 0x1fffffff) break;
+    decl.push_back({ owner, bus, CAN_frame_ext, range.id_from, std::min(range.id_to, (uint32_t)0x1fffffff) });
+    }
+
+  auto mine = [=](const CAN_rxinterest_t& i) { return i.bus == bus && i.owner == owner; };
+  m_rxinterest_mutex.Lock();
+  bool same = true;
+  size_t cnt = 0;
+  for (const CAN_rxinterest_t& i : m_rxinterests)
+    {
+    if (!mine(i)) continue;
+    if (cnt >= decl.size() || decl[cnt].format != i.format
+        || decl[cnt].id_from != i.id_from || decl[cnt].id_to != i.id_to)
+      same = false;
+    cnt++;
+    }
+  if (same && cnt == decl.size())
+    {
+    m_rxinterest_mutex.Unlock();
+    return false;
+    }
+  m_rxinterests.erase(std::remove_if(m_rxinterests.begin(), m_rxinterests.end(), mine),
+    m_rxinterests.end());
+  m_rxinterests.insert(m_rxinterests.end(), decl.begin(), decl.end());
+  m_rxinterest_mutex.Unlock();
+
+  if (update)
+    UpdateRxFilters(bus);
+  return true;
+  }
+
+/**
+ * GetRxInterest: collect the merged standard & extended ID ranges
+ *  declared for a bus. Returns false if nothing has been declared.
+ */
+bool can::GetRxInterest(canbus* bus, CAN_filter_range_list_t& std_ranges,
+                        CAN_filter_range_list_t& ext_ranges)
+  {
+  std_ranges.clear();
+  ext_ranges.clear();
+
+  m_rxinterest_mutex.Lock();
+  for (const CAN_rxinterest_t& i : m_rxinterests)
+    {
+    if (i.bus != NULL && i.bus != bus) continue;
+    if (i.format == CAN_frame_std)
+      std_ranges.push_back({ i.id_from, i.id_to });
+    else
+      ext_ranges.push_back({ i.id_from, i.id_to });
+    }
+  m_rxinterest_mutex.Unlock();
+
+  CAN_filter_range_merge(std_ranges);
+  CAN_filter_range_merge(ext_ranges);
+  return (!std_ranges.empty() || !ext_ranges.empty());
+  }
+
+/**
+ * UpdateRxFilters: let a bus (NULL = all buses) reconfigure its
+ *  hardware acceptance filter after interest changes
+ */
+void can::UpdateRxFilters(canbus* bus)
+  {
+  if (bus)
+    {
+    bus->UpdateRxFilter();
+    return;
+    }
+  for (int k=0; k<CAN_MAXBUSES; k++)
+    {
+    canbus* b = GetBus(k);
+    if (b) b->UpdateRxFilter();
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CanFrameDispatchTable - compiled frame subscription lookup
+////////////////////////////////////////////////////////////////////////
+
+CanFrameDispatchTable::CanFrameDispatchTable()
+  {
+  m_std_lookup = NULL;
+  }
+
+CanFrameDispatchTable::~CanFrameDispatchTable()
+  {
+  Clear();
+  }
+
+void CanFrameDispatchTable::Clear()
+  {
+  m_std.starts.clear();
+  m_std.index.clear();
+  m_std.entries.clear();
+  m_ext.starts.clear();
+  m_ext.index.clear();
+  m_ext.entries.clear();
+  if (m_std_lookup)
+    {
+    free(m_std_lookup);
+    m_std_lookup = NULL;
+    }
+  }
+
+void CanFrameDispatchTable::BuildSegments(segments_t& seg, const CanFrameSubscriptionList_t& subscriptions,
+                                          CAN_frame_format_t format, uint32_t id_max)
+  {
+  // Collect segment boundaries:
+  std::vector<uint32_t> bounds;
+  for (auto sub : subscriptions)
+    {
+    if (sub->m_format != format) continue;
+    bounds.push_back(sub->m_id_from);
+    if (sub->m_id_to < id_max) bounds.push_back(sub->m_id_to + 1);
+    }
+  if (bounds.empty()) return;
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+  // Assign covering subscriptions to each segment, keeping registration order:
+  seg.starts = bounds;
+  seg.index.reserve(bounds.size() + 1);
+  for (size_t n = 0; n < bounds.size(); n++)
+    {
+    seg.index.push_back(seg.entries.size());
+    for (auto sub : subscriptions)
+      {
+      if (sub->m_format == format && sub->m_id_from <= bounds[n] && sub->m_id_to >= bounds[n])
+        seg.entries.push_back(sub);
+      }
+    }
+  seg.index.push_back(seg.entries.size());
+  seg.starts.shrink_to_fit();
+  seg.entries.shrink_to_fit();
+  }
+
+void CanFrameDispatchTable::Build(const CanFrameSubscriptionList_t& subscriptions)
+  {
+  Clear();
+  BuildSegments(m_std, subscriptions, CAN_frame_std, 0x7ff);
+  BuildSegments(m_ext, subscriptions, CAN_frame_ext, 0x1fffffff);
+
+  if (!m_std.starts.empty())
+    {
+    m_std_lookup = (uint16_t*)calloc(0x800, sizeof(uint16_t));
+    if (!m_std_lookup)
+      {
+      ESP_LOGE(TAG, "CanFrameDispatchTable: out of memory");
+      Clear();
+      return;
+      }
+    for (size_t n = 0; n < m_std.starts.size(); n++)
+      {
+      if (m_std.index[n] == m_std.index[n+1]) continue; // gap segment
+      uint32_t end = (n+1 < m_std.starts.size()) ? m_std.starts[n+1] : 0x800;
+      for (uint32_t id = m_std.starts[n]; id < end; id++)
+        m_std_lookup[id] = n + 1;
+      }
+    }
+  }
+
+int CanFrameDispatchTable::ExecuteSegment(const segments_t& seg, int segment, const CAN_frame_t* frame, uint64_t changed)
+  {
+  int cnt = 0;
+  for (uint32_t k = seg.index[segment]; k < seg.index[segment+1]; k++)
+    {
+    CanFrameSubscription* sub = seg.entries[k];
+    if (sub->m_onchange && (changed & sub->m_mask) == 0)
+      continue;
+    if (sub->m_bus == NULL || sub->m_bus == frame->origin)
       {
-      entry->m_callback(frame, success);
+      sub->m_callback(frame, true);
       cnt++;
       }
     }
   return cnt;
   }
 
+int CanFrameDispatchTable::Execute(const CAN_frame_t* frame, uint64_t changed /*=UINT64_MAX*/)
+  {
+  if (frame->FIR.B.FF == CAN_frame_std)
+    {
+    if (!m_std_lookup || frame->MsgID > 0x7ff) return 0;
+    int segment = m_std_lookup[frame->MsgID];
+    return (segment) ? ExecuteSegment(m_std, segment-1, frame, changed) : 0;
+    }
+  else
+    {
+    if (m_ext.starts.empty()) return 0;
+    auto it = std::upper_bound(m_ext.starts.begin(), m_ext.starts.end(), frame->MsgID);
+    if (it == m_ext.starts.begin()) return 0;
+    return ExecuteSegment(m_ext, (it - m_ext.starts.begin()) - 1, frame, changed);
+    }
+  }
+
+CanFrameDispatchSnapshot::~CanFrameDispatchSnapshot()
+  {
+  for (auto entry : m_retired)
+    delete entry;
+  }
+
+/**
+ * Release: drop a snapshot reference, free the snapshot on the last one.
+ *  Freeing a snapshot drops its reference to the successor.
+ */
+void CanFrameDispatchSnapshot::Release(CanFrameDispatchSnapshot* snapshot)
+  {
+  while (snapshot && --snapshot->m_refs == 0)
+    {
+    CanFrameDispatchSnapshot* next = snapshot->m_next;
+    delete snapshot;
+    snapshot = next;
+    }
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // canbus - the definition of a CAN bus
 ////////////////////////////////////////////////////////////////////////
 
 canbus::canbus(const char* name)
-  : pcp(name)
+  : pcp(name), m_txqueue(this)
   {
   m_busnumber = name[strlen(name)-1] - '1';
-  m_txqueue = xQueueCreate(CONFIG_OVMS_HW_CAN_TX_QUEUE_SIZE, sizeof(CAN_frame_t));
   m_mode = CAN_MODE_OFF;
   m_speed = CAN_SPEED_1000KBPS;
   m_dbcfile = NULL;
   m_tx_frame = {};
+  m_metric_load = NULL;
+  m_metric_load_tx = NULL;
+  m_rxqueue = can::instance(TAG).m_rxqueue;
+  m_rxtask = NULL;
+  m_rxfilter_pending = false;
+  m_rxfilter_narrow = false;
   ClearStatus();
 
   using std::placeholders::_1;
   using std::placeholders::_2;
+  OvmsEvents::instance(TAG).RegisterEvent(TAG, "ticker.1", std::bind(&canbus::BusTicker1, this, _1, _2));
   OvmsEvents::instance(TAG).RegisterEvent(TAG, "ticker.10", std::bind(&canbus::BusTicker10, this, _1, _2));
   }
 
 canbus::~canbus()
   {
-  vQueueDelete(m_txqueue);
+  }
+
+/**
+ * SetupRxTask: select the RX dispatch queue according to config
+ *  "rxtask.mode": "shared" (default) or "bus" (one task per bus)
+ *  "rxtask.core.<bus>": core for the bus task (default: alternating)
+ */
+void canbus::SetupRxTask()
+  {
+  OvmsConfig& config = OvmsConfig::instance(TAG);
+  if (config.GetParamValue("can", "rxtask.mode", "shared") != "bus")
+    {
+    m_rxqueue = can::instance(TAG).m_rxqueue;
+    return;
+    }
+  if (!m_rxtask)
+    {
+    int core = config.GetParamValueInt("can", std::string("rxtask.core.") + m_name, m_busnumber % 2);
+    std::string name = std::string("OVMS CanRx ") + m_name;
+    m_rxtask = new canrxtask(name.c_str());
+    if (!m_rxtask->Start(CORE(core & 1)))
+      {
+      delete m_rxtask;
+      m_rxtask = NULL;
+      }
+    }
+  m_rxqueue = m_rxtask ? m_rxtask->m_queue : can::instance(TAG).m_rxqueue;
   }
 
 esp_err_t canbus::Start(CAN_mode_t mode, CAN_speed_t speed)
   {
+  SetupRxTask();
+  m_traffic.Init(CONFIG_OVMS_HW_CAN_TRAFFIC_IDS);
+  m_framecache.Init(CONFIG_OVMS_HW_CAN_CACHE_IDS);
+  if (!m_metric_load)
+    {
+    // Load of the frames passing the HW acceptance filter, i.e. under-reported
+    // while the filter is narrowed to declared interests (see UpdateRxFilter):
+    std::string prefix = std::string("m.can.") + m_name;
+    m_metric_load = OvmsMetrics::instance(TAG).InitFloat(strdup((prefix + ".load").c_str()), SM_STALE_MIN, 0, Percentage);
+    m_metric_load_tx = OvmsMetrics::instance(TAG).InitFloat(strdup((prefix + ".load.tx").c_str()), SM_STALE_MIN, 0, Percentage);
+    }
   ClearStatus();
+  UpdateRxFilter();
   return ESP_FAIL;
   }
 
@@ -1104,6 +4152,27 @@ void canbus::ClearStatus()
   memset(&m_status, 0, sizeof(m_status));
   m_status_chksum = 0;
   m_watchdog_timer = monotonictime;
+  m_traffic.Clear();
+  }
+
+/**
+ * CAN_dbc_rxinterest: declare the messages of a DBC file as frame interest
+ *  of the bus (NULL = remove the declaration)
+ */
+static void CAN_dbc_rxinterest(canbus* bus, dbcfile* dbcfile)
+  {
+  can& c = can::instance(TAG);
+  c.RemoveRxInterest("dbc", bus, false);
+  if (dbcfile)
+    {
+    for (auto& it : dbcfile->m_messages.m_entrymap)
+      {
+      dbcMessage* msg = it.second;
+      uint32_t id = msg->GetID() & 0x1fffffff;
+      c.AddRxInterest("dbc", bus, msg->GetFormat(), id, id, false);
+      }
+    }
+  c.UpdateRxFilters(bus);
   }
 
 void canbus::AttachDBC(dbcfile *dbcfile)
@@ -1111,6 +4180,7 @@ void canbus::AttachDBC(dbcfile *dbcfile)
   if (m_dbcfile) DetachDBC();
   m_dbcfile = dbcfile;
   m_dbcfile->LockFile();
+  CAN_dbc_rxinterest(this, m_dbcfile);
   }
 
 bool canbus::AttachDBC(const char *name)
@@ -1122,6 +4192,7 @@ bool canbus::AttachDBC(const char *name)
 
   m_dbcfile = dbcfile;
   m_dbcfile->LockFile();
+  CAN_dbc_rxinterest(this, m_dbcfile);
   return true;
   }
 
@@ -1131,6 +4202,7 @@ void canbus::DetachDBC()
     {
     m_dbcfile->UnlockFile();
     m_dbcfile = NULL;
+    CAN_dbc_rxinterest(this, NULL);
     }
   }
 
@@ -1139,6 +4211,21 @@ dbcfile* canbus::GetDBC()
   return m_dbcfile;
   }
 
+void canbus::BusTicker1(std::string event, void* data)
+  {
+  if (m_mode == CAN_MODE_OFF)
+    return;
+  // Retry a deferred acceptance filter change (request lost on a full queue):
+  if (m_rxfilter_pending)
+    RequestAcceptanceFilter();
+  m_traffic.Integrate(MAP_CAN_SPEED(m_speed));
+  if (m_metric_load)
+    {
+    m_metric_load->SetValue(m_traffic.m_load);
+    m_metric_load_tx->SetValue(m_traffic.m_load_tx);
+    }
+  }
+
 void canbus::BusTicker10(std::string event, void* data)
   {
   if ((m_powermode==On)&&(MetricsStandard::instance().ms_v_env_on->AsBool()))
@@ -1166,11 +4253,82 @@ bool canbus::AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesRe
   return false;
   }
 
+/**
+ * UpdateRxFilter: collect the frame interests declared for this bus and
+ *  let the driver configure its hardware acceptance filter accordingly.
+ *  Without any declaration, the bus accepts all frames.
+ */
+/**
+ * UpdateRxFilter: set the acceptance filter from the declared interests
+ *  Frames rejected by the hardware are not seen by the load & traffic
+ *  statistics. Config "rxfilter.<bus>" = no keeps the filter open to
+ *  measure the full bus load (at the cost of processing all frames).
+ */
+void canbus::UpdateRxFilter()
+  {
+  CAN_filter_range_list_t std_ranges, ext_ranges;
+  m_rxfilter_narrow = OvmsConfig::instance(TAG).GetParamValueBool("can", std::string("rxfilter.") + m_name, true)
+    && can::instance(TAG).GetRxInterest(this, std_ranges, ext_ranges);
+  if (!m_rxfilter_narrow)
+    {
+    std_ranges.clear();
+    ext_ranges.clear();
+    std_ranges.push_back({ 0, 0x7ff });
+    ext_ranges.push_back({ 0, 0x1fffffff });
+    }
+  SetAcceptanceFilter(std_ranges, ext_ranges);
+  }
+
+/**
+ * SetAcceptanceFilter: driver hook to derive & apply the hardware filter
+ *  configuration from the merged interest ranges. The configuration must
+ *  accept at least all frames in the ranges, drivers should fall back to
+ *  accept-all if they cannot express the set.
+ */
+esp_err_t canbus::SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                      const CAN_filter_range_list_t& ext_ranges)
+  {
+  return ESP_ERR_NOT_SUPPORTED;
+  }
+
+/**
+ * RequestAcceptanceFilter: let the RX dispatch task of the bus apply a
+ *  changed acceptance filter. Drivers that need to interrupt the bus
+ *  controller for a filter change (reset / config mode) set m_rxfilter_pending
+ *  in SetAcceptanceFilter() and apply it in ApplyAcceptanceFilter(), which
+ *  runs in the task that also handles their TX & RX events.
+ */
+void canbus::RequestAcceptanceFilter()
+  {
+  CAN_queue_msg_t msg;
+  msg.type = CAN_rxfilterupdate;
+  msg.body.bus = this;
+  xQueueSend(m_rxqueue, &msg, 0);
+  }
+
+/**
+ * ApplyAcceptanceFilter: driver hook to apply a pending filter change
+ *  (RX dispatch task)
+ */
+void canbus::ApplyAcceptanceFilter()
+  {
+  m_rxfilter_pending = false;
+  }
+
+/**
+ * GetDriverStatus: driver specific status & statistics for "can <bus> status"
+ */
+std::string canbus::GetDriverStatus()
+  {
+  return std::string();
+  }
+
 void canbus::TxCallback(CAN_frame_t* p_frame, bool success)
   {
   if (success)
     {
     m_status.packets_tx++;
+    m_traffic.Count(p_frame, true);
     can::instance(TAG).ExecuteCallbacks(p_frame, true, success);
     can::instance(TAG).NotifyListeners(p_frame, true);
     LogFrame(CAN_LogFrame_TX, p_frame);
@@ -1202,13 +4360,34 @@ esp_err_t canbus::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0
   return ESP_OK;
   }
 
+/**
+ * canbus::AddPeriodic -- register a cyclic frame on this bus (see canperiodic::Add)
+ */
+uint32_t canbus::AddPeriodic(const char* owner, const CAN_frame_t* frame, uint32_t period_ms,
+                             int32_t phase_ms /*=-1*/, CanPeriodicCallback update /*=NULL*/,
+                             bool dbcsource /*=false*/)
+  {
+  return can::instance(TAG).m_periodic.Add(owner, this, frame, period_ms, phase_ms, update, dbcsource);
+  }
+
+bool canbus::RemovePeriodic(uint32_t handle)
+  {
+  return can::instance(TAG).m_periodic.Remove(handle, this);
+  }
+
+int canbus::RemovePeriodics(const char* owner)
+  {
+  return can::instance(TAG).m_periodic.Remove(owner, this);
+  }
+
 /**
  * canbus::QueueWrite -- add a frame to the TX queue for later delivery
  *    - internal method, called by driver if no TX buffer is available
+ *    - the queue is drained in priority order by the driver TxCallback (see cantxqueue)
  */
 esp_err_t canbus::QueueWrite(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
   {
-  if (xQueueSend(m_txqueue, p_frame, maxqueuewait) == pdTRUE)
+  if (m_txqueue.Push(p_frame, maxqueuewait))
     {
     m_status.txbuf_delay++;
     LogFrame(CAN_LogFrame_TX_Queue, p_frame);
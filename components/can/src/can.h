@@ -41,9 +41,16 @@
 #include "freertos/queue.h"
 #include <stdint.h>
 #include <functional>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <string.h>
 #include <list>
+#include <vector>
+#include <string>
 #include "pcp.h"
 #include <esp_err.h>
+#include <esp_timer.h>
 #include "ovms_events.h"
 
 ////////////////////////////////////////////////////////////////////////
@@ -120,13 +127,107 @@ typedef union
 typedef struct CAN_frame_t CAN_frame_t;
 typedef std::function<void(const CAN_frame_t*, bool)> CanFrameCallback;
 
+////////////////////////////////////////////////////////////////////////
+// CAN frame callback delegate
+// Allocation free alternative to CanFrameCallback (std::function),
+// binding a plain function, an object member function or a small
+// trivially copyable callable (e.g. a lambda capturing 'this') stored
+// inline. Invocation is a single indirect call.
+//
+//   CanFrameDelegate::Member<MyClass, &MyClass::Handler>(this)
+//   CanFrameDelegate::Inline([this](const CAN_frame_t* f, bool s){ ... })
+//
+// For compatibility, a std::function can be wrapped explicitly; it is
+// then copied to the heap once on construction.
+////////////////////////////////////////////////////////////////////////
+
+#define CAN_DELEGATE_INLINE_SIZE  16
+
+class CanFrameDelegate
+  {
+  public:
+    typedef void (*Function)(const CAN_frame_t* frame, bool success);
+
+  public:
+    CanFrameDelegate() : m_invoke(NULL), m_manage(NULL) {}
+    explicit CanFrameDelegate(Function fn)
+      : m_invoke(fn ? InvokeFunction : NULL), m_manage(NULL)
+      { memcpy(m_data, &fn, sizeof(fn)); }
+    explicit CanFrameDelegate(const CanFrameCallback& fn);
+    CanFrameDelegate(const CanFrameDelegate& other) { Copy(other); }
+    CanFrameDelegate& operator=(const CanFrameDelegate& other)
+      {
+      if (this != &other) { Reset(); Copy(other); }
+      return *this;
+      }
+    ~CanFrameDelegate() { Reset(); }
+
+  public:
+    template <class T, void (T::*Method)(const CAN_frame_t*, bool)>
+    static CanFrameDelegate Member(T* obj)
+      {
+      CanFrameDelegate d;
+      memcpy(d.m_data, &obj, sizeof(obj));
+      d.m_invoke = InvokeMember<T, Method>;
+      return d;
+      }
+    template <class F>
+    static CanFrameDelegate Inline(const F& fn)
+      {
+      static_assert(sizeof(F) <= CAN_DELEGATE_INLINE_SIZE, "callable exceeds delegate inline storage");
+      static_assert(alignof(F) <= alignof(uint64_t), "callable alignment exceeds delegate inline storage");
+      static_assert(std::is_trivially_copyable<F>::value, "inline callable must be trivially copyable");
+      CanFrameDelegate d;
+      new (d.m_data) F(fn);
+      d.m_invoke = InvokeInline<F>;
+      return d;
+      }
+
+  public:
+    inline void operator()(const CAN_frame_t* frame, bool success) const
+      { m_invoke(this, frame, success); }
+    explicit operator bool() const { return m_invoke != NULL; }
+    void Reset();
+
+  protected:
+    typedef void (*Invoke)(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success);
+    typedef void (*Manage)(CanFrameDelegate* dst, const CanFrameDelegate* src);  // src NULL = destroy
+
+    void Copy(const CanFrameDelegate& other);
+    static void InvokeFunction(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success)
+      {
+      Function fn;
+      memcpy(&fn, d->m_data, sizeof(fn));
+      fn(frame, success);
+      }
+    template <class T, void (T::*Method)(const CAN_frame_t*, bool)>
+    static void InvokeMember(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success)
+      {
+      T* obj;
+      memcpy(&obj, d->m_data, sizeof(obj));
+      (obj->*Method)(frame, success);
+      }
+    template <class F>
+    static void InvokeInline(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success)
+      {
+      (*reinterpret_cast<const F*>(d->m_data))(frame, success);
+      }
+    static void InvokeStdFunction(const CanFrameDelegate* d, const CAN_frame_t* frame, bool success);
+    static void ManageStdFunction(CanFrameDelegate* dst, const CanFrameDelegate* src);
+
+  protected:
+    Invoke m_invoke;
+    Manage m_manage;                  // only set for owned (non trivially copyable) targets
+    alignas(uint64_t) uint8_t m_data[CAN_DELEGATE_INLINE_SIZE];
+  };
+
 // CAN Frame
 // Note: Take care changing this structure, as it is a union with
 // CAN_log_message_t and position of 'origin' is fixed.
 struct CAN_frame_t
   {
   canbus*     origin;                   // Origin of the frame
-  CanFrameCallback * callback;          // Frame-specific callback. Is called when this frame is successfully sent (or sending failed)
+  const CanFrameDelegate* callback;     // Frame-specific callback. Is called when this frame is successfully sent (or sending failed)
   CAN_FIR_t   FIR;                      // Frame information record
   uint32_t    MsgID;                    // Message ID
   union
@@ -183,14 +284,17 @@ typedef enum
   CAN_asyncinterrupthandler, // used for asynchronous handling of rx and other interrupts from MCP2515
   CAN_txcallback,
   CAN_txfailedcallback,
+  CAN_txdroppedcallback,     // frame dropped from the TX queue (expired/displaced), not a driver event
   CAN_logerror,
-  CAN_logstatus
+  CAN_logstatus,
+  CAN_rxfilterupdate         // apply a changed acceptance filter (see canbus::ApplyAcceptanceFilter)
 } CAN_queue_type_t;
 
 // CAN message
 typedef struct
   {
   CAN_queue_type_t type;
+  uint32_t time;        // CAN_frame: esp_timer time of reception, lower 32 bits (see CAN_time_expand)
   union
     {
     CAN_frame_t frame;  // CAN_frame
@@ -198,6 +302,11 @@ typedef struct
     } body;
   } CAN_queue_msg_t;
 
+// Reception timestamps are taken by the drivers with esp_timer_get_time() [us]
+// as early as possible, and converted to wall clock time once per log record:
+extern int64_t CAN_time_expand(uint32_t time);
+extern void CAN_wallclock(struct timeval* tv, int64_t time=0);   // time 0 = now
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Filtering (software based filter)
 // The canfilter object encapsulates the filtering of CAN frames
@@ -212,6 +321,19 @@ typedef struct
 
 typedef std::list<CAN_filter_t*> CAN_filter_list_t;
 
+typedef struct
+  {
+  uint32_t id_from;
+  uint32_t id_to;
+  } CAN_filter_range_t;
+
+typedef std::vector<CAN_filter_range_t> CAN_filter_range_list_t;
+
+#define CAN_FILTER_BUSKEYS (CAN_MAXBUSES+1)   // '0' (no origin) + '1'…
+
+// The filter list is compiled into a lookup structure per bus key on every
+// change: a 2048 bit bitmap for standard IDs and a sorted array of merged
+// ID ranges (binary search) for extended IDs.
 class canfilter
   {
   public:
@@ -228,11 +350,53 @@ class canfilter
     bool IsFiltered(const CAN_frame_t* p_frame);
     bool IsFiltered(canbus* bus);
     std::string Info();
+    const CAN_filter_range_list_t& GetRanges(int buskey);
+
+  protected:
+    void Compile();
 
   protected:
     CAN_filter_list_t m_filters;
+    uint32_t* m_std_bitmap[CAN_FILTER_BUSKEYS];             // NULL = no standard ID passes
+    CAN_filter_range_list_t m_ext_ranges[CAN_FILTER_BUSKEYS];
   };
 
+extern void CAN_filter_range_merge(CAN_filter_range_list_t& ranges);
+
+////////////////////////////////////////////////////////////////////////
+// CAN hardware acceptance filter
+// Frame consumers declare the ID ranges they need from a bus (their
+// "interest"). The canbus collects the union of all interests and lets
+// the driver derive the best hardware filter configuration from it.
+// Consumers that cannot name their IDs must declare the full ID space
+// (promiscuous), which makes the driver fall back to accept-all.
+////////////////////////////////////////////////////////////////////////
+
+typedef struct
+  {
+  std::string owner;
+  canbus* bus;                        // NULL = any bus
+  CAN_frame_format_t format;
+  uint32_t id_from;
+  uint32_t id_to;
+  } CAN_rxinterest_t;
+
+typedef std::vector<CAN_rxinterest_t> CAN_rxinterest_list_t;
+
+// Acceptance pattern: matches all IDs with (id & ~dontcare) == code
+typedef struct
+  {
+  uint32_t code;
+  uint32_t dontcare;
+  } CAN_acceptance_t;
+
+typedef std::vector<CAN_acceptance_t> CAN_acceptance_list_t;
+
+extern void CAN_acceptance_cover(const CAN_filter_range_list_t& ranges, CAN_acceptance_list_t& patterns,
+                                 size_t maxpatterns);
+extern CAN_acceptance_t CAN_acceptance_merge(const CAN_acceptance_t& a, const CAN_acceptance_t& b);
+extern uint64_t CAN_acceptance_size(uint32_t dontcare);
+
 ////////////////////////////////////////////////////////////////////////
 // CAN logging and tracing
 // These structures are involved in formatting, logging and tracing of
@@ -275,8 +439,484 @@ typedef struct
     };
   } CAN_log_message_t;
 
+// Compact frame log record (frame ring entry, 20 bytes):
+typedef struct
+  {
+  uint32_t time;              // esp_timer time [us], low 32 bits
+  uint32_t id;                // ID & CAN_LOGFRAME_* flags
+  uint8_t  bus;               // bus number
+  uint8_t  type;              // CAN_log_type_t
+  uint8_t  dlc;
+  uint8_t  reserved;
+  union
+    {
+    uint8_t  u8[8];
+    uint32_t u32[2];
+    } data;
+  } CAN_log_frame_t;
+
+#define CAN_LOGFRAME_IDMASK   0x1fffffff
+#define CAN_LOGFRAME_EXT      0x80000000
+#define CAN_LOGFRAME_RTR      0x40000000
+
 extern const char* GetCanLogTypeName(CAN_log_type_t type);
 
+////////////////////////////////////////////////////////////////////////
+// CAN frame ring
+// Single shared ring of compact frame records (CAN_log_frame_t) written
+// once by the CAN framework and read by any number of readers (loggers,
+// listeners), each with an independent read cursor.
+////////////////////////////////////////////////////////////////////////
+
+// Reader type masks:
+#define CAN_RING_RX           BIT(CAN_LogFrame_RX)
+#define CAN_RING_TX           BIT(CAN_LogFrame_TX)
+#define CAN_RING_ALL          (BIT(CAN_LogFrame_RX)|BIT(CAN_LogFrame_TX)| \
+                               BIT(CAN_LogFrame_TX_Queue)|BIT(CAN_LogFrame_TX_Fail))
+
+class canring;
+
+class canringreader
+  {
+  public:
+    canringreader(const char* name, uint32_t typemask=CAN_RING_RX);
+    ~canringreader();
+
+  public:
+    bool Attach(canring* ring=NULL);      // ring: NULL=framework ring
+    void Detach();
+    bool IsAttached() { return m_ring != NULL; }
+
+  public:
+    // Read: get next entry, or NULL on timeout/Signal().
+    // The record is expanded into a message owned by the reader, it is
+    // valid until the next Read() (origin = bus, callback = NULL).
+    CAN_log_message_t* Read(TickType_t maxwait=portMAX_DELAY);
+    void Signal();
+    uint32_t Pending();
+    void ClearStats();
+
+  public:
+    const char*         m_name;
+    uint32_t            m_typemask;
+    canring*            m_ring;
+    SemaphoreHandle_t   m_sem;
+    uint32_t            m_cursor;       // next sequence number to read
+    bool                m_waiting;
+    bool                m_wakeup;       // to be signalled by the writer
+    CAN_log_message_t   m_msg;          // last entry read
+    uint32_t            m_readcount;    // entries read
+    uint32_t            m_overflowcount;// entries lost by lagging behind
+  };
+
+class canring
+  {
+  public:
+    canring();
+    ~canring();
+
+  public:
+    bool Init(uint32_t size);
+    bool AddReader(canringreader* reader);
+    void RemoveReader(canringreader* reader);
+    bool Write(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame, int64_t time=0);
+    bool HasReaders() { return m_readercount > 0; }
+    std::string GetStats();
+    void ClearStats();
+
+  public:
+    CAN_log_frame_t*    m_entries;
+    uint32_t            m_size;
+    volatile uint32_t   m_head;         // next sequence number to write
+    std::vector<canringreader*> m_readers;  // changed & iterated under m_writemutex
+    int                 m_readercount;
+    OvmsMutex           m_writemutex;
+    portMUX_TYPE        m_spinlock;
+    uint32_t            m_writecount;
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN TX queue
+// Software TX queue of a bus, drained in priority order when the
+// hardware TX buffer becomes available. Frames are classified into
+// priority classes by ID rules on queueing, and may carry a deadline
+// after which they are dropped instead of sent.
+////////////////////////////////////////////////////////////////////////
+
+// TX priority classes (ascending = lower priority):
+typedef enum
+  {
+  CAN_TXPRIO_CONTROL = 0,         // time critical control frames
+  CAN_TXPRIO_NORMAL,              // default class
+  CAN_TXPRIO_DIAG,                // diagnostic requests & polls
+  CAN_TXPRIO_COUNT
+  } CAN_txprio_t;
+
+extern const char* CAN_txprio_name(CAN_txprio_t prio);
+
+// TX classification rule:
+typedef struct
+  {
+  CAN_frame_format_t  format;
+  uint32_t            id_from;
+  uint32_t            id_to;
+  CAN_txprio_t        prio;
+  uint32_t            deadline_ms;    // max queueing time, 0 = none
+  } CAN_txrule_t;
+
+typedef std::vector<CAN_txrule_t> CAN_txrule_list_t;
+
+// TX queue entry:
+typedef struct
+  {
+  CAN_frame_t         frame;
+  int64_t             queued;         // esp_timer time of queueing
+  int64_t             deadline;       // esp_timer time of expiry, 0 = none
+  uint32_t            seq;            // queueing sequence (FIFO order)
+  CAN_txprio_t        prio;
+  } CAN_txentry_t;
+
+// TX queueing statistics per priority class:
+typedef struct
+  {
+  uint32_t            queued;         // frames queued
+  uint32_t            sent;           // frames dequeued for transmission
+  uint32_t            expired;        // frames dropped on deadline
+  uint32_t            displaced;      // frames dropped for higher priority frames
+  uint32_t            overflows;      // frames rejected on full queue
+  uint64_t            delay_sum;      // total queueing delay of sent frames [us]
+  uint32_t            delay_max;      // max queueing delay of sent frames [us]
+  } CAN_txprio_stats_t;
+
+class cantxqueue
+  {
+  public:
+    cantxqueue(canbus* bus);
+    ~cantxqueue();
+
+  public:
+    bool Push(const CAN_frame_t* frame, TickType_t maxqueuewait=0);
+    bool Pop(CAN_frame_t* frame);
+    uint32_t Pending() { return m_count; }
+    void Clear();
+
+  public:
+    void AddRule(CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                 CAN_txprio_t prio, uint32_t deadline_ms=0);
+    void ClearRules();
+    CAN_txrule_list_t GetRules();
+    void SetOrderById(bool enable) { m_order_id = enable; }
+    bool GetOrderById() { return m_order_id; }
+    std::string GetStats();
+    void ClearStats();
+
+  protected:
+    void Classify(CAN_txentry_t* entry);
+    bool Before(const CAN_txentry_t* a, const CAN_txentry_t* b);
+    void Drop(uint32_t index);
+    void Expire(int64_t now);
+
+  protected:
+    canbus*             m_bus;
+    CAN_txentry_t*      m_entries;
+    uint32_t            m_size;
+    volatile uint32_t   m_count;
+    uint32_t            m_seq;
+    bool                m_order_id;     // order by arbitration ID within class
+    CAN_txrule_list_t   m_rules;        // most recent first
+    OvmsMutex           m_mutex;
+    SemaphoreHandle_t   m_space;        // given on dequeue
+    CAN_txprio_stats_t  m_stats[CAN_TXPRIO_COUNT];
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN periodic TX
+// Cyclic transmission of frame templates by a high priority task woken
+// by a one-shot esp_timer at the exact due time of the next frame.
+// Frames are scheduled on a common time base, auto phases are chosen
+// to minimize coincidences with other frames on the same bus.
+////////////////////////////////////////////////////////////////////////
+
+// Update callback: may modify the frame before each transmission,
+// return false to skip this cycle.
+typedef std::function<bool(CAN_frame_t*)> CanPeriodicCallback;
+
+typedef struct
+  {
+  uint32_t            handle;
+  std::string         owner;
+  canbus*             bus;
+  CAN_frame_t         frame;          // frame template
+  uint32_t            period_ms;
+  uint32_t            phase_ms;       // offset on the common time base
+  CanPeriodicCallback update;         // optional frame update callback
+  bool                dbcsource;      // encode DBC signals from their metrics
+  int64_t             due;            // esp_timer time of next transmission
+  uint32_t            sent;           // frames delivered or queued
+  uint32_t            fails;          // TX failures
+  uint32_t            missed;         // cycles skipped on overrun
+  uint64_t            jitter_sum;     // total TX latency vs. due time [us]
+  uint32_t            jitter_max;     // max TX latency vs. due time [us]
+  } CAN_periodic_t;
+
+typedef std::list<CAN_periodic_t*> CAN_periodic_list_t;
+
+class canperiodic
+  {
+  public:
+    canperiodic();
+    ~canperiodic();
+
+  public:
+    uint32_t Add(const char* owner, canbus* bus, const CAN_frame_t* frame,
+                 uint32_t period_ms, int32_t phase_ms=-1,
+                 CanPeriodicCallback update=NULL, bool dbcsource=false);
+    bool Remove(uint32_t handle, canbus* bus=NULL);
+    int Remove(const char* owner, canbus* bus=NULL);
+    std::string GetList(canbus* bus=NULL);
+    void ClearStats(canbus* bus=NULL);
+
+  protected:
+    static void PeriodicTask(void *pvParameters);
+    static void TimerCallback(void* arg);
+    void Run();
+    void Transmit(CAN_periodic_t* entry, int64_t now);
+    uint32_t AutoPhase(canbus* bus, uint32_t period_ms);
+    void Schedule(CAN_periodic_t* entry, int64_t now);
+    void Wakeup();
+
+  protected:
+    CAN_periodic_list_t m_entries;
+    OvmsMutex           m_mutex;
+    TaskHandle_t        m_task;
+    esp_timer_handle_t  m_timer;
+    int64_t             m_epoch;        // common time base
+    uint32_t            m_nexthandle;
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN traffic statistics
+// Bus load integrated from the worst case wire length of each frame,
+// and a fixed size open addressed table of per ID frame counts and
+// periods. Updated by the CAN task for received frames and TX
+// confirmations, integrated once per second by the bus ticker.
+////////////////////////////////////////////////////////////////////////
+
+#define CAN_TRAFFIC_EMPTY     0xffffffff
+#define CAN_TRAFFIC_KEY_EXT   BIT(31)
+#define CAN_TRAFFIC_KEY_TX    BIT(30)
+
+typedef struct
+  {
+  uint32_t            key;            // ID | KEY_EXT | KEY_TX, CAN_TRAFFIC_EMPTY = unused
+  uint32_t            count;
+  int64_t             last;           // esp_timer time of last frame
+  uint64_t            period_sum;     // sum of count-1 periods [us]
+  uint32_t            period_min;     // [us]
+  uint32_t            period_max;     // [us]
+  uint8_t             dlc;            // last DLC
+  } CAN_traffic_id_t;
+
+extern uint32_t CAN_frame_bits(const CAN_frame_t* frame);
+
+class cantraffic
+  {
+  public:
+    cantraffic();
+    ~cantraffic();
+
+  public:
+    bool Init(uint32_t size);
+    void Count(const CAN_frame_t* frame, bool tx, int64_t time=0);
+    void Integrate(uint32_t bitrate);
+    std::string GetStats(int maxids=-1);
+    void Clear();
+
+  protected:
+    CAN_traffic_id_t* Lookup(uint32_t key);
+
+  public:
+    float               m_load;         // last second [%]
+    float               m_load_tx;      // last second, own TX [%]
+    float               m_load_peak;    // max since clear [%]
+    uint32_t            m_fps;          // frames last second
+
+  protected:
+    CAN_traffic_id_t*   m_ids;
+    uint32_t            m_size;         // power of 2
+    uint32_t            m_used;
+    uint32_t            m_untracked;    // frames not fitting into the table
+    portMUX_TYPE        m_spinlock;
+    uint32_t            m_bits_rx;      // current second
+    uint32_t            m_bits_tx;
+    uint32_t            m_frames;
+    uint64_t            m_total_bits_rx;// since clear
+    uint64_t            m_total_bits_tx;
+    uint64_t            m_total_frames;
+    int64_t             m_start;        // esp_timer time of clear
+    int64_t             m_last;         // esp_timer time of last integration
+    uint64_t            m_total_capacity; // bits possible since clear
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN frame cache
+// Latest frame per ID of a bus, read lock free: entries are never
+// removed, and each entry is protected by a sequence lock (odd while a
+// writer updates it), so readers retry instead of blocking the writer.
+// Frames normally arrive from the RX dispatch task, but are also injected
+// by other tasks (shell, simulation, player), so writers are serialized
+// by a spinlock.
+////////////////////////////////////////////////////////////////////////
+
+#define CAN_CACHE_EMPTY       0xffffffff
+#define CAN_CACHE_KEY_EXT     BIT(31)
+
+typedef struct
+  {
+  std::atomic<uint32_t> key;          // ID | KEY_EXT, CAN_CACHE_EMPTY = unused
+  std::atomic<uint32_t> lock;         // sequence lock
+  uint32_t            seq;            // frames received with this ID
+  uint32_t            changes;        // frames with changed payload / DLC
+  int64_t             time;           // esp_timer time of reception
+  uint64_t            data;
+  uint8_t             dlc;
+  bool                changed;        // last frame changed the payload / DLC
+  } CAN_cache_entry_t;
+
+// Reader copy of a cache entry:
+typedef struct
+  {
+  CAN_frame_format_t  format;
+  uint32_t            id;
+  uint32_t            seq;
+  uint32_t            changes;
+  int64_t             time;
+  uint8_t             dlc;
+  bool                changed;
+  union
+    {
+    uint8_t           u8[8];
+    uint64_t          u64;
+    } data;
+  } CAN_cached_frame_t;
+
+class canframecache
+  {
+  public:
+    canframecache();
+    ~canframecache();
+
+  public:
+    bool Init(uint32_t size);
+    uint64_t Update(const CAN_frame_t* frame, int64_t time=0);
+    bool Get(CAN_frame_format_t format, uint32_t id, CAN_cached_frame_t* out);
+    std::string GetStats(int maxids=-1);
+
+  protected:
+    CAN_cache_entry_t* Find(uint32_t key);
+    void Read(CAN_cache_entry_t* entry, CAN_cached_frame_t* out);
+
+  protected:
+    CAN_cache_entry_t*  m_entries;
+    uint32_t            m_size;         // power of 2
+    uint32_t            m_used;
+    uint32_t            m_updates;      // frames processed
+    uint32_t            m_changes;      // frames with changed payload
+    uint32_t            m_untracked;    // frames not fitting into the table
+    portMUX_TYPE        m_spinlock;     // writer lock
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN gateway
+// Routes forwarding received frames to another bus, executed by the
+// CAN task before any other frame processing. A route matches a source
+// bus, frame format and ID code/mask, and may rewrite the ID, permute
+// the payload bytes and merge constant bits into the payload.
+////////////////////////////////////////////////////////////////////////
+
+typedef struct
+  {
+  uint32_t            handle;
+  canbus*             src;
+  canbus*             dst;
+  CAN_frame_format_t  format;
+  uint32_t            id;             // match: (MsgID & mask) == id
+  uint32_t            mask;
+  bool                rewrite;        // replace masked ID bits by newid
+  uint32_t            newid;
+  bool                permute;        // apply byte map
+  uint8_t             map[8];         // out byte k = in byte map[k], 0xff = zero
+  uint64_t            mergemask;      // out = (out & ~mergemask) | (mergevalue & mergemask)
+  uint64_t            mergevalue;
+  int8_t              dlc;            // output DLC, -1 = keep
+  uint32_t            forwarded;
+  uint32_t            fails;
+  uint64_t            latency_sum;    // reception to TX delivery [us]
+  uint32_t            latency_max;
+  } CAN_gateway_route_t;
+
+typedef std::vector<CAN_gateway_route_t> CAN_gateway_route_list_t;
+
+class cangateway
+  {
+  public:
+    cangateway();
+    ~cangateway();
+
+  public:
+    uint32_t AddRoute(const CAN_gateway_route_t& route);
+    bool RemoveRoute(uint32_t handle);
+    int RemoveRoutes(canbus* bus=NULL);
+    int Forward(const CAN_frame_t* frame, int64_t time=0);
+    std::string GetList();
+    void ClearStats();
+
+  protected:
+    void SetRxInterest(const CAN_gateway_route_t& route, bool add);
+
+  protected:
+    CAN_gateway_route_list_t m_routes;
+    volatile uint32_t   m_count;
+    OvmsMutex           m_mutex;
+    uint32_t            m_nexthandle;
+  };
+
+////////////////////////////////////////////////////////////////////////
+// CAN RX dispatch task
+// Processes the messages queued by the drivers: received frames,
+// asynchronous interrupt handling, TX callbacks and status logging.
+// By default all buses share one task. With config "can" "rxtask.mode"
+// set to "bus", each bus gets its own task & queue on bus start, pinned
+// to core "rxtask.core.<bus>". Messages of a bus are always processed
+// in order by one task; callbacks of different buses may run concurrently.
+////////////////////////////////////////////////////////////////////////
+
+class canrxtask
+  {
+  public:
+    canrxtask(const char* name);
+    ~canrxtask();
+
+  public:
+    bool Start(int core);
+    std::string GetStats();
+    void ClearStats();
+
+  protected:
+    static void RxTask(void *pvParameters);
+
+  public:
+    std::string         m_name;
+    QueueHandle_t       m_queue;
+    TaskHandle_t        m_task;
+    int                 m_core;
+    uint32_t            m_messages;     // messages processed
+    uint32_t            m_highwater;    // max queue fill level
+    uint64_t            m_busytime;     // processing time [us]
+    uint32_t            m_busymax;      // max processing time of a message [us]
+    int64_t             m_start;        // esp_timer time of stats clear
+  };
+
 ////////////////////////////////////////////////////////////////////////
 // canbus - the definition of a CAN bus
 ////////////////////////////////////////////////////////////////////////
@@ -284,6 +924,7 @@ extern const char* GetCanLogTypeName(CAN_log_type_t type);
 class canlog;
 class canplay;
 class dbcfile;
+class OvmsMetricFloat;
 
 class canbus : public pcp
   {
@@ -312,13 +953,31 @@ class canbus : public pcp
     virtual esp_err_t WriteStandard(uint16_t id, uint8_t length, uint8_t *data, TickType_t maxqueuewait=0);
     virtual bool AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesReceived);
     virtual void TxCallback(CAN_frame_t* frame, bool success);
+    virtual std::string GetDriverStatus();
 
   protected:
     virtual esp_err_t QueueWrite(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+    virtual void BusTicker1(std::string event, void* data);
     virtual void BusTicker10(std::string event, void* data);
+    void SetupRxTask();
+
+  public:
+    uint32_t AddPeriodic(const char* owner, const CAN_frame_t* frame, uint32_t period_ms,
+                         int32_t phase_ms=-1, CanPeriodicCallback update=NULL, bool dbcsource=false);
+    bool RemovePeriodic(uint32_t handle);
+    int RemovePeriodics(const char* owner);
 
   public:
-    void LogFrame(CAN_log_type_t type, const CAN_frame_t* p_frame);
+    void UpdateRxFilter();
+    virtual void ApplyAcceptanceFilter();
+
+  protected:
+    virtual esp_err_t SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                          const CAN_filter_range_list_t& ext_ranges);
+    void RequestAcceptanceFilter();
+
+  public:
+    void LogFrame(CAN_log_type_t type, const CAN_frame_t* p_frame, int64_t time=0);
     void LogStatus(CAN_log_type_t type);
     void LogInfo(CAN_log_type_t type, const char* text);
     bool StatusChanged();
@@ -333,8 +992,17 @@ class canbus : public pcp
     uint32_t m_status_chksum;
     uint32_t m_watchdog_timer;
     uint32_t m_state;             // state bitset
-    QueueHandle_t m_txqueue;
+    cantxqueue m_txqueue;
     int m_busnumber;
+    std::string m_rxfilter_info;  // hardware acceptance filter summary (driver)
+    volatile bool m_rxfilter_pending; // acceptance filter change waiting for the RX dispatch task
+    bool m_rxfilter_narrow;       // filter set from declared interests (load: accepted frames only)
+    QueueHandle_t m_rxqueue;      // driver → RX dispatch task queue
+    canrxtask* m_rxtask;          // own RX dispatch task (per bus mode)
+    cantraffic m_traffic;
+    canframecache m_framecache;
+    OvmsMetricFloat* m_metric_load;     // m.can.<bus>.load: of frames passing the HW filter
+    OvmsMetricFloat* m_metric_load_tx;
 
   protected:
     dbcfile *m_dbcfile;
@@ -352,17 +1020,101 @@ typedef std::map<QueueHandle_t, bool> CanListenerMap_t;
 class CanFrameCallbackEntry
   {
   public:
-    CanFrameCallbackEntry(const char* caller, CanFrameCallback callback)
+    CanFrameCallbackEntry(const char* caller, const CanFrameDelegate& callback)
+      : m_caller(caller), m_callback(callback)
       {
-      m_caller = caller;
-      m_callback = callback;
       }
     ~CanFrameCallbackEntry() {}
   public:
     const char *m_caller;
-    CanFrameCallback m_callback;
+    CanFrameDelegate m_callback;
   };
 typedef std::list<CanFrameCallbackEntry*> CanFrameCallbackList_t;
+typedef std::vector<CanFrameDelegate> CanFrameDelegateList_t;
+
+// Frame subscription: callback restricted to a bus, frame format and ID range
+class CanFrameSubscription : public CanFrameCallbackEntry
+  {
+  public:
+    CanFrameSubscription(const char* caller, const CanFrameDelegate& callback, canbus* bus,
+                         CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                         bool onchange=false, uint64_t mask=UINT64_MAX)
+      : CanFrameCallbackEntry(caller, callback)
+      {
+      m_bus = bus;
+      m_format = format;
+      m_id_from = id_from;
+      m_id_to = id_to;
+      m_onchange = onchange;
+      m_mask = mask;
+      }
+    ~CanFrameSubscription() {}
+  public:
+    canbus* m_bus;                    // NULL = any bus
+    CAN_frame_format_t m_format;
+    uint32_t m_id_from;
+    uint32_t m_id_to;
+    bool m_onchange;                  // only deliver frames with changed payload...
+    uint64_t m_mask;                  // ...in these bits of data.u64
+  };
+typedef std::list<CanFrameSubscription*> CanFrameSubscriptionList_t;
+
+// Compiled dispatch table for frame subscriptions:
+// the ID space is cut into disjoint segments at all range boundaries, each
+// segment holding the subscriptions covering it. Standard IDs map directly
+// to their segment via a 2048 entry lookup, extended IDs are located by
+// binary search over the segment start IDs.
+class CanFrameDispatchTable
+  {
+  public:
+    CanFrameDispatchTable();
+    ~CanFrameDispatchTable();
+
+  public:
+    void Build(const CanFrameSubscriptionList_t& subscriptions);
+    void Clear();
+    int Execute(const CAN_frame_t* frame, uint64_t changed=UINT64_MAX);
+    size_t Size() { return m_std.entries.size() + m_ext.entries.size(); }
+
+  protected:
+    typedef struct
+      {
+      std::vector<uint32_t> starts;               // segment start IDs, ascending
+      std::vector<uint32_t> index;                // segment n: entries[index[n]] .. entries[index[n+1]-1]
+      std::vector<CanFrameSubscription*> entries;
+      } segments_t;
+    static void BuildSegments(segments_t& seg, const CanFrameSubscriptionList_t& subscriptions,
+                              CAN_frame_format_t format, uint32_t id_max);
+    static int ExecuteSegment(const segments_t& seg, int segment, const CAN_frame_t* frame, uint64_t changed);
+
+  protected:
+    segments_t m_std;
+    segments_t m_ext;
+    uint16_t* m_std_lookup;           // standard ID -> segment+1 (0 = no subscription)
+  };
+
+// Dispatch snapshot: immutable callback lists & subscription table used by
+// ExecuteCallbacks() without locking. Reference counted: the current one
+// is referenced by can::m_rxdispatch, an outdated one keeps its successor
+// alive, so subscriptions retired when publishing the successor are freed
+// only after all snapshots that may still dispatch to them are gone.
+class CanFrameDispatchSnapshot
+  {
+  public:
+    CanFrameDispatchSnapshot() : m_refs(1), m_next(NULL) {}
+    ~CanFrameDispatchSnapshot();
+
+  public:
+    static void Release(CanFrameDispatchSnapshot* snapshot);
+
+  public:
+    std::atomic<int> m_refs;
+    CanFrameDelegateList_t m_rxcallbacks;
+    CanFrameDelegateList_t m_txcallbacks;
+    CanFrameDispatchTable m_table;
+    CanFrameSubscriptionList_t m_retired;   // freed with the snapshot
+    CanFrameDispatchSnapshot* m_next;       // successor (referenced)
+  };
 
 class can 
   {
@@ -374,14 +1126,13 @@ class can
     // Private constructor to prevent instantiation outside the class 
     can();
 
-  private:
-    static void CAN_rxtask(void *pvParameters);
-
   public:
-    void IncomingFrame(CAN_frame_t* p_frame);
+    void DispatchMessage(CAN_queue_msg_t* msg);
+    void IncomingFrame(CAN_frame_t* p_frame, int64_t time=0);
 
   public:
-    QueueHandle_t m_rxqueue;
+    QueueHandle_t m_rxqueue;          // shared RX dispatch queue
+    canrxtask* m_rxtask;              // shared RX dispatch task
 
   public:
     void RegisterListener(QueueHandle_t queue, bool txfeedback=false);
@@ -389,9 +1140,41 @@ class can
     void NotifyListeners(const CAN_frame_t* frame, bool tx);
 
   public:
-    void RegisterCallback(const char* caller, CanFrameCallback callback, bool txfeedback=false);
+    void RegisterCallback(const char* caller, const CanFrameDelegate& callback, bool txfeedback=false);
+    void RegisterCallback(const char* caller, const CanFrameDelegate& callback, canbus* bus,
+                          CAN_frame_format_t format, uint32_t id_from, uint32_t id_to);
+    void RegisterChangeCallback(const char* caller, const CanFrameDelegate& callback, canbus* bus,
+                                CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                                uint64_t mask=UINT64_MAX);
     void DeregisterCallback(const char* caller);
-    int ExecuteCallbacks(const CAN_frame_t* frame, bool tx, bool success);
+
+  public:
+    // std::function compatibility:
+    void RegisterCallback(const char* caller, CanFrameCallback callback, bool txfeedback=false)
+      { RegisterCallback(caller, CanFrameDelegate(callback), txfeedback); }
+    void RegisterCallback(const char* caller, CanFrameCallback callback, canbus* bus,
+                          CAN_frame_format_t format, uint32_t id_from, uint32_t id_to)
+      { RegisterCallback(caller, CanFrameDelegate(callback), bus, format, id_from, id_to); }
+    void RegisterChangeCallback(const char* caller, CanFrameCallback callback, canbus* bus,
+                                CAN_frame_format_t format, uint32_t id_from, uint32_t id_to,
+                                uint64_t mask=UINT64_MAX)
+      { RegisterChangeCallback(caller, CanFrameDelegate(callback), bus, format, id_from, id_to, mask); }
+    int ExecuteCallbacks(const CAN_frame_t* frame, bool tx, bool success, uint64_t changed=UINT64_MAX);
+
+  protected:
+    CanFrameDispatchSnapshot* PublishDispatch(CanFrameSubscriptionList_t* retired=NULL);
+    void SyncDispatch(CanFrameDispatchSnapshot* previous);
+
+  public:
+    void AddRxInterest(const char* owner, canbus* bus, CAN_frame_format_t format,
+                       uint32_t id_from, uint32_t id_to, bool update=true);
+    void AddRxInterestAll(const char* owner, canbus* bus=NULL, bool update=true);
+    void RemoveRxInterest(const char* owner, canbus* bus=NULL, bool update=true);
+    bool SetRxInterest(const char* owner, canbus* bus, CAN_filter_range_list_t std_ranges,
+                       CAN_filter_range_list_t ext_ranges, bool update=true);
+    bool GetRxInterest(canbus* bus, CAN_filter_range_list_t& std_ranges,
+                       CAN_filter_range_list_t& ext_ranges);
+    void UpdateRxFilters(canbus* bus=NULL);
 
   public:
     uint32_t AddLogger(canlog* logger, int filterc=0, const char* const* filterv=NULL);
@@ -408,13 +1191,18 @@ class can
     void RemovePlayers();
 
   public:
-    void LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame);
+    void LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame, int64_t time=0);
     void LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status);
     void LogInfo(canbus* bus, CAN_log_type_t type, const char* text);
 
   public:
     canbus* GetBus(int busnumber);
 
+  public:
+    canring m_ring;
+    canperiodic m_periodic;
+    cangateway m_gateway;
+
   public:
     typedef std::map<uint32_t, canlog*> canlog_map_t;
     canlog_map_t m_loggermap;
@@ -432,7 +1220,12 @@ class can
     CanListenerMap_t m_listeners;
     CanFrameCallbackList_t m_rxcallbacks;
     CanFrameCallbackList_t m_txcallbacks;
-    TaskHandle_t m_rxtask;            // Task to handle reception
+    CanFrameSubscriptionList_t m_rxsubscriptions;
+    std::atomic<CanFrameDispatchSnapshot*> m_rxdispatch;  // current snapshot
+    portMUX_TYPE m_rxdispatch_spinlock;   // snapshot acquisition vs. publishing
+    OvmsMutex m_rxdispatch_mutex;         // serializes registration changes
+    CAN_rxinterest_list_t m_rxinterests;
+    OvmsRecMutex m_rxinterest_mutex;
   };
 
 #endif //#ifndef __CAN_H__
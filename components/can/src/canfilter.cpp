@@ -0,0 +1,254 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN software filter
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// The software filter is kept separate from the CAN framework, so it can
+// be used by host tools (see tools/canlogtool) without the bus drivers.
+
+#include "can.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <iomanip>
+#include <sstream>
+
+////////////////////////////////////////////////////////////////////////
+// CAN Filtering (software based filter)
+// The canfilter object encapsulates the filtering of CAN frames
+////////////////////////////////////////////////////////////////////////
+
+canfilter::canfilter()
+  {
+  for (int k=0; k<CAN_FILTER_BUSKEYS; k++)
+    m_std_bitmap[k] = NULL;
+  }
+
+canfilter::~canfilter()
+  {
+  ClearFilters();
+  }
+
+void canfilter::ClearFilters()
+  {
+  for (CAN_filter_t* filter : m_filters)
+    {
+    delete filter;
+    }
+  m_filters.clear();
+  Compile();
+  }
+
+void canfilter::AddFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
+  {
+  CAN_filter_t* f = new CAN_filter_t;
+  f->bus = bus;
+  f->id_from = id_from;
+  f->id_to = id_to;
+  m_filters.push_back(f);
+  Compile();
+  }
+
+void canfilter::AddFilter(const char* filterstring)
+  {
+  char* fs = (char*)filterstring;
+  if (fs[1] == 0)
+    {
+    AddFilter((uint8_t)fs[0]);
+    }
+  else
+    {
+    uint8_t bus = 0;
+    uint32_t id_from = 0;
+    uint32_t id_to = UINT32_MAX;
+    if (fs[1] == ':')
+      {
+      bus = fs[0];
+      fs += 2;
+      }
+    id_from = strtol(fs, &fs, 16);
+    if (*fs)
+      id_to = strtol(fs+1, NULL, 16); // id range
+    else
+      id_to = id_from; // single id
+    AddFilter(bus,id_from,id_to);
+    }
+  }
+
+bool canfilter::RemoveFilter(uint8_t bus, uint32_t id_from, uint32_t id_to)
+  {
+  for (auto it = m_filters.begin(); it != m_filters.end(); ++it)
+    {
+    CAN_filter_t* filter = *it;
+    if ((filter->bus == bus)&&
+        (filter->id_from == id_from)&&
+        (filter->id_to == id_to))
+      {
+      m_filters.erase(it);
+      delete filter;
+      Compile();
+      return true;
+      }
+    }
+  return false;
+  }
+
+/**
+ * CAN_filter_range_merge: sort & merge overlapping / adjacent ranges
+ */
+void CAN_filter_range_merge(CAN_filter_range_list_t& ranges)
+  {
+  std::sort(ranges.begin(), ranges.end(),
+    [](const CAN_filter_range_t& a, const CAN_filter_range_t& b) { return a.id_from < b.id_from; });
+  size_t merged = 0;
+  for (size_t k=0; k<ranges.size(); k++)
+    {
+    if (merged > 0 && (ranges[merged-1].id_to == UINT32_MAX || ranges[k].id_from <= ranges[merged-1].id_to+1))
+      {
+      if (ranges[k].id_to > ranges[merged-1].id_to)
+        ranges[merged-1].id_to = ranges[k].id_to;
+      }
+    else
+      {
+      ranges[merged++] = ranges[k];
+      }
+    }
+  ranges.resize(merged);
+  }
+
+/**
+ * Compile: build the per bus key lookup structures from the filter list.
+ *  Bus key 0 is used for frames without origin, bus keys 1… for can1…
+ *  Filters without bus apply to all bus keys.
+ */
+void canfilter::Compile()
+  {
+  for (int key=0; key<CAN_FILTER_BUSKEYS; key++)
+    {
+    CAN_filter_range_list_t& ranges = m_ext_ranges[key];
+    ranges.clear();
+
+    for (CAN_filter_t* filter : m_filters)
+      {
+      if ((filter->bus)&&(filter->bus != '0'+key)) continue;
+      if (filter->id_from > filter->id_to) continue;
+      ranges.push_back({ filter->id_from, filter->id_to });
+      }
+
+    CAN_filter_range_merge(ranges);
+    ranges.shrink_to_fit();
+
+    // Standard ID bitmap:
+    if (ranges.empty() || ranges[0].id_from > 0x7ff)
+      {
+      if (m_std_bitmap[key])
+        {
+        free(m_std_bitmap[key]);
+        m_std_bitmap[key] = NULL;
+        }
+      continue;
+      }
+    if (!m_std_bitmap[key])
+      {
+      m_std_bitmap[key] = (uint32_t*)malloc(0x800/8);
+      if (!m_std_bitmap[key]) continue;  // fall back to range lookup
+      }
+    uint32_t* bitmap = m_std_bitmap[key];
+    memset(bitmap, 0, 0x800/8);
+    for (const CAN_filter_range_t& range : ranges)
+      {
+      if (range.id_from > 0x7ff) break;
+      uint32_t id_to = (range.id_to > 0x7ff) ? 0x7ff : range.id_to;
+      for (uint32_t id = range.id_from; id <= id_to; id++)
+        bitmap[id >> 5] |= (1UL << (id & 31));
+      }
+    }
+  }
+
+bool canfilter::IsFiltered(const CAN_frame_t* p_frame)
+  {
+  if (m_filters.size() == 0) return true;
+  if (! p_frame) return false;
+
+  int key = 0;
+  if (p_frame->origin) key = p_frame->origin->m_busnumber + 1;
+  if (key < 0 || key >= CAN_FILTER_BUSKEYS) return false;
+
+  uint32_t id = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_std && id <= 0x7ff)
+    {
+    const uint32_t* bitmap = m_std_bitmap[key];
+    if (bitmap)
+      return (bitmap[id >> 5] & (1UL << (id & 31))) != 0;
+    }
+
+  const CAN_filter_range_list_t& ranges = m_ext_ranges[key];
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), id,
+    [](uint32_t id, const CAN_filter_range_t& range) { return id < range.id_from; });
+  if (it == ranges.begin()) return false;
+  --it;
+  return (id <= it->id_to);
+  }
+
+bool canfilter::IsFiltered(canbus* bus)
+  {
+  if (m_filters.size() == 0) return true;
+  if (bus == NULL) return true;
+
+  char buskey = bus->GetName()[3];
+
+  for (CAN_filter_t* filter : m_filters)
+    {
+    if ((filter->bus)&&(filter->bus == buskey)) return true;
+    }
+
+  return false;
+  }
+
+/**
+ * GetRanges: merged ID ranges passing the filter for a bus key
+ *  (0 = frames without origin, 1… = can1…)
+ */
+const CAN_filter_range_list_t& canfilter::GetRanges(int buskey)
+  {
+  if (buskey < 0 || buskey >= CAN_FILTER_BUSKEYS) buskey = 0;
+  return m_ext_ranges[buskey];
+  }
+
+std::string canfilter::Info()
+  {
+  std::ostringstream buf;
+
+  for (CAN_filter_t* filter : m_filters)
+    {
+    if (filter->bus > 0) buf << std::setfill(' ') << std::dec << filter->bus << ':';
+    buf << std::setfill('0') << std::setw(3) << std::hex;
+    if (filter->id_from == filter->id_to)
+      { buf << filter->id_from << ' '; }
+    else
+      { buf << filter->id_from << '-' << filter->id_to << ' '; }
+    }
+
+  return buf.str();
+  }
@@ -28,6 +28,7 @@
 static const char *TAG = "canformat";
 
 #include "canformat.h"
+#include "canlz.h"
 
 canformat::canformat_serve_mode_t GetFormatModeType(std::string name)
   {
@@ -61,10 +62,16 @@ OvmsCanFormatFactory::~OvmsCanFormatFactory()
 
 canformat* OvmsCanFormatFactory::NewFormat(const char* FormatType)
   {
-  OvmsCanFormatFactory::map_can_format_t::iterator iter = m_fmap.find(FormatType);
+  // Stream options (i.e. "+lz" compression) are handled by the logger:
+  std::string type(FormatType);
+  size_t opt = type.find('+');
+  if (opt != std::string::npos)
+    type.resize(opt);
+
+  OvmsCanFormatFactory::map_can_format_t::iterator iter = m_fmap.find(type.c_str());
   if (iter != m_fmap.end())
     {
-    return iter->second(FormatType);
+    return iter->second(iter->first);
     }
   return NULL;
   }
@@ -82,6 +89,23 @@ void OvmsCanFormatFactory::RegisterCommandSet(OvmsCommand* base, const char* tit
     }
   }
 
+void OvmsCanFormatFactory::RegisterCompressedCommandSet(OvmsCommand* base, const char* title,
+                        void (*execute)(int, OvmsWriter*, OvmsCommand*, int, const char* const*),
+                        const char *usage, int min, int max, bool secure,
+                        int (*validate)(OvmsWriter*, OvmsCommand*, int, const char* const*, bool))
+  {
+  // Register "<format>+lz" for all formats, command names need to persist:
+  OvmsCanFormatFactory::map_can_format_t::iterator iter = m_fmap.begin();
+  while (iter != m_fmap.end())
+    {
+    std::string name(iter->first);
+    name.append(CANLZ_SUFFIX);
+    const std::string& cmdname = *m_cmdnames.insert(name).first;
+    base->RegisterCommand(cmdname.c_str(), title, execute, usage, min, max, secure, validate);
+    ++iter;
+    }
+  }
+
 canformat::canformat(const char* type, canformat_serve_mode_t mode)
   : m_buf(CANFORMAT_SERVE_BUFFERSIZE)
   {
@@ -99,9 +123,16 @@ const char* canformat::type()
   return m_type;
   }
 
+size_t canformat::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
+  {
+  return 0;
+  }
+
 std::string canformat::get(CAN_log_message_t* message)
   {
-  return std::string("");
+  uint8_t buf[CANFORMAT_GET_MAXLEN];
+  size_t len = get(message, buf, sizeof(buf));
+  return std::string((const char*)buf, len);
   }
 
 std::string canformat::getheader(struct timeval *time)
@@ -114,6 +145,31 @@ size_t canformat::put(CAN_log_message_t* message, uint8_t *buffer, size_t len, b
   return 0;
   }
 
+void canformat::Reset()
+  {
+  m_buf.EmptyAll();
+  m_servediscarding = false;
+  }
+
+bool canformat::IsStateful()
+  {
+  return false;
+  }
+
+void canformat::Resync()
+  {
+  }
+
+size_t canformat::Buffered()
+  {
+  return m_buf.UsedSpace();
+  }
+
+bool canformat::IsSeekPoint()
+  {
+  return false;
+  }
+
 size_t canformat::Serve(uint8_t *buffer, size_t len, canlogconnection* clc)
   {
   if ((m_servediscarding)||(m_servemode == Discard))
@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <string.h>
 #include <map>
+#include <set>
 #include "can.h"
 #include "ovms_utils.h"
 #include "ovms_command.h"
@@ -38,6 +39,7 @@
 using namespace std;
 
 #define CANFORMAT_SERVE_BUFFERSIZE 1024
+#define CANFORMAT_GET_MAXLEN 320          // max size of a formatted log record
 
 class canlogconnection;
 
@@ -54,11 +56,27 @@ class canformat
     const char* type();
 
   public: // Conversion from OVMS CAN log messages to specific format
-    virtual std::string get(CAN_log_message_t* message);
+    // get() formats into the buffer and returns the length, 0 = no output.
+    // Buffers of CANFORMAT_GET_MAXLEN bytes can take any record.
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
+    std::string get(CAN_log_message_t* message);
     virtual std::string getheader(struct timeval *time = NULL);
+    // Stateful formats encode records relative to the preceding output
+    // (i.e. a dictionary), so every log connection needs its own encoder,
+    // and the stream needs to restart after output has been lost.
+    // Resync() makes the next get() start with a new sync point.
+    virtual bool IsStateful();
+    virtual void Resync();
 
   public: // Conversion from specific format to OVMS CAN log messages
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
+    // Input position support for file playback: Buffered() is the number of
+    // bytes taken but not yet decoded by put(), IsSeekPoint() tells if
+    // decoding can start at the first of these without preceding data.
+    // Reset() discards the input buffer and decoder state (i.e. on seek).
+    virtual void Reset();
+    size_t Buffered();
+    virtual bool IsSeekPoint();
 
   private:
     const char* m_type;
@@ -116,6 +134,13 @@ class OvmsCanFormatFactory
                             void (*execute)(int, OvmsWriter*, OvmsCommand*, int, const char* const*) = NULL,
                             const char *usage = "", int min = 0, int max = 0, bool secure = true,
                             int (*validate)(OvmsWriter*, OvmsCommand*, int, const char* const*, bool) = NULL);
+    void RegisterCompressedCommandSet(OvmsCommand* base, const char* title,
+                            void (*execute)(int, OvmsWriter*, OvmsCommand*, int, const char* const*) = NULL,
+                            const char *usage = "", int min = 0, int max = 0, bool secure = true,
+                            int (*validate)(OvmsWriter*, OvmsCommand*, int, const char* const*, bool) = NULL);
+
+  protected:
+    std::set<std::string> m_cmdnames;       // generated command names
   };
 
 #endif // __CANFORMAT_H__
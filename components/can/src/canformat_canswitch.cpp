@@ -55,9 +55,10 @@ canformat_cs11::~canformat_cs11()
   {
   }
 
-std::string canformat_cs11::get(CAN_log_message_t* message)
+size_t canformat_cs11::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
-  char buf[CANFORMAT_CS11_MAXLEN];
+  if (cap < CANFORMAT_CS11_MAXLEN) return 0;
+  uint8_t* buf = out;
 
   char busnumber;
   if (message->origin != NULL)
@@ -75,14 +76,14 @@ std::string canformat_cs11::get(CAN_log_message_t* message)
         buf[2] = message->frame.MsgID & 0xff;
         buf[3] = (message->frame.MsgID >> 8) & 0xff;
         memcpy(buf+4,message->frame.data.u8,message->frame.FIR.B.DLC);
-        return std::string(buf,message->frame.FIR.B.DLC+4);
+        return message->frame.FIR.B.DLC+4;
         }
       break;
     default:
       break;
     }
 
-  return std::string("");
+  return 0;
   }
 
 std::string canformat_cs11::getheader(struct timeval *time)
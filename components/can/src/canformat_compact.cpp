@@ -0,0 +1,468 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN dump compact binary format
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "canformat-compact";
+
+#include "canformat_compact.h"
+#include <algorithm>
+#include "pcp.h"
+
+class OvmsCanFormatCompactInit
+  {
+  public: OvmsCanFormatCompactInit();
+} ;
+
+OvmsCanFormatCompactInit::OvmsCanFormatCompactInit()
+  {
+  ESP_LOGI(TAG, "Registering CAN Format: COMPACT");
+
+  OvmsCanFormatFactory::instance(TAG).RegisterCanFormat<canformat_compact>("compact");
+  }
+
+static const uint8_t compact_syncmagic[4] =
+  { CANFORMAT_COMPACT_TAG_SYNC, 'O', 'C', CANFORMAT_COMPACT_VERSION };
+
+static inline uint8_t* compact_putvarint(uint8_t* p, uint64_t value)
+  {
+  while (value >= 0x80)
+    {
+    *p++ = (uint8_t)value | 0x80;
+    value >>= 7;
+    }
+  *p++ = (uint8_t)value;
+  return p;
+  }
+
+// Read a varint: returns 1 = ok, 0 = incomplete, -1 = invalid
+static inline int compact_getvarint(const uint8_t*& p, const uint8_t* end, uint64_t* value)
+  {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+    {
+    if (p >= end) return 0;
+    uint8_t byte = *p++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return 1;
+    }
+  return -1;
+  }
+
+static inline uint8_t compact_flags(const CAN_log_message_t* message)
+  {
+  uint8_t flags = (message->origin) ? (message->origin->m_busnumber & CANFORMAT_COMPACT_FL_BUS) : 0;
+  if (message->frame.FIR.B.FF == CAN_frame_ext) flags |= CANFORMAT_COMPACT_FL_EXT;
+  if (message->frame.FIR.B.RTR == CAN_RTR) flags |= CANFORMAT_COMPACT_FL_RTR;
+  return flags;
+  }
+
+static inline int64_t compact_time(const struct timeval* tv)
+  {
+  return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+  }
+
+canformat_compact::canformat_compact(const char* type)
+  : canformat(type)
+  {
+  m_lasttime = 0;
+  m_synctime = 0;
+  m_records = 0;
+  m_synced = false;
+  m_dectime = 0;
+  m_insync = false;
+  }
+
+canformat_compact::~canformat_compact()
+  {
+  }
+
+/**
+ * PutSync: write a sync point, reset the encoder dictionary & time base
+ */
+uint8_t* canformat_compact::PutSync(uint8_t* p, const struct timeval* time)
+  {
+  memcpy(p, compact_syncmagic, sizeof(compact_syncmagic));
+  p += sizeof(compact_syncmagic);
+  p = compact_putvarint(p, time->tv_sec);
+  p = compact_putvarint(p, time->tv_usec);
+  m_index.clear();
+  m_entries.clear();
+  m_lasttime = m_synctime = compact_time(time);
+  m_records = 0;
+  m_synced = true;
+  return p;
+  }
+
+static_assert(CANFORMAT_COMPACT_MAXLEN <= CANFORMAT_GET_MAXLEN,
+  "compact records must fit the canformat get() buffer");
+
+size_t canformat_compact::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
+  {
+  if (cap < CANFORMAT_COMPACT_MAXLEN) return 0;
+  uint8_t* buf = out;
+  uint8_t* p = buf;
+  int64_t time = compact_time(&message->timestamp);
+  uint8_t dlc = std::min((int)message->frame.FIR.B.DLC, 8);
+
+  bool sync = (!m_synced) || (time < m_lasttime)
+    || (m_records >= CANFORMAT_COMPACT_SYNC_RECORDS)
+    || (time - m_synctime >= CANFORMAT_COMPACT_SYNC_TIME);
+
+  // RX frames are dictionary coded:
+  uint64_t key = 0;
+  if (message->type == CAN_LogFrame_RX)
+    {
+    key = (uint64_t)message->frame.MsgID | (uint64_t)compact_flags(message) << 29 | (uint64_t)dlc << 37;
+    if (!sync && m_entries.size() >= CANFORMAT_COMPACT_MAXDICT && m_index.find(key) == m_index.end())
+      sync = true;
+    }
+
+  if (sync)
+    p = PutSync(p, &message->timestamp);
+
+  uint64_t dt = time - m_lasttime;
+  m_lasttime = time;
+  m_records++;
+
+  switch (message->type)
+    {
+    case CAN_LogFrame_RX:
+      {
+      auto it = m_index.find(key);
+      if (it == m_index.end())
+        {
+        entry_t entry;
+        entry.flags = compact_flags(message);
+        entry.dlc = dlc;
+        entry.id = message->frame.MsgID;
+        memset(entry.data, 0, sizeof(entry.data));
+        memcpy(entry.data, message->frame.data.u8, dlc);
+        m_index[key] = m_entries.size();
+        m_entries.push_back(entry);
+        *p++ = CANFORMAT_COMPACT_TAG_DEFINE;
+        *p++ = entry.flags;
+        p = compact_putvarint(p, entry.id);
+        *p++ = dlc;
+        p = compact_putvarint(p, dt);
+        memcpy(p, message->frame.data.u8, dlc);
+        p += dlc;
+        }
+      else
+        {
+        uint32_t index = it->second;
+        entry_t& entry = m_entries[index];
+        if (index < CANFORMAT_COMPACT_TAG_INDEX)
+          *p++ = index;
+        else
+          {
+          *p++ = CANFORMAT_COMPACT_TAG_INDEX;
+          p = compact_putvarint(p, index);
+          }
+        p = compact_putvarint(p, dt);
+        uint8_t* mask = p++;
+        *mask = 0;
+        for (int k=0; k<dlc; k++)
+          {
+          if (message->frame.data.u8[k] != entry.data[k])
+            {
+            *mask |= 1 << k;
+            *p++ = entry.data[k] = message->frame.data.u8[k];
+            }
+          }
+        }
+      break;
+      }
+
+    case CAN_LogFrame_TX:
+    case CAN_LogFrame_TX_Queue:
+    case CAN_LogFrame_TX_Fail:
+      *p++ = CANFORMAT_COMPACT_TAG_FRAME;
+      *p++ = message->type;
+      *p++ = compact_flags(message);
+      p = compact_putvarint(p, message->frame.MsgID);
+      *p++ = dlc;
+      p = compact_putvarint(p, dt);
+      memcpy(p, message->frame.data.u8, dlc);
+      p += dlc;
+      break;
+
+    case CAN_LogStatus_Error:
+    case CAN_LogStatus_Statistics:
+      *p++ = CANFORMAT_COMPACT_TAG_STATUS;
+      *p++ = message->type;
+      *p++ = (message->origin) ? message->origin->m_busnumber : 0;
+      p = compact_putvarint(p, dt);
+      *p++ = sizeof(CAN_status_t);
+      memcpy(p, &message->status, sizeof(CAN_status_t));
+      p += sizeof(CAN_status_t);
+      break;
+
+    case CAN_LogInfo_Comment:
+    case CAN_LogInfo_Config:
+    case CAN_LogInfo_Event:
+    case CAN_LogInfo_Metric:
+      {
+      size_t len = (message->text) ? std::min(strlen(message->text), (size_t)CANFORMAT_COMPACT_MAXTEXT) : 0;
+      *p++ = CANFORMAT_COMPACT_TAG_TEXT;
+      *p++ = message->type;
+      *p++ = (message->origin) ? message->origin->m_busnumber : 0;
+      p = compact_putvarint(p, dt);
+      p = compact_putvarint(p, len);
+      memcpy(p, message->text, len);
+      p += len;
+      break;
+      }
+
+    default:
+      m_records--;
+      break;
+    }
+
+  return p - buf;
+  }
+
+bool canformat_compact::IsStateful()
+  {
+  return true;
+  }
+
+void canformat_compact::Resync()
+  {
+  m_synced = false;
+  }
+
+std::string canformat_compact::getheader(struct timeval *time)
+  {
+  uint8_t buf[CANFORMAT_COMPACT_MAXLEN];
+  struct timeval t;
+
+  if (time == NULL)
+    {
+    gettimeofday(&t,NULL);
+    time = &t;
+    }
+
+  uint8_t* p = PutSync(buf, time);
+  return std::string((const char*)buf, p - buf);
+  }
+
+/**
+ * Decode: decode a record
+ *  Returns the record length, 0 if the record is incomplete or -1 if
+ *  the data is invalid (out of sync). Sets message->frame.origin for
+ *  frames to be served.
+ */
+int canformat_compact::Decode(const uint8_t* buf, size_t len, CAN_log_message_t* message)
+  {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t v, dt;
+  int res;
+
+  #define GETVARINT(var) if ((res = compact_getvarint(p, end, &var)) <= 0) return res;
+  #define NEED(n) if (end - p < (ptrdiff_t)(n)) return 0;
+
+  NEED(1);
+  uint8_t tag = *p++;
+
+  if (tag == CANFORMAT_COMPACT_TAG_SYNC)
+    {
+    NEED(3);
+    if (p[0] != compact_syncmagic[1] || p[1] != compact_syncmagic[2]) return -1;
+    if (p[2] != CANFORMAT_COMPACT_VERSION)
+      {
+      ESP_LOGE(TAG, "Unsupported version %d", p[2]);
+      return -1;
+      }
+    p += 3;
+    uint64_t sec, usec;
+    GETVARINT(sec);
+    GETVARINT(usec);
+    m_dict.clear();
+    m_dectime = (int64_t)sec * 1000000 + usec;
+    m_insync = true;
+    return p - buf;
+    }
+
+  if (!m_insync) return -1;
+
+  if (tag <= CANFORMAT_COMPACT_TAG_INDEX)
+    {
+    uint64_t index = tag;
+    if (tag == CANFORMAT_COMPACT_TAG_INDEX)
+      GETVARINT(index);
+    if (index >= m_dict.size()) return -1;
+    GETVARINT(dt);
+    NEED(1);
+    uint8_t mask = *p++;
+    entry_t& entry = m_dict[index];
+    NEED(__builtin_popcount(mask));
+    uint8_t data[8];
+    memcpy(data, entry.data, 8);
+    for (int k=0; k<8; k++)
+      {
+      if (mask & (1 << k))
+        {
+        if (k >= entry.dlc) return -1;
+        data[k] = *p++;
+        }
+      }
+    // Record complete, commit:
+    memcpy(entry.data, data, 8);
+    m_dectime += dt;
+    message->type = CAN_LogFrame_RX;
+    message->frame.origin = can::instance(TAG).GetBus(entry.flags & CANFORMAT_COMPACT_FL_BUS);
+    message->frame.FIR.B.FF = (entry.flags & CANFORMAT_COMPACT_FL_EXT) ? CAN_frame_ext : CAN_frame_std;
+    message->frame.FIR.B.RTR = (entry.flags & CANFORMAT_COMPACT_FL_RTR) ? CAN_RTR : CAN_no_RTR;
+    message->frame.FIR.B.DLC = entry.dlc;
+    message->frame.MsgID = entry.id;
+    memcpy(message->frame.data.u8, entry.data, 8);
+    }
+  else if (tag == CANFORMAT_COMPACT_TAG_DEFINE || tag == CANFORMAT_COMPACT_TAG_FRAME)
+    {
+    entry_t entry;
+    CAN_log_type_t type = CAN_LogFrame_RX;
+    if (tag == CANFORMAT_COMPACT_TAG_FRAME)
+      {
+      NEED(1);
+      type = (CAN_log_type_t)*p++;
+      }
+    NEED(1);
+    entry.flags = *p++;
+    GETVARINT(v);
+    entry.id = v & 0x1fffffff;
+    NEED(1);
+    entry.dlc = *p++;
+    if (entry.dlc > 8) return -1;
+    GETVARINT(dt);
+    NEED(entry.dlc);
+    memset(entry.data, 0, sizeof(entry.data));
+    memcpy(entry.data, p, entry.dlc);
+    p += entry.dlc;
+    // Record complete, commit:
+    if (tag == CANFORMAT_COMPACT_TAG_DEFINE)
+      m_dict.push_back(entry);
+    m_dectime += dt;
+    message->type = type;
+    if (type == CAN_LogFrame_RX || type == CAN_LogFrame_TX)
+      message->frame.origin = can::instance(TAG).GetBus(entry.flags & CANFORMAT_COMPACT_FL_BUS);
+    message->frame.FIR.B.FF = (entry.flags & CANFORMAT_COMPACT_FL_EXT) ? CAN_frame_ext : CAN_frame_std;
+    message->frame.FIR.B.RTR = (entry.flags & CANFORMAT_COMPACT_FL_RTR) ? CAN_RTR : CAN_no_RTR;
+    message->frame.FIR.B.DLC = entry.dlc;
+    message->frame.MsgID = entry.id;
+    memcpy(message->frame.data.u8, entry.data, 8);
+    }
+  else if (tag == CANFORMAT_COMPACT_TAG_STATUS || tag == CANFORMAT_COMPACT_TAG_TEXT)
+    {
+    // Not served; skip:
+    NEED(2);
+    p += 2;
+    GETVARINT(dt);
+    GETVARINT(v);
+    NEED(v);
+    p += v;
+    m_dectime += dt;
+    }
+  else
+    {
+    return -1;
+    }
+
+  #undef GETVARINT
+  #undef NEED
+
+  message->timestamp.tv_sec = m_dectime / 1000000;
+  message->timestamp.tv_usec = m_dectime % 1000000;
+  return p - buf;
+  }
+
+size_t canformat_compact::put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc)
+  {
+  if (m_buf.FreeSpace()==0) SetServeDiscarding(true); // Buffer full, so discard from now on
+  if (IsServeDiscarding()) return len;  // Quick return if discarding
+
+  size_t consumed = Stuff(buffer,len);  // Stuff m_buf with as much as possible
+
+  uint8_t rec[CANFORMAT_COMPACT_MAXLEN];
+  size_t avail = m_buf.Peek(sizeof(rec), rec);
+  if (avail == 0) return consumed;
+
+  if (!m_insync)
+    {
+    // Skip to the next sync point:
+    size_t skip = 0;
+    while (skip + sizeof(compact_syncmagic) <= avail
+           && memcmp(rec + skip, compact_syncmagic, sizeof(compact_syncmagic)) != 0)
+      skip++;
+    if (skip > 0)
+      {
+      m_buf.Pop(skip, rec);
+      *hasmore = true;
+      return consumed;
+      }
+    }
+
+  int res = Decode(rec, avail, message);
+  if (res > 0)
+    {
+    m_buf.Pop(res, rec);
+    *hasmore = true;
+    }
+  else if (res < 0)
+    {
+    // Out of sync: drop the tag byte and search for the next sync point
+    if (m_insync) ESP_LOGW(TAG, "Invalid record, resyncing");
+    m_insync = false;
+    message->frame.origin = NULL;
+    m_buf.Pop(1, rec);
+    *hasmore = true;
+    }
+  else if (avail == sizeof(rec))
+    {
+    // Incomplete although max record size available: invalid
+    m_insync = false;
+    m_buf.Pop(1, rec);
+    *hasmore = true;
+    }
+
+  return consumed;
+  }
+
+void canformat_compact::Reset()
+  {
+  canformat::Reset();
+  m_dict.clear();
+  m_dectime = 0;
+  m_insync = false;
+  }
+
+bool canformat_compact::IsSeekPoint()
+  {
+  // Decoding can start at sync points only:
+  uint8_t magic[sizeof(compact_syncmagic)];
+  return (m_buf.Peek(sizeof(magic), magic) == sizeof(magic)
+          && memcmp(magic, compact_syncmagic, sizeof(magic)) == 0);
+  }
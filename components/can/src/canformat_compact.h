@@ -0,0 +1,118 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN dump compact binary format
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CANFORMAT_COMPACT_H__
+#define __CANFORMAT_COMPACT_H__
+
+#include "canformat.h"
+#include <vector>
+#include <unordered_map>
+
+// Compact binary CAN log format
+//
+// A stream of variable length records. All integers are unsigned LEB128
+// varints, 'dt' is the time delta in us to the previous record.
+//
+//   0x00-0xEF  RX frame of dictionary entry <tag>: dt, mask, data bytes
+//   0xF0       RX frame of dictionary entry: index, dt, mask, data bytes
+//   0xF1       RX frame, new dictionary entry: flags, id, dlc, dt, data
+//   0xF3       other frame (TX, TX queue/fail): type, flags, id, dlc, dt, data
+//   0xF4       bus status: type, bus, dt, len, CAN_status_t
+//   0xF5       text info: type, bus, dt, len, text
+//   0xF8 'O' 'C' <version>  sync point: tv_sec, tv_usec
+//
+// flags: bits 0-2 = bus number, bit 3 = extended ID, bit 4 = RTR.
+// Dictionary frames only carry the payload bytes changed vs. the last
+// frame of the entry, mask bit n set = byte n follows. A dictionary entry
+// is defined per bus, ID, RTR and DLC and numbered in order of definition.
+// Sync points reset the dictionary and time base; they are written as the
+// header and then periodically, so a reader can start decoding from any
+// sync point (i.e. after seeking or when joining a log stream).
+
+#define CANFORMAT_COMPACT_VERSION       1
+#define CANFORMAT_COMPACT_MAXLEN        320       // max record size
+#define CANFORMAT_COMPACT_MAXTEXT       255       // max text length
+#define CANFORMAT_COMPACT_MAXDICT       1024      // max dictionary entries
+#define CANFORMAT_COMPACT_SYNC_RECORDS  4096      // sync point after this many records…
+#define CANFORMAT_COMPACT_SYNC_TIME     10000000  // …or this time [us]
+
+#define CANFORMAT_COMPACT_TAG_INDEX     0xf0
+#define CANFORMAT_COMPACT_TAG_DEFINE    0xf1
+#define CANFORMAT_COMPACT_TAG_FRAME     0xf3
+#define CANFORMAT_COMPACT_TAG_STATUS    0xf4
+#define CANFORMAT_COMPACT_TAG_TEXT      0xf5
+#define CANFORMAT_COMPACT_TAG_SYNC      0xf8
+
+#define CANFORMAT_COMPACT_FL_BUS        0x07
+#define CANFORMAT_COMPACT_FL_EXT        0x08
+#define CANFORMAT_COMPACT_FL_RTR        0x10
+
+class canformat_compact : public canformat
+  {
+  public:
+    canformat_compact(const char* type);
+    virtual ~canformat_compact();
+
+  public:
+    using canformat::get;
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
+    virtual std::string getheader(struct timeval *time);
+    virtual bool IsStateful();
+    virtual void Resync();
+    virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
+    virtual void Reset();
+    virtual bool IsSeekPoint();
+
+  protected:
+    typedef struct
+      {
+      uint8_t flags;
+      uint8_t dlc;
+      uint32_t id;
+      uint8_t data[8];
+      } entry_t;
+
+  protected:
+    uint8_t* PutSync(uint8_t* p, const struct timeval* time);
+    int Decode(const uint8_t* buf, size_t len, CAN_log_message_t* message);
+
+  protected:
+    // Encoder state:
+    std::unordered_map<uint64_t, uint32_t> m_index;   // frame key → dictionary index
+    std::vector<entry_t> m_entries;
+    int64_t m_lasttime;
+    int64_t m_synctime;
+    uint32_t m_records;                               // records since sync point
+    bool m_synced;
+
+  protected:
+    // Decoder state:
+    std::vector<entry_t> m_dict;
+    int64_t m_dectime;
+    bool m_insync;
+  };
+
+#endif // __CANFORMAT_COMPACT_H__
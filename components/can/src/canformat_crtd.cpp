@@ -54,9 +54,10 @@ canformat_crtd::~canformat_crtd()
   {
   }
 
-std::string canformat_crtd::get(CAN_log_message_t* message)
+size_t canformat_crtd::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
-  char buf[CANFORMAT_CRTD_MAXLEN];
+  if (cap < CANFORMAT_CRTD_MAXLEN+1) return 0;
+  char *buf = (char*)out;
   char *p;
 
   char busnumber;
@@ -69,7 +70,7 @@ std::string canformat_crtd::get(CAN_log_message_t* message)
     {
     case CAN_LogFrame_RX:
     case CAN_LogFrame_TX:
-      snprintf(buf,sizeof(buf),"%l" PRId32 ".%06ld %c%c%s %0*" PRIX32,
+      snprintf(buf,CANFORMAT_CRTD_MAXLEN,"%l" PRId32 ".%06ld %c%c%s %0*" PRIX32,
         message->timestamp.tv_sec, message->timestamp.tv_usec,
         busnumber,
         (message->type == CAN_LogFrame_RX) ? 'R' : 'T',
@@ -87,7 +88,7 @@ std::string canformat_crtd::get(CAN_log_message_t* message)
 
     case CAN_LogFrame_TX_Queue:
     case CAN_LogFrame_TX_Fail:
-      snprintf(buf,sizeof(buf),"%l" PRId32 ".%06ld %cCER %s %c%s %0*" PRIX32,
+      snprintf(buf,CANFORMAT_CRTD_MAXLEN,"%l" PRId32 ".%06ld %cCER %s %c%s %0*" PRIX32,
         message->timestamp.tv_sec, message->timestamp.tv_usec,
         busnumber,
         GetCanLogTypeName(message->type),
@@ -106,7 +107,7 @@ std::string canformat_crtd::get(CAN_log_message_t* message)
 
     case CAN_LogStatus_Error:
     case CAN_LogStatus_Statistics:
-      snprintf(buf,sizeof(buf),
+      snprintf(buf,CANFORMAT_CRTD_MAXLEN,
         "%l" PRId32 ".%06ld %c%s %s intr=%" PRId32 " rxpkt=%" PRId32 " txpkt=%" PRId32 " errflags=%#" PRIx32 " rxerr=%d txerr=%d"
         " rxinval=%d rxovr=%d txovr=%d txdelay=%" PRId32 " txfail=%" PRId32 " wdgreset=%d errreset=%d",
         message->timestamp.tv_sec, message->timestamp.tv_usec,
@@ -124,7 +125,7 @@ std::string canformat_crtd::get(CAN_log_message_t* message)
     case CAN_LogInfo_Config:
     case CAN_LogInfo_Event:
     case CAN_LogInfo_Metric:
-      snprintf(buf,sizeof(buf),"%l" PRId32 ".%06ld %c%s %s %s",
+      snprintf(buf,CANFORMAT_CRTD_MAXLEN,"%l" PRId32 ".%06ld %c%s %s %s",
         message->timestamp.tv_sec, message->timestamp.tv_usec,
         busnumber,
         (message->type == CAN_LogInfo_Event) ? "CEV" : (message->type == CAN_LogInfo_Metric) ? "CMT" : "CXX",
@@ -137,8 +138,9 @@ std::string canformat_crtd::get(CAN_log_message_t* message)
       break;
     }
 
-  strcat(buf,"\n");
-  return std::string(buf);
+  size_t len = strlen(buf);
+  buf[len++] = '\n';
+  return len;
   }
 
 std::string canformat_crtd::getheader(struct timeval *time)
@@ -178,6 +180,16 @@ size_t canformat_crtd::put(CAN_log_message_t* message, uint8_t *buffer, size_t l
     // We look for something like
     // 1524311386.811100 1R11 100 01 02 03
     if (!isdigit(b[0])) return consumed;    // Discard invalid line
+    char *t;
+    message->timestamp.tv_sec = strtoul(b,&t,10);
+    if (*t == '.')
+      {
+      int digits = 0;
+      for (t++; isdigit(*t) && digits < 6; t++, digits++)
+        message->timestamp.tv_usec = message->timestamp.tv_usec * 10 + (*t - '0');
+      for (; digits < 6; digits++)
+        message->timestamp.tv_usec *= 10;
+      }
     for (;((*b != 0)&&(*b != ' '));b++) {}
     if (*b == 0) return consumed;           // Discard invalid line
     b++;
@@ -286,3 +298,9 @@ size_t canformat_crtd::put(CAN_log_message_t* message, uint8_t *buffer, size_t l
     return consumed;
     }
   }
+
+bool canformat_crtd::IsSeekPoint()
+  {
+  // Lines can be decoded independently:
+  return true;
+  }
@@ -38,9 +38,11 @@ class canformat_crtd : public canformat
     virtual ~canformat_crtd();
 
   public:
-    virtual std::string get(CAN_log_message_t* message);
+    using canformat::get;
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
     virtual std::string getheader(struct timeval *time);
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
+    virtual bool IsSeekPoint();
   };
 
 #endif // __CANFORMAT_CRTD_H__
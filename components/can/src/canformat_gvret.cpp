@@ -63,9 +63,9 @@ canformat_gvret::~canformat_gvret()
   {
   }
 
-std::string canformat_gvret::get(CAN_log_message_t* message)
+size_t canformat_gvret::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
-  return std::string("");
+  return 0;
   }
 
 std::string canformat_gvret::getheader(struct timeval *time)
@@ -87,14 +87,15 @@ canformat_gvret_ascii::canformat_gvret_ascii(const char* type)
   {
   }
 
-std::string canformat_gvret_ascii::get(CAN_log_message_t* message)
+size_t canformat_gvret_ascii::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
-  char buf[CANFORMAT_GVRET_MAXLEN];
+  if (cap < CANFORMAT_GVRET_MAXLEN) return 0;
+  char *buf = (char*)out;
 
   if ((message->type != CAN_LogFrame_RX)&&
       (message->type != CAN_LogFrame_TX))
     {
-    return std::string("");
+    return 0;
     }
 
   char busnumber = (message->origin != NULL)?message->origin->m_busnumber + '0':'0';
@@ -109,7 +110,7 @@ std::string canformat_gvret_ascii::get(CAN_log_message_t* message)
       sprintf(buf+strlen(buf)," %02x", message->frame.data.u8[k]);
 
   strcat(buf,"\n");
-  return std::string(buf);
+  return strlen(buf);
   }
 
 size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc)
@@ -125,8 +126,9 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
     }
   else
     {
+    *hasmore = true;  // Call us again to see if we have more frames to process
     std::string line = m_buf.ReadLine();
-    char *b = strdup(line.c_str());
+    char *b = (char*)line.c_str();
 
     // We look for something like
     // 1000 - 100 S 0 4 01 02 03 04
@@ -134,9 +136,9 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
 
     message->type = CAN_LogFrame_RX;
 
-    uint32_t timestamp = strtol(b,&b,10);
-    message->timestamp.tv_sec = timestamp % 1000000;
-    message->timestamp.tv_usec = timestamp / 1000000;
+    uint32_t timestamp = strtoul(b,&b,10);
+    message->timestamp.tv_sec = timestamp / 1000000;
+    message->timestamp.tv_usec = timestamp % 1000000;
 
     b += 2; // Skip the '-'
 
@@ -152,7 +154,6 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
     else
       {
       // Bad frame type - discard
-      free(b);
       return consumed;
       }
 
@@ -164,7 +165,6 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
     if (message->frame.FIR.B.DLC > 8)
       {
       // Bad frame length - discard
-      free(b);
       return consumed;
       }
 
@@ -173,9 +173,8 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
       message->frame.data.u8[x] = strtol(b,&b,16);
       }
 
-    message->origin = can::instance(TAG).GetBus(busnumber-'0');
+    message->origin = can::instance(TAG).GetBus(busnumber);
 
-    free(b);
     return consumed;
     }
   }
@@ -189,7 +188,7 @@ canformat_gvret_binary::canformat_gvret_binary(const char* type)
   {
   }
 
-std::string canformat_gvret_binary::get(CAN_log_message_t* message)
+size_t canformat_gvret_binary::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
   gvret_binary_frame_t frame;
   memset(&frame,0,sizeof(frame));
@@ -197,8 +196,10 @@ std::string canformat_gvret_binary::get(CAN_log_message_t* message)
   if ((message->type != CAN_LogFrame_RX)&&
       (message->type != CAN_LogFrame_TX))
     {
-    return std::string("");
+    return 0;
     }
+  size_t len = 12 + message->frame.FIR.B.DLC;
+  if (cap < len) return 0;
 
   char busnumber = (message->origin != NULL)?message->origin->m_busnumber:0;
 
@@ -210,7 +211,8 @@ std::string canformat_gvret_binary::get(CAN_log_message_t* message)
   frame.lenbus = message->frame.FIR.B.DLC + (busnumber<<4);
   for (int k=0; k<message->frame.FIR.B.DLC; k++)
     frame.data[k] = message->frame.data.u8[k];
-  return std::string((const char*)&frame,12 + message->frame.FIR.B.DLC);
+  memcpy(out, &frame, len);
+  return len;
   }
 
 std::string canformat_gvret_binary::getheader(struct timeval *time)
@@ -168,7 +168,8 @@ class canformat_gvret : public canformat
     virtual ~canformat_gvret();
 
   public:
-    virtual std::string get(CAN_log_message_t* message);
+    using canformat::get;
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
     virtual std::string getheader(struct timeval *time);
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
   };
@@ -177,7 +178,8 @@ class canformat_gvret_ascii : public canformat_gvret
   {
   public:
     canformat_gvret_ascii(const char* type);
-    virtual std::string get(CAN_log_message_t* message);
+    using canformat::get;
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
   };
 
@@ -185,7 +187,8 @@ class canformat_gvret_binary : public canformat_gvret
   {
   public:
     canformat_gvret_binary(const char* type);
-    virtual std::string get(CAN_log_message_t* message);
+    using canformat::get;
+    virtual size_t get(CAN_log_message_t* message, uint8_t* out, size_t cap);
     virtual std::string getheader(struct timeval *time);
     virtual size_t put(CAN_log_message_t* message, uint8_t *buffer, size_t len, bool* hasmore, canlogconnection* clc=NULL);
 
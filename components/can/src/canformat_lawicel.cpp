@@ -60,14 +60,15 @@ canformat_lawicel::~canformat_lawicel()
   {
   }
 
-std::string canformat_lawicel::get(CAN_log_message_t* message)
+size_t canformat_lawicel::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
-  char buf[CANFORMAT_LAWICEL_MAXLEN];
+  if (cap < CANFORMAT_LAWICEL_MAXLEN) return 0;
+  char *buf = (char*)out;
 
   if ((message->type != CAN_LogFrame_RX)&&
       (message->type != CAN_LogFrame_TX))
     {
-    return std::string("");
+    return 0;
     }
 
   if (message->frame.FIR.B.FF == CAN_frame_std)
@@ -84,7 +85,7 @@ std::string canformat_lawicel::get(CAN_log_message_t* message)
   sprintf(buf+strlen(buf),"%04lx", message->timestamp.tv_usec/1000);
 
   strcat(buf,"\n");
-  return std::string(buf);
+  return strlen(buf);
   }
 
 std::string canformat_lawicel::getheader(struct timeval *time)
@@ -149,7 +150,7 @@ size_t canformat_lawicel::put(CAN_log_message_t* message, uint8_t *buffer, size_
     for (size_t x=0;x<message->frame.FIR.B.DLC;x++)
       {
       hex[0] = b[0];
-      hex[1] = b[2];
+      hex[1] = b[1];
       hex[2] = 0;
       b += 2;
       message->frame.data.u8[x] = (uint8_t)strtol(hex,NULL,16);
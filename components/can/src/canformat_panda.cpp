@@ -54,7 +54,7 @@ canformat_panda::~canformat_panda()
   {
   }
 
-std::string canformat_panda::get(CAN_log_message_t* message)
+size_t canformat_panda::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
   struct
     {
@@ -70,10 +70,12 @@ std::string canformat_panda::get(CAN_log_message_t* message)
       packet.w1 = (uint32_t)message->frame.MsgID <<21;
       packet.w2 = (message->frame.FIR.B.DLC & 0x0f) | (message->origin->m_busnumber << 4);
       memcpy(&packet.data, message->frame.data.u8, 8);
-      return std::string((char*)&packet,sizeof(packet));
+      if (cap < sizeof(packet)) return 0;
+      memcpy(out, &packet, sizeof(packet));
+      return sizeof(packet);
 
     default:
-      return std::string("");
+      return 0;
     }
   }
 
@@ -53,13 +53,13 @@ canformat_pcap::~canformat_pcap()
   {
   }
 
-std::string canformat_pcap::get(CAN_log_message_t* message)
+size_t canformat_pcap::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
   pcaprec_can_t m;
 
-  if (message->type != CAN_LogFrame_RX)
+  if ((message->type != CAN_LogFrame_RX) || (cap < sizeof(m)))
     {
-    return std::string("");
+    return 0;
     }
 
   memset(&m,0,sizeof(m));
@@ -77,7 +77,8 @@ std::string canformat_pcap::get(CAN_log_message_t* message)
 
   memcpy(m.data, message->frame.data.u8, message->frame.FIR.B.DLC);
 
-  return std::string((const char*)&m, sizeof(m));
+  memcpy(out, &m, sizeof(m));
+  return sizeof(m);
   }
 
 std::string canformat_pcap::getheader(struct timeval *time)
@@ -150,7 +151,14 @@ size_t canformat_pcap::put(CAN_log_message_t* message, uint8_t *buffer, size_t l
     // Just ignore it
     return consumed;
     }
+  if (m.record.phdr.len > 8)
+    {
+    // Invalid payload length (damaged data): ignore it
+    return consumed;
+    }
   message->type = CAN_LogFrame_RX;
+  message->timestamp.tv_sec = be32toh(m.record.hdr.ts_sec);
+  message->timestamp.tv_usec = be32toh(m.record.hdr.ts_usec);
   message->frame.FIR.B.RTR = (idf & CANFORMAT_PCAP_FL_RTR)?CAN_RTR:CAN_no_RTR;
   message->frame.FIR.B.FF = (idf & CANFORMAT_PCAP_FL_EXT)?CAN_frame_ext:CAN_frame_std;
   message->frame.MsgID = idf & CANFORMAT_PCAP_FL_MASK;
@@ -53,12 +53,14 @@ canformat_raw::~canformat_raw()
   {
   }
 
-std::string canformat_raw::get(CAN_log_message_t* message)
+size_t canformat_raw::get(CAN_log_message_t* message, uint8_t* out, size_t cap)
   {
   CAN_log_message_t raw;
+  if (cap < sizeof(raw)) return 0;
   memcpy(&raw,message,sizeof(raw));
-  raw.origin = (canbus*)raw.origin->m_busnumber;
-  return std::string((const char*)&raw,sizeof(CAN_log_message_t));
+  raw.origin = (canbus*)(intptr_t)raw.origin->m_busnumber;
+  memcpy(out, &raw, sizeof(raw));
+  return sizeof(raw);
   }
 
 std::string canformat_raw::getheader(struct timeval *time)
@@ -77,6 +79,6 @@ size_t canformat_raw::put(CAN_log_message_t* message, uint8_t *buffer, size_t le
 
   *hasmore = true;  // Call us again to see if we have more frames to process
   m_buf.Pop(sizeof(CAN_log_message_t), (uint8_t*)message);
-  message->origin = can::instance(TAG).GetBus((int)message->origin);
+  message->origin = can::instance(TAG).GetBus((int)(intptr_t)message->origin);
   return consumed;
   }
@@ -35,6 +35,8 @@ static const char *TAG = "canlog";
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include "ovms_utils.h"
 #include "ovms_config.h"
 #include "ovms_command.h"
@@ -100,7 +102,7 @@ void can_log_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
           canlogconnection* clc = it->second;
           writer->printf("  %s: %s %s%s%s\n",
             clc->GetSummary().c_str(),
-            (clc->m_ispaused)?"paused":"running",
+            (clc->m_ispaused)?"paused":(clc->m_stalled)?"stalled":"running",
             (clc->m_filters != NULL)?" filter:":"",
             (clc->m_filters != NULL)?clc->m_filters->Info().c_str():"",
             clc->GetStats().c_str());
@@ -134,7 +136,7 @@ void can_log_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
           canlogconnection* clc = it->second;
           writer->printf("  %s: %s %s%s%s\n",
             clc->GetSummary().c_str(),
-            (clc->m_ispaused)?"paused":"running",
+            (clc->m_ispaused)?"paused":(clc->m_stalled)?"stalled":"running",
             (clc->m_filters != NULL)?" filter:":"",
             (clc->m_filters != NULL)?clc->m_filters->Info().c_str():"",
             clc->GetStats().c_str());
@@ -191,6 +193,145 @@ OvmsCanLogInit::OvmsCanLogInit()
   cmd_canlog->RegisterCommand("start", "CAN logging start framework");
   }
 
+////////////////////////////////////////////////////////////////////////
+// CAN Logger Connection Backlog class
+////////////////////////////////////////////////////////////////////////
+
+typedef struct
+  {
+  uint16_t len;                         // data length
+  uint16_t msgs;                        // messages contained
+  uint32_t time;                        // enqueue time [ms]
+  } canlog_backlog_chunk_t;
+
+canlogbacklog::canlogbacklog(size_t size)
+  {
+  m_buf = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+  if (!m_buf)
+    m_buf = (uint8_t*)malloc(size);
+  m_size = (m_buf) ? size : 0;
+  m_head = 0;
+  m_tail = 0;
+  m_used = 0;
+  m_dropchunks = 0;
+  }
+
+canlogbacklog::~canlogbacklog()
+  {
+  if (m_buf)
+    {
+    free(m_buf);
+    m_buf = NULL;
+    }
+  }
+
+void canlogbacklog::Write(size_t pos, const void* src, size_t len)
+  {
+  size_t n = MIN(len, m_size - pos);
+  memcpy(m_buf + pos, src, n);
+  if (n < len)
+    memcpy(m_buf, (const uint8_t*)src + n, len - n);
+  }
+
+void canlogbacklog::Read(size_t pos, void* dst, size_t len)
+  {
+  size_t n = MIN(len, m_size - pos);
+  memcpy(dst, m_buf + pos, n);
+  if (n < len)
+    memcpy((uint8_t*)dst + n, m_buf, len - n);
+  }
+
+/**
+ * Put: add a chunk, optionally dropping the oldest chunks to make room.
+ *  Returns false if the chunk has not been added.
+ */
+bool canlogbacklog::Put(const uint8_t* data, size_t len, uint32_t msgs, bool dropoldest, uint32_t* droppedmsgs)
+  {
+  size_t need = sizeof(canlog_backlog_chunk_t) + len;
+  if (len == 0 || len > UINT16_MAX || need > m_size)
+    return false;
+
+  canlog_backlog_chunk_t chunk;
+  while (m_size - m_used < need)
+    {
+    if (!dropoldest)
+      return false;
+    Read(m_tail, &chunk, sizeof(chunk));
+    *droppedmsgs += chunk.msgs;
+    m_dropchunks++;
+    Pop();
+    }
+
+  chunk.len = len;
+  chunk.msgs = MIN(msgs, UINT16_MAX);
+  chunk.time = esp_timer_get_time() / 1000;
+  Write(m_head, &chunk, sizeof(chunk));
+  Write((m_head + sizeof(chunk)) % m_size, data, len);
+  m_head = (m_head + need) % m_size;
+  m_used += need;
+  return true;
+  }
+
+/**
+ * Peek: get the oldest chunk, data may wrap around the buffer end
+ *  (len2 > 0). Returns false if the backlog is empty.
+ */
+bool canlogbacklog::Peek(const uint8_t** data1, size_t* len1, const uint8_t** data2, size_t* len2)
+  {
+  if (m_used == 0)
+    return false;
+  canlog_backlog_chunk_t chunk;
+  Read(m_tail, &chunk, sizeof(chunk));
+  size_t pos = (m_tail + sizeof(chunk)) % m_size;
+  *data1 = m_buf + pos;
+  *len1 = MIN((size_t)chunk.len, m_size - pos);
+  *data2 = m_buf;
+  *len2 = chunk.len - *len1;
+  return true;
+  }
+
+/**
+ * Pop: remove the oldest chunk
+ */
+void canlogbacklog::Pop()
+  {
+  if (m_used == 0)
+    return;
+  canlog_backlog_chunk_t chunk;
+  Read(m_tail, &chunk, sizeof(chunk));
+  size_t len = sizeof(chunk) + chunk.len;
+  m_tail = (m_tail + len) % m_size;
+  m_used -= len;
+  }
+
+/**
+ * Clear: drop all chunks
+ */
+void canlogbacklog::Clear(uint32_t* droppedmsgs)
+  {
+  canlog_backlog_chunk_t chunk;
+  while (m_used > 0)
+    {
+    Read(m_tail, &chunk, sizeof(chunk));
+    *droppedmsgs += chunk.msgs;
+    m_dropchunks++;
+    Pop();
+    }
+  }
+
+/**
+ * Lag: age of the oldest chunk [ms]
+ */
+uint32_t canlogbacklog::Lag()
+  {
+  if (m_used == 0)
+    return 0;
+  canlog_backlog_chunk_t chunk;
+  Read(m_tail, &chunk, sizeof(chunk));
+  return (uint32_t)(esp_timer_get_time() / 1000) - chunk.time;
+  }
+
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Logger Connection class
 ////////////////////////////////////////////////////////////////////////
@@ -201,6 +342,16 @@ canlogconnection::canlogconnection(canlog* logger, std::string format, canformat
   m_logger = logger;
   m_formatter = OvmsCanFormatFactory::instance(TAG).NewFormat(format.c_str());
   m_formatter->SetServeMode(mode);
+  m_lz = NULL;
+  if (canlz::HasSuffix(format))
+    {
+    m_lz = new canlz();
+    if (!m_lz->IsValid())
+      {
+      delete m_lz;
+      m_lz = NULL;
+      }
+    }
   m_nc = NULL;
   m_ispaused = false;
   m_filters = NULL;
@@ -208,10 +359,35 @@ canlogconnection::canlogconnection(canlog* logger, std::string format, canformat
   m_dropcount = 0;
   m_discardcount = 0;
   m_filtercount = 0;
+  m_resyncs = 0;
+  m_sendbuf = NULL;
+  m_sendsize = 0;
+  m_sendlen = 0;
+  m_sendmsgs = 0;
+  m_outcount = 0;
+  m_packetcount = 0;
+  m_sentbytes = 0;
+  m_starttime = esp_timer_get_time();
+  m_backlog = NULL;
+  m_backlogpolicy = CANLOG_BACKLOG_DROPNEWEST;
+  m_stalled = false;
+  m_stallcount = 0;
+  m_lagmax = 0;
+  m_drainedbytes = 0;
   }
 
 canlogconnection::~canlogconnection()
   {
+  if (m_sendbuf != NULL)
+    {
+    free(m_sendbuf);
+    m_sendbuf = NULL;
+    }
+  if (m_backlog != NULL)
+    {
+    delete m_backlog;
+    m_backlog = NULL;
+    }
   if (m_filters != NULL)
     {
     delete m_filters;
@@ -222,9 +398,14 @@ canlogconnection::~canlogconnection()
     delete m_formatter;
     m_formatter = NULL;
     }
+  if (m_lz != NULL)
+    {
+    delete m_lz;
+    m_lz = NULL;
+    }
   }
 
-void canlogconnection::OutputMsg(CAN_log_message_t& msg, std::string &result)
+void canlogconnection::OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len)
   {
   m_msgcount++;
 
@@ -234,31 +415,280 @@ void canlogconnection::OutputMsg(CAN_log_message_t& msg, std::string &result)
     return;
     }
 
+  len = Format(msg, &data, len);
+  if (len>0)
+    {
+    m_outcount++;
+    if (!Output(data, len))
+      m_dropcount++;
+    else if (m_sendlen > 0)
+      m_sendmsgs++;
+    }
+  }
+
+/**
+ * Format: stateful formats (see canformat::IsStateful()) are encoded per
+ *  connection, as connections skip messages independently (filters,
+ *  pauses, dropped output). The logger passes data NULL for these, the
+ *  message is then encoded by the connection's formatter into the logger's
+ *  output buffer. Returns the record length.
+ */
+size_t canlogconnection::Format(CAN_log_message_t& msg, const uint8_t** data, size_t len)
+  {
+  if (*data != NULL)
+    return len;
+  *data = m_logger->m_outbuf;
+  return m_formatter->get(&msg, m_logger->m_outbuf, sizeof(m_logger->m_outbuf));
+  }
+
+/**
+ * Output: pass formatted log data through the compression stage (if any)
+ *  to OutputData(). Returns false if data was dropped.
+ */
+bool canlogconnection::Output(const uint8_t* data, size_t len)
+  {
+  if (m_lz == NULL)
+    {
+    if (OutputData(data, len))
+      return true;
+    OutputLost();
+    return false;
+    }
+
+  // On lost output, a stateful record cannot follow the gap (see OutputLost()):
+  bool ok = true;
+  const uint8_t* block;
+  size_t blocklen;
+  if (m_lz->IsAged(esp_timer_get_time()))
+    {
+    blocklen = m_lz->Flush(&block);
+    if (!OutputData(block, blocklen))
+      {
+      ok = false;
+      if (OutputLost())
+        return false;
+      }
+    }
+  while (len > 0)
+    {
+    size_t n = m_lz->Add(data, len);
+    data += n;
+    len -= n;
+    if (len > 0 || m_lz->IsFull())
+      {
+      blocklen = m_lz->Flush(&block);
+      if (blocklen > 0 && !OutputData(block, blocklen))
+        {
+        ok = false;
+        if (OutputLost())
+          return false;
+        }
+      }
+    }
+  return ok;
+  }
+
+/**
+ * OutputLost: output data has been dropped. Records of stateful formats
+ *  depend on the preceding ones, so the output pending after the lost data
+ *  is discarded and the stream restarts with a sync point. Returns true in
+ *  this case.
+ */
+bool canlogconnection::OutputLost()
+  {
+  if (!m_formatter->IsStateful())
+    return false;
+  if (m_lz != NULL)
+    m_lz->Discard();
+  m_formatter->Resync();
+  m_resyncs++;
+  return true;
+  }
+
+/**
+ * FlushOutput: output pending compressed data, if forced or aged,
+ *  and send buffered data
+ */
+void canlogconnection::FlushOutput(bool force)
+  {
+  if (m_lz != NULL && (force || m_lz->IsAged(esp_timer_get_time())))
+    {
+    const uint8_t* block;
+    size_t blocklen = m_lz->Flush(&block);
+    if (blocklen > 0 && !OutputData(block, blocklen))
+      {
+      m_dropcount++;
+      OutputLost();
+      }
+    }
+  FlushSend();
+  }
+
+/**
+ * SetSendBuffer: enable coalescing of output data into packets of up to
+ *  size bytes (0 = disable). Buffered data is sent by FlushSend(), which
+ *  the logger calls at the end of each output batch, or when the next
+ *  output would not fit.
+ */
+void canlogconnection::SetSendBuffer(size_t size)
+  {
+  FlushSend();
+  if (m_sendbuf != NULL)
+    {
+    free(m_sendbuf);
+    m_sendbuf = NULL;
+    }
+  m_sendsize = 0;
+  if (size > 0)
+    {
+    m_sendbuf = (uint8_t*)malloc(size);
+    if (m_sendbuf != NULL)
+      m_sendsize = size;
+    else
+      ESP_LOGW(TAG, "SetSendBuffer: no memory for %u bytes, output unbuffered", (unsigned)size);
+    }
+  }
+
+/**
+ * FlushSend: send the buffered output data
+ */
+void canlogconnection::FlushSend()
+  {
+  if (m_sendlen == 0)
+    return;
+  if (!Send(m_sendbuf, m_sendlen))
+    {
+    m_dropcount += m_sendmsgs;
+    OutputLost();
+    }
+  m_sendlen = 0;
+  m_sendmsgs = 0;
+  }
+
+bool canlogconnection::OutputData(const uint8_t* data, size_t len)
+  {
+  if (m_sendbuf == NULL || len > m_sendsize)
+    {
+    FlushSend();
+    return Send(data, len);
+    }
+  if (m_sendlen + len > m_sendsize)
+    FlushSend();
+  memcpy(m_sendbuf + m_sendlen, data, len);
+  m_sendlen += len;
+  return true;
+  }
+
+bool canlogconnection::Send(const uint8_t* data, size_t len)
+  {
+  if (!SendData(data, len))
+    return false;
+  m_packetcount++;
+  m_sentbytes += len;
+  return true;
+  }
+
+/**
+ * SetBacklog: decouple a network client from the logger task by a
+ *  backlog of size bytes (0 = none, data is passed to mongoose directly).
+ *  The backlog is drained by the network task (Drain()), a slow client
+ *  only fills its own backlog and is handled by the policy when full.
+ */
+void canlogconnection::SetBacklog(size_t size, canlog_backlog_policy_t policy)
+  {
+  if (m_backlog != NULL)
+    {
+    delete m_backlog;
+    m_backlog = NULL;
+    }
+  m_backlogpolicy = policy;
+  m_stalled = false;
+  if (size > 0)
+    {
+    m_backlog = new canlogbacklog(size);
+    if (!m_backlog->IsValid())
+      {
+      ESP_LOGW(TAG, "SetBacklog: no memory for %u bytes, output unbuffered", (unsigned)size);
+      delete m_backlog;
+      m_backlog = NULL;
+      }
+    }
+  }
+
+/**
+ * Drain: pass backlog chunks to the network connection while its send
+ *  buffer is below CANLOG_BACKLOG_NETBUF. Called by the network task on
+ *  poll and send events, with the logger's m_cmmutex held.
+ */
+void canlogconnection::Drain()
+  {
 #ifdef CONFIG_OVMS_SC_GPL_MONGOOSE
+  if (m_backlog == NULL || m_nc == NULL)
+    return;
+
+  const uint8_t *data1, *data2;
+  size_t len1, len2;
+#if MG_VERSION_NUMBER >= MG_VERSION_VAL(7, 0, 0)
+  while (m_nc->send.len < CANLOG_BACKLOG_NETBUF
+#else /* MG_VERSION_NUMBER */
+  while (m_nc->send_mbuf.len < CANLOG_BACKLOG_NETBUF
+#endif /* MG_VERSION_NUMBER */
+    && m_backlog->Peek(&data1, &len1, &data2, &len2))
+    {
+    uint32_t lag = m_backlog->Lag();
+    if (lag > m_lagmax) m_lagmax = lag;
+    mg_send(m_nc, (const char*)data1, len1);
+    if (len2 > 0)
+      mg_send(m_nc, (const char*)data2, len2);
+    m_drainedbytes += len1 + len2;
+    m_backlog->Pop();
+    }
+
+  if (m_stalled && m_backlog->Used() <= m_backlog->Size() / 2)
+    m_stalled = false;
+#endif // CONFIG_OVMS_SC_GPL_MONGOOSE
+  }
+
+bool canlogconnection::SendData(const uint8_t* data, size_t len)
+  {
+#ifdef CONFIG_OVMS_SC_GPL_MONGOOSE
+  if (m_backlog != NULL)
+    {
+    uint32_t dropped = 0;
+    bool dropoldest = (m_backlogpolicy == CANLOG_BACKLOG_DROPOLDEST);
+    bool stateful = m_formatter->IsStateful();
+    bool ok = m_backlog->Put(data, len, MAX(m_sendmsgs, 1), dropoldest && !stateful, &dropped);
+    if (!ok && dropoldest && stateful)
+      {
+      // All queued chunks and the new one depend on the oldest, drop
+      // them all. The caller counts the new chunk as dropped and
+      // restarts the stream on our failure:
+      m_backlog->Clear(&dropped);
+      m_backlog->m_dropchunks++;
+      }
+    m_dropcount += dropped;
+    if (!ok && m_backlogpolicy == CANLOG_BACKLOG_PAUSE && !m_stalled)
+      {
+      m_stalled = true;
+      m_stallcount++;
+      }
+    return ok;
+    }
   // The standard base implemention here is for mongoose network connections
   if (m_nc != NULL)
     {
-    if (result.length()>0)
-      {
 #if MG_VERSION_NUMBER >= MG_VERSION_VAL(7, 0, 0)
-      if (m_nc->send.len < 32768)
+    if (m_nc->send.len < 32768)
 #else /* MG_VERSION_NUMBER */
-      if (m_nc->send_mbuf.len < 32768)
+    if (m_nc->send_mbuf.len < 32768)
 #endif /* MG_VERSION_NUMBER */
-        {
-        mg_send(m_nc, (const char*)result.c_str(), result.length());
-        }
-      else
-        {
-        m_dropcount++;
-        }
+      {
+      mg_send(m_nc, (const char*)data, len);
+      return true;
       }
     }
-  else
 #endif // CONFIG_OVMS_SC_GPL_MONGOOSE
-    {
-    m_dropcount++;
-    }
+  return false;
   }
 
 void canlogconnection::TransmitCallback(uint8_t *buffer, size_t len)
@@ -336,6 +766,30 @@ std::string canlogconnection::GetStats()
     << " Dropped:" << m_dropcount
     << " Filtered:" << m_filtercount
     << " Rate:" << std::fixed << std::setprecision(1) << droprate << "%";
+  if (m_packetcount > 0)
+    {
+    int64_t elapsed = esp_timer_get_time() - m_starttime;
+    float bps = (elapsed > 0) ? ((float) m_sentbytes * 1000000 / elapsed) : 0;
+    buf << " Sent:" << m_sentbytes
+      << " Packets:" << m_packetcount
+      << " Msgs/packet:" << std::setprecision(1) << ((float) m_outcount / m_packetcount)
+      << " Bytes/s:" << std::setprecision(0) << bps;
+    }
+  if (m_backlog)
+    {
+    int64_t elapsed = esp_timer_get_time() - m_starttime;
+    float bps = (elapsed > 0) ? ((float) m_drainedbytes * 1000000 / elapsed) : 0;
+    buf << " Backlog:" << m_backlog->Used() << "/" << m_backlog->Size()
+      << " Lag:" << m_backlog->Lag() << "ms"
+      << " Lagmax:" << m_lagmax << "ms"
+      << " Dropchunks:" << m_backlog->m_dropchunks
+      << " Stalls:" << m_stallcount
+      << " Tx:" << std::setprecision(0) << bps << "B/s";
+    }
+  if (m_resyncs)
+    buf << " Resyncs:" << m_resyncs;
+  if (m_lz)
+    buf << " " << m_lz->GetStats();
 
   return buf.str();
   }
@@ -346,13 +800,14 @@ std::string canlogconnection::GetStats()
 ////////////////////////////////////////////////////////////////////////
 
 canlog::canlog(const char* type, std::string format, canformat::canformat_serve_mode_t mode)
-  : m_events_filters(TAG), m_metrics_filters(TAG)
+  : m_ringreader(type, CAN_RING_ALL), m_events_filters(TAG), m_metrics_filters(TAG)
   {
   m_type = type;
   m_format = format;
   m_mode = mode;
   m_formatter = OvmsCanFormatFactory::instance(TAG).NewFormat(format.c_str());
   m_formatter->SetServeMode(mode);
+  m_compressed = canlz::HasSuffix(format);
   m_filter = NULL;
   m_isopen = false;
 
@@ -367,9 +822,21 @@ canlog::canlog(const char* type, std::string format, canformat::canformat_serve_
   OvmsEvents::instance(TAG).RegisterEvent(IDTAG,"config.changed", std::bind(&canlog::UpdatedConfig, this, _1, _2));
   OvmsMetrics::instance(TAG).RegisterListener(IDTAG, "*", std::bind(&canlog::MetricListener, this, _1));
 
-  int queuesize = OvmsConfig::instance(TAG).GetParamValueInt(CAN_PARAM, "log.queuesize",100);
+  int queuesize = OvmsConfig::instance(TAG).GetParamValueInt(CAN_PARAM, "log.queuesize",400);
+  m_batchsize = MAX(1, OvmsConfig::instance(TAG).GetParamValueInt(CAN_PARAM, "log.batch.size", 32));
+  m_batchtime = MAX(0, OvmsConfig::instance(TAG).GetParamValueInt(CAN_PARAM, "log.batch.time", 20));
+  m_backlogsize = MAX(0, OvmsConfig::instance(TAG).GetParamValueInt(CAN_PARAM, "log.backlog", 32)) * 1024;
+  std::string policy = OvmsConfig::instance(TAG).GetParamValue(CAN_PARAM, "log.backlog.policy", "dropnewest");
+  if (policy == "dropoldest")
+    m_backlogpolicy = CANLOG_BACKLOG_DROPOLDEST;
+  else if (policy == "pause")
+    m_backlogpolicy = CANLOG_BACKLOG_PAUSE;
+  else
+    m_backlogpolicy = CANLOG_BACKLOG_DROPNEWEST;
   LoadConfig();
-  m_queue = xQueueCreate(queuesize, sizeof(CAN_log_message_t));
+  m_queue = xQueueCreate(queuesize, sizeof(CAN_log_message_t*));
+  if (!m_ringreader.Attach())
+    ESP_LOGE(TAG, "Cannot attach to the CAN frame ring, no frames will be logged");
   xTaskCreatePinnedToCore(RxTask, "OVMS CanLog", 4096, (void*)this, 10, &m_task, CORE(1));
   }
 
@@ -386,25 +853,17 @@ canlog::~canlog()
     vTaskDelete(t);
     }
 
+  m_ringreader.Detach();
+
   if (m_queue)
     {
     QueueHandle_t q = m_queue;
     m_queue = NULL;
 
-    CAN_log_message_t msg;
+    CAN_log_message_t* msg;
     while (xQueueReceive(q, &msg, 0) == pdTRUE)
       {
-      switch (msg.type)
-        {
-        case CAN_LogInfo_Comment:
-        case CAN_LogInfo_Config:
-        case CAN_LogInfo_Event:
-        case CAN_LogInfo_Metric:
-          free(msg.text);
-          break;
-        default:
-          break;
-        }
+      FreeMsg(msg);
       }
     vQueueDelete(q);
     }
@@ -425,25 +884,63 @@ canlog::~canlog()
 void canlog::RxTask(void *context)
   {
   canlog* me = (canlog*) context;
-  CAN_log_message_t msg;
+  CAN_log_message_t* msg;
+  CAN_log_message_t* entry;
+  int64_t lastflush = 0;
+  int64_t batchstart = 0;
+  int batchcount = 0;
   while (1)
     {
-    if (xQueueReceive(me->m_queue, &msg, (portTickType)portMAX_DELAY) == pdTRUE)
+    // Frames from the CAN frame ring (Read() also returns on Signal()).
+    // An open batch waits at most until its age limit, compressed logs
+    // need to flush aged data when idle:
+    TickType_t wait = me->m_compressed ? pdMS_TO_TICKS(CANLZ_MAXAGE/4000) : portMAX_DELAY;
+    if (batchcount > 0)
+      {
+      int64_t remain = (int64_t)me->m_batchtime*1000 - (esp_timer_get_time() - batchstart);
+      wait = (remain > 0) ? pdMS_TO_TICKS(remain/1000) + 1 : 0;
+      }
+    entry = me->m_ringreader.Read(wait);
+    if (me->m_compressed && me->IsOpen())
       {
-      switch (msg.type)
+      int64_t now = esp_timer_get_time();
+      if (now - lastflush >= CANLZ_MAXAGE/4)
         {
-        case CAN_LogInfo_Comment:
-        case CAN_LogInfo_Config:
-        case CAN_LogInfo_Event:
-        case CAN_LogInfo_Metric:
-          me->OutputMsg(msg);
-          free(msg.text);
-          break;
-        default:
-          me->OutputMsg(msg);
-          break;
+        me->FlushOutput(false);
+        lastflush = now;
         }
       }
+    if (entry && me->IsOpen())
+      {
+      if ((me->m_filter == NULL)||(me->m_filter->IsFiltered(&entry->frame)))
+        {
+        me->m_msgcount++;
+        me->OutputMsg(*entry);
+        if (batchcount++ == 0)
+          batchstart = esp_timer_get_time();
+        }
+      else
+        {
+        me->m_filtercount++;
+        }
+      }
+
+    // Status & info messages:
+    while (xQueueReceive(me->m_queue, &msg, 0) == pdTRUE)
+      {
+      me->OutputMsg(*msg);
+      FreeMsg(msg);
+      if (batchcount++ == 0)
+        batchstart = esp_timer_get_time();
+      }
+
+    // Send the batch when full or aged:
+    if (batchcount > 0 && (batchcount >= me->m_batchsize ||
+        esp_timer_get_time() - batchstart >= (int64_t)me->m_batchtime*1000))
+      {
+      me->FlushSend();
+      batchcount = 0;
+      }
     }
   }
 
@@ -536,22 +1033,50 @@ void canlog::OutputMsg(CAN_log_message_t& msg)
     return;
     }
 
-  std::string result = m_formatter->get(&msg);
-  if (result.length()>0)
+  // Formatters write into the logger's output buffer, so the message is
+  // formatted once without heap allocation and shared by all connections.
+  // Stateful formats are encoded by the connections (see Format()).
+  // OutputMsg is only called from the logger task, so no locking is needed.
+  const uint8_t* data = NULL;
+  size_t len = 0;
+  if (!m_formatter->IsStateful())
     {
-    OvmsRecMutexLock lock(&m_cmmutex);
-    for (conn_map_t::iterator it=m_connmap.begin(); it!=m_connmap.end(); ++it)
+    len = m_formatter->get(&msg, m_outbuf, sizeof(m_outbuf));
+    if (len == 0)
+      return;
+    data = m_outbuf;
+    }
+
+  OvmsRecMutexLock lock(&m_cmmutex);
+  for (conn_map_t::iterator it=m_connmap.begin(); it!=m_connmap.end(); ++it)
+    {
+    if (it->second->m_ispaused || it->second->m_stalled)
       {
-      if (it->second->m_ispaused)
-        {
-        it->second->m_msgcount++;
-        it->second->m_discardcount++;
-        }
-      else
-        {
-        it->second->OutputMsg(msg, result);
-        }
+      it->second->m_msgcount++;
+      it->second->m_discardcount++;
       }
+    else
+      {
+      it->second->OutputMsg(msg, data, len);
+      }
+    }
+  }
+
+void canlog::FlushOutput(bool force)
+  {
+  OvmsRecMutexLock lock(&m_cmmutex);
+  for (conn_map_t::iterator it=m_connmap.begin(); it!=m_connmap.end(); ++it)
+    {
+    it->second->FlushOutput(force);
+    }
+  }
+
+void canlog::FlushSend()
+  {
+  OvmsRecMutexLock lock(&m_cmmutex);
+  for (conn_map_t::iterator it=m_connmap.begin(); it!=m_connmap.end(); ++it)
+    {
+    it->second->FlushSend();
     }
   }
 
@@ -588,11 +1113,12 @@ std::string canlog::GetStats()
   {
   std::ostringstream buf;
 
-  float droprate = (m_msgcount > 0) ? ((float) m_dropcount/m_msgcount*100) : 0;
-  uint32_t waiting = uxQueueMessagesWaiting(m_queue);
+  uint32_t dropcount = m_dropcount + m_ringreader.m_overflowcount;
+  float droprate = (m_msgcount > 0) ? ((float) dropcount/m_msgcount*100) : 0;
+  uint32_t waiting = uxQueueMessagesWaiting(m_queue) + m_ringreader.Pending();
 
   buf << "Messages:" << m_msgcount
-    << " Dropped:" << m_dropcount
+    << " Dropped:" << dropcount
     << " Filtered:" << m_filtercount
     << " Rate:" << std::fixed << std::setprecision(1) << droprate << "%";
 
@@ -620,24 +1146,37 @@ void canlog::ClearFilter()
     }
   }
 
-void canlog::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame)
+/**
+ * Status & info messages take the slow path: they are allocated on the
+ *  heap and queued by pointer, frames normally arrive via the frame ring.
+ */
+bool canlog::QueueMsg(CAN_log_message_t* msg)
   {
-  if (!IsOpen() || !bus || !frame) return;
-
-  if (((m_filter == NULL)||(m_filter->IsFiltered(frame)))&&(m_queue))
+  m_msgcount++;
+  if (xQueueSend(m_queue, &msg, 0) != pdTRUE)
     {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    memcpy(&msg.frame,frame,sizeof(CAN_frame_t));
-    msg.frame.origin = bus;
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
+    m_dropcount++;
+    FreeMsg(msg);
+    return false;
     }
-  else
+  m_ringreader.Signal();
+  return true;
+  }
+
+void canlog::FreeMsg(CAN_log_message_t* msg)
+  {
+  switch (msg->type)
     {
-    m_filtercount++;
+    case CAN_LogInfo_Comment:
+    case CAN_LogInfo_Config:
+    case CAN_LogInfo_Event:
+    case CAN_LogInfo_Metric:
+      free(msg->text);
+      break;
+    default:
+      break;
     }
+  free(msg);
   }
 
 void canlog::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status)
@@ -646,13 +1185,17 @@ void canlog::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* sta
 
   if (((m_filter == NULL)||(m_filter->IsFiltered(bus)))&&(m_queue))
     {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    msg.origin = bus;
-    memcpy(&msg.status,status,sizeof(CAN_status_t));
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
+    CAN_log_message_t* msg = (CAN_log_message_t*)malloc(sizeof(CAN_log_message_t));
+    if (!msg)
+      {
+      m_dropcount++;
+      return;
+      }
+    msg->type = type;
+    CAN_wallclock(&msg->timestamp);
+    msg->origin = bus;
+    memcpy(&msg->status,status,sizeof(CAN_status_t));
+    QueueMsg(msg);
     }
   else
     {
@@ -666,17 +1209,17 @@ void canlog::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
 
   if (((m_filter == NULL)||(m_filter->IsFiltered(bus)))&&(m_queue))
     {
-    CAN_log_message_t msg;
-    msg.type = type;
-    gettimeofday(&msg.timestamp,NULL);
-    msg.origin = bus;
-    msg.text = strdup(text);
-    m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE)
+    CAN_log_message_t* msg = (CAN_log_message_t*)malloc(sizeof(CAN_log_message_t));
+    if (!msg)
       {
       m_dropcount++;
-      free(msg.text);
+      return;
       }
+    msg->type = type;
+    CAN_wallclock(&msg->timestamp);
+    msg->origin = bus;
+    msg->text = strdup(text);
+    QueueMsg(msg);
     }
   else
     {
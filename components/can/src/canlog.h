@@ -30,6 +30,7 @@
 #include "freertos/semphr.h"
 #include "can.h"
 #include "canformat.h"
+#include "canlz.h"
 #include <sdkconfig.h>
 #ifdef CONFIG_OVMS_SC_GPL_MONGOOSE
 #include "ovms_netmanager.h"
@@ -38,6 +39,59 @@
 #include "id_filter.h"
 // #include "mg_version.h"
 
+// Send buffer sizes for network connections (see SetSendBuffer()):
+#define CANLOG_SENDBUF_STREAM   4096    // TCP: large writes
+#define CANLOG_SENDBUF_DGRAM    1400    // UDP: datagram fits the path MTU
+
+// Network buffer fill level up to which the backlog is drained:
+#define CANLOG_BACKLOG_NETBUF   8192
+
+typedef enum
+  {
+  CANLOG_BACKLOG_DROPNEWEST = 0,        // discard new data when full
+  CANLOG_BACKLOG_DROPOLDEST,            // discard oldest data to make room
+  CANLOG_BACKLOG_PAUSE                  // pause client until half drained
+  } canlog_backlog_policy_t;
+
+/**
+ * canlogbacklog: bounded byte ring holding the output of a network client
+ *  until the network task takes it over. Data is stored in chunks (one
+ *  send buffer each) with enqueue time and message count, so whole chunks
+ *  can be dropped and the stream stays decodable.
+ *
+ * No locking, the connection owner serializes access (m_cmmutex).
+ */
+class canlogbacklog
+  {
+  public:
+    canlogbacklog(size_t size);
+    ~canlogbacklog();
+
+  public:
+    bool IsValid() { return m_buf != NULL; }
+    size_t Size() { return m_size; }
+    size_t Used() { return m_used; }
+    bool Put(const uint8_t* data, size_t len, uint32_t msgs, bool dropoldest, uint32_t* droppedmsgs);
+    bool Peek(const uint8_t** data1, size_t* len1, const uint8_t** data2, size_t* len2);
+    void Pop();
+    void Clear(uint32_t* droppedmsgs);
+    uint32_t Lag();
+
+  protected:
+    void Write(size_t pos, const void* src, size_t len);
+    void Read(size_t pos, void* dst, size_t len);
+
+  public:
+    uint32_t       m_dropchunks;
+
+  protected:
+    uint8_t*       m_buf;
+    size_t         m_size;
+    size_t         m_head;
+    size_t         m_tail;
+    size_t         m_used;
+  };
+
 /**
  * canlog is the general interface and base implementation for all can loggers.
  *  It provides standard methods to open files and configure message filters
@@ -47,9 +101,13 @@
  *  to the type list & method Instantiate(). See canlog_trace & canlog_crtd
  *  for examples & reference.
  *
- * Log messages are sent to a canlog through a queue handled by a separate
- *  task for the logger, so logging doesn't affect CAN framework speed and
- *  a log can be written/streamed to a slow medium.
+ * Log messages are handled by a separate task for the logger, so logging
+ *  doesn't affect CAN framework speed and a log can be written/streamed to
+ *  a slow medium. Frames are read from the CAN frame ring (compact records),
+ *  status and info messages are heap allocated and queued by pointer.
+ *  Output is done in batches (log.batch.size / log.batch.time), network
+ *  connections coalesce a batch into few large writes or datagrams (see
+ *  canlogconnection::SetSendBuffer()).
  *
  * Log entries can be frames, status or info messages (see CAN_LogEntry_t).
  * The timestamp of the original event is preserved.
@@ -67,7 +125,20 @@ class canlogconnection
     virtual ~canlogconnection();
 
   public:
-    virtual void OutputMsg(CAN_log_message_t& msg, std::string &result);
+    virtual void OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len);
+    size_t Format(CAN_log_message_t& msg, const uint8_t** data, size_t len);
+    bool Output(const uint8_t* data, size_t len);
+    bool OutputLost();
+    virtual bool OutputData(const uint8_t* data, size_t len);
+    virtual void FlushOutput(bool force);
+    void SetSendBuffer(size_t size);
+    void FlushSend();
+    void SetBacklog(size_t size, canlog_backlog_policy_t policy);
+    void Drain();
+
+  protected:
+    bool Send(const uint8_t* data, size_t len);
+    virtual bool SendData(const uint8_t* data, size_t len);
 
   public:
     virtual void TransmitCallback(uint8_t *buffer, size_t len);
@@ -84,6 +155,7 @@ class canlogconnection
   public:
     canlog*        m_logger;
     canformat*     m_formatter;
+    canlz*         m_lz;                // compression stage, NULL = none
 #ifdef CONFIG_OVMS_SC_GPL_MONGOOSE
     mg_connection* m_nc;
 #else
@@ -96,6 +168,25 @@ class canlogconnection
     uint32_t       m_dropcount;
     uint32_t       m_discardcount;
     uint32_t       m_filtercount;
+    uint32_t       m_resyncs;           // stateful format restarts after lost output
+
+  public:
+    uint8_t*       m_sendbuf;           // coalescing send buffer, NULL = unbuffered
+    size_t         m_sendsize;
+    size_t         m_sendlen;
+    uint32_t       m_sendmsgs;          // messages in send buffer
+    uint32_t       m_outcount;          // messages passed to Output()
+    uint32_t       m_packetcount;       // SendData() calls
+    uint64_t       m_sentbytes;
+    int64_t        m_starttime;
+
+  public:
+    canlogbacklog* m_backlog;           // network client backlog, NULL = none
+    canlog_backlog_policy_t m_backlogpolicy;
+    bool           m_stalled;           // paused by backlog policy
+    uint32_t       m_stallcount;
+    uint32_t       m_lagmax;            // max backlog lag [ms]
+    uint64_t       m_drainedbytes;
   };
 
 class canlog 
@@ -121,14 +212,15 @@ class canlog
     virtual bool IsOpen();
     virtual std::string GetInfo();
     virtual void OutputMsg(CAN_log_message_t& msg);
+    virtual void FlushOutput(bool force);
+    virtual void FlushSend();
 
   public:
     virtual void SetFilter(canfilter* filter);
     virtual void ClearFilter();
 
   public:
-    // Logging API:
-    virtual void LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* p_frame);
+    // Logging API (frames are read from the CAN frame ring, see RxTask):
     virtual void LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* status);
     virtual void LogInfo(canbus* bus, CAN_log_type_t type, const char* text);
 
@@ -150,11 +242,22 @@ class canlog
 
   public:
     TaskHandle_t        m_task;
-    QueueHandle_t       m_queue;
+    QueueHandle_t       m_queue;        // status & info messages (pointers)
+    canringreader       m_ringreader;   // frames
     bool                m_isopen;
     uint32_t            m_msgcount;
     uint32_t            m_dropcount;
     uint32_t            m_filtercount;
+    uint8_t             m_outbuf[CANFORMAT_GET_MAXLEN]; // formatter output (logger task)
+    bool                m_compressed;   // format has CANLZ_SUFFIX
+    int                 m_batchsize;    // max messages per output batch
+    int                 m_batchtime;    // max output batch age [ms]
+    size_t              m_backlogsize;  // network client backlog [bytes]
+    canlog_backlog_policy_t m_backlogpolicy;
+
+  protected:
+    bool QueueMsg(CAN_log_message_t* msg);
+    static void FreeMsg(CAN_log_message_t* msg);
 
   protected:
     virtual void UpdatedConfig(std::string event, void* data);
@@ -82,7 +82,7 @@ canlog_monitor_conn::~canlog_monitor_conn()
   {
   }
 
-void canlog_monitor_conn::OutputMsg(CAN_log_message_t& msg, std::string &result)
+void canlog_monitor_conn::OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len)
   {
   m_msgcount++;
 
@@ -92,7 +92,8 @@ void canlog_monitor_conn::OutputMsg(CAN_log_message_t& msg, std::string &result)
     return;
     }
 
-  if (result.length()>0)
+  len = Format(msg, &data, len);
+  if (len>0)
     {
     switch (msg.type)
       {
@@ -100,17 +101,17 @@ void canlog_monitor_conn::OutputMsg(CAN_log_message_t& msg, std::string &result)
       case CAN_LogFrame_TX:
       case CAN_LogFrame_TX_Queue:
       case CAN_LogFrame_TX_Fail:
-        ESP_LOGV(TAG,"%s",result.c_str());
+        ESP_LOGV(TAG,"%.*s",(int)len,(const char*)data);
         break;
       case CAN_LogStatus_Error:
-        ESP_LOGE(TAG,"%s",result.c_str());
+        ESP_LOGE(TAG,"%.*s",(int)len,(const char*)data);
         break;
       case CAN_LogStatus_Statistics:
       case CAN_LogInfo_Comment:
       case CAN_LogInfo_Config:
       case CAN_LogInfo_Event:
       case CAN_LogInfo_Metric:
-        ESP_LOGD(TAG,"%s",result.c_str());
+        ESP_LOGD(TAG,"%.*s",(int)len,(const char*)data);
         break;
       default:
         break;
@@ -138,7 +139,7 @@ bool canlog_monitor::Open()
   m_connmap[NULL] = clc;
   m_isopen = true;
 
-  std::string header = m_formatter->getheader();
+  std::string header = clc->m_formatter->getheader();
   if (header.length()>0)
     { ESP_LOGD(TAG,"%s",header.c_str()); }
 
@@ -38,7 +38,7 @@ class canlog_monitor_conn: public canlogconnection
     virtual ~canlog_monitor_conn();
 
   public:
-    virtual void OutputMsg(CAN_log_message_t& msg, std::string &result);
+    virtual void OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len);
   };
 
 
@@ -91,6 +91,12 @@ OvmsCanLogTcpClientInit::OvmsCanLogTcpClientInit()
           "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
           "Example: 2:2a0-37f",
           1, 9);
+        OvmsCanFormatFactory::instance(TAG).RegisterCompressedCommandSet(discard, "Start compressed CAN logging as TCP client (discard mode)",
+          can_log_tcpclient_start,
+          "<host:port> [filter1] ... [filterN]\n"
+          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Example: 2:2a0-37f",
+          1, 9);
         OvmsCanFormatFactory::instance(TAG).RegisterCommandSet(simulate, "Start CAN logging as TCP client (simulate mode)",
           can_log_tcpclient_start,
           "<host:port> [filter1] ... [filterN]\n"
@@ -243,14 +249,18 @@ void canlog_tcpclient::MongooseHandler(struct mg_connection *nc, int ev, void *p
         ESP_LOGI(TAG, "Connection successful to %s", m_path.c_str());
         canlogconnection* clc = new canlogconnection(this, m_format, m_mode);
         clc->m_nc = nc;
+        clc->SetSendBuffer(CANLOG_SENDBUF_STREAM);
+        clc->SetBacklog(m_backlogsize, m_backlogpolicy);
         clc->m_peer = m_path;
         m_connmap[nc] = clc;
         m_isopen = true;
         std::string result = clc->m_formatter->getheader();
         if (result.length()>0)
           {
-          mg_send(nc, (const char*)result.c_str(), result.length());
+          clc->Output((const uint8_t*)result.data(), result.length());
+          clc->FlushOutput(true);
           }
+        clc->Drain();
         }
       else
         { // Connection failed
@@ -275,6 +285,19 @@ void canlog_tcpclient::MongooseHandler(struct mg_connection *nc, int ev, void *p
           }
         }
       break;
+    case MG_EV_POLL:
+#if MG_VERSION_NUMBER >= MG_VERSION_VAL(7, 0, 0)
+    case MG_EV_WRITE:
+#else /* MG_VERSION_NUMBER */
+    case MG_EV_SEND:
+#endif /* MG_VERSION_NUMBER */
+      {
+      // Pass backlog data to the network connection
+      OvmsRecMutexLock lock(&m_cmmutex);
+      auto k = m_connmap.find(nc);
+      if (k != m_connmap.end()) k->second->Drain();
+      break;
+      }
 #if MG_VERSION_NUMBER >= MG_VERSION_VAL(7, 0, 0)
     case MG_EV_READ:
       {
@@ -157,6 +157,7 @@ bool canlog_udpclient::Open()
         {
         canlogconnection* clc = new canlogconnection(this, m_format, m_mode);
         clc->m_nc = nc;
+        clc->SetSendBuffer(CANLOG_SENDBUF_DGRAM);
         clc->m_peer = m_path;
         m_connmap[nc] = clc;
         m_isopen = true;
@@ -51,28 +51,17 @@ udpcanlogconnection::~udpcanlogconnection()
   {
   }
 
-void udpcanlogconnection::OutputMsg(CAN_log_message_t& msg, std::string &result)
+bool udpcanlogconnection::SendData(const uint8_t* data, size_t len)
   {
-  m_msgcount++;
-
-  if ((m_filters != NULL) && (! m_filters->IsFiltered(&msg.frame)))
-    {
-    m_filtercount++;
-    return;
-    }
-
-  if (result.length()>0)
-    {
 #if MG_VERSION_NUMBER >= MG_VERSION_VAL(7, 0, 0)
-    struct mg_connection fake_nc;
-    fake_nc.is_udp = 1;
-    fake_nc.fd = m_fd;
-    memcpy(&fake_nc.rem, &m_rem, sizeof(fake_nc.rem));
-    mg_io_send(&fake_nc, (const void *)result.c_str(), result.length());
+  struct mg_connection fake_nc;
+  fake_nc.is_udp = 1;
+  fake_nc.fd = m_fd;
+  memcpy(&fake_nc.rem, &m_rem, sizeof(fake_nc.rem));
+  return (mg_io_send(&fake_nc, (const void *)data, len) > 0);
 #else /* MG_VERSION_NUMBER */
-    sendto(m_sock, (const char*)result.c_str(), result.length(), 0, &m_sa, sizeof(m_sa));
+  return (sendto(m_sock, (const char*)data, len, 0, &m_sa, sizeof(m_sa)) > 0);
 #endif /* MG_VERSION_NUMBER */
-    }
   }
 
 void udpcanlogconnection::Tickle()
@@ -367,6 +356,7 @@ void canlog_udpserver::MongooseHandler(struct mg_connection *nc, int ev, void *p
       memcpy(&clc->m_sa,&nc->sa.sin,sizeof(nc->sa.sin));
 #endif /* MG_VERSION_NUMBER */
       clc->m_peer = std::string(addr);
+      clc->SetSendBuffer(CANLOG_SENDBUF_DGRAM);
       m_connmap[&clc->m_fakenc] = clc;
       std::string result = clc->m_formatter->getheader();
       if (result.length()>0)
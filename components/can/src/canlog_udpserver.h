@@ -41,8 +41,8 @@ class udpcanlogconnection: public canlogconnection
     udpcanlogconnection(canlog* logger, std::string format, canformat::canformat_serve_mode_t mode);
     virtual ~udpcanlogconnection();
 
-  public:
-    virtual void OutputMsg(CAN_log_message_t& msg, std::string &result);
+  protected:
+    virtual bool SendData(const uint8_t* data, size_t len);
 
   public:
     void Tickle();
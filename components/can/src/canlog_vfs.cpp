@@ -27,6 +27,14 @@
 #include "ovms_log.h"
 static const char *TAG = "canlog-vfs";
 
+#include "global.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sstream>
+#include <iomanip>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include "can.h"
 #include "canformat.h"
 #include "canlog_vfs.h"
@@ -83,6 +91,12 @@ OvmsCanLogVFSInit::OvmsCanLogVFSInit()
           "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
           "Example: 2:2a0-37f",
           1, 9);
+        OvmsCanFormatFactory::instance(TAG).RegisterCompressedCommandSet(start, "Start compressed CAN logging to VFS",
+          can_log_vfs_start,
+          "<path> [filter1] ... [filterN]\n"
+          "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+          "Example: 2:2a0-37f",
+          1, 9);
         }
       }
     }
@@ -93,10 +107,53 @@ canlog_vfs_conn::canlog_vfs_conn(canlog* logger, std::string format, canformat::
   : canlogconnection(logger, format, mode), m_file_size(0)
   {
   m_file = NULL;
+  for (int k=0; k<CANLOG_VFS_BUFFERS; k++)
+    m_buffers[k] = NULL;
+  m_freequeue = NULL;
+  m_writequeue = NULL;
+  m_writertask = NULL;
+  m_writerdone = NULL;
+  m_active = NULL;
+  m_fill = 0;
+  m_limit = 0;
+  m_queued = 0;
+  m_firsttime = 0;
+  m_bufsize = 0;
+  m_cluster = 0;
+  m_flushage = 0;
+  m_syncinterval = 0;
+  m_starttime = 0;
+  m_lastsync = 0;
+  m_written = 0;
+  m_flushes = 0;
+  m_syncs = 0;
+  m_overflows = 0;
+  m_writeerrors = 0;
+  m_flushtime = 0;
+  m_flushmax = 0;
+  m_fillmax = 0;
+  m_fileoffset = 0;
+  m_rotate = false;
+  m_rotatesize = 0;
+  m_rotatetime = 0;
+  m_retention = 0;
+  memset(&m_seg, 0, sizeof(m_seg));
+  m_part = 0;
+  m_nextfile = NULL;
+  m_segtotal = 0;
+  m_rotations = 0;
   }
 
 canlog_vfs_conn::~canlog_vfs_conn()
   {
+  if (m_file)
+    FlushOutput(true);
+  StopWriter();
+  if (m_rotate && m_file)
+    {
+    // Direct mode, the writer did not complete the segment:
+    CompleteSegment(m_seg);
+    }
   if (m_file)
     {
     fclose(m_file);
@@ -104,7 +161,273 @@ canlog_vfs_conn::~canlog_vfs_conn()
     }
   }
 
-void canlog_vfs_conn::OutputMsg(CAN_log_message_t& msg, std::string &result)
+bool canlog_vfs_conn::StartWriter(size_t bufsize, size_t cluster, uint32_t flushage, uint32_t syncinterval)
+  {
+  if (cluster < 512) cluster = 512;
+  if (bufsize < cluster) bufsize = cluster;
+  m_bufsize = bufsize - (bufsize % cluster);
+  m_cluster = cluster;
+  m_flushage = (flushage > 0) ? flushage : 1;
+  m_syncinterval = syncinterval;
+
+  for (int k=0; k<CANLOG_VFS_BUFFERS; k++)
+    {
+    m_buffers[k] = (uint8_t*)heap_caps_malloc(m_bufsize, MALLOC_CAP_SPIRAM);
+    if (!m_buffers[k])
+      m_buffers[k] = (uint8_t*)malloc(m_bufsize);
+    if (!m_buffers[k])
+      {
+      ESP_LOGE(TAG, "Error: out of memory for %u byte write buffers, using direct writes", m_bufsize);
+      StopWriter();
+      return false;
+      }
+    }
+
+  m_freequeue = xQueueCreate(CANLOG_VFS_BUFFERS, sizeof(uint8_t*));
+  // Room for all buffers plus a rotation marker between each, and the stop marker:
+  m_writequeue = xQueueCreate(2*CANLOG_VFS_BUFFERS+1, sizeof(canlog_vfs_block_t));
+  m_writerdone = xSemaphoreCreateBinary();
+  if (!m_freequeue || !m_writequeue || !m_writerdone)
+    {
+    StopWriter();
+    return false;
+    }
+  for (int k=0; k<CANLOG_VFS_BUFFERS; k++)
+    xQueueSend(m_freequeue, &m_buffers[k], 0);
+
+  // The file system gets full clusters from us, so stdio buffering would
+  // just add a copy:
+  setvbuf(m_file, NULL, _IONBF, 0);
+
+  m_starttime = m_lastsync = esp_timer_get_time();
+  if (xTaskCreatePinnedToCore(WriterTask, "OVMS CanLogVFS", 4096, (void*)this, 9, &m_writertask, CORE(1)) != pdPASS)
+    {
+    m_writertask = NULL;
+    StopWriter();
+    return false;
+    }
+
+  return true;
+  }
+
+void canlog_vfs_conn::StopWriter()
+  {
+  if (m_writertask)
+    {
+    // Flush the active buffer and let the writer finish all pending blocks:
+      {
+      OvmsMutexLock lock(&m_bufmutex);
+      Submit();
+      }
+    canlog_vfs_block_t stop = { CANLOG_VFS_STOP, NULL, 0, m_seg };
+    xQueueSend(m_writequeue, &stop, portMAX_DELAY);
+    xSemaphoreTake(m_writerdone, portMAX_DELAY);
+    m_writertask = NULL;
+    if (m_file)
+      {
+      fflush(m_file);
+      fsync(fileno(m_file));
+      }
+    }
+
+  if (m_writerdone)
+    {
+    vSemaphoreDelete(m_writerdone);
+    m_writerdone = NULL;
+    }
+  if (m_writequeue)
+    {
+    vQueueDelete(m_writequeue);
+    m_writequeue = NULL;
+    }
+  if (m_freequeue)
+    {
+    vQueueDelete(m_freequeue);
+    m_freequeue = NULL;
+    }
+  for (int k=0; k<CANLOG_VFS_BUFFERS; k++)
+    {
+    if (m_buffers[k])
+      {
+      free(m_buffers[k]);
+      m_buffers[k] = NULL;
+      }
+    }
+  m_active = NULL;
+  m_fill = 0;
+  }
+
+/**
+ * Submit: hand the active buffer over to the writer (m_bufmutex held)
+ */
+void canlog_vfs_conn::Submit()
+  {
+  if (!m_active || m_fill == 0)
+    return;
+  canlog_vfs_block_t block = { CANLOG_VFS_DATA, m_active, m_fill };
+  m_queued += m_fill;
+  m_fileoffset += m_fill;
+  m_active = NULL;
+  m_fill = 0;
+  // The queue can hold all buffers, so this cannot block:
+  xQueueSend(m_writequeue, &block, portMAX_DELAY);
+  }
+
+/**
+ * Write: append a record to the write-behind buffers
+ *  Returns false if the record had to be dropped (writer too slow).
+ */
+bool canlog_vfs_conn::Write(const uint8_t* data, size_t len)
+  {
+  if (!m_writertask)
+    {
+    // Direct mode (no buffers available):
+    if (fwrite(data,len,1,m_file) != 1)
+      return false;
+    m_file_size += len;
+    return true;
+    }
+
+  OvmsMutexLock lock(&m_bufmutex);
+  int64_t now = esp_timer_get_time();
+
+  // Records are kept complete: if the record does not fit into the active
+  // buffer and no free buffer is available, drop it:
+  size_t room = m_active ? (m_limit - m_fill) : 0;
+  if (len > room && uxQueueMessagesWaiting(m_freequeue) == 0)
+    {
+    m_overflows++;
+    return false;
+    }
+
+  while (len > 0)
+    {
+    if (!m_active)
+      {
+      if (xQueueReceive(m_freequeue, &m_active, 0) != pdTRUE)
+        {
+        // Cannot happen, see above; the record is truncated
+        m_active = NULL;
+        m_overflows++;
+        return false;
+        }
+      // End full buffers on a cluster boundary of the file:
+      m_limit = m_bufsize - (m_fileoffset % m_cluster);
+      m_fill = 0;
+      }
+    if (m_fill == 0)
+      m_firsttime = now;
+    size_t n = (len < m_limit - m_fill) ? len : (m_limit - m_fill);
+    memcpy(m_active + m_fill, data, n);
+    m_fill += n;
+    m_file_size += n;
+    m_seg.size += n;
+    data += n;
+    len -= n;
+    if (m_fill == m_limit)
+      Submit();
+    }
+
+  // Backlog from the low words, these are updated atomically:
+  size_t backlog = ((uint32_t)m_queued - (uint32_t)m_written) + m_fill;
+  if (backlog > m_fillmax)
+    m_fillmax = backlog;
+
+  if (m_fill > 0 && now - m_firsttime >= (int64_t)m_flushage * 1000)
+    Submit();
+
+  return true;
+  }
+
+void canlog_vfs_conn::WriterTask(void* context)
+  {
+  canlog_vfs_conn* me = (canlog_vfs_conn*) context;
+  canlog_vfs_block_t block;
+  bool unsynced = false;
+  TickType_t wait = pdMS_TO_TICKS(me->m_flushage / 2) + 1;
+
+  // Pre-open the next segment:
+  if (me->m_rotate)
+    me->m_nextfile = fopen(me->PartPath(me->m_part ^ 1).c_str(), "w");
+
+  while (1)
+    {
+    if (xQueueReceive(me->m_writequeue, &block, wait) == pdTRUE)
+      {
+      if (block.type == CANLOG_VFS_STOP)
+        {
+        if (me->m_rotate)
+          {
+          me->CompleteSegment(block.seg);
+          if (me->m_nextfile)
+            {
+            fclose(me->m_nextfile);
+            me->m_nextfile = NULL;
+            unlink(me->PartPath(me->m_part ^ 1).c_str());
+            }
+          }
+        break;
+        }
+      else if (block.type == CANLOG_VFS_ROTATE)
+        {
+        me->CompleteSegment(block.seg);
+        me->m_part ^= 1;
+        me->m_file = me->m_nextfile;
+        if (!me->m_file)
+          me->m_file = fopen(me->PartPath(me->m_part).c_str(), "w");
+        if (me->m_file)
+          setvbuf(me->m_file, NULL, _IONBF, 0);
+        else
+          ESP_LOGE(TAG, "Error: Can't write to '%s'", me->PartPath(me->m_part).c_str());
+        me->m_nextfile = fopen(me->PartPath(me->m_part ^ 1).c_str(), "w");
+        me->m_lastsync = esp_timer_get_time();
+        unsynced = false;
+        continue;
+        }
+      me->WriteBlock(block);
+      unsynced = true;
+      }
+    else
+      {
+      // Idle: flush aged data
+      OvmsMutexLock lock(&me->m_bufmutex);
+      if (me->m_fill > 0 && esp_timer_get_time() - me->m_firsttime >= (int64_t)me->m_flushage * 1000)
+        me->Submit();
+      }
+
+    if (unsynced && me->m_syncinterval > 0 &&
+        esp_timer_get_time() - me->m_lastsync >= (int64_t)me->m_syncinterval * 1000000)
+      {
+      if (me->m_file)
+        fsync(fileno(me->m_file));
+      me->m_lastsync = esp_timer_get_time();
+      me->m_syncs++;
+      unsynced = false;
+      }
+    }
+
+  xSemaphoreGive(me->m_writerdone);
+  vTaskDelete(NULL);
+  }
+
+void canlog_vfs_conn::WriteBlock(const canlog_vfs_block_t& block)
+  {
+  int64_t start = esp_timer_get_time();
+  if (!m_file || fwrite(block.data, block.len, 1, m_file) != 1)
+    m_writeerrors++;
+  uint32_t duration = esp_timer_get_time() - start;
+
+  m_written += block.len;
+  m_flushes++;
+  m_flushtime += duration;
+  if (duration > m_flushmax)
+    m_flushmax = duration;
+
+  uint8_t* buf = block.data;
+  xQueueSend(m_freequeue, &buf, portMAX_DELAY);
+  }
+
+void canlog_vfs_conn::OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len)
   {
   m_msgcount++;
 
@@ -114,13 +437,251 @@ void canlog_vfs_conn::OutputMsg(CAN_log_message_t& msg, std::string &result)
     return;
     }
 
-  if (result.length()>0)
+  len = Format(msg, &data, len);
+  if (len>0)
     {
-    fwrite(result.c_str(),result.length(),1,m_file);
-    m_file_size += result.length();
+    // Rotate before the record exceeds the segment limits:
+    if (m_rotate && m_writertask && m_seg.size > 0 &&
+        ((m_rotatesize && m_seg.size + len > m_rotatesize) ||
+         (m_rotatetime && msg.timestamp.tv_sec - m_seg.start.tv_sec >= (time_t)m_rotatetime)))
+      {
+      // The segment header restarts stateful formats (see Rotate()), so
+      // records of these need to be encoded again for the new segment:
+      if (Rotate(msg.timestamp) && m_formatter->IsStateful())
+        {
+        data = NULL;
+        len = Format(msg, &data, 0);
+        }
+      }
+
+    if (!Output(data,len))
+      {
+      m_dropcount++;
+      }
+    else
+      {
+      if (msg.type == CAN_LogFrame_RX || msg.type == CAN_LogFrame_TX)
+        m_seg.frames++;
+      m_seg.end = msg.timestamp;
+      }
     }
   }
 
+/**
+ * Rotate: complete the current segment and continue with the next one
+ *  (logger task). The writer task switches files, so this does not block.
+ *  Returns false if the writer is busy (try again with the next record).
+ */
+bool canlog_vfs_conn::Rotate(const struct timeval& time)
+  {
+  // Segments shall be decodable on their own, so end the compressed block:
+  FlushOutput(true);
+
+    {
+    OvmsMutexLock lock(&m_bufmutex);
+    Submit();
+    canlog_vfs_block_t block = { CANLOG_VFS_ROTATE, NULL, 0, m_seg };
+    if (xQueueSend(m_writequeue, &block, 0) != pdTRUE)
+      return false;
+    m_fileoffset = 0;
+    m_seg.start = m_seg.end = time;
+    m_seg.frames = 0;
+    m_seg.size = 0;
+    m_rotations++;
+    }
+
+  // Each segment starts with the format header. This also resets
+  // stateful formatters (i.e. the compact format dictionary):
+  struct timeval t = time;
+  std::string header = m_formatter->getheader(&t);
+  if (header.length()>0)
+    Output((const uint8_t*)header.data(), header.length());
+  return true;
+  }
+
+bool canlog_vfs_conn::OutputData(const uint8_t* data, size_t len)
+  {
+  return Write(data, len);
+  }
+
+std::string canlog_vfs_conn::PartPath(int part)
+  {
+  char suffix[8];
+  snprintf(suffix, sizeof(suffix), ".part%d", part);
+  return m_path + suffix;
+  }
+
+/**
+ * OpenRotation: enable segment rotation, load the index and open the first part
+ */
+FILE* canlog_vfs_conn::OpenRotation(std::string path, size_t size, uint32_t duration, size_t retention)
+  {
+  m_path = path;
+  m_rotatesize = size;
+  m_rotatetime = duration;
+  m_retention = retention;
+  m_part = 0;
+  gettimeofday(&m_seg.start, NULL);
+  m_seg.end = m_seg.start;
+  m_seg.frames = 0;
+  m_seg.size = 0;
+  LoadIndex();
+  m_file = fopen(PartPath(m_part).c_str(), "w");
+  m_rotate = (m_file != NULL);
+  return m_file;
+  }
+
+/**
+ * CompleteSegment: close the current part, rename it by the segment start
+ *  time and add it to the index
+ */
+void canlog_vfs_conn::CompleteSegment(const canlog_vfs_seginfo_t& info)
+  {
+  if (!m_file)
+    return;
+  fflush(m_file);
+  fsync(fileno(m_file));
+  fclose(m_file);
+  m_file = NULL;
+
+  std::string part = PartPath(m_part);
+  std::string dir, stem = m_path, ext;
+  size_t slash = m_path.find_last_of('/');
+  if (slash != std::string::npos)
+    {
+    dir = m_path.substr(0, slash+1);
+    stem = m_path.substr(slash+1);
+    }
+  size_t dot = stem.find_last_of('.');
+  if (dot != std::string::npos && dot > 0)
+    {
+    ext = stem.substr(dot);
+    stem = stem.substr(0, dot);
+    }
+
+  char ts[20];
+  time_t tm = info.start.tv_sec;
+  strftime(ts, sizeof(ts), "-%Y%m%d-%H%M%S", localtime(&tm));
+  std::string name = stem + ts + ext;
+  struct stat st;
+  for (int k=1; stat((dir + name).c_str(), &st) == 0; k++)
+    {
+    char seq[8];
+    snprintf(seq, sizeof(seq), "-%d", k);
+    name = stem + ts + seq + ext;
+    }
+
+  if (rename(part.c_str(), (dir + name).c_str()) != 0)
+    {
+    ESP_LOGE(TAG, "Error: rename '%s' to '%s' failed", part.c_str(), (dir + name).c_str());
+    return;
+    }
+  ESP_LOGD(TAG, "Segment complete: %s (%" PRIu32 " frames)", name.c_str(), info.frames);
+
+    {
+    OvmsMutexLock lock(&m_indexmutex);
+    canlog_vfs_segment_t seg;
+    seg.name = name;
+    seg.info = info;
+    m_segments.push_back(seg);
+    m_segtotal += info.size;
+    }
+  Purge();
+  SaveIndex();
+  }
+
+/**
+ * Purge: remove the oldest segments beyond the retention quota
+ */
+void canlog_vfs_conn::Purge()
+  {
+  if (m_retention == 0)
+    return;
+  std::string dir;
+  size_t slash = m_path.find_last_of('/');
+  if (slash != std::string::npos)
+    dir = m_path.substr(0, slash+1);
+
+  OvmsMutexLock lock(&m_indexmutex);
+  while (m_segtotal > m_retention && m_segments.size() > 1)
+    {
+    canlog_vfs_segment_t& seg = m_segments.front();
+    if (unlink((dir + seg.name).c_str()) != 0)
+      ESP_LOGW(TAG, "Purge: can't remove '%s'", seg.name.c_str());
+    else
+      ESP_LOGD(TAG, "Purge: removed '%s'", seg.name.c_str());
+    m_segtotal -= seg.info.size;
+    m_segments.pop_front();
+    }
+  }
+
+/**
+ * Index file: one line per complete segment, oldest first:
+ *   <file> <start> <end> <frames> <bytes>
+ * Times are UNIX timestamps with microseconds.
+ */
+void canlog_vfs_conn::LoadIndex()
+  {
+  OvmsMutexLock lock(&m_indexmutex);
+  m_segments.clear();
+  m_segtotal = 0;
+
+  FILE* f = fopen((m_path + ".idx").c_str(), "r");
+  if (!f)
+    return;
+  char line[256], name[128];
+  long ssec, susec, esec, eusec;
+  unsigned long frames, size;
+  while (fgets(line, sizeof(line), f))
+    {
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%127s %ld.%ld %ld.%ld %lu %lu", name,
+               &ssec, &susec, &esec, &eusec, &frames, &size) != 7)
+      continue;
+    canlog_vfs_segment_t seg;
+    seg.name = name;
+    seg.info.start.tv_sec = ssec;
+    seg.info.start.tv_usec = susec;
+    seg.info.end.tv_sec = esec;
+    seg.info.end.tv_usec = eusec;
+    seg.info.frames = frames;
+    seg.info.size = size;
+    m_segments.push_back(seg);
+    m_segtotal += size;
+    }
+  fclose(f);
+  }
+
+void canlog_vfs_conn::SaveIndex()
+  {
+  std::string path = m_path + ".idx";
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f)
+    {
+    ESP_LOGE(TAG, "Error: Can't write to '%s'", tmp.c_str());
+    return;
+    }
+
+    {
+    OvmsMutexLock lock(&m_indexmutex);
+    fprintf(f, "# file start end frames bytes\n");
+    for (const canlog_vfs_segment_t& seg : m_segments)
+      {
+      fprintf(f, "%s %ld.%06ld %ld.%06ld %" PRIu32 " %u\n", seg.name.c_str(),
+        (long)seg.info.start.tv_sec, (long)seg.info.start.tv_usec,
+        (long)seg.info.end.tv_sec, (long)seg.info.end.tv_usec,
+        seg.info.frames, (unsigned)seg.info.size);
+      }
+    }
+  fclose(f);
+
+  // Replace the index atomically (FAT rename does not overwrite):
+  unlink(path.c_str());
+  rename(tmp.c_str(), path.c_str());
+  }
+
 
 canlog_vfs::canlog_vfs(std::string path, std::string format)
   : canlog("vfs", format)
@@ -173,7 +734,21 @@ bool canlog_vfs::Open()
   canlog_vfs_conn* clc = new canlog_vfs_conn(this, m_format, m_mode);
   clc->m_peer = m_path;
 
-  clc->m_file = fopen(m_path.c_str(), "w");
+  OvmsConfig& config = OvmsConfig::instance(TAG);
+  size_t rotatesize = config.GetParamValueInt("can", "vfs.rotate.size", 0) * 1024;
+  uint32_t rotatetime = config.GetParamValueInt("can", "vfs.rotate.time", 0);
+  if (rotatesize || rotatetime)
+    {
+    // Lower limits keep the index and file count sane:
+    if (rotatesize && rotatesize < 64*1024) rotatesize = 64*1024;
+    if (rotatetime && rotatetime < 10) rotatetime = 10;
+    clc->OpenRotation(m_path, rotatesize, rotatetime,
+      (size_t)config.GetParamValueInt("can", "vfs.retention", 0) * 1024 * 1024);
+    }
+  else
+    {
+    clc->m_file = fopen(m_path.c_str(), "w");
+    }
   if (!clc->m_file)
     {
     ESP_LOGE(TAG, "Error: Can't write to '%s'", m_path.c_str());
@@ -183,11 +758,19 @@ bool canlog_vfs::Open()
 
   ESP_LOGI(TAG, "Now logging CAN messages to '%s'", m_path.c_str());
 
-  std::string header = m_formatter->getheader();
+  if (!clc->StartWriter(
+    config.GetParamValueInt("can", "vfs.bufsize", 64) * 1024,
+    config.GetParamValueInt("can", "vfs.cluster", 4096),
+    config.GetParamValueInt("can", "vfs.flushage", 2000),
+    config.GetParamValueInt("can", "vfs.syncinterval", 10)) && (rotatesize || rotatetime))
+    {
+    ESP_LOGW(TAG, "Log rotation needs the write-behind buffers, rotation disabled");
+    }
+
+  std::string header = clc->m_formatter->getheader();
   if (header.length()>0)
     {
-    fwrite(header.c_str(),header.length(),1,clc->m_file);
-    clc->m_file_size += header.length();
+    clc->Output((const uint8_t*)header.data(), header.length());
     }
 
   m_connmap[NULL] = clc;
@@ -238,6 +821,38 @@ std::string canlog_vfs_conn::GetStats()
   result.append(" ");
   result.append(canlogconnection::GetStats());
 
+  if (m_writertask)
+    {
+    std::ostringstream buf;
+    int64_t elapsed = esp_timer_get_time() - m_starttime;
+    size_t total = CANLOG_VFS_BUFFERS * m_bufsize;
+    size_t backlog = ((uint32_t)m_queued - (uint32_t)m_written) + m_fill;
+    buf << std::fixed << std::setprecision(3)
+      << " Write:" << ((elapsed > 0) ? (double)m_written / elapsed : 0.0) << "MB/s"
+      << std::setprecision(0)
+      << " Buffer:" << (100.0 * backlog / total) << "%"
+      << "/" << (100.0 * m_fillmax / total) << "%"
+      << " of " << (total / 1024) << "kB"
+      << std::setprecision(1)
+      << " Flushes:" << m_flushes
+      << " avg:" << ((m_flushes > 0) ? (double)m_flushtime / m_flushes / 1000 : 0.0) << "ms"
+      << " max:" << (m_flushmax / 1000.0) << "ms"
+      << " Syncs:" << m_syncs
+      << " Overflows:" << m_overflows;
+    if (m_writeerrors)
+      buf << " Errors:" << m_writeerrors;
+    if (m_rotate)
+      {
+      OvmsMutexLock lock(&m_indexmutex);
+      char segsize[15];
+      format_file_size(segsize, sizeof(segsize), m_segtotal);
+      buf << " Rotations:" << m_rotations
+        << " Segments:" << m_segments.size()
+        << " (" << segsize << ")";
+      }
+    result.append(buf.str());
+    }
+
   return result;
   }
 
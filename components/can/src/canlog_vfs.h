@@ -28,9 +28,61 @@
 #ifndef __CANLOG_VFS_H__
 #define __CANLOG_VFS_H__
 
+#include <deque>
 #include "canlog.h"
 
 
+// Write-behind: records are collected in one of two large buffers (PSRAM
+// if available), full buffers are written by a dedicated writer task while
+// the logger task continues filling the other one. Full buffer writes end
+// on cluster boundaries, partial buffers are flushed after the max age.
+// Config ("can" params, applied on open):
+//   vfs.bufsize        buffer size [KB], default 64 (two buffers are used)
+//   vfs.cluster        write alignment [bytes], default 4096
+//   vfs.flushage       max age of buffered data [ms], default 2000
+//   vfs.syncinterval   fsync interval [s], default 10, 0 = only on close
+//
+// Rotation: if a size or duration limit is configured, the log is split
+// into segments. Segments are written to "<path>.part<n>" and renamed to
+// "<stem>-<YYYYmmdd-HHMMSS><ext>" (start time) when complete. The writer
+// pre-opens the next segment, so rotation does not stall logging. The
+// index "<path>.idx" lists the complete segments (file, start & end time,
+// frames, bytes); the oldest segments are purged beyond the retention quota.
+//   vfs.rotate.size    segment size limit [KB], default 0 = unlimited
+//   vfs.rotate.time    segment duration limit [s], default 0 = unlimited
+//   vfs.retention      max total size of complete segments [MB], 0 = unlimited
+
+#define CANLOG_VFS_BUFFERS      2
+
+typedef enum
+  {
+  CANLOG_VFS_DATA = 0,                // write data
+  CANLOG_VFS_ROTATE,                  // complete segment, switch to next
+  CANLOG_VFS_STOP                     // complete segment, stop writer
+  } canlog_vfs_block_type_t;
+
+typedef struct
+  {
+  struct timeval  start;
+  struct timeval  end;
+  uint32_t        frames;
+  size_t          size;
+  } canlog_vfs_seginfo_t;
+
+typedef struct
+  {
+  canlog_vfs_block_type_t type;
+  uint8_t*  data;
+  size_t    len;
+  canlog_vfs_seginfo_t seg;           // ROTATE/STOP: segment completed
+  } canlog_vfs_block_t;
+
+typedef struct
+  {
+  std::string     name;
+  canlog_vfs_seginfo_t info;
+  } canlog_vfs_segment_t;
+
 class canlog_vfs_conn: public canlogconnection
   {
   public:
@@ -38,12 +90,73 @@ class canlog_vfs_conn: public canlogconnection
     virtual ~canlog_vfs_conn();
 
   public:
-    virtual void OutputMsg(CAN_log_message_t& msg, std::string &result);
+    bool StartWriter(size_t bufsize, size_t cluster, uint32_t flushage, uint32_t syncinterval);
+    void StopWriter();
+    bool Write(const uint8_t* data, size_t len);
+    FILE* OpenRotation(std::string path, size_t size, uint32_t duration, size_t retention);
+    virtual void OutputMsg(CAN_log_message_t& msg, const uint8_t* data, size_t len);
+    virtual bool OutputData(const uint8_t* data, size_t len);
     virtual std::string GetStats();
 
+  protected:
+    static void WriterTask(void* context);
+    void Submit();
+    void WriteBlock(const canlog_vfs_block_t& block);
+    bool Rotate(const struct timeval& time);
+    std::string PartPath(int part);
+    void CompleteSegment(const canlog_vfs_seginfo_t& info);
+    void LoadIndex();
+    void SaveIndex();
+    void Purge();
+
   public:
     FILE*               m_file;
     size_t              m_file_size;
+
+  protected:
+    OvmsMutex           m_bufmutex;                   // protects the active buffer
+    uint8_t*            m_buffers[CANLOG_VFS_BUFFERS];
+    QueueHandle_t       m_freequeue;                  // free buffers
+    QueueHandle_t       m_writequeue;                 // blocks to write
+    TaskHandle_t        m_writertask;
+    SemaphoreHandle_t   m_writerdone;
+    uint8_t*            m_active;                     // buffer being filled, NULL = none
+    size_t              m_fill;                       // bytes in active buffer
+    size_t              m_limit;                      // active buffer capacity
+    uint64_t            m_queued;                     // bytes handed to the writer
+    size_t              m_fileoffset;                 // … of the current file
+    int64_t             m_firsttime;                  // time of oldest buffered byte [us]
+    size_t              m_bufsize;
+    size_t              m_cluster;
+    uint32_t            m_flushage;                   // [ms]
+    uint32_t            m_syncinterval;               // [s]
+
+  protected:
+    int64_t             m_starttime;                  // writer start [us]
+    int64_t             m_lastsync;                   // [us]
+    uint64_t            m_written;                    // bytes written to the file(s)
+    uint32_t            m_flushes;
+    uint32_t            m_syncs;
+    uint32_t            m_overflows;                  // records lost, no free buffer
+    uint32_t            m_writeerrors;
+    int64_t             m_flushtime;                  // total write time [us]
+    uint32_t            m_flushmax;                   // max write time [us]
+    size_t              m_fillmax;                    // max buffered bytes
+
+  protected:
+    // Rotation (m_rotate set by OpenRotation):
+    bool                m_rotate;
+    std::string         m_path;
+    size_t              m_rotatesize;                 // [bytes], 0 = unlimited
+    uint32_t            m_rotatetime;                 // [s], 0 = unlimited
+    size_t              m_retention;                  // [bytes], 0 = unlimited
+    canlog_vfs_seginfo_t m_seg;                       // current segment (logger task)
+    int                 m_part;                       // current part file (writer task)
+    FILE*               m_nextfile;                   // pre-opened next part
+    OvmsMutex           m_indexmutex;                 // protects m_segments
+    std::deque<canlog_vfs_segment_t> m_segments;      // complete segments, oldest first
+    size_t              m_segtotal;                   // total size of m_segments
+    uint32_t            m_rotations;
   };
 
 
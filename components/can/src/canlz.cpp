@@ -0,0 +1,281 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN log stream compression
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+
+#include "ovms_log.h"
+static const char *TAG = "canlz";
+
+#include <string.h>
+#include <stdlib.h>
+#include <sstream>
+#include <iomanip>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include "canlz.h"
+
+static inline uint32_t lz_read32(const uint8_t* p)
+  {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+  }
+
+static inline uint32_t lz_hash(uint32_t v)
+  {
+  return (v * 2654435761U) >> (32 - CANLZ_HASHBITS);
+  }
+
+static inline uint8_t* lz_putlength(uint8_t* op, size_t len)
+  {
+  while (len >= 255)
+    {
+    *op++ = 255;
+    len -= 255;
+    }
+  *op++ = (uint8_t)len;
+  return op;
+  }
+
+static inline uint8_t* lz_putsequence(uint8_t* op, const uint8_t* lit, size_t litlen, size_t offset, size_t matchlen)
+  {
+  uint8_t* token = op++;
+  *token = (litlen >= 15) ? 0xf0 : (litlen << 4);
+  if (litlen >= 15)
+    op = lz_putlength(op, litlen - 15);
+  memcpy(op, lit, litlen);
+  op += litlen;
+  if (matchlen)
+    {
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    matchlen -= 4;
+    *token |= (matchlen >= 15) ? 0x0f : matchlen;
+    if (matchlen >= 15)
+      op = lz_putlength(op, matchlen - 15);
+    }
+  return op;
+  }
+
+canlz::canlz()
+  {
+  m_in = (uint8_t*)heap_caps_malloc(CANLZ_BLOCKSIZE, MALLOC_CAP_SPIRAM);
+  if (!m_in) m_in = (uint8_t*)malloc(CANLZ_BLOCKSIZE);
+  m_out = (uint8_t*)heap_caps_malloc(CANLZ_MAXBLOCK, MALLOC_CAP_SPIRAM);
+  if (!m_out) m_out = (uint8_t*)malloc(CANLZ_MAXBLOCK);
+  // The hash table is accessed randomly, keep it in internal RAM:
+  m_table = (uint16_t*)malloc(sizeof(uint16_t) << CANLZ_HASHBITS);
+  if (!IsValid())
+    ESP_LOGE(TAG, "Error: out of memory for compression buffers");
+  m_fill = 0;
+  m_firsttime = 0;
+  m_bytesin = 0;
+  m_bytesout = 0;
+  m_blocks = 0;
+  m_time = 0;
+  }
+
+canlz::~canlz()
+  {
+  free(m_in);
+  free(m_out);
+  free(m_table);
+  }
+
+bool canlz::IsValid()
+  {
+  return (m_in && m_out && m_table);
+  }
+
+bool canlz::HasSuffix(const std::string& format)
+  {
+  size_t len = strlen(CANLZ_SUFFIX);
+  return (format.length() > len) &&
+    (format.compare(format.length()-len, len, CANLZ_SUFFIX) == 0);
+  }
+
+/**
+ * Add: append log data to the current block
+ *  Records are kept whole if possible: returns 0 if the data does not fit
+ *  into the remaining space (caller needs to flush). Data larger than a
+ *  block is split.
+ */
+size_t canlz::Add(const uint8_t* data, size_t len)
+  {
+  if (!IsValid())
+    return 0;
+  size_t room = CANLZ_BLOCKSIZE - m_fill;
+  if (len > room)
+    {
+    if (m_fill > 0)
+      return 0;
+    len = room;
+    }
+  if (m_fill == 0)
+    m_firsttime = esp_timer_get_time();
+  memcpy(m_in + m_fill, data, len);
+  m_fill += len;
+  return len;
+  }
+
+bool canlz::IsFull()
+  {
+  return (m_fill == CANLZ_BLOCKSIZE);
+  }
+
+bool canlz::IsAged(int64_t now, int64_t maxage)
+  {
+  return (m_fill > 0) && (now - m_firsttime >= maxage);
+  }
+
+/**
+ * Flush: compress & frame the current block
+ *  Returns the block size (0 = nothing pending), *block points to the
+ *  framed block, valid until the next Flush().
+ */
+size_t canlz::Flush(const uint8_t** block)
+  {
+  if (m_fill == 0 || !IsValid())
+    return 0;
+
+  int64_t start = esp_timer_get_time();
+  uint8_t* hdr = m_out;
+  size_t len = Compress(m_in, m_fill, m_out + CANLZ_HEADERSIZE,
+                        CANLZ_MAXBLOCK - CANLZ_HEADERSIZE, m_table);
+  uint8_t type = CANLZ_TYPE_LZ4;
+  if (len == 0 || len >= m_fill)
+    {
+    // Incompressible: store
+    memcpy(m_out + CANLZ_HEADERSIZE, m_in, m_fill);
+    len = m_fill;
+    type = CANLZ_TYPE_STORED;
+    }
+  uint32_t adler = Adler32(m_in, m_fill);
+  hdr[0] = 'O';
+  hdr[1] = 'L';
+  hdr[2] = 'Z';
+  hdr[3] = type;
+  hdr[4] = m_fill & 0xff;
+  hdr[5] = m_fill >> 8;
+  hdr[6] = len & 0xff;
+  hdr[7] = len >> 8;
+  hdr[8] = adler & 0xff;
+  hdr[9] = (adler >> 8) & 0xff;
+  hdr[10] = (adler >> 16) & 0xff;
+  hdr[11] = adler >> 24;
+  m_time += esp_timer_get_time() - start;
+
+  m_bytesin += m_fill;
+  m_bytesout += CANLZ_HEADERSIZE + len;
+  m_blocks++;
+  m_fill = 0;
+  *block = m_out;
+  return CANLZ_HEADERSIZE + len;
+  }
+
+/**
+ * Discard: drop the data of the current block
+ */
+void canlz::Discard()
+  {
+  m_fill = 0;
+  }
+
+/**
+ * Compress: LZ4 block compression (greedy, single probe hash)
+ *  Returns the compressed size, 0 if it exceeds cap.
+ *  Follows the LZ4 end of block rules, so any LZ4 block decoder can be used.
+ */
+size_t canlz::Compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap, uint16_t* table)
+  {
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + len;
+  const uint8_t* mflimit = end - 12;      // last match must start before
+  const uint8_t* matchlimit = end - 5;    // last 5 bytes are literals
+  uint8_t* op = dst;
+
+  // Worst case expansion, see CANLZ_MAXBLOCK:
+  if (cap < len + len/255 + 16)
+    return 0;
+
+  if (len >= 13)
+    {
+    memset(table, 0, sizeof(uint16_t) << CANLZ_HASHBITS);
+    ip++;
+    while (ip < mflimit)
+      {
+      uint32_t seq = lz_read32(ip);
+      uint32_t h = lz_hash(seq);
+      const uint8_t* ref = src + table[h];
+      table[h] = ip - src;
+      if (ref >= ip || lz_read32(ref) != seq)
+        {
+        ip++;
+        continue;
+        }
+      const uint8_t* mp = ip + 4;
+      const uint8_t* rp = ref + 4;
+      while (mp < matchlimit && *mp == *rp)
+        {
+        mp++;
+        rp++;
+        }
+      op = lz_putsequence(op, anchor, ip - anchor, ip - ref, mp - ip);
+      ip = anchor = mp;
+      }
+    }
+
+  op = lz_putsequence(op, anchor, end - anchor, 0, 0);
+  return op - dst;
+  }
+
+uint32_t canlz::Adler32(const uint8_t* data, size_t len)
+  {
+  uint32_t a = 1, b = 0;
+  while (len > 0)
+    {
+    size_t n = (len < 5552) ? len : 5552;
+    len -= n;
+    while (n--)
+      {
+      a += *data++;
+      b += a;
+      }
+    a %= 65521;
+    b %= 65521;
+    }
+  return (b << 16) | a;
+  }
+
+std::string canlz::GetStats()
+  {
+  std::ostringstream buf;
+  buf << std::fixed << std::setprecision(2)
+    << "LZ:" << ((m_bytesout > 0) ? (double)m_bytesin / m_bytesout : 0.0) << "x"
+    << std::setprecision(1)
+    << " " << ((m_bytesin > 0) ? (double)m_time * 1000 / m_bytesin : 0.0) << "ms/MB";
+  return buf.str();
+  }
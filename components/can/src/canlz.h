@@ -0,0 +1,96 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN log stream compression
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+
+#ifndef __CANLZ_H__
+#define __CANLZ_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Streaming compression for CAN logs
+//
+// The formatted log stream is collected into blocks of up to
+// CANLZ_BLOCKSIZE bytes, each block is compressed independently (LZ4
+// block format) and framed by a header:
+//
+//   'O' 'L' 'Z' <type>   type 0 = stored, 1 = LZ4 block
+//   <rawlen:16>          uncompressed size (little endian)
+//   <datalen:16>         size of the data following the header
+//   <adler32:32>         checksum of the uncompressed data
+//
+// As blocks do not depend on each other, a truncated or damaged file
+// stays decodable up to the damaged block and a reader can resync on the
+// next header. See scripts/canlog_lz.py for a host side decompressor.
+//
+// Logs are selected by appending "+lz" to the format, i.e. "crtd+lz".
+
+#define CANLZ_SUFFIX            "+lz"
+#define CANLZ_BLOCKSIZE         8192
+#define CANLZ_HEADERSIZE        12
+#define CANLZ_MAXBLOCK          (CANLZ_HEADERSIZE + CANLZ_BLOCKSIZE + CANLZ_BLOCKSIZE/255 + 16)
+#define CANLZ_HASHBITS          12
+#define CANLZ_MAXAGE            1000000   // max age of pending data [us]
+
+#define CANLZ_TYPE_STORED       0
+#define CANLZ_TYPE_LZ4          1
+
+class canlz
+  {
+  public:
+    canlz();
+    ~canlz();
+
+  public:
+    bool IsValid();
+    size_t Add(const uint8_t* data, size_t len);
+    size_t Flush(const uint8_t** block);
+    void Discard();
+    bool IsFull();
+    bool IsAged(int64_t now, int64_t maxage=CANLZ_MAXAGE);
+    std::string GetStats();
+
+  public:
+    static size_t Compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap, uint16_t* table);
+    static uint32_t Adler32(const uint8_t* data, size_t len);
+    static bool HasSuffix(const std::string& format);
+
+  protected:
+    uint8_t*            m_in;           // block being collected
+    size_t              m_fill;
+    uint8_t*            m_out;          // framed compressed block
+    uint16_t*           m_table;        // match finder hash table
+    int64_t             m_firsttime;    // time of first byte in block [us]
+
+  public:
+    uint64_t            m_bytesin;
+    uint64_t            m_bytesout;
+    uint32_t            m_blocks;
+    int64_t             m_time;         // total compression time [us]
+  };
+
+#endif // __CANLZ_H__
@@ -132,12 +132,19 @@ void can_play_speed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
     return;
     }
 
+  float speed = (strcmp(argv[0], "max") == 0) ? 0 : atof(argv[0]);
+  if (speed != 0 && (speed < CANPLAY_SPEED_MIN || speed > CANPLAY_SPEED_MAX))
+    {
+    writer->printf("Error: speed must be %g..%g or max\n", CANPLAY_SPEED_MIN, (double)CANPLAY_SPEED_MAX);
+    return;
+    }
+
   if (argc==2)
     {
     canplay* cl = can::instance(TAG).GetPlayer(atoi(argv[1]));
     if (cl)
       {
-      cl->SetSpeed(atoi(argv[0]));
+      cl->SetSpeed(speed);
       writer->printf("CAN playing active: %s\n  Statistics: %s\n", cl->GetInfo().c_str(), cl->GetStats().c_str());
       }
     else
@@ -153,13 +160,115 @@ void can_play_speed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
     for (can::canplay_map_t::iterator it=can::instance(TAG).m_playermap.begin(); it!=can::instance(TAG).m_playermap.end(); ++it)
       {
       canplay* cl = it->second;
-      cl->SetSpeed(atoi(argv[0]));
+      cl->SetSpeed(speed);
       writer->printf("CAN player #%" PRId32 ": %s\n  Statistics: %s\n",
         it->first, cl->GetInfo().c_str(), cl->GetStats().c_str());
       }
     }
   }
 
+/**
+ * Parse a time relative to the log start: [[<hours>:]<minutes>:]<seconds>[.<fraction>]
+ */
+static bool can_play_parsetime(const char* arg, int64_t* time)
+  {
+  int64_t value = 0;
+  const char* p = arg;
+  while (1)
+    {
+    char* e;
+    unsigned long n = strtoul(p, &e, 10);
+    if (e == p) return false;
+    value = value * 60 + n;
+    p = e;
+    if (*p != ':') break;
+    p++;
+    }
+  value *= 1000000;
+  if (*p == '.')
+    {
+    int64_t scale = 100000;
+    for (p++; isdigit((unsigned char)*p); p++, scale /= 10)
+      value += (*p - '0') * scale;
+    }
+  if (*p != 0) return false;
+  *time = value;
+  return true;
+  }
+
+void can_play_seek(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!can::instance(TAG).HasPlayer())
+    {
+    writer->puts("CAN playing inactive");
+    return;
+    }
+
+  int64_t time;
+  if (!can_play_parsetime(argv[0], &time))
+    {
+    writer->printf("Error: invalid time '%s'\n", argv[0]);
+    return;
+    }
+
+  OvmsMutexLock lock(&can::instance(TAG).m_playermap_mutex);
+  for (can::canplay_map_t::iterator it=can::instance(TAG).m_playermap.begin(); it!=can::instance(TAG).m_playermap.end(); ++it)
+    {
+    if (argc>1 && it->first != (uint32_t)atoi(argv[1])) continue;
+    canplay* cl = it->second;
+    if (cl->Seek(time))
+      writer->printf("CAN player #%" PRId32 ": %s\n", it->first, cl->GetInfo().c_str());
+    else
+      writer->printf("CAN player #%" PRId32 ": Error: cannot seek (not indexed or busy)\n", it->first);
+    }
+  }
+
+void can_play_range(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!can::instance(TAG).HasPlayer())
+    {
+    writer->puts("CAN playing inactive");
+    return;
+    }
+
+  int64_t from, to;
+  if (!can_play_parsetime(argv[0], &from) || !can_play_parsetime(argv[1], &to) || (to > 0 && to <= from))
+    {
+    writer->puts("Error: invalid range");
+    return;
+    }
+
+  OvmsMutexLock lock(&can::instance(TAG).m_playermap_mutex);
+  for (can::canplay_map_t::iterator it=can::instance(TAG).m_playermap.begin(); it!=can::instance(TAG).m_playermap.end(); ++it)
+    {
+    if (argc>2 && it->first != (uint32_t)atoi(argv[2])) continue;
+    canplay* cl = it->second;
+    if (cl->SetRange(from, to))
+      writer->printf("CAN player #%" PRId32 ": %s\n", it->first, cl->GetInfo().c_str());
+    else
+      writer->printf("CAN player #%" PRId32 ": Error: cannot seek (not indexed or busy)\n", it->first);
+    }
+  }
+
+void can_play_loop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!can::instance(TAG).HasPlayer())
+    {
+    writer->puts("CAN playing inactive");
+    return;
+    }
+
+  bool loop = (strcmp(cmd->GetName(), "on") == 0);
+  OvmsMutexLock lock(&can::instance(TAG).m_playermap_mutex);
+  for (can::canplay_map_t::iterator it=can::instance(TAG).m_playermap.begin(); it!=can::instance(TAG).m_playermap.end(); ++it)
+    {
+    if (argc>0 && it->first != (uint32_t)atoi(argv[0])) continue;
+    canplay* cl = it->second;
+    cl->SetLoop(loop);
+    writer->printf("CAN player #%" PRId32 ": %s\n", it->first, cl->GetInfo().c_str());
+    }
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Play System initialisation
 ////////////////////////////////////////////////////////////////////////
@@ -183,7 +292,18 @@ OvmsCanPlayInit::OvmsCanPlayInit()
 
   OvmsCommand* cmd_canplay = cmd_can->RegisterCommand("play", "CAN play framework");
   cmd_canplay->RegisterCommand("stop", "Stop playing", can_play_stop,"[<id>]",0,1);
-  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,"<speed> [<id>]",1,2);
+  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,
+    "<speed> [<id>]\n"
+    "Speed: factor 0.1 … 100, or 0 / max = as fast as possible",1,2);
+  cmd_canplay->RegisterCommand("seek", "Seek to time", can_play_seek,
+    "<time> [<id>]\n"
+    "Time: [[<hours>:]<minutes>:]<seconds>[.<fraction>] from log start",1,2);
+  cmd_canplay->RegisterCommand("range", "Play time range", can_play_range,
+    "<from> <to> [<id>]\n"
+    "Times: [[<hours>:]<minutes>:]<seconds>[.<fraction>] from log start, <to> 0 = end of log",2,3);
+  OvmsCommand* cmd_canplay_loop = cmd_canplay->RegisterCommand("loop", "Loop playback of log or range");
+  cmd_canplay_loop->RegisterCommand("on", "Enable looping", can_play_loop,"[<id>]",0,1);
+  cmd_canplay_loop->RegisterCommand("off", "Disable looping", can_play_loop,"[<id>]",0,1);
   cmd_canplay->RegisterCommand("status", "Playing status", can_play_status,"[<id>]",0,1);
   cmd_canplay->RegisterCommand("list", "Playing list", can_play_list);
   cmd_canplay->RegisterCommand("start", "CAN play start framework");
@@ -201,13 +321,60 @@ canplay::canplay(const char* type, std::string format, canformat::canformat_serv
   m_formatter->SetServeMode(mode);
   m_filter = NULL;
   m_speed = 1;
+  m_task = NULL;
+  m_timer = NULL;
+  m_logstart = 0;
+  m_rangestart = 0;
+  m_rangeend = 0;
+  m_loop = false;
+  m_atend = false;
+  m_lasttime = 0;
+  m_reftime = 0;
+  m_reflog = 0;
 
   m_msgcount = 0;
-  xTaskCreatePinnedToCore(PlayTask, "OVMS CanPlay", 4096, (void*)this, 10, &m_task, CORE(1));
+  m_filtercount = 0;
+  m_seekcount = 0;
+  m_loopcount = 0;
+  m_driftcount = 0;
+  m_driftsum = 0;
+  m_driftmax = 0;
+  m_latecount = 0;
+  }
+
+/**
+ * Start: start the player task, called once the player is fully
+ *  constructed (the task uses the virtual input methods)
+ */
+void canplay::Start()
+  {
+  if (!m_timer)
+    {
+    esp_timer_create_args_t args = {};
+    args.callback = TimerCallback;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "can play";
+    if (esp_timer_create(&args, &m_timer) != ESP_OK)
+      {
+      ESP_LOGE(TAG, "canplay: cannot create timer");
+      m_timer = NULL;
+      return;
+      }
+    }
+  if (m_task == NULL)
+    xTaskCreatePinnedToCore(PlayTask, "OVMS CanPlay", 4096, (void*)this, 10, &m_task, CORE(1));
   }
 
 canplay::~canplay()
   {
+  if (m_timer)
+    {
+    esp_timer_stop(m_timer);
+    esp_timer_delete(m_timer);
+    m_timer = NULL;
+    }
+
   if (m_task)
     {
     vTaskDelete(m_task);
@@ -229,18 +396,128 @@ canplay::~canplay()
 
 void canplay::PlayTask(void *context)
   {
-//  canplay* me = (canplay*) context;
+  canplay* me = (canplay*) context;
+  CAN_log_message_t msg;
+  memset(&msg, 0, sizeof(msg));
+
+  while (1)
+    {
+    bool ok = false;
+    uint32_t seekcount = 0;
+    if (!me->m_atend)
+      {
+      OvmsMutexLock lock(&me->m_inputmutex);
+      seekcount = me->m_seekcount;
+      ok = me->IsOpen() && me->InputMsg(&msg);
+      }
+    int64_t time = (int64_t)msg.timestamp.tv_sec * 1000000 + msg.timestamp.tv_usec;
+    if (ok && me->m_rangeend > 0 && time - me->m_logstart > me->m_rangeend)
+      ok = false;
+
+    if (!ok)
+      {
+      // End of log or range: restart if looping, else wait for a seek
+      if (me->IsOpen() && !me->m_atend)
+        {
+        me->m_atend = true;
+        ESP_LOGI(TAG, "Playback end: %s", me->GetStats().c_str());
+        if (me->m_loop && me->Seek(me->m_rangestart))
+          {
+          me->m_loopcount++;
+          continue;
+          }
+        }
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+      }
+
+    if (!me->Schedule(time, seekcount))
+      continue;   // sought while waiting: discard the message
+    me->m_lasttime = time;
+    me->PlayMsg(&msg);
+    }
+  }
 
-//  CAN_log_message_t msg;
-//  while (me->InputMsg(&msg))
-//    {
-//    vTaskDelay(pdMS_TO_TICKS(1000));
-//    }
+void canplay::TimerCallback(void* arg)
+  {
+  canplay* me = (canplay*)arg;
+  if (me->m_task) xTaskNotifyGive(me->m_task);
+  }
 
-//  me->Close();
-  while(1)
+void canplay::Wakeup()
+  {
+  if (m_task) xTaskNotifyGive(m_task);
+  }
+
+/**
+ * Schedule: wait for the release time of a message logged at time [us],
+ *  i.e. its log time relative to the playback time base, scaled by the
+ *  speed factor. The time base is set on the first message after start
+ *  or seek, and rebased at the last message on speed changes or when
+ *  the log time jumps backwards.
+ *  Returns false if a seek occurred while waiting.
+ */
+bool canplay::Schedule(int64_t time, uint32_t seekcount)
+  {
+  while (1)
     {
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    if (m_seekcount != seekcount)
+      return false;
+
+    float speed = m_speed;
+    if (speed <= 0)
+      {
+      m_reftime = 0;
+      return true;
+      }
+
+    int64_t now = esp_timer_get_time();
+    if (m_reftime == 0 || m_lasttime == 0 || time < m_lasttime)
+      {
+      m_reftime = now;
+      m_reflog = (m_lasttime > 0 && time >= m_lasttime) ? m_lasttime : time;
+      }
+
+    int64_t due = m_reftime + (int64_t)((time - m_reflog) / speed);
+    int64_t delay = due - now;
+    if (delay <= CANPLAY_SLACK_US)
+      {
+      uint32_t late = (delay < 0) ? MIN(-delay, (int64_t)UINT32_MAX) : 0;
+      m_driftcount++;
+      m_driftsum += late;
+      if (late > m_driftmax) m_driftmax = late;
+      if (late > CANPLAY_LATE_US) m_latecount++;
+      return true;
+      }
+
+    esp_timer_stop(m_timer);
+    esp_timer_start_once(m_timer, delay);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+
+void canplay::PlayMsg(CAN_log_message_t* msg)
+  {
+  if (msg->type != CAN_LogFrame_RX && msg->type != CAN_LogFrame_TX)
+    return;
+
+  if ((m_filter != NULL) && (! m_filter->IsFiltered(&msg->frame)))
+    {
+    m_filtercount++;
+    return;
+    }
+
+  m_msgcount++;
+  switch (m_formatter->GetServeMode())
+    {
+    case canformat::Simulate:
+      can::instance(TAG).IncomingFrame(&msg->frame);
+      break;
+    case canformat::Transmit:
+      msg->frame.origin->Write(&msg->frame, pdMS_TO_TICKS(500));
+      break;
+    default:
+      break;
     }
   }
 
@@ -254,9 +531,47 @@ const char* canplay::GetFormat()
   return m_format.c_str();
   }
 
-void canplay::SetSpeed(uint32_t speed)
+void canplay::SetSpeed(float speed)
   {
   m_speed = speed;
+  m_reftime = 0;
+  Wakeup();
+  }
+
+/**
+ * Seek: continue playing at time (relative to the log start) [us]
+ */
+bool canplay::Seek(int64_t time)
+  {
+  OvmsMutexLock lock(&m_inputmutex, pdMS_TO_TICKS(1000));
+  if (!lock.IsLocked() || !SeekInput(time))
+    return false;
+  m_lasttime = 0;
+  m_atend = false;
+  m_seekcount++;
+  m_driftcount = 0;
+  m_driftsum = 0;
+  m_driftmax = 0;
+  m_latecount = 0;
+  Wakeup();
+  return true;
+  }
+
+/**
+ * SetRange: play from..to (relative to the log start, to = 0: end of log) [us]
+ */
+bool canplay::SetRange(int64_t from, int64_t to)
+  {
+  m_rangestart = from;
+  m_rangeend = to;
+  return Seek(from);
+  }
+
+void canplay::SetLoop(bool loop)
+  {
+  m_loop = loop;
+  if (loop && m_atend)
+    Seek(m_rangestart);
   }
 
 bool canplay::InputMsg(CAN_log_message_t* msg)
@@ -264,6 +579,11 @@ bool canplay::InputMsg(CAN_log_message_t* msg)
   return false;
   }
 
+bool canplay::SeekInput(int64_t time)
+  {
+  return false;
+  }
+
 std::string canplay::GetInfo()
   {
   std::ostringstream buf;
@@ -274,7 +594,23 @@ std::string canplay::GetInfo()
     buf << "(" << m_formatter->GetServeModeName() << ")";
     }
 
-  buf << " Speed:" << m_speed << "x";
+  if (m_speed > 0)
+    buf << " Speed:" << m_speed << "x";
+  else
+    buf << " Speed:max";
+
+  if (m_rangestart > 0 || m_rangeend > 0)
+    {
+    buf << " Range:" << std::fixed << std::setprecision(3) << ((double)m_rangestart / 1000000) << "-";
+    if (m_rangeend > 0)
+      buf << ((double)m_rangeend / 1000000);
+    else
+      buf << "end";
+    }
+  if (m_loop)
+    {
+    buf << " Loop:on";
+    }
 
   if (m_filter)
     {
@@ -293,6 +629,21 @@ std::string canplay::GetStats()
   std::ostringstream buf;
 
   buf << "total messages: " << m_msgcount;
+  buf << " filtered: " << m_filtercount;
+  if (m_logstart > 0 && m_lasttime > 0)
+    buf << " position: " << std::fixed << std::setprecision(3) << ((double)(m_lasttime - m_logstart) / 1000000) << "s";
+  if (m_driftcount > 0)
+    {
+    buf << " drift avg: " << std::fixed << std::setprecision(0) << ((double)m_driftsum / m_driftcount) << "us"
+      << " max: " << m_driftmax << "us"
+      << " late: " << m_latecount << " (>" << CANPLAY_LATE_US << "us)";
+    }
+  if (m_seekcount > 0)
+    buf << " seeks: " << m_seekcount;
+  if (m_loopcount > 0)
+    buf << " loops: " << m_loopcount;
+  if (m_atend)
+    buf << " (end)";
 
   return buf.str();
   }
@@ -30,9 +30,24 @@
 #include "freertos/semphr.h"
 #include "can.h"
 #include "canformat.h"
+#include <esp_timer.h>
+
+#define CANPLAY_SPEED_MIN       0.1     // speed factor range, 0 = as fast as possible
+#define CANPLAY_SPEED_MAX       100
+#define CANPLAY_SLACK_US        100     // release messages due within this time
+#define CANPLAY_LATE_US         1000    // drift statistics: late threshold
 
 /**
  * canplay is the general interface and base implementation for all can players.
+ *
+ * The player task reads messages via InputMsg() and releases each at its
+ * log time relative to the playback start (scaled by the speed factor),
+ * woken by a one-shot esp_timer. Messages due within CANPLAY_SLACK_US are
+ * released as a batch. Release latencies are collected per run (from the
+ * start or last seek) and logged at the end of the log or range. Times given to Seek() and
+ * SetRange() are relative to the first message of the log [us]. Players
+ * supporting random access implement SeekInput(), InputMsg() then returns
+ * the first message at or after the target time.
  */
 class canplay 
   {
@@ -42,12 +57,17 @@ class canplay
 
   public:
     static void PlayTask(void* context);
+    static void TimerCallback(void* arg);
+    void Start();
 
   public:
     const char* GetType();
     const char* GetFormat();
     virtual std::string GetStats();
-    void SetSpeed(uint32_t speed);
+    void SetSpeed(float speed);
+    bool Seek(int64_t time);
+    bool SetRange(int64_t from, int64_t to);
+    void SetLoop(bool loop);
 
   public:
     // Methods expected to be implemented by sub-classes
@@ -56,6 +76,7 @@ class canplay
     virtual bool IsOpen() = 0;
     virtual std::string GetInfo();
     virtual bool InputMsg(CAN_log_message_t* msg);
+    virtual bool SeekInput(int64_t time);
 
   public:
     virtual void SetFilter(canfilter* filter);
@@ -64,13 +85,35 @@ class canplay
   public:
     const char*         m_type;
     std::string         m_format;
-    uint32_t            m_speed;
+    float               m_speed;        // 0 = as fast as possible
     canformat*          m_formatter;
     canfilter*          m_filter;
 
+  protected:
+    bool Schedule(int64_t time, uint32_t seekcount);
+    void PlayMsg(CAN_log_message_t* msg);
+    void Wakeup();
+
   public:
     TaskHandle_t        m_task;
+    esp_timer_handle_t  m_timer;
+    OvmsMutex           m_inputmutex;   // input access: player task vs. commands
+    int64_t             m_logstart;     // time of first log message [us], 0 = unknown
+    int64_t             m_rangestart;   // relative to m_logstart [us]
+    int64_t             m_rangeend;     // relative to m_logstart [us], 0 = end of log
+    bool                m_loop;
+    bool                m_atend;        // end of log or range reached
+    int64_t             m_lasttime;     // time of last message played [us]
+    int64_t             m_reftime;      // playback time base: esp_timer time…
+    int64_t             m_reflog;       // …of log time [us], m_reftime 0 = rebase
     uint32_t            m_msgcount;
+    uint32_t            m_filtercount;
+    uint32_t            m_seekcount;
+    uint32_t            m_loopcount;
+    uint32_t            m_driftcount;   // messages scheduled in this run
+    uint64_t            m_driftsum;     // total release latency vs. due time [us]
+    uint32_t            m_driftmax;     // max release latency vs. due time [us]
+    uint32_t            m_latecount;    // messages released > CANPLAY_LATE_US late
   };
 
 #endif // __CANPLAY_H__
@@ -27,6 +27,11 @@
 #include "ovms_log.h"
 static const char *TAG = "canplay-vfs";
 
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
 #include "can.h"
 #include "canformat.h"
 #include "canplay_vfs.h"
@@ -91,6 +96,14 @@ canplay_vfs::canplay_vfs(std::string path, std::string format)
   {
   m_file = NULL;
   m_path = path;
+  m_closing = false;
+  m_rlen = 0;
+  m_rpos = 0;
+  m_roffset = 0;
+  m_seekpoint = -1;
+  m_skipuntil = 0;
+  m_indexed = false;
+  m_logend = 0;
   using std::placeholders::_1;
   using std::placeholders::_2;
   OvmsEvents::instance(TAG).RegisterEvent(IDTAG, "sd.mounted", std::bind(&canplay_vfs::MountListener, this, _1, _2));
@@ -109,6 +122,8 @@ canplay_vfs::~canplay_vfs()
 
 bool canplay_vfs::Open()
   {
+  OvmsMutexLock lock(&m_inputmutex);
+  m_closing = false;
   if (m_file)
     {
     fclose(m_file);
@@ -135,6 +150,12 @@ bool canplay_vfs::Open()
     ESP_LOGE(TAG, "Error: Can't read from '%s'", m_path.c_str());
     return false;
     }
+  ResetInput(0);
+  m_skipuntil = 0;
+  m_lasttime = 0;
+  m_atend = false;
+  m_indexed = false;
+  m_index.clear();
 
   ESP_LOGI(TAG, "Now playing CAN messages from '%s'", m_path.c_str());
 
@@ -143,6 +164,8 @@ bool canplay_vfs::Open()
 
 void canplay_vfs::Close()
   {
+  m_closing = true;
+  OvmsMutexLock lock(&m_inputmutex);
   if (m_file)
     {
     fclose(m_file);
@@ -162,6 +185,17 @@ std::string canplay_vfs::GetInfo()
   std::string result = canplay::GetInfo();
   result.append(" Path:");
   result.append(m_path);
+  if (m_indexed && m_index.size() > 0)
+    {
+    std::ostringstream buf;
+    buf << " Index:" << m_index.size()
+      << " Duration:" << std::fixed << std::setprecision(0) << ((double)(m_logend - m_logstart) / 1000000) << "s";
+    result.append(buf.str());
+    }
+  else if (m_file && !m_indexed)
+    {
+    result.append(" Index:pending");
+    }
   return result;
   }
 
@@ -178,5 +212,220 @@ bool canplay_vfs::InputMsg(CAN_log_message_t* msg)
   if (m_file == NULL) return false;
   if (m_formatter == NULL) return false;
 
+  if (!m_indexed)
+    {
+    if (!BuildIndex())
+      return false;
+    }
+
+  while (ReadMsg(msg))
+    {
+    int64_t time = (int64_t)msg->timestamp.tv_sec * 1000000 + msg->timestamp.tv_usec;
+    if (time < m_skipuntil)
+      continue;   // seeking: decode up to the target time
+    m_skipuntil = 0;
+    if (m_logstart == 0)
+      m_logstart = time;
+    return true;
+    }
   return false;
   }
+
+/**
+ * SeekInput: position the input at the last seek point before the log
+ *  start + time and skip the messages up to the target time.
+ *  The index lookup is a binary search, only the data from the seek
+ *  point is decoded. Without an index, only the log start can be sought.
+ */
+bool canplay_vfs::SeekInput(int64_t time)
+  {
+  if (m_file == NULL) return false;
+
+  if (time <= 0)
+    {
+    ResetInput(0);
+    m_skipuntil = 0;
+    return true;
+    }
+
+  if (m_index.empty()) return false;
+
+  int64_t target = m_logstart + time;
+  std::vector<canplay_index_entry_t>::iterator it = std::upper_bound(m_index.begin(), m_index.end(), target,
+    [](int64_t t, const canplay_index_entry_t& e) { return t < e.time; });
+  if (it != m_index.begin()) --it;
+  ResetInput(it->offset);
+  m_skipuntil = target;
+  return true;
+  }
+
+/**
+ * ReadMsg: decode the next message from the file.
+ *  m_seekpoint is set to the file offset from which decoding of the
+ *  message can start without preceding data, or -1 if there was no seek
+ *  point between the previous and this message.
+ */
+bool canplay_vfs::ReadMsg(CAN_log_message_t* msg)
+  {
+  m_seekpoint = m_formatter->IsSeekPoint() ? InputOffset() : -1;
+  while (1)
+    {
+    if (m_rpos >= m_rlen)
+      {
+      m_roffset += m_rlen;
+      m_rlen = fread(m_rbuf, 1, sizeof(m_rbuf), m_file);
+      m_rpos = 0;
+      if (m_rlen == 0 && m_formatter->Buffered() == 0)
+        return false;
+      }
+
+    memset(msg, 0, sizeof(*msg));
+    bool hasmore = false;
+    size_t used = m_formatter->put(msg, m_rbuf + m_rpos, m_rlen - m_rpos, &hasmore, NULL);
+    m_rpos += used;
+    if (msg->frame.origin != NULL)
+      return true;
+    if (used == 0 && !hasmore && (m_rlen == 0 || m_rpos < m_rlen))
+      return false;   // end of file, or the format can't decode the data
+    if (m_seekpoint < 0 && m_formatter->IsSeekPoint())
+      m_seekpoint = InputOffset();
+    }
+  }
+
+void canplay_vfs::ResetInput(long offset)
+  {
+  fseek(m_file, offset, SEEK_SET);
+  m_roffset = offset;
+  m_rlen = 0;
+  m_rpos = 0;
+  if (m_formatter) m_formatter->Reset();
+  }
+
+long canplay_vfs::InputOffset()
+  {
+  return m_roffset + m_rpos - m_formatter->Buffered();
+  }
+
+bool canplay_vfs::GetFileStat(uint32_t* size, uint32_t* time)
+  {
+  struct stat st;
+  if (stat(m_path.c_str(), &st) != 0)
+    return false;
+  *size = st.st_size;
+  *time = st.st_mtime;
+  return true;
+  }
+
+/**
+ * BuildIndex: load the stored index or scan the file to build it.
+ *  Returns false if aborted by Close().
+ */
+bool canplay_vfs::BuildIndex()
+  {
+  m_index.clear();
+  if (LoadIndex())
+    {
+    m_indexed = true;
+    m_logstart = m_index.front().time;
+    return true;
+    }
+
+  ESP_LOGI(TAG, "Building index for '%s'", m_path.c_str());
+  int64_t interval = (int64_t)OvmsConfig::instance(TAG).GetParamValueInt("can", "play.index.interval", 5) * 1000000;
+  CAN_log_message_t msg;
+  int64_t time = 0;
+  ResetInput(0);
+  while (!m_closing && ReadMsg(&msg))
+    {
+    time = (int64_t)msg.timestamp.tv_sec * 1000000 + msg.timestamp.tv_usec;
+    if (m_seekpoint >= 0 && (m_index.empty() || time >= m_index.back().time + interval))
+      {
+      canplay_index_entry_t entry = { time, (uint32_t)m_seekpoint, 0 };
+      m_index.push_back(entry);
+      }
+    }
+  ResetInput(0);
+
+  if (m_closing)
+    {
+    m_index.clear();
+    return false;
+    }
+
+  m_indexed = true;
+  m_logend = time;
+  if (m_index.empty())
+    {
+    ESP_LOGW(TAG, "No seek points found in '%s', seeking disabled", m_path.c_str());
+    return true;
+    }
+  m_logstart = m_index.front().time;
+  ESP_LOGI(TAG, "Index for '%s': %u entries", m_path.c_str(), (unsigned)m_index.size());
+  SaveIndex();
+  return true;
+  }
+
+bool canplay_vfs::LoadIndex()
+  {
+  uint32_t size, mtime;
+  if (!GetFileStat(&size, &mtime))
+    return false;
+
+  std::string path = m_path + CANPLAY_VFS_INDEXSUFFIX;
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    return false;
+
+  canplay_index_header_t hdr;
+  bool ok = (fread(&hdr, sizeof(hdr), 1, f) == 1)
+    && hdr.magic == CANPLAY_VFS_INDEXMAGIC
+    && hdr.version == CANPLAY_VFS_INDEXVERSION
+    && hdr.filesize == size
+    && hdr.filetime == mtime
+    && hdr.count > 0
+    && strncmp(hdr.format, m_format.c_str(), sizeof(hdr.format)) == 0;
+  if (ok)
+    {
+    m_index.resize(hdr.count);
+    ok = (fread(m_index.data(), sizeof(canplay_index_entry_t), hdr.count, f) == hdr.count);
+    }
+  fclose(f);
+
+  if (!ok)
+    {
+    m_index.clear();
+    return false;
+    }
+  m_logend = hdr.end;
+  ESP_LOGI(TAG, "Loaded index for '%s': %u entries", m_path.c_str(), (unsigned)m_index.size());
+  return true;
+  }
+
+void canplay_vfs::SaveIndex()
+  {
+  canplay_index_header_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  if (!GetFileStat(&hdr.filesize, &hdr.filetime))
+    return;
+  hdr.magic = CANPLAY_VFS_INDEXMAGIC;
+  hdr.version = CANPLAY_VFS_INDEXVERSION;
+  hdr.count = m_index.size();
+  hdr.end = m_logend;
+  strncpy(hdr.format, m_format.c_str(), sizeof(hdr.format));
+
+  std::string path = m_path + CANPLAY_VFS_INDEXSUFFIX;
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f)
+    {
+    ESP_LOGW(TAG, "Can't store index to '%s'", path.c_str());
+    return;
+    }
+  bool ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1)
+    && (fwrite(m_index.data(), sizeof(canplay_index_entry_t), m_index.size(), f) == m_index.size());
+  fclose(f);
+  if (!ok)
+    {
+    ESP_LOGW(TAG, "Error writing index '%s'", path.c_str());
+    unlink(path.c_str());
+    }
+  }
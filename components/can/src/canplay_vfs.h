@@ -29,6 +29,38 @@
 #define __CANPLAY_VFS_H__
 
 #include "canplay.h"
+#include <vector>
+
+#define CANPLAY_VFS_READSIZE    1024            // file read chunk size
+#define CANPLAY_VFS_INDEXSUFFIX ".sidx"         // seek index file suffix
+#define CANPLAY_VFS_INDEXMAGIC  0x5849534f      // "OSIX"
+#define CANPLAY_VFS_INDEXVERSION 1
+
+/**
+ * Seek index: maps log times to file offsets at which the format can be
+ *  decoded without preceding data (see canformat::IsSeekPoint()), at
+ *  intervals of play.index.interval seconds. It is built by scanning the
+ *  file on first playback and stored as <path>.sidx, the stored index is
+ *  used as long as the log file size & modification time match.
+ */
+typedef struct
+  {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;                       // number of entries
+  uint32_t filesize;
+  uint32_t filetime;                    // log file modification time
+  uint32_t reserved;
+  int64_t end;                          // time of last message [us]
+  char format[16];
+  } canplay_index_header_t;
+
+typedef struct
+  {
+  int64_t time;                         // time of first message [us]
+  uint32_t offset;                      // file offset of seek point
+  uint32_t reserved;
+  } canplay_index_entry_t;
 
 class canplay_vfs : public canplay
   {
@@ -44,13 +76,37 @@ class canplay_vfs : public canplay
 
   public:
     virtual bool InputMsg(CAN_log_message_t* msg);
+    virtual bool SeekInput(int64_t time);
 
   public:
     virtual void MountListener(std::string event, void* data);
 
+  protected:
+    bool ReadMsg(CAN_log_message_t* msg);
+    void ResetInput(long offset);
+    long InputOffset();
+    bool BuildIndex();
+    bool LoadIndex();
+    void SaveIndex();
+    bool GetFileStat(uint32_t* size, uint32_t* time);
+
   public:
     std::string         m_path;
     FILE*               m_file;
+    volatile bool       m_closing;      // abort index scan
+
+  protected:
+    uint8_t             m_rbuf[CANPLAY_VFS_READSIZE];
+    size_t              m_rlen;
+    size_t              m_rpos;
+    long                m_roffset;      // file offset of m_rbuf
+    long                m_seekpoint;    // see ReadMsg()
+    int64_t             m_skipuntil;    // seeking: skip messages before [us]
+
+  protected:
+    std::vector<canplay_index_entry_t> m_index;
+    bool                m_indexed;      // index built/loaded for the file
+    int64_t             m_logend;       // time of last message [us]
   };
 
 #endif // __CANPLAY_VFS_H__
@@ -52,11 +52,11 @@ CANopen &CANopen::instance(const char* caller) {
 
 
 CANopen::CANopen()
+  : m_rxreader("canopen")
   {
   ESP_LOGI(TAG, "Initialising CANopen");
 
   m_rxtask = NULL;
-  m_rxqueue = NULL;
 
   for (int i=0; i < CAN_INTERFACE_CNT; i++)
     m_worker[i] = NULL;
@@ -99,8 +99,8 @@ CANopen::~CANopen()
     }
   if (m_rxtask)
     {
-    vQueueDelete(m_rxqueue);
     vTaskDelete(m_rxtask);
+    m_rxreader.Detach();
     }
   }
 
@@ -117,17 +117,17 @@ static void CANopenRxTask(void *pvParameters)
 
 void CANopen::CanRxTask()
   {
-  CAN_frame_t frame;
+  CAN_log_message_t* entry;
 
   while(1)
     {
-    if (xQueueReceive(m_rxqueue, &frame, (portTickType)portMAX_DELAY) == pdTRUE)
+    if ((entry = m_rxreader.Read(portMAX_DELAY)) != NULL)
       {
       for (int i=0; i < CAN_INTERFACE_CNT; i++)
         {
-        if (m_worker[i] && m_worker[i]->m_bus == frame.origin)
+        if (m_worker[i] && m_worker[i]->m_bus == entry->frame.origin)
           {
-          m_worker[i]->IncomingFrame(&frame);
+          m_worker[i]->IncomingFrame(&entry->frame);
           break;
           }
         }
@@ -151,10 +151,13 @@ CANopenWorker* CANopen::Start(canbus* bus)
   // start CAN rx task:
   if (m_rxtask == NULL)
     {
-    m_rxqueue = xQueueCreate(20, sizeof(CAN_frame_t));
+    if (!m_rxreader.Attach())
+      {
+      ESP_LOGE(TAG, "Start: cannot attach to the CAN frame ring");
+      return NULL;
+      }
     xTaskCreatePinnedToCore(CANopenRxTask, "OVMS COrx",
       CONFIG_OVMS_COMP_CANOPEN_RX_STACK, (void*)this, 15, &m_rxtask, CORE(0));
-    can::instance(TAG).RegisterListener(m_rxqueue);
     }
 
   // start worker:
@@ -164,6 +167,8 @@ CANopenWorker* CANopen::Start(canbus* bus)
       {
       m_worker[i] = new CANopenWorker(bus);
       m_workercnt++;
+      // CANopen uses standard frames only:
+      can::instance(TAG).AddRxInterest("canopen", bus, CAN_frame_std, 0, 0x7ff);
       ESP_LOGI(TAG, "Worker started on %s", bus->GetName());
       OvmsEvents::instance().SignalEvent("canopen.worker.start", (void*) m_worker[i]);
       return m_worker[i];
@@ -192,15 +197,14 @@ bool CANopen::Stop(canbus* bus)
       OvmsEvents::instance().SignalEvent("canopen.worker.stop", (void*) m_worker[i]);
       delete m_worker[i];
       m_worker[i] = NULL;
+      can::instance(TAG).RemoveRxInterest("canopen", bus);
       ESP_LOGI(TAG, "Worker stopped on %s", bus->GetName());
 
       if (--m_workercnt == 0)
         {
         // last worker stopped, stop CAN rx task:
-        can::instance(TAG).DeregisterListener(m_rxqueue);
-        vQueueDelete(m_rxqueue);
         vTaskDelete(m_rxtask);
-        m_rxqueue = NULL;
+        m_rxreader.Detach();
         m_rxtask = NULL;
         }
 
@@ -418,7 +418,7 @@ class CANopen
     static void shell_scan(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
 
   public:
-    QueueHandle_t         m_rxqueue;    // CAN rx queue
+    canringreader         m_rxreader;   // CAN rx frame ring reader
     TaskHandle_t          m_rxtask;     // CAN rx task
 
     CANopenWorker*        m_worker[CAN_INTERFACE_CNT];
@@ -105,6 +105,53 @@ dbc_extract_bits_big_endian(uint8_t *candata, unsigned int bpos, unsigned int bi
   return val;
   }
 
+static inline void
+dbc_insert_bits(uint8_t *candata, unsigned int bpos, unsigned int align, unsigned int shifter, unsigned int pos, uint64_t val)
+  {
+  unsigned int mask = ((1 << shifter) - 1) << align;
+  candata[bpos/8] = (candata[bpos/8] & ~mask) | (((val >> pos) << align) & mask);
+  }
+
+static void
+dbc_insert_bits_little_endian(uint8_t *candata, unsigned int bpos, unsigned int bits, uint64_t val)
+  {
+  unsigned int pos, aligner, shifter;
+
+  pos = 0;
+  while (bits > 0)
+    {
+    aligner = bpos % 8;
+    shifter = 8 - aligner;
+    shifter = MIN(shifter, bits);
+
+    dbc_insert_bits(candata, bpos, aligner, shifter, pos, val);
+    pos += shifter;
+
+    bpos += shifter;
+    bits -= shifter;
+    }
+  }
+
+static void
+dbc_insert_bits_big_endian(uint8_t *candata, unsigned int bpos, unsigned int bits, uint64_t val)
+  {
+  unsigned int pos, aligner, slicer;
+
+  pos = bits;
+  while (bits > 0)
+    {
+    slicer = (bpos % 8) + 1;
+    slicer = MIN(slicer, bits);
+    aligner = ((bpos % 8) + 1) - slicer;
+
+    pos -= slicer;
+    dbc_insert_bits(candata, bpos, aligner, slicer, pos, val);
+
+    bpos = ((bpos / 8) + 1) * 8 + 7;
+    bits -= slicer;
+    }
+  }
+
 uint32_t dbcMessageIdFromString(const char* id)
   {
   uint32_t msgid = 0;
@@ -815,7 +862,37 @@ void dbcSignal::SetUnit(const char* unit)
 
 void dbcSignal::Encode(dbcNumber* source, CAN_frame_t* msg)
   {
-  // TODO: An efficient encoding of the signal
+  if (m_signal_size <= 0 || m_signal_size > 64)
+    return;
+
+  // Remove offset and factor, round to the nearest raw value:
+  double factor = m_factor.GetDouble();
+  double raw = source->GetDouble() - m_offset.GetDouble();
+  if (factor != 0)
+    raw /= factor;
+  raw = (raw < 0) ? (raw - 0.5) : (raw + 0.5);
+
+  // Saturate to the signal range:
+  uint64_t val;
+  if (m_value_type == DBC_VALUETYPE_UNSIGNED)
+    {
+    double max = (m_signal_size == 64) ? 18446744073709551615.0 : (double)((1ULL << m_signal_size) - 1);
+    if (raw < 0) raw = 0;
+    if (raw > max) raw = max;
+    val = (uint64_t)raw;
+    }
+  else
+    {
+    double max = (double)((1ULL << (m_signal_size-1)) - 1);
+    if (raw < -max-1) raw = -max-1;
+    if (raw > max) raw = max;
+    val = (uint64_t)(int64_t)raw;
+    }
+
+  if (m_byte_order == DBC_BYTEORDER_BIG_ENDIAN)
+    dbc_insert_bits_big_endian(msg->data.u8,m_start_bit,m_signal_size,val);
+  else
+    dbc_insert_bits_little_endian(msg->data.u8,m_start_bit,m_signal_size,val);
   }
 
 dbcNumber dbcSignal::Decode(CAN_frame_t* msg)
@@ -44,6 +44,7 @@
 #include "dbc.h"
 #include "ovms_log.h"
 #ifdef CONFIG_OVMS
+#include "esp_heap_caps.h"
 //#define YYMALLOC ExternalRamMalloc
 #endif // #ifdef CONFIG_OVMS
 
@@ -39,6 +39,10 @@ static const char *TAG = "esp32can";
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
 #include <string.h>
+#include <sstream>
+#include <iomanip>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "global.h"
 #include "esp32can.h"
 #include "esp32can_regdef.h"
@@ -65,7 +69,6 @@ static portMUX_TYPE esp32can_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static inline uint32_t ESP32CAN_rxframe(esp32can *me, BaseType_t* task_woken)
   {
-  static CAN_queue_msg_t msg;
   uint32_t error_irqs = 0;
 
   // The ESP32 CAN controller works different from the SJA1000 here.
@@ -127,16 +130,26 @@ static inline uint32_t ESP32CAN_rxframe(esp32can *me, BaseType_t* task_woken)
       }
     else
       {
-      // Valid frame in receive buffer: record the origin
-      memset(&msg,0,sizeof(msg));
-      msg.type = CAN_frame;
-      msg.body.frame.origin = me;
+      uint32_t head = me->m_rxring_head;
+      if (head - me->m_rxring_tail >= ESP32CAN_RXRING_SIZE)
+        {
+        // RX ring full, CAN task is lagging behind => discard frame:
+        me->m_status.rxbuf_overflow++;
+        MODULE_ESP32CAN->CMR.B.RRB = 1;
+        continue;
+        }
+
+      // Valid frame in receive buffer: read directly into the RX ring
+      esp32can_rxentry_t* entry = &me->m_rxring[head & (ESP32CAN_RXRING_SIZE-1)];
+      CAN_frame_t* frame = &entry->frame;
+      memset(frame,0,sizeof(CAN_frame_t));
+      frame->origin = me;
 
       // get FIR
-      msg.body.frame.FIR.U = MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U;
+      frame->FIR.U = MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U;
 
       // Detect invalid frames
-      if (msg.body.frame.FIR.B.DLC > sizeof(msg.body.frame.data.u8))
+      if (frame->FIR.B.DLC > sizeof(frame->data.u8))
         {
         error_irqs |= __CAN_IRQ_INVALID_RX;
         me->m_status.invalid_rx++;
@@ -147,32 +160,51 @@ static inline uint32_t ESP32CAN_rxframe(esp32can *me, BaseType_t* task_woken)
         }
 
       // check if this is a standard or extended CAN frame
-      if (msg.body.frame.FIR.B.FF == CAN_frame_std)
+      if (frame->FIR.B.FF == CAN_frame_std)
         {
         // Standard frame: Get Message ID
-        msg.body.frame.MsgID = ESP32CAN_GET_STD_ID;
+        frame->MsgID = ESP32CAN_GET_STD_ID;
         // …deep copy data bytes
-        for (int k=0 ; k<msg.body.frame.FIR.B.DLC ; k++)
-          msg.body.frame.data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.STD.data[k];
+        for (int k=0 ; k<frame->FIR.B.DLC ; k++)
+          frame->data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.STD.data[k];
         }
       else
         {
         // Extended frame: Get Message ID
-        msg.body.frame.MsgID = ESP32CAN_GET_EXT_ID;
+        frame->MsgID = ESP32CAN_GET_EXT_ID;
         // …deep copy data bytes
-        for (int k=0 ; k<msg.body.frame.FIR.B.DLC ; k++)
-          msg.body.frame.data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.EXT.data[k];
+        for (int k=0 ; k<frame->FIR.B.DLC ; k++)
+          frame->data.u8[k] = MODULE_ESP32CAN->MBX_CTRL.FCTRL.TX_RX.EXT.data[k];
         }
 
       // Request next frame:
       MODULE_ESP32CAN->CMR.B.RRB = 1;
 
-      // Send frame to CAN framework:
-      xQueueSendFromISR(can::instance(TAG).m_rxqueue, &msg, task_woken);
+      // Publish frame to CAN task:
+      entry->time = esp_timer_get_time();
+      me->m_rxring_head = head + 1;
       }
 
     } // while (MODULE_ESP32CAN->SR.B.RBS | MODULE_ESP32CAN->SR.B.DOS)
 
+  // Notify CAN task on the empty → non-empty transition, or again on
+  // reaching the watermark (i.e. if the first notification got lost):
+  uint32_t fill = me->m_rxring_head - me->m_rxring_tail;
+  if (fill > 0 && (!me->m_rxring_signalled ||
+      (fill >= ESP32CAN_RXRING_WATERMARK && !me->m_rxring_watermark)))
+    {
+    CAN_queue_msg_t msg;
+    msg.type = CAN_asyncinterrupthandler;
+    msg.body.bus = me;
+    if (xQueueSendFromISR(me->m_rxqueue, &msg, task_woken) == pdTRUE)
+      {
+      me->m_rxring_signals++;
+      if (me->m_rxring_signalled)
+        me->m_rxring_watermark = true;
+      me->m_rxring_signalled = true;
+      }
+    }
+
   return error_irqs;
   }
 
@@ -275,7 +307,7 @@ static IRAM_ATTR void ESP32CAN_isr(void *pvParameters)
         }
       msg.body.frame = me->m_tx_frame;
       msg.body.bus = me;
-      xQueueSendFromISR(can::instance(TAG).m_rxqueue, &msg, &task_woken);
+      xQueueSendFromISR(me->m_rxqueue, &msg, &task_woken);
       }
 
     // Collect error interrupts:
@@ -343,7 +375,7 @@ static IRAM_ATTR void ESP32CAN_isr(void *pvParameters)
         else
           msg.type = CAN_logstatus;
         msg.body.bus = me;
-        xQueueSendFromISR(can::instance(TAG).m_rxqueue, &msg, &task_woken);
+        xQueueSendFromISR(me->m_rxqueue, &msg, &task_woken);
         }
       }
     }
@@ -386,6 +418,22 @@ esp32can::esp32can(const char* name, int txpin, int rxpin)
   // after startup.
   m_powermode = Off;
   m_tx_abort = false;
+
+  m_rxring = (esp32can_rxentry_t*)heap_caps_malloc(ESP32CAN_RXRING_SIZE * sizeof(esp32can_rxentry_t),
+    MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+  if (m_rxring == NULL)
+    ESP_LOGE(TAG, "Failed to allocate RX ring, Start() will retry");
+  m_rxring_head = 0;
+  m_rxring_tail = 0;
+  m_rxring_signalled = false;
+  m_rxring_watermark = false;
+  ClearStatus();
+
+  // Accept all frames until the frame interests are known:
+  m_acc_single = false;
+  memset(m_acc_code, 0, sizeof(m_acc_code));
+  memset(m_acc_mask, 0xff, sizeof(m_acc_mask));
+
   MODULE_ESP32CAN->MOD.B.RM = 1;
 
   // Launch ISR allocator task on core 0:
@@ -399,6 +447,107 @@ esp32can::~esp32can()
   MyESP32can = NULL;
   }
 
+/**
+ * AsynchronousInterruptHandler: drain the RX ring filled by the ISR
+ *  in one batch, dispatching the frames in place.
+ */
+bool esp32can::AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesReceived)
+  {
+  ESP32CAN_ENTER_CRITICAL();
+  uint32_t head = m_rxring_head;
+  ESP32CAN_EXIT_CRITICAL();
+
+  uint32_t tail = m_rxring_tail;
+  uint32_t batch = head - tail;
+  *framesReceived = batch;
+
+  if (batch > 0)
+    {
+    int bucket = 31 - __builtin_clz(batch);
+    if (bucket >= ESP32CAN_RXBATCH_BUCKETS) bucket = ESP32CAN_RXBATCH_BUCKETS-1;
+    m_rxbatch_hist[bucket]++;
+
+    for (; tail != head; tail++)
+      {
+      esp32can_rxentry_t* entry = &m_rxring[tail & (ESP32CAN_RXRING_SIZE-1)];
+      uint32_t latency = esp_timer_get_time() - entry->time;
+      if (latency < m_rxlatency_min) m_rxlatency_min = latency;
+      if (latency > m_rxlatency_max) m_rxlatency_max = latency;
+      m_rxlatency_sum += latency;
+      m_rxlatency_cnt++;
+
+      can::instance(TAG).IncomingFrame(&entry->frame, entry->time);
+
+      // Release entry to the ISR:
+      m_rxring_tail = tail + 1;
+      }
+    }
+
+  // Reset notification state if the ring is empty now:
+  ESP32CAN_ENTER_CRITICAL();
+  bool more = (m_rxring_head != m_rxring_tail);
+  if (!more)
+    {
+    m_rxring_signalled = false;
+    m_rxring_watermark = false;
+    }
+  ESP32CAN_EXIT_CRITICAL();
+
+  if (more)
+    {
+    // Requeue the next batch to give other CAN task jobs a chance:
+    CAN_queue_msg_t msg;
+    msg.type = CAN_asyncinterrupthandler;
+    msg.body.bus = this;
+    if (xQueueSend(m_rxqueue, &msg, 0) != pdTRUE)
+      return true;
+    }
+
+  return false;
+  }
+
+void esp32can::ClearStatus()
+  {
+  canbus::ClearStatus();
+  m_rxring_signals = 0;
+  memset(m_rxbatch_hist, 0, sizeof(m_rxbatch_hist));
+  m_rxlatency_min = UINT32_MAX;
+  m_rxlatency_max = 0;
+  m_rxlatency_sum = 0;
+  m_rxlatency_cnt = 0;
+  }
+
+std::string esp32can::GetDriverStatus()
+  {
+  std::ostringstream buf;
+
+  buf << "Rx signals:" << std::setw(20) << m_rxring_signals << "\n";
+  buf << "Rx batches:";
+  for (int k=0; k<ESP32CAN_RXBATCH_BUCKETS; k++)
+    {
+    uint32_t from = 1 << k;
+    if (from >= ESP32CAN_RXRING_SIZE)
+      buf << " " << from << ":";
+    else if (from == 1)
+      buf << " 1:";
+    else
+      buf << " " << from << "-" << (2*from-1) << ":";
+    buf << m_rxbatch_hist[k];
+    }
+  buf << "\n";
+
+  if (m_rxlatency_cnt > 0)
+    {
+    buf << "Rx latency:" << std::setw(20)
+      << (std::to_string(m_rxlatency_min) + "/"
+        + std::to_string((uint32_t)(m_rxlatency_sum / m_rxlatency_cnt)) + "/"
+        + std::to_string(m_rxlatency_max))
+      << " us (min/avg/max)\n";
+    }
+
+  return buf.str();
+  }
+
 esp_err_t esp32can::InitController()
   {
   bool brp_div = 0;
@@ -453,15 +602,9 @@ esp_err_t esp32can::InitController()
       ier &= ~__CAN_IER_BRP_DIV;
   MODULE_ESP32CAN->IER.U = ier;
 
-  // No acceptance filtering, as we want to fetch all messages
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[0] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[1] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[2] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[3] = 0;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[0] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[1] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[2] = 0xff;
-  MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[3] = 0xff;
+  // Acceptance filter as derived from the frame interests (see SetAcceptanceFilter)
+  WriteAcceptanceFilter();
+  m_rxfilter_pending = false;
 
   // Set to normal mode
   MODULE_ESP32CAN->OCR.B.OCMODE=__CAN_OC_NOM;
@@ -501,6 +644,21 @@ esp_err_t esp32can::Start(CAN_mode_t mode, CAN_speed_t speed)
       break;
     }
 
+  // The ISR needs the RX ring, retry if the allocation failed at boot:
+  if (m_rxring == NULL)
+    {
+    m_rxring = (esp32can_rxentry_t*)heap_caps_malloc(ESP32CAN_RXRING_SIZE * sizeof(esp32can_rxentry_t),
+      MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+    if (m_rxring == NULL)
+      {
+      ESP_LOGE(TAG, "Failed to allocate RX ring (%d bytes)",
+        (int)(ESP32CAN_RXRING_SIZE * sizeof(esp32can_rxentry_t)));
+      return ESP_ERR_NO_MEM;
+      }
+    m_rxring_head = 0;
+    m_rxring_tail = 0;
+    }
+
   canbus::Start(mode, speed);
 
   m_mode = mode;
@@ -557,7 +715,7 @@ esp_err_t esp32can::Stop()
   canbus::Stop();
 
   // Clear TX queue
-  xQueueReset(m_txqueue);
+  m_txqueue.Clear();
 
   ESP32CAN_ENTER_CRITICAL();
 
@@ -583,6 +741,196 @@ esp_err_t esp32can::Stop()
   }
 
 
+/**
+ * WriteAcceptanceFilter: transfer the acceptance filter setup to the
+ *  controller (driver internal, controller needs to be in reset mode)
+ */
+void esp32can::WriteAcceptanceFilter()
+  {
+  MODULE_ESP32CAN->MOD.B.AFM = m_acc_single ? 1 : 0;
+  for (int i=0; i<4; i++)
+    {
+    MODULE_ESP32CAN->MBX_CTRL.ACC.CODE[i] = m_acc_code[i];
+    MODULE_ESP32CAN->MBX_CTRL.ACC.MASK[i] = m_acc_mask[i];
+    }
+  }
+
+/**
+ * SetAcceptanceFilter: derive the acceptance filter setup from the frame interests
+ *  The SJA1000 style filter offers these options:
+ *   - dual filter mode: two patterns on the standard ID, which also apply to
+ *     the upper 11 bits of extended IDs (the only choice if standard frames
+ *     are needed)
+ *   - single filter mode: one pattern on the full extended ID
+ *   - dual filter mode: two patterns on the upper 16 bits of extended IDs
+ *  The option accepting the smallest share of the ID space is applied. If
+ *  all IDs would pass, the filter is opened completely.
+ */
+esp_err_t esp32can::SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                        const CAN_filter_range_list_t& ext_ranges)
+  {
+  CAN_acceptance_list_t p;
+  CAN_filter_range_list_t r;
+  bool single = false;
+  uint8_t code[4] = { 0, 0, 0, 0 };
+  uint8_t mask[4] = { 0xff, 0xff, 0xff, 0xff };
+  double share = 1.0;
+
+  // Dual filter, 11 bit patterns (standard ID / extended ID 28…18):
+  r = std_ranges;
+  for (const CAN_filter_range_t& range : ext_ranges)
+    r.push_back({ range.id_from >> 18, range.id_to >> 18 });
+  CAN_filter_range_merge(r);
+  CAN_acceptance_cover(r, p, 2);
+  if (!p.empty())
+    {
+    if (p.size() == 1) p.push_back(p[0]);
+    double s = (double)(CAN_acceptance_size(p[0].dontcare) + CAN_acceptance_size(p[1].dontcare)) / 0x800;
+    if (s < share)
+      {
+      share = s;
+      for (int i=0; i<2; i++)
+        {
+        // RTR & data bits are don't care:
+        code[i*2]   = p[i].code >> 3;
+        code[i*2+1] = (p[i].code & 7) << 5;
+        mask[i*2]   = p[i].dontcare >> 3;
+        mask[i*2+1] = ((p[i].dontcare & 7) << 5) | 0x1f;
+        }
+      }
+    }
+
+  if (std_ranges.empty() && !ext_ranges.empty())
+    {
+    // Single filter, 29 bit pattern:
+    CAN_acceptance_cover(ext_ranges, p, 1);
+    double s = (double)CAN_acceptance_size(p[0].dontcare) / 0x20000000;
+    if (s < share)
+      {
+      share = s;
+      single = true;
+      uint32_t c = p[0].code << 3;
+      uint32_t m = (p[0].dontcare << 3) | 0x07;
+      for (int i=0; i<4; i++)
+        {
+        code[i] = c >> (24 - i*8);
+        mask[i] = m >> (24 - i*8);
+        }
+      }
+
+    // Dual filter, 16 bit patterns (extended ID 28…13):
+    r.clear();
+    for (const CAN_filter_range_t& range : ext_ranges)
+      r.push_back({ range.id_from >> 13, range.id_to >> 13 });
+    CAN_filter_range_merge(r);
+    CAN_acceptance_cover(r, p, 2);
+    if (p.size() == 1) p.push_back(p[0]);
+    s = (double)(CAN_acceptance_size(p[0].dontcare) + CAN_acceptance_size(p[1].dontcare)) / 0x10000;
+    if (s < share)
+      {
+      share = s;
+      single = false;
+      for (int i=0; i<2; i++)
+        {
+        code[i*2]   = p[i].code >> 8;
+        code[i*2+1] = p[i].code & 0xff;
+        mask[i*2]   = p[i].dontcare >> 8;
+        mask[i*2+1] = p[i].dontcare & 0xff;
+        }
+      }
+    }
+
+  if (share >= 1.0)
+    {
+    // Open filter:
+    single = false;
+    memset(code, 0, sizeof(code));
+    memset(mask, 0xff, sizeof(mask));
+    m_rxfilter_info = "accept all";
+    }
+  else
+    {
+    std::ostringstream buf;
+    buf << (single ? "single" : "dual") << std::hex << std::setfill('0')
+      << " code " << std::setw(2) << (int)code[0] << std::setw(2) << (int)code[1]
+      << std::setw(2) << (int)code[2] << std::setw(2) << (int)code[3]
+      << " mask " << std::setw(2) << (int)mask[0] << std::setw(2) << (int)mask[1]
+      << std::setw(2) << (int)mask[2] << std::setw(2) << (int)mask[3]
+      << std::dec << std::fixed << std::setprecision(2) << ", " << share * 100 << "% of ID space";
+    m_rxfilter_info = buf.str();
+    }
+
+  if (single == m_acc_single && memcmp(code, m_acc_code, 4) == 0 && memcmp(mask, m_acc_mask, 4) == 0)
+    return ESP_OK;
+
+  ESP_LOGD(TAG, "%s: acceptance filter: %s", GetName(), m_rxfilter_info.c_str());
+
+  OvmsMutexLock lock(&m_write_mutex);
+  m_acc_single = single;
+  memcpy(m_acc_code, code, 4);
+  memcpy(m_acc_mask, mask, 4);
+  if (m_powermode != On)
+    return ESP_OK; // applied by InitController()
+
+  // Entering reset mode aborts a running transmission or reception, so the
+  // filter is applied by the CAN task when the controller is idle:
+  if (!m_rxfilter_pending)
+    {
+    m_rxfilter_pending = true;
+    RequestAcceptanceFilter();
+    }
+  return ESP_OK;
+  }
+
+/**
+ * ApplyAcceptanceFilter: transfer a changed acceptance filter to the
+ *  controller (CAN task). The controller needs to enter reset mode for this,
+ *  which aborts a running transmission or reception and clears the RX FIFO.
+ *  So this waits for an idle moment: TX buffer free, no transmission or
+ *  reception in progress and the RX FIFO drained by the ISR. If a frame is
+ *  being sent, TxCallback() retries after its completion.
+ */
+void esp32can::ApplyAcceptanceFilter()
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+  if (!m_rxfilter_pending)
+    return;
+  if (m_powermode != On)
+    {
+    m_rxfilter_pending = false; // applied by InitController()
+    return;
+    }
+
+  for (int i=0; i<ESP32CAN_ACCFILTER_POLLS; i++)
+    {
+    if ((m_state & CAN_M_STATE_TX_BUF_OCCUPIED) != 0)
+      return; // retried by TxCallback()
+    if ((MODULE_ESP32CAN->SR.U & (__CAN_STS_RXBUF|__CAN_STS_RXPEND|__CAN_STS_TXPEND)) != 0)
+      continue;
+
+    ESP32CAN_ENTER_CRITICAL();
+    // Check again, the ISR may have run meanwhile:
+    if ((m_state & CAN_M_STATE_TX_BUF_OCCUPIED) == 0 &&
+        (MODULE_ESP32CAN->SR.U & (__CAN_STS_RXBUF|__CAN_STS_RXPEND|__CAN_STS_TXPEND)) == 0)
+      {
+      MODULE_ESP32CAN->MOD.B.RM = 1;
+      WriteAcceptanceFilter();
+      MODULE_ESP32CAN->MOD.B.RM = 0;
+      m_rxfilter_pending = false;
+      }
+    ESP32CAN_EXIT_CRITICAL();
+
+    if (!m_rxfilter_pending)
+      {
+      ESP_LOGD(TAG, "%s: acceptance filter applied", GetName());
+      return;
+      }
+    }
+
+  // Receiver stayed busy: retry after the frames received meanwhile
+  RequestAcceptanceFilter();
+  }
+
 /**
  * WriteFrame: deliver a frame to the hardware for transmission (driver internal)
  */
@@ -644,7 +992,7 @@ esp_err_t esp32can::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*
     }
 
   // if there are frames waiting in the TX queue, add the new one there as well:
-  if (uxQueueMessagesWaiting(m_txqueue))
+  if (m_txqueue.Pending())
     {
     return QueueWrite(p_frame, maxqueuewait);
     }
@@ -667,11 +1015,15 @@ void esp32can::TxCallback(CAN_frame_t* p_frame, bool success)
   // Application callbacks & logging:
   canbus::TxCallback(p_frame, success);
 
+  // Apply a filter change deferred by the transmission:
+  if (m_rxfilter_pending)
+    ApplyAcceptanceFilter();
+
   // TX buffer has become available; send next queued frame (if any):
     {
     OvmsMutexLock lock(&m_write_mutex);
     CAN_frame_t frame;
-    while (xQueueReceive(m_txqueue, (void*)&frame, 0) == pdTRUE)
+    while (m_txqueue.Pop(&frame))
       {
       if (WriteFrame(&frame) == ESP_FAIL)
         {
@@ -681,7 +1033,7 @@ void esp32can::TxCallback(CAN_frame_t* p_frame, bool success)
         msg.type = CAN_txfailedcallback;
         msg.body.frame = frame;
         msg.body.bus = this;
-        xQueueSend(can::instance(TAG).m_rxqueue, &msg, 0);
+        xQueueSend(m_rxqueue, &msg, 0);
         }
       else
         {
@@ -47,6 +47,20 @@
 #include "soc/dport_reg.h"
 #include <math.h>
 
+// RX ring between ISR and CAN task:
+#define ESP32CAN_RXRING_SIZE        64    // entries, must be a power of 2
+#define ESP32CAN_RXRING_WATERMARK   48    // fill level to signal the CAN task again
+#define ESP32CAN_RXBATCH_BUCKETS    7     // batch size histogram: 1, 2-3, 4-7, … 64
+
+// Status polls waiting for an idle controller to apply an acceptance filter:
+#define ESP32CAN_ACCFILTER_POLLS    2000
+
+typedef struct
+  {
+  CAN_frame_t frame;
+  int64_t     time;                   // esp_timer time of reception
+  } esp32can_rxentry_t;
+
 class esp32can : public canbus
   {
   public:
@@ -61,12 +75,19 @@ class esp32can : public canbus
   public:
     esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
     void TxCallback(CAN_frame_t* p_frame, bool success);
+    bool AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesReceived);
+    void ClearStatus();
+    std::string GetDriverStatus();
 
   protected:
     esp_err_t WriteFrame(const CAN_frame_t* p_frame);
     void BusTicker10(std::string event, void* data);
+    esp_err_t SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                  const CAN_filter_range_list_t& ext_ranges);
+    void WriteAcceptanceFilter();
 
   public:
+    void ApplyAcceptanceFilter();
     void SetPowerMode(PowerMode powermode);
 
   public:
@@ -74,6 +95,26 @@ class esp32can : public canbus
     gpio_num_t m_rxpin;               // RX pin
     OvmsMutex m_write_mutex;
     bool m_tx_abort;
+
+  public:
+    // Acceptance filter setup (MOD.AFM, ACR0-3, AMR0-3):
+    bool m_acc_single;                        // single filter mode
+    uint8_t m_acc_code[4];
+    uint8_t m_acc_mask[4];                    // 1 = don't care
+
+  public:
+    // RX ring (single producer: ISR, single consumer: CAN task):
+    esp32can_rxentry_t* m_rxring;
+    volatile uint32_t m_rxring_head;          // next entry to write (ISR)
+    volatile uint32_t m_rxring_tail;          // next entry to read (CAN task)
+    volatile bool m_rxring_signalled;         // CAN task has been notified
+    volatile bool m_rxring_watermark;         // …and notified again at watermark
+    uint32_t m_rxring_signals;                // notifications sent
+    uint32_t m_rxbatch_hist[ESP32CAN_RXBATCH_BUCKETS];
+    uint32_t m_rxlatency_min;                 // ISR to dispatch latency [us]
+    uint32_t m_rxlatency_max;
+    uint64_t m_rxlatency_sum;
+    uint32_t m_rxlatency_cnt;
   };
 
 #endif //#ifndef __ESP32CAN_H__
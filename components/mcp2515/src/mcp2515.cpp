@@ -32,6 +32,7 @@
 static const char *TAG = "mcp2515";
 
 #include <string.h>
+#include "esp_timer.h"
 #include "mcp2515.h"
 #include "mcp2515_regdef.h"
 #include "soc/gpio_struct.h"
@@ -46,6 +47,9 @@ static IRAM_ATTR void MCP2515_isr(void *pvParameters)
 
   me->m_status.interrupts++;
 
+  // take the reception time in case this is an RX interrupt:
+  me->m_isr_time = (uint32_t)esp_timer_get_time();
+
   // we don't know the IRQ source and querying by SPI is too slow for an ISR,
   // so we let AsynchronousInterruptHandler() figure out what to do.
   CAN_queue_msg_t msg = {};
@@ -53,7 +57,7 @@ static IRAM_ATTR void MCP2515_isr(void *pvParameters)
   msg.body.bus = me;
 
   //send callback request to main CAN processor task
-  xQueueSendFromISR(can::instance(TAG) .m_rxqueue, &msg, &task_woken);
+  xQueueSendFromISR(me->m_rxqueue, &msg, &task_woken);
 
   // Yield to minimize latency if we have woken up a higher priority task:
   if (task_woken == pdTRUE)
@@ -155,8 +159,9 @@ esp_err_t mcp2515::Start(CAN_mode_t mode, CAN_speed_t speed)
   // Set CONFIG mode (abort transmisions, one-shot mode, clkout disabled)
   WriteReg(REG_CANCTRL, CANCTRL_MODE_CONFIG | CANCTRL_ABAT | CANCTRL_OSM);
 
-  // Rx Buffer 0 control (receive all and enable buffer 1 rollover)
-  WriteRegAndVerify(REG_RXB0CTRL, 0b01100100, 0b01101101);
+  // Acceptance filters & Rx buffer control (enable buffer 1 rollover)
+  WriteAcceptanceFilter();
+  m_rxfilter_pending = false;
 
   // BFPCTRL RXnBF PIN CONTROL AND STATUS
   WriteRegAndVerify(REG_BFPCTRL, 0b00001100);
@@ -241,6 +246,233 @@ esp_err_t mcp2515::Start(CAN_mode_t mode, CAN_speed_t speed)
   }
 
 
+/**
+ * WriteAcceptanceFilter: transfer the acceptance filter setup to the
+ *  controller (driver internal, controller needs to be in config mode)
+ */
+void mcp2515::WriteAcceptanceFilter()
+  {
+  uint8_t buf[16];
+  if (m_rxfilter)
+    {
+    static const uint8_t rxf_reg[6] = { REG_RXF0SIDH, REG_RXF0SIDH+4, REG_RXF0SIDH+8,
+                                        REG_RXF3SIDH, REG_RXF3SIDH+4, REG_RXF3SIDH+8 };
+    for (int i=0; i<2; i++)
+      m_spibus->spi_cmd(m_device, buf, 0, 6, CMD_WRITE, REG_RXM0SIDH+i*4,
+        m_rxm[i][0], m_rxm[i][1], m_rxm[i][2], m_rxm[i][3]);
+    for (int i=0; i<6; i++)
+      m_spibus->spi_cmd(m_device, buf, 0, 6, CMD_WRITE, rxf_reg[i],
+        m_rxf[i][0], m_rxf[i][1], m_rxf[i][2], m_rxf[i][3]);
+    // Rx buffers: use filters, buffer 0 rollover:
+    WriteRegAndVerify(REG_RXB0CTRL, 0b00000100, 0b01101101);
+    WriteRegAndVerify(REG_RXB1CTRL, 0b00000000, 0b01100000);
+    }
+  else
+    {
+    // Rx buffers: receive all, buffer 0 rollover:
+    WriteRegAndVerify(REG_RXB0CTRL, 0b01100100, 0b01101101);
+    WriteRegAndVerify(REG_RXB1CTRL, 0b01100000, 0b01100000);
+    }
+  }
+
+/**
+ * MCP2515_encode_id: encode an ID / mask into SIDH, SIDL, EID8, EID0
+ */
+static void MCP2515_encode_id(uint8_t* reg, uint32_t id, bool ext)
+  {
+  if (ext)
+    {
+    reg[0] = id >> 21;
+    reg[1] = ((id >> 13) & 0xe0) | 0x08 | ((id >> 16) & 0x03);   // SID2…0, EXIDE, EID17…16
+    reg[2] = id >> 8;
+    reg[3] = id;
+    }
+  else
+    {
+    reg[0] = id >> 3;
+    reg[1] = (id & 7) << 5;
+    reg[2] = 0;                 // standard frames: data bytes 0/1 not filtered
+    reg[3] = 0;
+    }
+  }
+
+// Acceptance group: one mask (RXM0/RXM1) shared by a set of filters of one frame format
+typedef struct
+  {
+  bool ext;
+  CAN_acceptance_list_t filters;
+  uint32_t dontcare;
+  } mcp2515_accgroup_t;
+
+static double MCP2515_group_share(mcp2515_accgroup_t& g)
+  {
+  g.dontcare = 0;
+  for (const CAN_acceptance_t& f : g.filters)
+    g.dontcare |= f.dontcare;
+  if (g.filters.empty()) return 0;
+  return (double)(g.filters.size() * CAN_acceptance_size(g.dontcare)) / (g.ext ? 0x20000000 : 0x800);
+  }
+
+/**
+ * SetAcceptanceFilter: derive the acceptance filter setup from the frame interests
+ *  The MCP2515 has two masks, RXM0 shared by filters RXF0-1 (buffer 0) and
+ *  RXM1 shared by filters RXF2-5 (buffer 1). Each filter matches either
+ *  standard or extended frames, so a frame format is kept in one mask group
+ *  if both are needed; otherwise all six patterns are distributed over the
+ *  groups to minimize the accepted share of the ID space. If all IDs would
+ *  pass, the filters are disabled (receive all).
+ */
+esp_err_t mcp2515::SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                       const CAN_filter_range_list_t& ext_ranges)
+  {
+  mcp2515_accgroup_t best[2] = {}, cand[2] = {};
+  double share = 2.0, s;
+
+  if (!std_ranges.empty() && !ext_ranges.empty())
+    {
+    // Group 0 (2 filters) gets one format, group 1 (4 filters) the other:
+    for (int ext0=0; ext0<2; ext0++)
+      {
+      cand[0].ext = ext0;
+      cand[1].ext = !ext0;
+      CAN_acceptance_cover(ext0 ? ext_ranges : std_ranges, cand[0].filters, 2);
+      CAN_acceptance_cover(ext0 ? std_ranges : ext_ranges, cand[1].filters, 4);
+      s = MCP2515_group_share(cand[0]) + MCP2515_group_share(cand[1]);
+      if (s < share)
+        {
+        share = s;
+        best[0] = cand[0];
+        best[1] = cand[1];
+        }
+      }
+    // The share sums up both formats, normalize for the accept-all check:
+    share /= 2;
+    }
+  else if (!std_ranges.empty() || !ext_ranges.empty())
+    {
+    // Distribute up to six patterns over both groups:
+    bool ext = !ext_ranges.empty();
+    CAN_acceptance_list_t p;
+    CAN_acceptance_cover(ext ? ext_ranges : std_ranges, p, 6);
+    int n = p.size();
+    for (int sel=0; sel < (1<<n); sel++)
+      {
+      int n0 = __builtin_popcount(sel);
+      if (n0 > 2 || n-n0 > 4) continue;
+      cand[0].ext = cand[1].ext = ext;
+      cand[0].filters.clear();
+      cand[1].filters.clear();
+      for (int i=0; i<n; i++)
+        cand[(sel & (1<<i)) ? 0 : 1].filters.push_back(p[i]);
+      s = MCP2515_group_share(cand[0]) + MCP2515_group_share(cand[1]);
+      if (s < share)
+        {
+        share = s;
+        best[0] = cand[0];
+        best[1] = cand[1];
+        }
+      }
+    }
+
+  bool rxfilter = (share < 1.0);
+  uint8_t rxm[2][4] = {}, rxf[6][4] = {};
+  if (rxfilter)
+    {
+    // An unused group repeats the other one, so it adds no acceptance:
+    if (best[0].filters.empty()) best[0] = best[1];
+    if (best[1].filters.empty()) best[1] = best[0];
+    for (int g=0, f=0; g<2; g++)
+      {
+      uint32_t idmask = best[g].ext ? 0x1fffffff : 0x7ff;
+      MCP2515_encode_id(rxm[g], ~best[g].dontcare & idmask, best[g].ext);
+      rxm[g][1] &= ~0x08;       // no EXIDE bit in masks
+      for (int k=0; k < (g ? 4 : 2); k++, f++)
+        {
+        const CAN_acceptance_t& p = best[g].filters[k % best[g].filters.size()];
+        MCP2515_encode_id(rxf[f], p.code & ~best[g].dontcare, best[g].ext);
+        }
+      }
+
+    std::string info;
+    for (int g=0; g<2; g++)
+      {
+      char grp[48];
+      snprintf(grp, sizeof(grp), "%sRXM%d %d %s mask %0*" PRIx32,
+        g ? ", " : "", g, (int)best[g].filters.size(), best[g].ext ? "ext" : "std",
+        best[g].ext ? 8 : 3, ~best[g].dontcare & (best[g].ext ? 0x1fffffff : 0x7ff));
+      info += grp;
+      }
+    char pct[32];
+    snprintf(pct, sizeof(pct), ", %.2f%% of ID space", share * 100);
+    m_rxfilter_info = info + pct;
+    }
+  else
+    {
+    m_rxfilter_info = "accept all";
+    }
+
+  if (rxfilter == m_rxfilter && (!rxfilter ||
+      (memcmp(rxm, m_rxm, sizeof(rxm)) == 0 && memcmp(rxf, m_rxf, sizeof(rxf)) == 0)))
+    return ESP_OK;
+
+  ESP_LOGD(TAG, "%s: acceptance filter: %s", GetName(), m_rxfilter_info.c_str());
+
+  OvmsMutexLock lock(&m_write_mutex);
+  m_rxfilter = rxfilter;
+  memcpy(m_rxm, rxm, sizeof(rxm));
+  memcpy(m_rxf, rxf, sizeof(rxf));
+  if (m_powermode != On)
+    return ESP_OK; // applied by Start()
+
+  // The controller does not receive in config mode, so the filter is
+  // applied by the CAN task when the controller is idle:
+  if (!m_rxfilter_pending)
+    {
+    m_rxfilter_pending = true;
+    RequestAcceptanceFilter();
+    }
+  return ESP_OK;
+  }
+
+/**
+ * ApplyAcceptanceFilter: transfer a changed acceptance filter to the
+ *  controller (CAN task, serialized with the interrupt handler). Filters can
+ *  only be changed in config mode, which is only entered after pending
+ *  transmissions and drops frames arriving meanwhile. So this waits for idle
+ *  TX & RX buffers and keeps the config mode phase short. If a frame is
+ *  being sent, TxCallback() retries after its completion.
+ */
+void mcp2515::ApplyAcceptanceFilter()
+  {
+  uint8_t buf[16];
+  OvmsMutexLock lock(&m_write_mutex);
+  if (!m_rxfilter_pending)
+    return;
+  if (m_powermode != On)
+    {
+    m_rxfilter_pending = false; // applied by Start()
+    return;
+    }
+
+  uint8_t* p = m_spibus->spi_cmd(m_device, buf, 1, 1, CMD_READ_STATUS);
+  if (p[0] & STATUS_TX012REQ)
+    return; // retried by TxCallback()
+  if (p[0] & STATUS_RX01IF)
+    {
+    // Let the interrupt handler fetch the frames first:
+    RequestAcceptanceFilter();
+    return;
+    }
+
+  m_rxfilter_pending = false;
+  if (ChangeMode(CANCTRL_MODE_CONFIG) != ESP_OK)
+    return;
+  WriteAcceptanceFilter();
+  ChangeMode((m_mode == CAN_MODE_LISTEN) ? CANCTRL_MODE_LISTEN : CANCTRL_MODE_NORMAL);
+  ESP_LOGD(TAG, "%s: acceptance filter applied", GetName());
+  }
+
+
 esp_err_t mcp2515::ChangeMode( uint8_t mode )
   {
   uint8_t buf[16];
@@ -252,15 +484,16 @@ esp_err_t mcp2515::ChangeMode( uint8_t mode )
   m_spibus->spi_cmd(m_device, buf, 0, 4, CMD_BITMODIFY, REG_CANCTRL, CANCTRL_MODE, mode);
 
   // verify that mode is changed by polling CANSTAT register
-  do
+  // (idle controllers change immediately, check before waiting)
+  rcvbuf = m_spibus->spi_cmd(m_device, buf, 1, 2, CMD_READ, REG_CANSTAT);
+  while ( ((rcvbuf[0] & CANCTRL_MODE) != mode) && (timeout < MCP2515_TIMEOUT) )
     {
     vTaskDelay(20 / portTICK_PERIOD_MS);
 
     rcvbuf = m_spibus->spi_cmd(m_device, buf, 1, 2, CMD_READ, REG_CANSTAT);
     ESP_LOGD(TAG, "%s:  read CANSTAT register (0x%02x : 0x%02x)", this->GetName(), REG_CANSTAT, rcvbuf[0]);
     timeout += 20;
-
-    } while ( ((rcvbuf[0] & CANCTRL_MODE) != mode) && (timeout < MCP2515_TIMEOUT) );
+    }
 
   if (timeout >= MCP2515_TIMEOUT)
     {
@@ -389,7 +622,7 @@ esp_err_t mcp2515::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=
     }
 
   // if there are frames waiting in the TX queue, add the new one there as well:
-  if (uxQueueMessagesWaiting(m_txqueue))
+  if (m_txqueue.Pending())
     {
     return QueueWrite(p_frame, maxqueuewait);
     }
@@ -476,7 +709,10 @@ bool mcp2515::AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesR
 
     memcpy(&frame->data,p+5,8);
     *framesReceived = *framesReceived + 1;
-    can::instance(TAG) .IncomingFrame(frame);
+
+    // Frames pending while the interrupt line stays active share the time
+    // of the initial interrupt:
+    can::instance(TAG) .IncomingFrame(frame, CAN_time_expand(m_isr_time));
     }
 
   // handle other interrupts that came in at the same time:
@@ -493,7 +729,7 @@ bool mcp2515::AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesR
     msg.type = CAN_txcallback;
     msg.body.frame = m_tx_frame;
     msg.body.bus = this;
-    xQueueSend(can::instance(TAG) .m_rxqueue, &msg, 0);
+    xQueueSend(m_rxqueue, &msg, 0);
     }
 
   if (intstat & (CANINTF_MERRF | CANINTF_WAKIF | CANINTF_ERRIF))
@@ -556,7 +792,7 @@ bool mcp2515::AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesR
       msg.type = tx_aborted ? CAN_txfailedcallback : CAN_txcallback;
       msg.body.frame = m_tx_frame;
       msg.body.bus = this;
-      xQueueSend(can::instance(TAG) .m_rxqueue, &msg, 0);
+      xQueueSend(m_rxqueue, &msg, 0);
       // …which will log the error as well
       }
     else
@@ -633,11 +869,15 @@ void mcp2515::TxCallback(CAN_frame_t* p_frame, bool success)
   // Application callbacks & logging:
   canbus::TxCallback(p_frame, success);
 
+  // Apply a filter change deferred by the transmission:
+  if (m_rxfilter_pending)
+    ApplyAcceptanceFilter();
+
   // TX buffer has become available; send next queued frame (if any):
     {
     OvmsMutexLock lock(&m_write_mutex);
     CAN_frame_t frame;
-    while (xQueueReceive(m_txqueue, (void*)&frame, 0) == pdTRUE)
+    while (m_txqueue.Pop(&frame))
       {
       if (WriteFrame(&frame) == ESP_FAIL)
         {
@@ -647,7 +887,7 @@ void mcp2515::TxCallback(CAN_frame_t* p_frame, bool success)
         msg.type = CAN_txfailedcallback;
         msg.body.frame = frame;
         msg.body.bus = this;
-        xQueueSend(can::instance(TAG) .m_rxqueue, &msg, 0);
+        xQueueSend(m_rxqueue, &msg, 0);
         }
       else
         {
@@ -57,9 +57,13 @@ class mcp2515 : public canbus
     esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
     bool AsynchronousInterruptHandler(CAN_frame_t* frame, uint32_t* framesReceived);
     void TxCallback(CAN_frame_t* p_frame, bool success);
+    void ApplyAcceptanceFilter();
 
   protected:
     esp_err_t WriteFrame(const CAN_frame_t* p_frame);
+    esp_err_t SetAcceptanceFilter(const CAN_filter_range_list_t& std_ranges,
+                                  const CAN_filter_range_list_t& ext_ranges);
+    void WriteAcceptanceFilter();
 
   public:
     void SetPowerMode(PowerMode powermode);
@@ -67,6 +71,7 @@ class mcp2515 : public canbus
   public:
     spi* m_spibus;
     spi_device_handle_t m_device;
+    volatile uint32_t m_isr_time = 0;   // esp_timer time of last interrupt, lower 32 bits
 
   protected:
     spi_device_interface_config_t m_devcfg;
@@ -75,6 +80,9 @@ class mcp2515 : public canbus
     int m_intpin;
     uint8_t m_last_errflag = 0;
     OvmsMutex m_write_mutex;
+    bool m_rxfilter = false;          // false = receive all frames
+    uint8_t m_rxm[2][4] = {};         // RXM0-1: SIDH, SIDL, EID8, EID0
+    uint8_t m_rxf[6][4] = {};         // RXF0-5: SIDH, SIDL, EID8, EID0
   };
 
 #endif //#ifndef __MCP2515_H__
@@ -112,6 +112,10 @@
 #define REG_TXB1CTRL            0x40
 #define REG_TXB2CTRL            0x50
 #define REG_RXB0CTRL            0x60
+#define REG_RXB1CTRL            0x70
+#define REG_RXF0SIDH            0x00          // Filters 0-2, 4 registers each: SIDH, SIDL, EID8, EID0
+#define REG_RXF3SIDH            0x10          // Filters 3-5
+#define REG_RXM0SIDH            0x20          // Masks 0-1
 
 #define MCP2515_TIMEOUT         100           // Timeout for register verification, in milliseconds
 
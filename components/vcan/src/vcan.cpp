@@ -0,0 +1,356 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vcan";
+
+#include <string.h>
+#include <sstream>
+#include <iomanip>
+#include "vcan.h"
+#include "ovms_config.h"
+
+////////////////////////////////////////////////////////////////////////
+// vcanwire - the shared virtual bus medium
+////////////////////////////////////////////////////////////////////////
+
+vcanwire::vcanwire()
+  {
+  m_nodecount = 0;
+  m_sender = NULL;
+  m_txend = 0;
+  for (int k=0; k<VCAN_MAXNODES; k++) m_nodes[k] = NULL;
+
+  esp_timer_create_args_t args = {};
+  args.callback = TimerCallback;
+  args.arg = this;
+  args.name = "vcanwire";
+  if (esp_timer_create(&args, &m_timer) != ESP_OK)
+    {
+    ESP_LOGE(TAG, "vcanwire: timer creation failed");
+    m_timer = NULL;
+    }
+  }
+
+vcanwire::~vcanwire()
+  {
+  if (m_timer)
+    {
+    esp_timer_stop(m_timer);
+    esp_timer_delete(m_timer);
+    }
+  }
+
+bool vcanwire::Attach(vcan* node)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (m_nodecount >= VCAN_MAXNODES) return false;
+  m_nodes[m_nodecount++] = node;
+  return true;
+  }
+
+/**
+ * Transmit: load the node's TX buffer and arbitrate if the wire is idle
+ */
+void vcanwire::Transmit(vcan* node, const CAN_frame_t* frame)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  node->m_txframe = *frame;
+  node->m_txframe.origin = node;
+  node->m_txpending = true;
+  Arbitrate();
+  }
+
+/**
+ * Abort: drop the node's pending / ongoing transmission
+ */
+void vcanwire::Abort(vcan* node)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  node->m_txpending = false;
+  if (m_sender == node)
+    {
+    esp_timer_stop(m_timer);
+    m_sender = NULL;
+    Arbitrate();
+    }
+  }
+
+// Arbitration field order, lower wins: base ID, then IDE (standard
+// frames win against extended frames of the same base ID), then ID
+// extension bits.
+static inline uint32_t vcan_arbitration_key(const CAN_frame_t* frame)
+  {
+  if (frame->FIR.B.FF == CAN_frame_std)
+    return (frame->MsgID & 0x7ff) << 19;
+  else
+    return ((frame->MsgID >> 18) & 0x7ff) << 19 | 1 << 18 | (frame->MsgID & 0x3ffff);
+  }
+
+/**
+ * Arbitrate: start the next transmission if the wire is idle
+ *  (call with m_mutex held)
+ */
+void vcanwire::Arbitrate()
+  {
+  if (m_sender || !m_timer) return;
+
+  vcan* winner = NULL;
+  uint32_t winkey = 0;
+  int contenders = 0;
+  for (int k=0; k<m_nodecount; k++)
+    {
+    vcan* node = m_nodes[k];
+    if (!node->m_txpending) continue;
+    contenders++;
+    uint32_t key = vcan_arbitration_key(&node->m_txframe);
+    if (!winner || key < winkey)
+      {
+      winner = node;
+      winkey = key;
+      }
+    }
+  if (!winner) return;
+
+  if (contenders > 1)
+    {
+    for (int k=0; k<m_nodecount; k++)
+      {
+      if (m_nodes[k]->m_txpending && m_nodes[k] != winner)
+        m_nodes[k]->m_arbitration_lost++;
+      }
+    }
+
+  m_sender = winner;
+  uint64_t duration = (uint64_t)CAN_frame_bits(&winner->m_txframe) * 1000000
+                      / MAP_CAN_SPEED(winner->m_speed) + winner->m_latency;
+  m_txend = esp_timer_get_time() + duration;
+  esp_timer_start_once(m_timer, duration);
+  }
+
+void vcanwire::TimerCallback(void* arg)
+  {
+  vcanwire* me = (vcanwire*)arg;
+  me->Complete();
+  }
+
+/**
+ * Complete: end of transmission, deliver the frame to all receivers
+ *  on the same speed and report the result to the sender
+ */
+void vcanwire::Complete()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  int64_t now = esp_timer_get_time();
+  // Ignore a stale timer run of an aborted transmission:
+  if (!m_sender || now < m_txend) return;
+
+  vcan* sender = m_sender;
+  m_sender = NULL;
+  if (!sender->m_txpending)
+    {
+    Arbitrate();
+    return;
+    }
+
+  bool acked = sender->m_loopback;
+  for (int k=0; k<m_nodecount; k++)
+    {
+    vcan* node = m_nodes[k];
+    if (node == sender || node->m_powermode != On || node->m_speed != sender->m_speed)
+      continue;
+    node->Receive(&sender->m_txframe, now);
+    if (node->m_mode == CAN_MODE_ACTIVE)
+      acked = true;
+    }
+  if (sender->m_loopback)
+    sender->Receive(&sender->m_txframe, now);
+
+  // Release the TX buffer before queueing the callback, the CAN task
+  // checks m_txpending to send the next queued frame:
+  sender->m_txpending = false;
+  sender->TxDone(acked);
+
+  Arbitrate();
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vcan - a virtual CAN controller
+////////////////////////////////////////////////////////////////////////
+
+vcan::vcan(const char* name, vcanwire* wire)
+  : canbus(name)
+  {
+  m_wire = wire;
+  m_powermode = Off;
+  m_loopback = false;
+  m_latency = 0;
+  m_txframe = {};
+  m_txpending = false;
+  ClearStatus();
+
+  if (!m_wire->Attach(this))
+    ESP_LOGE(TAG, "%s: wire has no free node slot", name);
+  }
+
+vcan::~vcan()
+  {
+  }
+
+esp_err_t vcan::Start(CAN_mode_t mode, CAN_speed_t speed)
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  canbus::Start(mode, speed);
+
+  m_mode = mode;
+  m_speed = speed;
+
+  OvmsConfig& config = OvmsConfig::instance(TAG);
+  m_loopback = config.GetParamValueBool("can", std::string("vcan.loopback.") + m_name, false);
+  m_latency = config.GetParamValueInt("can", std::string("vcan.latency.") + m_name, 0);
+
+  ClearStatus();
+
+  // And record that we are powered on
+  pcp::SetPowerMode(On);
+
+  return ESP_OK;
+  }
+
+esp_err_t vcan::Stop()
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  canbus::Stop();
+
+  // Clear TX queue & abort TX
+  m_txqueue.Clear();
+  m_wire->Abort(this);
+
+  // And record that we are powered down
+  pcp::SetPowerMode(Off);
+
+  return ESP_OK;
+  }
+
+esp_err_t vcan::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  if (m_powermode != On || m_mode != CAN_MODE_ACTIVE)
+    {
+    ESP_LOGW(TAG,"Cannot write %s when not in ACTIVE mode",m_name);
+    return ESP_FAIL;
+    }
+
+  // if the TX buffer is in use or frames are waiting in the TX queue,
+  // add the new one to the queue:
+  if (m_txpending || m_txqueue.Pending())
+    {
+    return QueueWrite(p_frame, maxqueuewait);
+    }
+
+  m_wire->Transmit(this, p_frame);
+
+  // stats & logging:
+  canbus::Write(p_frame, maxqueuewait);
+
+  return ESP_OK;
+  }
+
+void vcan::TxCallback(CAN_frame_t* p_frame, bool success)
+  {
+  // Application callbacks & logging:
+  canbus::TxCallback(p_frame, success);
+
+  // TX buffer has become available; send next queued frame (if any):
+  OvmsMutexLock lock(&m_write_mutex);
+  CAN_frame_t frame;
+  if (!m_txpending && m_powermode == On && m_txqueue.Pop(&frame))
+    {
+    m_wire->Transmit(this, &frame);
+    canbus::Write(&frame, 0);
+    }
+  }
+
+/**
+ * Receive: frame received from the wire (called by the wire)
+ */
+void vcan::Receive(const CAN_frame_t* p_frame, int64_t time)
+  {
+  CAN_queue_msg_t msg;
+  msg.type = CAN_frame;
+  msg.time = (uint32_t)time;
+  msg.body.frame = *p_frame;
+  msg.body.frame.origin = this;
+  msg.body.frame.callback = NULL;
+  if (xQueueSend(m_rxqueue, &msg, 0) != pdTRUE)
+    m_status.rxbuf_overflow++;
+  }
+
+/**
+ * TxDone: transmission finished (called by the wire)
+ *  A frame without ACK is reported as failed instead of being
+ *  retransmitted like a real controller would do.
+ */
+void vcan::TxDone(bool success)
+  {
+  if (!success)
+    {
+    m_ack_errors++;
+    m_status.errors_tx++;
+    }
+  CAN_queue_msg_t msg;
+  msg.type = success ? CAN_txcallback : CAN_txfailedcallback;
+  msg.body.frame = m_txframe;
+  msg.body.bus = this;
+  xQueueSend(m_rxqueue, &msg, 0);
+  }
+
+void vcan::ClearStatus()
+  {
+  canbus::ClearStatus();
+  m_arbitration_lost = 0;
+  m_ack_errors = 0;
+  }
+
+std::string vcan::GetDriverStatus()
+  {
+  std::ostringstream buf;
+
+  buf << "Wire nodes:" << std::setw(20) << m_wire->m_nodecount << "\n";
+  buf << "Loopback:  " << std::setw(20) << (m_loopback ? "yes" : "no") << "\n";
+  buf << "Latency:   " << std::setw(20) << m_latency << " us\n";
+  buf << "Arb lost:  " << std::setw(20) << m_arbitration_lost << "\n";
+  buf << "ACK errors:" << std::setw(20) << m_ack_errors << "\n";
+
+  return buf.str();
+  }
@@ -0,0 +1,118 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VCAN_H__
+#define __VCAN_H__
+
+#include <stdint.h>
+#include "can.h"
+#include "ovms_mutex.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+// Virtual CAN bus
+// Simulated CAN controllers attached to a shared virtual wire. A frame
+// written to one node is transmitted on the wire at the node's bit rate
+// (see CAN_frame_bits) and received by all other started nodes running at
+// the same speed. Pending frames of multiple nodes arbitrate by ID like on
+// a real bus, and frames need an ACK from another active node.
+// This allows exercising the CAN framework, loggers, gateways and pollers
+// without hardware.
+//
+// Config "can":
+//   vcan.loopback.<bus>   yes = also receive own frames & self-ACK (default no)
+//   vcan.latency.<bus>    additional delay per transmission in us (default 0)
+
+#define VCAN_MAXNODES 4
+
+class vcan;
+
+class vcanwire
+  {
+  public:
+    vcanwire();
+    ~vcanwire();
+
+  public:
+    bool Attach(vcan* node);
+    void Transmit(vcan* node, const CAN_frame_t* frame);
+    void Abort(vcan* node);
+
+  protected:
+    static void TimerCallback(void* arg);
+    void Arbitrate();
+    void Complete();
+
+  public:
+    OvmsMutex m_mutex;
+    vcan* m_nodes[VCAN_MAXNODES];
+    int m_nodecount;
+    vcan* m_sender;                   // node transmitting, NULL = wire idle
+    int64_t m_txend;                  // esp_timer time of end of transmission
+    esp_timer_handle_t m_timer;
+  };
+
+class vcan : public canbus
+  {
+  public:
+    vcan(const char* name, vcanwire* wire);
+    ~vcan();
+
+  public:
+    esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
+    esp_err_t Stop();
+
+  public:
+    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+    void TxCallback(CAN_frame_t* p_frame, bool success);
+    void ClearStatus();
+    std::string GetDriverStatus();
+
+  protected:
+    friend class vcanwire;
+    void Receive(const CAN_frame_t* p_frame, int64_t time);
+    void TxDone(bool success);
+
+  public:
+    vcanwire* m_wire;
+    OvmsMutex m_write_mutex;
+    bool m_loopback;
+    uint32_t m_latency;               // additional transmission delay [us]
+
+  public:
+    // TX buffer, owned by the wire while m_txpending:
+    CAN_frame_t m_txframe;
+    bool m_txpending;
+    uint32_t m_arbitration_lost;      // arbitration rounds lost
+    uint32_t m_ack_errors;            // transmissions without ACK
+  };
+
+#endif //#ifndef __VCAN_H__
@@ -254,6 +254,7 @@ static void OvmsVehicleRxTask(void *pvParameters)
   }
 
 OvmsVehicle::OvmsVehicle()
+  : m_rxreader("vehicle")
   {
   using std::placeholders::_1;
   using std::placeholders::_2;
@@ -262,6 +263,7 @@ OvmsVehicle::OvmsVehicle()
   m_can2 = NULL;
   m_can3 = NULL;
   m_can4 = NULL;
+  m_can_interest = 0;
 
   m_last_chargetime = 0;
   m_last_drivetime = 0;
@@ -284,20 +286,21 @@ OvmsVehicle::OvmsVehicle()
   m_vehicleon_ticker = 0;
   m_vehicleoff_ticker = 0;
   m_idle_ticker = 0;
-  m_registeredlistener = false;
   m_autonotifications = true;
   m_ready = false;
 
   m_poll_state = 0;
   m_poll_bus = NULL;
   m_poll_bus_default = NULL;
-  m_poll_txcallback = std::bind(&OvmsVehicle::PollerTxCallback, this, _1, _2);
+  m_poll_txcallback = CanFrameDelegate::Member<OvmsVehicle, &OvmsVehicle::PollerTxCallback>(this);
   m_poll_plist = NULL;
   m_poll_plcur = NULL;
   m_poll_entry = {};
   m_poll_vwtp = {};
   m_poll_ticker = 0;
   m_poll_single_rxbuf = NULL;
+  m_poll_single_plist = NULL;
+  m_poll_single_bus = NULL;
   m_poll_single_rxerr = 0;
   m_poll_moduleid_sent = 0;
   m_poll_moduleid_low = 0;
@@ -377,7 +380,6 @@ OvmsVehicle::OvmsVehicle()
   m_inv_energyused = 0;
   m_inv_energyrecd = 0;
 
-  m_rxqueue = xQueueCreate(CONFIG_OVMS_VEHICLE_CAN_RX_QUEUE_SIZE,sizeof(CAN_frame_t));
   xTaskCreatePinnedToCore(OvmsVehicleRxTask, "OVMS Vehicle",
     CONFIG_OVMS_VEHICLE_RXTASK_STACK, (void*)this, 10, &m_rxtask, CORE(1));
 
@@ -396,6 +398,9 @@ OvmsVehicle::~OvmsVehicle()
   if (m_can3) m_can3->SetPowerMode(Off);
   if (m_can4) m_can4->SetPowerMode(Off);
 
+  can::instance(TAG).RemoveRxInterest("vehicle", NULL, false);
+  can::instance(TAG).RemoveRxInterest("poller");
+
   if (m_bms_voltages != NULL)
     {
     delete [] m_bms_voltages;
@@ -448,13 +453,7 @@ OvmsVehicle::~OvmsVehicle()
     m_bms_talerts = NULL;
     }
 
-  if (m_registeredlistener)
-    {
-    can::instance(TAG).DeregisterListener(m_rxqueue);
-    m_registeredlistener = false;
-    }
-
-  vQueueDelete(m_rxqueue);
+  m_rxreader.Detach();
   vTaskDelete(m_rxtask);
 
   OvmsEvents::instance(TAG).DeregisterEvent(TAG);
@@ -473,38 +472,42 @@ const char* OvmsVehicle::VehicleType()
 
 void OvmsVehicle::RxTask()
   {
-  CAN_frame_t frame;
+  CAN_log_message_t* entry;
 
   while(1)
     {
-    if (xQueueReceive(m_rxqueue, &frame, (portTickType)portMAX_DELAY)==pdTRUE)
+    // Frames are read in place from the CAN frame ring,
+    // handlers must not modify them:
+    if ((entry = m_rxreader.Read(portMAX_DELAY)) != NULL)
       {
       if (!m_ready)
         continue;
 
+      CAN_frame_t* frame = &entry->frame;
+
       // Pass frame to poller protocol handlers:
-      if (frame.origin == m_poll_vwtp.bus && frame.MsgID == m_poll_vwtp.rxid)
+      if (frame->origin == m_poll_vwtp.bus && frame->MsgID == m_poll_vwtp.rxid)
         {
-        PollerVWTPReceive(&frame, frame.MsgID);
+        PollerVWTPReceive(frame, frame->MsgID);
         }
-      else if (m_poll_wait && frame.origin == m_poll_bus && m_poll_plist)
+      else if (m_poll_wait && frame->origin == m_poll_bus && m_poll_plist)
         {
         uint32_t msgid;
         if (m_poll_protocol == ISOTP_EXTADR)
-          msgid = frame.MsgID << 8 | frame.data.u8[0];
+          msgid = frame->MsgID << 8 | frame->data.u8[0];
         else
-          msgid = frame.MsgID;
+          msgid = frame->MsgID;
         if (msgid >= m_poll_moduleid_low && msgid <= m_poll_moduleid_high)
           {
-          PollerISOTPReceive(&frame, msgid);
+          PollerISOTPReceive(frame, msgid);
           }
         }
 
       // Pass frame to standard handlers:
-      if (m_can1 == frame.origin) IncomingFrameCan1(&frame);
-      else if (m_can2 == frame.origin) IncomingFrameCan2(&frame);
-      else if (m_can3 == frame.origin) IncomingFrameCan3(&frame);
-      else if (m_can4 == frame.origin) IncomingFrameCan4(&frame);
+      if (m_can1 == frame->origin) IncomingFrameCan1(frame);
+      else if (m_can2 == frame->origin) IncomingFrameCan2(frame);
+      else if (m_can3 == frame->origin) IncomingFrameCan3(frame);
+      else if (m_can4 == frame->origin) IncomingFrameCan4(frame);
       }
     }
   }
@@ -536,21 +539,25 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed, db
     {
     case 1:
       m_can1 = (canbus*)pcpapp::instance().FindDeviceByName("can1");
+      can::instance(TAG).AddRxInterestAll("vehicle", m_can1, false);
       m_can1->SetPowerMode(On);
       m_can1->Start(mode,speed,dbcfile);
       break;
     case 2:
       m_can2 = (canbus*)pcpapp::instance().FindDeviceByName("can2");
+      can::instance(TAG).AddRxInterestAll("vehicle", m_can2, false);
       m_can2->SetPowerMode(On);
       m_can2->Start(mode,speed,dbcfile);
       break;
     case 3:
       m_can3 = (canbus*)pcpapp::instance().FindDeviceByName("can3");
+      can::instance(TAG).AddRxInterestAll("vehicle", m_can3, false);
       m_can3->SetPowerMode(On);
       m_can3->Start(mode,speed,dbcfile);
       break;
     case 4:
       m_can4 = (canbus*)pcpapp::instance().FindDeviceByName("can4");
+      can::instance(TAG).AddRxInterestAll("vehicle", m_can4, false);
       m_can4->SetPowerMode(On);
       m_can4->Start(mode,speed,dbcfile);
       break;
@@ -558,11 +565,40 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed, db
       break;
     }
 
-  if (!m_registeredlistener)
+  if (!m_rxreader.IsAttached() && !m_rxreader.Attach())
+    ESP_LOGE(TAG, "RegisterCanBus: cannot attach to the CAN frame ring, no frames will be received");
+  }
+
+/**
+ * AddCanInterest: declare frames the vehicle needs from a bus (1…4)
+ *  By default the vehicle receives all frames of its registered buses. Vehicles
+ *  knowing their frame IDs should declare them after RegisterCanBus(), so the
+ *  hardware acceptance filter can drop unneeded frames. The first declaration
+ *  replaces the default for the bus. Poller & DBC responses need not be declared.
+ */
+void OvmsVehicle::AddCanInterest(int bus, CAN_frame_format_t format, uint32_t id_from, uint32_t id_to)
+  {
+  canbus* cbus;
+  switch (bus)
+    {
+    case 1: cbus = m_can1; break;
+    case 2: cbus = m_can2; break;
+    case 3: cbus = m_can3; break;
+    case 4: cbus = m_can4; break;
+    default: cbus = NULL; break;
+    }
+  if (!cbus)
+    {
+    ESP_LOGE(TAG, "AddCanInterest: bus %d not registered", bus);
+    return;
+    }
+
+  if ((m_can_interest & (1 << bus)) == 0)
     {
-    m_registeredlistener = true;
-    can::instance(TAG).RegisterListener(m_rxqueue);
+    can::instance(TAG).RemoveRxInterest("vehicle", cbus, false);
+    m_can_interest |= (1 << bus);
     }
+  can::instance(TAG).AddRxInterest("vehicle", cbus, format, id_from, id_to);
   }
 
 bool OvmsVehicle::PinCheck(const char* pin)
@@ -295,9 +295,8 @@ class OvmsVehicle
     virtual const char* VehicleType();
 
   protected:
-    QueueHandle_t m_rxqueue;
+    canringreader m_rxreader;
     TaskHandle_t m_rxtask;
-    bool m_registeredlistener;
     bool m_autonotifications;
     bool m_ready;
 
@@ -307,10 +306,14 @@ class OvmsVehicle
     canbus* m_can3;
     canbus* m_can4;
 
+  protected:
+    uint8_t m_can_interest;       // bitset: buses with specific frame interest (else promiscuous)
+
   private:
     void VehicleTicker1(std::string event, void* data);
     void VehicleConfigChanged(std::string event, void* data);
     void PollerSend(bool fromTicker);
+    void PollerSetRxInterest();
     void PollerReceive(CAN_frame_t* frame, uint32_t msgid);
 
   protected:
@@ -465,6 +468,7 @@ class OvmsVehicle
 
   protected:
     void RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed, dbcfile* dbcfile = NULL);
+    void AddCanInterest(int bus, CAN_frame_format_t format, uint32_t id_from, uint32_t id_to);
     bool PinCheck(const char* pin);
 
   public:
@@ -605,6 +609,8 @@ class OvmsVehicle
     std::string*      m_poll_single_rxbuf;    // … response buffer
     int               m_poll_single_rxerr;    // … response error code (NRC) / TX failure code
     OvmsSemaphore     m_poll_single_rxdone;   // … response done (ok/error)
+    const poll_pid_t* m_poll_single_plist;    // … interrupted poll list (frame interest kept)
+    canbus*           m_poll_single_bus;      // … interrupted poll list default bus
 
   protected:
     vwtp_channel_t    m_poll_vwtp;            // VWTP channel state
@@ -635,7 +641,7 @@ class OvmsVehicle
     void PollerVWTPTxCallback(const CAN_frame_t* frame, bool success);
 
   private:
-    CanFrameCallback  m_poll_txcallback;      // Poller CAN TxCallback
+    CanFrameDelegate  m_poll_txcallback;      // Poller CAN TxCallback
     uint32_t          m_poll_txmsgid;         // Poller last TX CAN ID (frame MsgID)
 
   private:
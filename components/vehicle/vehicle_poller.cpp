@@ -33,6 +33,7 @@ static const char *TAG = "v_poller";
 
 #include <stdio.h>
 #include <algorithm>
+#include <map>
 #include <ovms_command.h>
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 #include "ovms_script.h"
@@ -164,6 +165,82 @@ void OvmsVehicle::PollSetPidList(canbus* bus, const poll_pid_t* plist)
   m_poll_plcur = NULL;
   m_poll_entry = {};
   m_poll_txmsgid = 0;
+  PollerSetRxInterest();
+  }
+
+
+/**
+ * PollerSetRxInterest: declare the response IDs of the polling list as frame interest
+ *  The declarations replace those of the previous list. Only buses with changed
+ *  response ranges get their hardware filter updated. While a PollSingleRequest()
+ *  is processed, the interrupted list stays declared, so single requests to the
+ *  same devices don't change the filters. The declarations are removed when the
+ *  vehicle is unloaded.
+ */
+void OvmsVehicle::PollerSetRxInterest()
+  {
+  typedef struct
+    {
+    CAN_filter_range_list_t std_ranges;
+    CAN_filter_range_list_t ext_ranges;
+    } poll_rxinterest_t;
+  can& c = can::instance(TAG);
+  std::map<canbus*, poll_rxinterest_t> interest;
+  for (int k=0; k<CAN_MAXBUSES; k++)
+    {
+    canbus* bus = c.GetBus(k);
+    if (bus) interest[bus];   // clears declarations of previous lists
+    }
+
+  auto collect = [&](const poll_pid_t* plist, canbus* defaultbus)
+    {
+    if (!plist) return;
+    for (const poll_pid_t* p = plist; p->txmoduleid != 0; p++)
+      {
+      canbus* bus;
+      switch (p->pollbus)
+        {
+        case 1: bus = m_can1; break;
+        case 2: bus = m_can2; break;
+        case 3: bus = m_can3; break;
+        case 4: bus = m_can4; break;
+        default: bus = defaultbus; break;
+        }
+      if (!bus) continue;
+      poll_rxinterest_t& i = interest[bus];
+
+      // see PollerISOTPStart() for the response ID ranges:
+      uint32_t id_from = p->rxmoduleid ? p->rxmoduleid : 0x7e8;
+      uint32_t id_to = p->rxmoduleid ? p->rxmoduleid : 0x7ef;
+      switch (p->protocol)
+        {
+        case ISOTP_STD:
+          i.std_ranges.push_back({ id_from, id_to });
+          break;
+        case ISOTP_EXTADR:
+          i.std_ranges.push_back({ id_from >> 8, id_to >> 8 });
+          break;
+        case ISOTP_EXTFRAME:
+          i.ext_ranges.push_back({ id_from, id_to });
+          break;
+        case VWTP_20:
+          // Gateway responses & channel IDs are assigned dynamically above the base ID:
+          i.std_ranges.push_back({ p->txmoduleid, p->txmoduleid + 0x1ff });
+          break;
+        default:
+          i.std_ranges.push_back({ 0, 0x7ff });
+          i.ext_ranges.push_back({ 0, 0x1fffffff });
+          break;
+        }
+      }
+    };
+
+  if (m_poll_bus_default)
+    collect(m_poll_plist, m_poll_bus_default);
+  collect(m_poll_single_plist, m_poll_single_bus);
+
+  for (auto& it : interest)
+    c.SetRxInterest("poller", it.first, it.second.std_ranges, it.second.ext_ranges);
   }
 
 
@@ -407,11 +484,8 @@ int OvmsVehicle::PollSingleRequest(canbus* bus, uint32_t txid, uint32_t rxid,
   if (!m_ready)
     return -1;
 
-  if (!m_registeredlistener)
-    {
-    m_registeredlistener = true;
-    can::instance(TAG).RegisterListener(m_rxqueue);
-    }
+  if (!m_rxreader.IsAttached() && !m_rxreader.Attach())
+    return -1;
 
   OvmsRecMutexLock slock(&m_poll_single_mutex, pdMS_TO_TICKS(timeout_ms));
   if (!slock.IsLocked())
@@ -459,7 +533,9 @@ int OvmsVehicle::PollSingleRequest(canbus* bus, uint32_t txid, uint32_t rxid,
   const poll_pid_t* p_plcur  = m_poll_plcur;
   uint32_t          p_ticker = m_poll_ticker;
 
-  // start single poll:
+  // start single poll (keeping the list's frame interest):
+  m_poll_single_plist = p_list;
+  m_poll_single_bus = p_bus;
   PollSetPidList(bus, poll);
   m_poll_single_rxdone.Take(0);
   m_poll_single_rxbuf = &response;
@@ -471,6 +547,8 @@ int OvmsVehicle::PollSingleRequest(canbus* bus, uint32_t txid, uint32_t rxid,
 
   // restore poller state:
   m_poll_mutex.Lock();
+  m_poll_single_plist = NULL;
+  m_poll_single_bus = NULL;
   PollSetPidList(p_bus, p_list);
   m_poll_plcur = p_plcur;
   m_poll_ticker = p_ticker;
@@ -50,6 +50,10 @@
 #include "esp32can.h"
 #endif // #ifdef CONFIG_OVMS_COMP_ESP32CAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+#include "vcan.h"
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_MAX7317
 #include "max7317.h"
 #endif // #ifdef CONFIG_OVMS_COMP_MAX7317
@@ -118,6 +122,12 @@ class Peripherals
     swcan* m_mcp2515_swcan;
 #endif // #ifdef CONFIG_OVMS_COMP_EXTERNAL_SWCAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+    vcanwire* m_vcanwire;
+    vcan* m_vcan_1;
+    vcan* m_vcan_2;
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
     sdcard* m_sdcard;
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
@@ -318,7 +318,7 @@ void OvmsCommand::PutUsage(OvmsWriter* writer)
     if (parent->m_validate)
       {
       size_t len = strlen(parent->m_usage_template);
-      char* dollar = index(parent->m_usage_template, '$');
+      const char* dollar = index(parent->m_usage_template, '$');
       if (dollar)
         {
         len = dollar - parent->m_usage_template;
@@ -52,7 +52,9 @@ static const char *TAG = "config";
 #include "zip_archive.h"
 #endif // CONFIG_OVMS_SC_ZIP
 
+#ifndef OVMS_CONFIGPATH
 #define OVMS_CONFIGPATH "/store/ovms_config"
+#endif
 #define OVMS_MAXVALSIZE 2500
 //#define OVMS_PERSIST_METADATA
 
@@ -487,6 +489,8 @@ esp_err_t OvmsConfig::mount()
     }
   while ((dp = readdir(dir)) != NULL)
     {
+    if (dp->d_name[0] == '.')
+      continue;
     // Register the param in case this was not already done
     if (CachedParam(dp->d_name) == NULL)
       RegisterParam(dp->d_name, "", true, false);
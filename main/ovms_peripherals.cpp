@@ -201,6 +201,13 @@ Peripherals::Peripherals()
   m_mcp2515_swcan = new swcan("can4", m_spibus, 10000000, MCP2515_SWCAN_CS, MCP2515_SWCAN_INT, false);
 #endif // #ifdef CONFIG_OVMS_COMP_EXTERNAL_SWCAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+  ESP_LOGI(TAG, "  Virtual CAN 1/2 & 2/2");
+  m_vcanwire = new vcanwire();
+  m_vcan_1 = new vcan("can4", m_vcanwire);
+  m_vcan_2 = new vcan("can5", m_vcanwire);
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
   ESP_LOGI(TAG, "  SD CARD");
   m_sdcard = new sdcard("sdcard", true, true, CONFIG_SDCARD_CD);
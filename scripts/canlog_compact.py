@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+#
+# Decode an OVMS compact binary CAN log (format "compact", see
+# components/can/src/canformat_compact.h) to CRTD text.
+#
+# Usage: canlog_compact.py [--stats] [infile [outfile]]
+#   infile/outfile default to stdin/stdout.
+#   --stats prints record statistics to stderr.
+#
+# Decoding starts at the first sync point, so files cut at arbitrary
+# positions can be decoded as well.
+
+import sys
+
+SYNC_MAGIC = b'\xf8OC'
+VERSION = 1
+
+TAG_INDEX = 0xf0
+TAG_DEFINE = 0xf1
+TAG_FRAME = 0xf3
+TAG_STATUS = 0xf4
+TAG_TEXT = 0xf5
+TAG_SYNC = 0xf8
+
+FL_BUS = 0x07
+FL_EXT = 0x08
+FL_RTR = 0x10
+
+TYPE_NAMES = ["-", "RX", "TX", "TX_Queue", "TX_Fail", "Error", "Status",
+              "Comment", "Info", "Event", "Metric"]
+
+
+class DecodeError(Exception):
+    pass
+
+
+class Reader:
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise EOFError
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def bytes(self, n):
+        if self.pos + n > len(self.data):
+            raise EOFError
+        b = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return b
+
+    def varint(self):
+        value = 0
+        for shift in range(0, 64, 7):
+            b = self.byte()
+            value |= (b & 0x7f) << shift
+            if not b & 0x80:
+                return value
+        raise DecodeError("varint too long")
+
+
+class Decoder:
+    def __init__(self, out):
+        self.out = out
+        self.dict = []
+        self.time = 0
+        self.insync = False
+        self.stats = {"records": 0, "frames": 0, "defines": 0, "syncs": 0, "resyncs": 0}
+
+    def timestamp(self):
+        return "%d.%06d" % (self.time // 1000000, self.time % 1000000)
+
+    def frame(self, typ, flags, msgid, data):
+        kind = ("R" if typ == 1 else "T") + ("29" if flags & FL_EXT else "11")
+        idfmt = "%08X" if flags & FL_EXT else "%03X"
+        line = "%s %d%s %s" % (self.timestamp(), (flags & FL_BUS) + 1, kind, idfmt % msgid)
+        if typ in (1, 2):
+            line += "".join(" %02X" % b for b in data)
+        else:
+            line = "%s %dCER %s %s%s" % (self.timestamp(), (flags & FL_BUS) + 1,
+                                         TYPE_NAMES[typ], kind, (" " + idfmt % msgid))
+            line += "".join(" %02X" % b for b in data)
+        self.out.write(line + "\n")
+        self.stats["frames"] += 1
+
+    def record(self, r):
+        tag = r.byte()
+        if tag == TAG_SYNC:
+            if r.bytes(2) != SYNC_MAGIC[1:]:
+                raise DecodeError("bad sync magic")
+            version = r.byte()
+            if version != VERSION:
+                raise DecodeError("unsupported version %d" % version)
+            sec = r.varint()
+            usec = r.varint()
+            self.dict = []
+            self.time = sec * 1000000 + usec
+            self.insync = True
+            self.stats["syncs"] += 1
+            return
+        if not self.insync:
+            raise DecodeError("not in sync")
+        if tag <= TAG_INDEX:
+            index = r.varint() if tag == TAG_INDEX else tag
+            if index >= len(self.dict):
+                raise DecodeError("undefined dictionary index %d" % index)
+            dt = r.varint()
+            mask = r.byte()
+            flags, msgid, dlc, data = self.dict[index]
+            data = bytearray(data)
+            for k in range(8):
+                if mask & (1 << k):
+                    if k >= dlc:
+                        raise DecodeError("mask exceeds DLC")
+                    data[k] = r.byte()
+            self.dict[index] = (flags, msgid, dlc, bytes(data))
+            self.time += dt
+            self.frame(1, flags, msgid, data[:dlc])
+        elif tag in (TAG_DEFINE, TAG_FRAME):
+            typ = r.byte() if tag == TAG_FRAME else 1
+            flags = r.byte()
+            msgid = r.varint() & 0x1fffffff
+            dlc = r.byte()
+            if dlc > 8:
+                raise DecodeError("invalid DLC %d" % dlc)
+            dt = r.varint()
+            data = r.bytes(dlc)
+            if tag == TAG_DEFINE:
+                self.dict.append((flags, msgid, dlc, bytes(data) + bytes(8 - dlc)))
+                self.stats["defines"] += 1
+            self.time += dt
+            self.frame(typ, flags, msgid, data)
+        elif tag == TAG_STATUS:
+            typ = r.byte()
+            bus = r.byte()
+            self.time += r.varint()
+            r.bytes(r.varint())
+            self.out.write("%s %d%s %s\n" % (self.timestamp(), bus + 1,
+                           "CER" if typ == 5 else "CST", TYPE_NAMES[typ]))
+        elif tag == TAG_TEXT:
+            typ = r.byte()
+            bus = r.byte()
+            self.time += r.varint()
+            text = r.bytes(r.varint()).decode("utf-8", "replace")
+            code = "CEV" if typ == 9 else "CMT" if typ == 10 else "CXX"
+            self.out.write("%s %d%s %s %s\n" % (self.timestamp(), bus + 1, code,
+                           TYPE_NAMES[typ] if typ < len(TYPE_NAMES) else "-", text))
+        else:
+            raise DecodeError("unknown tag 0x%02x" % tag)
+        self.stats["records"] += 1
+
+    def decode(self, data):
+        pos = 0
+        while pos < len(data):
+            if not self.insync:
+                nxt = data.find(SYNC_MAGIC, pos)
+                if nxt < 0:
+                    break
+                pos = nxt
+            r = Reader(data, pos)
+            try:
+                self.record(r)
+                pos = r.pos
+            except EOFError:
+                break
+            except DecodeError as e:
+                sys.stderr.write("offset %d: %s, resyncing\n" % (pos, e))
+                self.insync = False
+                self.stats["resyncs"] += 1
+                pos += 1
+
+
+def main(argv):
+    stats = "--stats" in argv
+    args = [a for a in argv if a != "--stats"]
+    infile = open(args[0], "rb") if len(args) > 0 else sys.stdin.buffer
+    outfile = open(args[1], "w") if len(args) > 1 else sys.stdout
+    data = infile.read()
+    decoder = Decoder(outfile)
+    decoder.decode(data)
+    if stats:
+        s = decoder.stats
+        sys.stderr.write("%d bytes, %d records, %d frames, %d defines, %d syncs, %d resyncs\n"
+                         % (len(data), s["records"], s["frames"], s["defines"], s["syncs"], s["resyncs"]))
+        if s["frames"]:
+            sys.stderr.write("%.2f bytes/frame\n" % (len(data) / s["frames"]))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+#
+# Decompress an OVMS compressed CAN log (formats "<format>+lz", see
+# components/can/src/canlz.h), i.e. a "crtd+lz" log to CRTD text.
+#
+# Usage: canlog_lz.py [--stats] [--crtd] [infile [outfile]]
+#   infile/outfile default to stdin/stdout.
+#   --stats prints block statistics to stderr.
+#   --crtd converts a decompressed "compact" log to CRTD text
+#          (needs canlog_compact.py next to this script).
+#
+# Blocks are independent, so truncated or damaged files are decoded up to
+# the damaged block, decoding then resumes at the next valid block.
+
+import struct
+import sys
+import zlib
+
+MAGIC = b'OLZ'
+HEADERSIZE = 12
+TYPE_STORED = 0
+TYPE_LZ4 = 1
+
+
+class DecodeError(Exception):
+    pass
+
+
+def lz4_block_decode(src, rawlen):
+    out = bytearray()
+    pos = 0
+    end = len(src)
+    while pos < end:
+        token = src[pos]
+        pos += 1
+        litlen = token >> 4
+        if litlen == 15:
+            while True:
+                if pos >= end:
+                    raise DecodeError("truncated literal length")
+                b = src[pos]
+                pos += 1
+                litlen += b
+                if b != 255:
+                    break
+        if pos + litlen > end:
+            raise DecodeError("truncated literals")
+        out += src[pos:pos + litlen]
+        pos += litlen
+        if pos >= end:
+            break
+        if pos + 2 > end:
+            raise DecodeError("truncated offset")
+        offset = src[pos] | (src[pos + 1] << 8)
+        pos += 2
+        if offset == 0 or offset > len(out):
+            raise DecodeError("invalid offset %d" % offset)
+        matchlen = (token & 0x0f) + 4
+        if (token & 0x0f) == 15:
+            while True:
+                if pos >= end:
+                    raise DecodeError("truncated match length")
+                b = src[pos]
+                pos += 1
+                matchlen += b
+                if b != 255:
+                    break
+        start = len(out) - offset
+        for k in range(matchlen):
+            out.append(out[start + k])
+        if len(out) > rawlen:
+            raise DecodeError("output overrun")
+    if len(out) != rawlen:
+        raise DecodeError("size mismatch %d != %d" % (len(out), rawlen))
+    return bytes(out)
+
+
+def decompress(data, stats):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        nxt = data.find(MAGIC, pos)
+        if nxt < 0:
+            if pos < len(data):
+                stats["skipped"] += len(data) - pos
+            break
+        if nxt > pos:
+            stats["skipped"] += nxt - pos
+        pos = nxt
+        if pos + HEADERSIZE > len(data):
+            stats["truncated"] += 1
+            break
+        typ, rawlen, datalen, adler = struct.unpack_from("<BHHI", data, pos + 3)
+        body = data[pos + HEADERSIZE:pos + HEADERSIZE + datalen]
+        if len(body) < datalen:
+            stats["truncated"] += 1
+            break
+        try:
+            if typ == TYPE_STORED:
+                if datalen != rawlen:
+                    raise DecodeError("stored size mismatch")
+                raw = bytes(body)
+            elif typ == TYPE_LZ4:
+                raw = lz4_block_decode(body, rawlen)
+            else:
+                raise DecodeError("unknown block type %d" % typ)
+            if zlib.adler32(raw) != adler:
+                raise DecodeError("checksum mismatch")
+        except DecodeError as e:
+            sys.stderr.write("offset %d: %s, resyncing\n" % (pos, e))
+            stats["errors"] += 1
+            pos += 1
+            continue
+        out += raw
+        stats["blocks"] += 1
+        stats["raw"] += rawlen
+        pos += HEADERSIZE + datalen
+    return bytes(out)
+
+
+def main(argv):
+    showstats = "--stats" in argv
+    crtd = "--crtd" in argv
+    args = [a for a in argv if a not in ("--stats", "--crtd")]
+    infile = open(args[0], "rb") if len(args) > 0 else sys.stdin.buffer
+    data = infile.read()
+
+    stats = {"blocks": 0, "raw": 0, "errors": 0, "skipped": 0, "truncated": 0}
+    raw = decompress(data, stats)
+
+    if crtd:
+        import canlog_compact
+        outfile = open(args[1], "w") if len(args) > 1 else sys.stdout
+        canlog_compact.Decoder(outfile).decode(raw)
+    else:
+        outfile = open(args[1], "wb") if len(args) > 1 else sys.stdout.buffer
+        outfile.write(raw)
+
+    if showstats:
+        sys.stderr.write("%d bytes, %d blocks, %d bytes uncompressed, %d errors, %d bytes skipped%s\n"
+                         % (len(data), stats["blocks"], stats["raw"], stats["errors"], stats["skipped"],
+                            ", truncated" if stats["truncated"] else ""))
+        if len(data):
+            sys.stderr.write("ratio %.2fx\n" % (stats["raw"] / len(data)))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
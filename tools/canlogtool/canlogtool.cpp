@@ -0,0 +1,1041 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN log conversion & analysis tool (host)
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// canlogtool: convert & analyse CAN logs on a Linux host, using the
+// canformat implementations of the firmware. Build:
+//   cmake -S tools/canlogtool -B build/canlogtool
+//   cmake --build build/canlogtool
+//
+// Examples:
+//   canlogtool trip.crtd trip.pcap             convert (formats by extension)
+//   canlogtool -o gvret-a trip.crtd - | less   convert to stdout
+//   canlogtool -S -f 2 trip.crtd               per ID statistics of can2
+//   canlogtool -f 1:7e8 -s 1:30 -e 2:00 -o crtd trip.compact -
+//                                              ID 7e8 on can1 in minute 1:30…2:00
+//   canlogtool -b 1000000                      encode/decode frames/s per format
+//   canlogtool -B 10000000                     filter lookup time per frame
+//
+// Only frames are converted, status & info records are dropped. Formats
+// reading host commands only (gvret-b, cs11, panda) can only be written.
+// "raw" records are the in-memory layout, so only portable between hosts
+// of the same architecture.
+//
+// The input file is memory mapped and cut into chunks at seek points of
+// the input format (canformat::IsSeekPoint(): line starts for crtd, sync
+// points for compact). Chunks are decoded, filtered & encoded in parallel
+// by a pool of worker threads, each with its own formatter instances.
+// The writer outputs the chunks and merges their statistics in file
+// order, workers stay at most CANLOGTOOL_INFLIGHT chunks per thread
+// ahead of it. Formats without seek points are processed as one chunk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include "host_stubs.h"
+#include "can.h"
+#include "canformat.h"
+#include "canlz.h"
+#include "canformat_canswitch.h"
+#include "canformat_compact.h"
+#include "canformat_crtd.h"
+#include "canformat_gvret.h"
+#include "canformat_lawicel.h"
+#include "canformat_panda.h"
+#include "canformat_pcap.h"
+#include "canformat_raw.h"
+
+#define CANLOGTOOL_CHUNKSIZE    16            // default chunk size [MB]
+#define CANLOGTOOL_SCANSIZE     (256*1024)    // max distance to the next seek point
+#define CANLOGTOOL_INFLIGHT     2             // chunks per thread ahead of the writer
+#define CANLOGTOOL_OUTBUFSIZE   (1024*1024)   // output file buffer
+
+typedef struct
+  {
+  uint64_t count;
+  uint64_t changes;                     // frames with payload changed
+  int64_t first, last;                  // timestamps [us]
+  int64_t intmin, intmax;               // min/max interval [us]
+  uint8_t firstdlc, lastdlc;
+  uint8_t firstdata[8], lastdata[8];
+  } canlogtool_idstats_t;
+
+// ID key: bus << 32 | extended << 31 | ID
+typedef std::unordered_map<uint64_t, canlogtool_idstats_t> canlogtool_idmap_t;
+
+typedef struct
+  {
+  size_t start, end;                    // input range
+  bool done;
+  std::string out;                      // formatted output
+  uint64_t msgs;                        // frames decoded
+  uint64_t passed;                      // frames passing the filters
+  canlogtool_idmap_t ids;
+  } canlogtool_chunk_t;
+
+class canlogtool
+  {
+  public:
+    canlogtool();
+    ~canlogtool();
+
+  public:
+    bool Open(const char* path);
+    int Run(FILE* out, FILE* report);
+
+  protected:
+    canformat* NewInput();
+    int64_t FirstTime();
+    size_t FindSeekPoint(size_t pos);
+    void Split();
+    void Worker();
+    void Process(canlogtool_chunk_t& chunk, size_t index);
+    void Output(canlogtool_chunk_t& chunk, canlz* lz, const uint8_t* data, size_t len);
+    static void Count(canlogtool_idmap_t& ids, const CAN_log_message_t* msg, int64_t time);
+    static void Merge(canlogtool_idstats_t& a, const canlogtool_idstats_t& b);
+    void Report(FILE* report, double elapsed);
+    void ReportIds(FILE* report);
+
+  public:
+    std::string         m_informat;
+    std::string         m_outformat;    // "" = no output
+    bool                m_lz;           // compress output
+    canfilter           m_filter;
+    int64_t             m_from, m_to;   // time range [us]
+    bool                m_fromrel, m_torel; // …relative to log start
+    bool                m_idstats;
+    unsigned            m_threads;
+    size_t              m_chunksize;
+
+  protected:
+    std::string         m_path;
+    uint8_t*            m_data;         // mapped input
+    size_t              m_size;
+    int64_t             m_logstart;     // first frame time [us]
+    std::vector<canlogtool_chunk_t> m_chunks;
+    std::atomic<size_t> m_next;         // next chunk to process
+    size_t              m_written;      // chunks written
+    std::mutex          m_mutex;
+    std::condition_variable m_cond;
+
+  protected:
+    uint64_t            m_msgs;
+    uint64_t            m_passed;
+    uint64_t            m_outbytes;
+    std::map<uint64_t, canlogtool_idstats_t> m_ids;
+  };
+
+canlogtool::canlogtool()
+  {
+  m_lz = false;
+  m_from = INT64_MIN;
+  m_to = INT64_MAX;
+  m_fromrel = m_torel = false;
+  m_idstats = false;
+  m_threads = std::max(1u, std::thread::hardware_concurrency());
+  m_chunksize = CANLOGTOOL_CHUNKSIZE * 1024 * 1024;
+  m_data = NULL;
+  m_size = 0;
+  m_logstart = 0;
+  m_next = 0;
+  m_written = 0;
+  m_msgs = 0;
+  m_passed = 0;
+  m_outbytes = 0;
+  }
+
+canlogtool::~canlogtool()
+  {
+  if (m_data)
+    munmap(m_data, m_size);
+  }
+
+bool canlogtool::Open(const char* path)
+  {
+  m_path = path;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    {
+    perror(path);
+    return false;
+    }
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    {
+    perror(path);
+    close(fd);
+    return false;
+    }
+  m_size = st.st_size;
+  if (m_size > 0)
+    {
+    void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+      {
+      perror(path);
+      close(fd);
+      return false;
+      }
+    m_data = (uint8_t*)data;
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+  close(fd);
+  return true;
+  }
+
+/**
+ * NewInput: create an input formatter
+ *  The serve mode enables decoding, frames are not served by the tool.
+ */
+canformat* canlogtool::NewInput()
+  {
+  canformat* fmt = OvmsCanFormatFactory::instance().NewFormat(m_informat.c_str());
+  fmt->SetServeMode(canformat::Simulate);
+  return fmt;
+  }
+
+/**
+ * FirstTime: decode the time of the first frame (log start)
+ */
+int64_t canlogtool::FirstTime()
+  {
+  canformat* fmt = NewInput();
+  int64_t time = 0;
+  size_t pos = 0;
+  while (1)
+    {
+    CAN_log_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    bool hasmore = false;
+    size_t used = fmt->put(&msg, m_data + pos, m_size - pos, &hasmore, NULL);
+    pos += used;
+    if (msg.frame.origin != NULL)
+      {
+      time = (int64_t)msg.timestamp.tv_sec * 1000000 + msg.timestamp.tv_usec;
+      break;
+      }
+    if (used == 0 && !hasmore)
+      break;
+    }
+  delete fmt;
+  return time;
+  }
+
+/**
+ * FindSeekPoint: find the first seek point after pos
+ *  Returns SIZE_MAX if there is none within CANLOGTOOL_SCANSIZE.
+ */
+size_t canlogtool::FindSeekPoint(size_t pos)
+  {
+  canformat* fmt = NewInput();
+  size_t limit = std::min(m_size, pos + CANLOGTOOL_SCANSIZE);
+  size_t found = SIZE_MAX;
+  size_t p = pos;
+  while (1)
+    {
+    CAN_log_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    bool hasmore = false;
+    size_t used = fmt->put(&msg, m_data + p, limit - p, &hasmore, NULL);
+    p += used;
+    size_t offset = p - fmt->Buffered();
+    if (offset > pos && fmt->IsSeekPoint())
+      {
+      found = offset;
+      break;
+      }
+    if (used == 0 && !hasmore)
+      break;
+    }
+  delete fmt;
+  return found;
+  }
+
+/**
+ * Split: cut the input into chunks of about m_chunksize at seek points
+ */
+void canlogtool::Split()
+  {
+  m_chunks.clear();
+  size_t start = 0;
+  size_t nominal = m_chunksize;
+  while (nominal < m_size)
+    {
+    size_t point = FindSeekPoint(nominal);
+    if (point == SIZE_MAX)
+      {
+      if (m_chunks.empty())
+        break;                          // format has no seek points
+      nominal += m_chunksize;
+      continue;
+      }
+    if (point >= m_size)
+      break;
+    m_chunks.push_back({ start, point, false });
+    start = point;
+    nominal = point + m_chunksize;
+    }
+  m_chunks.push_back({ start, m_size, false });
+  }
+
+void canlogtool::Worker()
+  {
+  while (1)
+    {
+    size_t index = m_next++;
+    if (index >= m_chunks.size())
+      return;
+      {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [&]{ return index < m_written + m_threads * CANLOGTOOL_INFLIGHT; });
+      }
+    Process(m_chunks[index], index);
+      {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_chunks[index].done = true;
+      }
+    m_cond.notify_all();
+    }
+  }
+
+void canlogtool::Process(canlogtool_chunk_t& chunk, size_t index)
+  {
+  canformat* in = NewInput();
+  canformat* out = m_outformat.empty() ? NULL : OvmsCanFormatFactory::instance().NewFormat(m_outformat.c_str());
+  canlz* lz = (out && m_lz) ? new canlz() : NULL;
+
+  if (out && index == 0)
+    {
+    struct timeval tv;
+    tv.tv_sec = m_logstart / 1000000;
+    tv.tv_usec = m_logstart % 1000000;
+    std::string header = out->getheader(&tv);
+    Output(chunk, lz, (const uint8_t*)header.data(), header.size());
+    }
+
+  uint8_t* p = m_data + chunk.start;
+  size_t len = chunk.end - chunk.start;
+  uint8_t buf[CANFORMAT_GET_MAXLEN];
+  while (1)
+    {
+    CAN_log_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    bool hasmore = false;
+    size_t used = in->put(&msg, p, len, &hasmore, NULL);
+    p += used;
+    len -= used;
+    if (msg.frame.origin == NULL)
+      {
+      if (used == 0 && !hasmore)
+        break;
+      continue;
+      }
+
+    chunk.msgs++;
+    int64_t time = (int64_t)msg.timestamp.tv_sec * 1000000 + msg.timestamp.tv_usec;
+    if (time < m_from || time > m_to || !m_filter.IsFiltered(&msg.frame))
+      continue;
+    chunk.passed++;
+    if (m_idstats)
+      Count(chunk.ids, &msg, time);
+    if (out)
+      Output(chunk, lz, buf, out->get(&msg, buf, sizeof(buf)));
+    }
+
+  if (lz)
+    {
+    const uint8_t* block;
+    size_t blocklen = lz->Flush(&block);
+    chunk.out.append((const char*)block, blocklen);
+    delete lz;
+    }
+  delete out;
+  delete in;
+  }
+
+void canlogtool::Output(canlogtool_chunk_t& chunk, canlz* lz, const uint8_t* data, size_t len)
+  {
+  if (!lz)
+    {
+    chunk.out.append((const char*)data, len);
+    return;
+    }
+  while (len > 0)
+    {
+    size_t added = lz->Add(data, len);
+    data += added;
+    len -= added;
+    if (added == 0 || lz->IsFull())
+      {
+      const uint8_t* block;
+      size_t blocklen = lz->Flush(&block);
+      chunk.out.append((const char*)block, blocklen);
+      }
+    }
+  }
+
+void canlogtool::Count(canlogtool_idmap_t& ids, const CAN_log_message_t* msg, int64_t time)
+  {
+  const CAN_frame_t* frame = &msg->frame;
+  uint64_t key = (uint64_t)frame->origin->m_busnumber << 32
+    | (uint64_t)frame->FIR.B.FF << 31 | frame->MsgID;
+  uint8_t dlc = std::min((int)frame->FIR.B.DLC, 8);
+  auto it = ids.find(key);
+  if (it == ids.end())
+    {
+    canlogtool_idstats_t& s = ids[key];
+    s.count = 1;
+    s.changes = 0;
+    s.first = s.last = time;
+    s.intmin = INT64_MAX;
+    s.intmax = 0;
+    s.firstdlc = s.lastdlc = dlc;
+    memcpy(s.firstdata, frame->data.u8, 8);
+    memcpy(s.lastdata, frame->data.u8, 8);
+    return;
+    }
+  canlogtool_idstats_t& s = it->second;
+  int64_t interval = time - s.last;
+  s.intmin = std::min(s.intmin, interval);
+  s.intmax = std::max(s.intmax, interval);
+  if (dlc != s.lastdlc || memcmp(s.lastdata, frame->data.u8, dlc) != 0)
+    s.changes++;
+  s.count++;
+  s.last = time;
+  s.lastdlc = dlc;
+  memcpy(s.lastdata, frame->data.u8, 8);
+  }
+
+/**
+ * Merge: append the statistics b of the following chunk to a
+ */
+void canlogtool::Merge(canlogtool_idstats_t& a, const canlogtool_idstats_t& b)
+  {
+  int64_t interval = b.first - a.last;
+  a.intmin = std::min(std::min(a.intmin, b.intmin), interval);
+  a.intmax = std::max(std::max(a.intmax, b.intmax), interval);
+  a.changes += b.changes;
+  if (b.firstdlc != a.lastdlc || memcmp(a.lastdata, b.firstdata, b.firstdlc) != 0)
+    a.changes++;
+  a.count += b.count;
+  a.last = b.last;
+  a.lastdlc = b.lastdlc;
+  memcpy(a.lastdata, b.lastdata, 8);
+  }
+
+int canlogtool::Run(FILE* out, FILE* report)
+  {
+  int64_t started = esp_timer_get_time();
+
+  m_logstart = FirstTime();
+  if (m_fromrel) m_from += m_logstart;
+  if (m_torel) m_to += m_logstart;
+  Split();
+
+  std::vector<std::thread> workers;
+  unsigned threads = std::min((size_t)m_threads, m_chunks.size());
+  for (unsigned k=0; k<threads; k++)
+    workers.emplace_back(&canlogtool::Worker, this);
+
+  int result = 0;
+  for (size_t index=0; index<m_chunks.size(); index++)
+    {
+    canlogtool_chunk_t& chunk = m_chunks[index];
+      {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [&]{ return chunk.done; });
+      }
+
+    if (out && !chunk.out.empty())
+      {
+      if (fwrite(chunk.out.data(), 1, chunk.out.size(), out) != chunk.out.size() && result == 0)
+        {
+        perror("write");
+        result = 1;
+        }
+      m_outbytes += chunk.out.size();
+      }
+    std::string().swap(chunk.out);
+
+    m_msgs += chunk.msgs;
+    m_passed += chunk.passed;
+    for (auto& it : chunk.ids)
+      {
+      auto found = m_ids.find(it.first);
+      if (found == m_ids.end())
+        m_ids[it.first] = it.second;
+      else
+        Merge(found->second, it.second);
+      }
+    canlogtool_idmap_t().swap(chunk.ids);
+
+      {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_written = index + 1;
+      }
+    m_cond.notify_all();
+    }
+
+  for (std::thread& worker : workers)
+    worker.join();
+  if (out && fflush(out) != 0 && result == 0)
+    {
+    perror("write");
+    result = 1;
+    }
+
+  double elapsed = (esp_timer_get_time() - started) / 1e6;
+  if (m_idstats)
+    ReportIds(report);
+  Report(report, elapsed);
+  return result;
+  }
+
+void canlogtool::Report(FILE* report, double elapsed)
+  {
+  unsigned threads = std::min((size_t)m_threads, m_chunks.size());
+  fprintf(report, "%s: %zu bytes %s, %zu chunks, %u threads\n",
+    m_path.c_str(), m_size, m_informat.c_str(), m_chunks.size(), threads);
+  fprintf(report, "%" PRIu64 " frames, %" PRIu64 " passed filter, %zu IDs",
+    m_msgs, m_passed, m_ids.size());
+  if (!m_outformat.empty())
+    fprintf(report, ", %" PRIu64 " bytes %s%s", m_outbytes, m_outformat.c_str(), m_lz ? CANLZ_SUFFIX : "");
+  fprintf(report, "\n");
+  if (m_msgs == 0 && m_size > 0)
+    fprintf(report, "No frames decoded: invalid data, or %s can only be written\n", m_informat.c_str());
+  if (elapsed > 0)
+    fprintf(report, "%.3f s: %.0f frames/s, %.1f MB/s\n",
+      elapsed, m_msgs / elapsed, m_size / elapsed / (1024*1024));
+  }
+
+void canlogtool::ReportIds(FILE* report)
+  {
+  fprintf(report, "Bus ID          Frames     Rate/s  Period avg/min/max [ms]      Changes  Last data\n");
+  for (auto& it : m_ids)
+    {
+    const canlogtool_idstats_t& s = it.second;
+    int bus = it.first >> 32;
+    bool ext = (it.first >> 31) & 1;
+    uint32_t id = it.first & 0x1fffffff;
+    double span = (s.last - s.first) / 1e6;
+    double rate = (s.count > 1 && span > 0) ? (s.count - 1) / span : 0;
+    double avg = (s.count > 1) ? (s.last - s.first) / 1e3 / (s.count - 1) : 0;
+    char idbuf[12];
+    snprintf(idbuf, sizeof(idbuf), ext ? "%08" PRIX32 : "%03" PRIX32, id);
+    fprintf(report, "%-3d %-8s %10" PRIu64 " %10.2f  %8.1f %8.1f %8.1f %10" PRIu64 " ",
+      bus + 1, idbuf, s.count, rate, avg,
+      (s.count > 1) ? s.intmin / 1e3 : 0.0, (s.count > 1) ? s.intmax / 1e3 : 0.0, s.changes);
+    for (int k=0; k<s.lastdlc; k++)
+      fprintf(report, " %02X", s.lastdata[k]);
+    fprintf(report, "\n");
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Benchmark
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * bench: encode & decode throughput per format
+ *  Frames: ID mix of standard & extended IDs on can1/can2, DLC 0..8,
+ *  250 us apart. get() is measured through the buffer API and through
+ *  the std::string wrapper, put() decodes the buffer API output. Formats
+ *  reading host commands (see header) are not decoded.
+ */
+static double benchtime(int64_t started, size_t frames)
+  {
+  double elapsed = (esp_timer_get_time() - started) / 1e6;
+  return (elapsed > 0) ? frames / elapsed : 0;
+  }
+
+static void bench(FILE* report, size_t frames, const std::string& only)
+  {
+  static const char* const writeonly[] = { "cs11", "gvret-b", "panda", NULL };
+  std::vector<CAN_log_message_t> msgs(frames);
+  for (size_t k=0; k<frames; k++)
+    {
+    CAN_log_message_t& msg = msgs[k];
+    memset(&msg, 0, sizeof(msg));
+    msg.type = CAN_LogFrame_RX;
+    int64_t time = 1700000000LL * 1000000 + (int64_t)k * 250;
+    msg.timestamp.tv_sec = time / 1000000;
+    msg.timestamp.tv_usec = time % 1000000;
+    msg.frame.origin = can::instance().GetBus(k & 1);
+    msg.frame.FIR.B.FF = (k % 5 == 0) ? CAN_frame_ext : CAN_frame_std;
+    msg.frame.MsgID = (msg.frame.FIR.B.FF == CAN_frame_ext)
+      ? 0x18DAF100 + (k % 16) : 0x100 + (k * 7) % 0x600;
+    msg.frame.FIR.B.DLC = k % 9;
+    for (int i=0; i<8; i++)
+      msg.frame.data.u8[i] = (uint8_t)(k >> (i & 3) * 8) ^ i;
+    }
+
+  fprintf(report, "%zu frames\n", frames);
+  fprintf(report, "Format      Bytes/frame  get() frames/s  get() string  put() frames/s\n");
+  uint8_t buf[CANFORMAT_GET_MAXLEN];
+  for (auto& it : OvmsCanFormatFactory::instance().m_fmap)
+    {
+    if (!only.empty() && only != it.first)
+      continue;
+
+    // get(), buffer API:
+    canformat* fmt = OvmsCanFormatFactory::instance().NewFormat(it.first);
+    size_t buflen = 0;
+    int64_t started = esp_timer_get_time();
+    for (size_t k=0; k<frames; k++)
+      buflen += fmt->get(&msgs[k], buf, sizeof(buf));
+    double getrate = benchtime(started, frames);
+    delete fmt;
+
+    // get(), string API:
+    fmt = OvmsCanFormatFactory::instance().NewFormat(it.first);
+    size_t strlen = 0;
+    started = esp_timer_get_time();
+    for (size_t k=0; k<frames; k++)
+      strlen += fmt->get(&msgs[k]).size();
+    double getstrrate = benchtime(started, frames);
+    delete fmt;
+    if (strlen != buflen)
+      fprintf(report, "%s: string API output differs (%zu / %zu bytes)\n", it.first, strlen, buflen);
+
+    // put() input:
+    fmt = OvmsCanFormatFactory::instance().NewFormat(it.first);
+    std::string out;
+    out.reserve(buflen);
+    for (size_t k=0; k<frames; k++)
+      out.append((const char*)buf, fmt->get(&msgs[k], buf, sizeof(buf)));
+    delete fmt;
+
+    // put():
+    bool readable = true;
+    for (int k=0; writeonly[k]; k++)
+      readable &= (strcmp(it.first, writeonly[k]) != 0);
+    if (!readable)
+      {
+      fprintf(report, "%-10s %12.1f %15.0f %13.0f %15s\n", it.first, (double)buflen / frames, getrate, getstrrate, "-");
+      continue;
+      }
+    fmt = OvmsCanFormatFactory::instance().NewFormat(it.first);
+    fmt->SetServeMode(canformat::Simulate);
+    uint8_t* p = (uint8_t*)out.data();
+    size_t len = out.size();
+    size_t decoded = 0;
+    started = esp_timer_get_time();
+    while (1)
+      {
+      CAN_log_message_t msg;
+      memset(&msg, 0, sizeof(msg));
+      bool hasmore = false;
+      size_t used = fmt->put(&msg, p, len, &hasmore, NULL);
+      p += used;
+      len -= used;
+      if (msg.frame.origin != NULL)
+        decoded++;
+      else if (used == 0 && !hasmore)
+        break;
+      }
+    double putrate = benchtime(started, decoded);
+    delete fmt;
+
+    fprintf(report, "%-10s %12.1f %15.0f %13.0f ", it.first, (double)buflen / frames, getrate, getstrrate);
+    if (decoded != frames)
+      fprintf(report, "%15.0f (%zu frames decoded)\n", putrate, decoded);
+    else
+      fprintf(report, "%15.0f\n", putrate);
+    }
+  }
+
+/**
+ * filterbench: canfilter lookup time with 1, 10 and 100 ranges
+ *  Compares the compiled lookup (IsFiltered) against a scan of the
+ *  filter list, as done before the filter was compiled. Ranges are a
+ *  mix of standard & extended IDs, half of them bound to can1; frames
+ *  are a mix of standard & extended IDs on can1, can2 and no bus.
+ */
+static void filterbench(FILE* report, size_t frames)
+  {
+  uint32_t rnd = 0x12345678;
+  std::vector<CAN_frame_t> testframes(4096);
+  for (size_t k=0; k<testframes.size(); k++)
+    {
+    CAN_frame_t& frame = testframes[k];
+    rnd = rnd * 1103515245 + 12345;
+    memset(&frame, 0, sizeof(frame));
+    frame.origin = (k % 3 == 2) ? NULL : can::instance().GetBus(k % 3);
+    frame.FIR.B.FF = (k & 3) ? CAN_frame_std : CAN_frame_ext;
+    frame.MsgID = (k & 3) ? ((rnd >> 8) & 0x7ff) : ((rnd >> 3) & 0x1fffffff);
+    }
+
+  fprintf(report, "%zu frames\n", frames);
+  fprintf(report, "Ranges   List scan ns/frame  Compiled ns/frame\n");
+  static const int rangecounts[] = { 1, 10, 100 };
+  for (int rangecount : rangecounts)
+    {
+    canfilter filter;
+    std::vector<CAN_filter_t> list;
+    for (int k=0; k<rangecount; k++)
+      {
+      rnd = rnd * 1103515245 + 12345;
+      CAN_filter_t f;
+      f.bus = (k & 1) ? '1' : 0;
+      f.id_from = (k & 3) ? ((rnd >> 8) & 0x7ff) : ((rnd >> 3) & 0x1fffffff);
+      f.id_to = f.id_from + (rnd & 0x0f);
+      list.push_back(f);
+      filter.AddFilter(f.bus, f.id_from, f.id_to);
+      }
+
+    size_t listmatches = 0, compiledmatches = 0;
+    int64_t started = esp_timer_get_time();
+    for (size_t n=0; n<frames; n++)
+      {
+      const CAN_frame_t& frame = testframes[n & 4095];
+      char buskey = frame.origin ? frame.origin->m_busnumber + '1' : '0';
+      for (const CAN_filter_t& f : list)
+        {
+        if ((f.bus)&&(f.bus != buskey)) continue;
+        if ((frame.MsgID >= f.id_from) && (frame.MsgID <= f.id_to))
+          {
+          listmatches++;
+          break;
+          }
+        }
+      }
+    double listtime = (esp_timer_get_time() - started) * 1000.0 / frames;
+
+    started = esp_timer_get_time();
+    for (size_t n=0; n<frames; n++)
+      {
+      if (filter.IsFiltered(&testframes[n & 4095]))
+        compiledmatches++;
+      }
+    double compiledtime = (esp_timer_get_time() - started) * 1000.0 / frames;
+
+    fprintf(report, "%6d  %18.1f  %17.1f%s\n", rangecount, listtime, compiledtime,
+      (listmatches != compiledmatches) ? "  (MISMATCH)" : "");
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Command line
+////////////////////////////////////////////////////////////////////////
+
+static void usage(FILE* f)
+  {
+  fprintf(f,
+    "Usage: canlogtool [options] infile [outfile]\n"
+    "       canlogtool -b N [-o FORMAT]\n"
+    "       canlogtool -B N\n"
+    "Convert & analyse CAN logs, outfile \"-\" = stdout.\n"
+    "  -i, --in FORMAT       input format (default: infile extension)\n"
+    "  -o, --out FORMAT      output format, \"" CANLZ_SUFFIX "\" appended = compressed\n"
+    "                        (default: outfile extension, no outfile: no output)\n"
+    "  -f, --filter FILTER   pass frames matching [bus:]id[-id] (hex) or bus,\n"
+    "                        may be given multiple times (see \"can log start\")\n"
+    "  -s, --start TIME      skip frames before TIME\n"
+    "  -e, --end TIME        skip frames after TIME\n"
+    "                        TIME: [[h:]m:]s[.frac] from log start, or @epoch[.frac]\n"
+    "  -S, --stats           per ID statistics\n"
+    "  -t, --threads N       worker threads (default: %u)\n"
+    "  -c, --chunk MB        chunk size (default: %d)\n"
+    "  -l, --list            list formats\n"
+    "  -b, --bench N         benchmark encoding & decoding of N frames per\n"
+    "                        format (all formats or --out)\n"
+    "  -B, --filterbench N   benchmark filter lookups of N frames with 1, 10\n"
+    "                        and 100 ranges\n"
+    "  -v, --verbose         log framework messages\n",
+    std::max(1u, std::thread::hardware_concurrency()), CANLOGTOOL_CHUNKSIZE);
+  }
+
+/**
+ * parsetime: [[h:]m:]s[.frac] relative or @sec[.frac] absolute
+ *  Returns false on syntax error.
+ */
+static bool parsetime(const char* arg, int64_t* time, bool* relative)
+  {
+  *relative = (arg[0] != '@');
+  const char* p = *relative ? arg : arg+1;
+  if (!*p) return false;
+
+  int64_t sec = 0;
+  int fields = 0;
+  while (1)
+    {
+    char* end;
+    long long val = strtoll(p, &end, 10);
+    if (end == p || val < 0) return false;
+    sec = (*relative ? sec * 60 : 0) + val;
+    fields++;
+    p = end;
+    if (*p != ':') break;
+    if (!*relative || fields == 3) return false;
+    p++;
+    }
+
+  int64_t usec = 0;
+  if (*p == '.')
+    {
+    int digits = 0;
+    for (p++; *p >= '0' && *p <= '9'; p++)
+      {
+      if (digits++ < 6) usec = usec * 10 + (*p - '0');
+      }
+    for (; digits < 6; digits++) usec *= 10;
+    }
+  if (*p) return false;
+
+  *time = sec * 1000000 + usec;
+  return true;
+  }
+
+static void registerformats()
+  {
+  OvmsCanFormatFactory& factory = OvmsCanFormatFactory::instance();
+  factory.RegisterCanFormat<canformat_compact>("compact");
+  factory.RegisterCanFormat<canformat_crtd>("crtd");
+  factory.RegisterCanFormat<canformat_cs11>("cs11");
+  factory.RegisterCanFormat<canformat_gvret_ascii>("gvret-a");
+  factory.RegisterCanFormat<canformat_gvret_binary>("gvret-b");
+  factory.RegisterCanFormat<canformat_lawicel>("lawicel");
+  factory.RegisterCanFormat<canformat_panda>("panda");
+  factory.RegisterCanFormat<canformat_pcap>("pcap");
+  factory.RegisterCanFormat<canformat_raw>("raw");
+  }
+
+static bool hasformat(const std::string& format)
+  {
+  canformat* fmt = OvmsCanFormatFactory::instance().NewFormat(format.c_str());
+  delete fmt;
+  return (fmt != NULL);
+  }
+
+/**
+ * extformat: format by file extension, ".lz" maps to "+lz"
+ */
+static std::string extformat(const char* path)
+  {
+  std::string name(path);
+  std::string suffix;
+  if (name.size() > 3 && name.compare(name.size()-3, 3, ".lz") == 0)
+    {
+    name.resize(name.size()-3);
+    suffix = CANLZ_SUFFIX;
+    }
+  size_t dot = name.rfind('.');
+  if (dot == std::string::npos || name.find('/', dot) != std::string::npos)
+    return "";
+  std::string format = name.substr(dot+1);
+  return hasformat(format) ? format + suffix : "";
+  }
+
+int main(int argc, char* const* argv)
+  {
+  static const struct option options[] =
+    {
+    { "in",       required_argument,  NULL, 'i' },
+    { "out",      required_argument,  NULL, 'o' },
+    { "filter",   required_argument,  NULL, 'f' },
+    { "start",    required_argument,  NULL, 's' },
+    { "end",      required_argument,  NULL, 'e' },
+    { "stats",    no_argument,        NULL, 'S' },
+    { "threads",  required_argument,  NULL, 't' },
+    { "chunk",    required_argument,  NULL, 'c' },
+    { "list",     no_argument,        NULL, 'l' },
+    { "bench",    required_argument,  NULL, 'b' },
+    { "filterbench", required_argument, NULL, 'B' },
+    { "verbose",  no_argument,        NULL, 'v' },
+    { "help",     no_argument,        NULL, 'h' },
+    { NULL,       0,                  NULL, 0 }
+    };
+
+  esp_log_level_set("*", ESP_LOG_WARN);
+  registerformats();
+
+  canlogtool tool;
+  std::string informat, outformat;
+  size_t benchframes = 0, filterbenchframes = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "i:o:f:s:e:St:c:lb:B:vh", options, NULL)) != -1)
+    {
+    switch (opt)
+      {
+      case 'i':
+        informat = optarg;
+        break;
+      case 'o':
+        outformat = optarg;
+        break;
+      case 'f':
+        tool.m_filter.AddFilter(optarg);
+        break;
+      case 's':
+        if (!parsetime(optarg, &tool.m_from, &tool.m_fromrel))
+          {
+          fprintf(stderr, "Invalid time: %s\n", optarg);
+          return 2;
+          }
+        break;
+      case 'e':
+        if (!parsetime(optarg, &tool.m_to, &tool.m_torel))
+          {
+          fprintf(stderr, "Invalid time: %s\n", optarg);
+          return 2;
+          }
+        break;
+      case 'S':
+        tool.m_idstats = true;
+        break;
+      case 't':
+        tool.m_threads = std::max(1, atoi(optarg));
+        break;
+      case 'c':
+        tool.m_chunksize = (size_t)std::max(1, atoi(optarg)) * 1024 * 1024;
+        break;
+      case 'l':
+        for (auto& it : OvmsCanFormatFactory::instance().m_fmap)
+          printf("%s\n", it.first);
+        return 0;
+      case 'b':
+        benchframes = std::max(1, atoi(optarg));
+        break;
+      case 'B':
+        filterbenchframes = std::max(1, atoi(optarg));
+        break;
+      case 'v':
+        esp_log_level_set("*", ESP_LOG_VERBOSE);
+        break;
+      case 'h':
+        usage(stdout);
+        return 0;
+      default:
+        usage(stderr);
+        return 2;
+      }
+    }
+  if (filterbenchframes)
+    {
+    filterbench(stdout, filterbenchframes);
+    return 0;
+    }
+  if (benchframes)
+    {
+    if (!outformat.empty() && !hasformat(outformat))
+      {
+      fprintf(stderr, "%s: unknown format\n", outformat.c_str());
+      return 2;
+      }
+    bench(stdout, benchframes, outformat);
+    return 0;
+    }
+  if (optind >= argc || argc - optind > 2)
+    {
+    usage(stderr);
+    return 2;
+    }
+  const char* inpath = argv[optind];
+  const char* outpath = (argc - optind > 1) ? argv[optind+1] : NULL;
+
+  if (informat.empty())
+    informat = extformat(inpath);
+  if (informat.empty())
+    {
+    fprintf(stderr, "%s: unknown input format, use --in\n", inpath);
+    return 2;
+    }
+  if (canlz::HasSuffix(informat))
+    {
+    fprintf(stderr, "%s: compressed input, decompress with scripts/canlog_lz.py\n", inpath);
+    return 2;
+    }
+  if (!hasformat(informat))
+    {
+    fprintf(stderr, "%s: unknown format\n", informat.c_str());
+    return 2;
+    }
+  if (outformat.empty() && outpath && strcmp(outpath, "-") != 0)
+    outformat = extformat(outpath);
+  if (outpath && outformat.empty())
+    {
+    fprintf(stderr, "%s: unknown output format, use --out\n", outpath);
+    return 2;
+    }
+  if (canlz::HasSuffix(outformat))
+    {
+    outformat.resize(outformat.size() - strlen(CANLZ_SUFFIX));
+    tool.m_lz = true;
+    }
+  if (!outformat.empty() && !hasformat(outformat))
+    {
+    fprintf(stderr, "%s: unknown format\n", outformat.c_str());
+    return 2;
+    }
+  tool.m_informat = informat;
+  tool.m_outformat = outformat;
+
+  if (!tool.Open(inpath))
+    return 1;
+
+  struct stat inst, outst;
+  if (outpath && stat(inpath, &inst) == 0 && stat(outpath, &outst) == 0
+      && inst.st_dev == outst.st_dev && inst.st_ino == outst.st_ino)
+    {
+    fprintf(stderr, "%s: input and output are the same file\n", outpath);
+    return 2;
+    }
+
+  FILE* out = NULL;
+  if (!outformat.empty())
+    {
+    out = (!outpath || strcmp(outpath, "-") == 0) ? stdout : fopen(outpath, "wb");
+    if (!out)
+      {
+      perror(outpath);
+      return 1;
+      }
+    setvbuf(out, NULL, _IOFBF, CANLOGTOOL_OUTBUFSIZE);
+    }
+
+  int result = tool.Run(out, (out == stdout) ? stderr : stdout);
+  if (out && out != stdout && fclose(out) != 0)
+    {
+    perror(outpath);
+    result = 1;
+    }
+  return result;
+  }
@@ -0,0 +1,142 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN log tool: host runtime
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_stubs.h"
+#include "can.h"
+#include "pcp.h"
+#include "ovms_command.h"
+#include "ovms_utils.h"
+
+////////////////////////////////////////////////////////////////////////
+// OVMS utilities & commands
+////////////////////////////////////////////////////////////////////////
+
+char* HexByte(char* p, uint8_t byte)
+  {
+  uint8_t nibble;
+
+  nibble = byte >> 4;   // high nibble
+  nibble += '0'; if (nibble>'9') nibble += 39;
+  *p = nibble; p++;
+
+  nibble = byte & 0x0f; // low nibble
+  nibble += '0'; if (nibble>'9') nibble += 39;
+  *p = nibble; p++;
+  return p;
+  }
+
+OvmsCommand* OvmsCommand::RegisterCommand(const char* name, const char* title,
+                                          OvmsCommandExecuteCallback_t execute,
+                                          const char *usage, int min, int max, bool secure,
+                                          OvmsCommandValidateCallback_t validate)
+  {
+  // No command shell on the host
+  return NULL;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Power control
+////////////////////////////////////////////////////////////////////////
+
+const char* pcp::GetName()
+  {
+  return m_name;
+  }
+
+pcpapp& pcpapp::instance(const char* caller)
+  {
+  static pcpapp _instance;
+  return _instance;
+  }
+
+pcpapp::pcpapp()
+  {
+  }
+
+pcp* pcpapp::FindDeviceByName(const char* name)
+  {
+  // Buses "can1"… are the only devices
+  if (strncmp(name, "can", 3) == 0 && name[3] >= '1' && name[4] == 0)
+    return can::instance().GetBus(name[3] - '1');
+  return NULL;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// CAN framework: bus registry
+////////////////////////////////////////////////////////////////////////
+
+static const char* const CAN_log_type_names[] = {
+  "-",
+  "RX",
+  "TX",
+  "TX_Queue",
+  "TX_Fail",
+  "Error",
+  "Status",
+  "Comment",
+  "Info",
+  "Event",
+  "Metric"
+  };
+
+const char* GetCanLogTypeName(CAN_log_type_t type)
+  {
+  return CAN_log_type_names[type];
+  }
+
+// The bus and framework objects are never constructed (their members
+// need the drivers & FreeRTOS), only the bus number is set up. The
+// formatters' serve modes (simulate/transmit) are not available.
+alignas(canbus) static uint8_t host_canbus[CAN_MAXBUSES][sizeof(canbus)];
+alignas(can) static uint8_t host_can[sizeof(can)];
+
+static bool host_canbus_init()
+  {
+  for (int k=0; k<CAN_MAXBUSES; k++)
+    reinterpret_cast<canbus*>(host_canbus[k])->m_busnumber = k;
+  return true;
+  }
+
+can& can::instance(const char* caller)
+  {
+  static bool initialized = host_canbus_init();   // thread safe init
+  (void)initialized;
+  return *reinterpret_cast<can*>(host_can);
+  }
+
+canbus* can::GetBus(int busnumber)
+  {
+  if ((busnumber<0)||(busnumber>=CAN_MAXBUSES)) return NULL;
+  return reinterpret_cast<canbus*>(host_canbus[busnumber]);
+  }
+
+void can::IncomingFrame(CAN_frame_t* p_frame, int64_t time)
+  {
+  }
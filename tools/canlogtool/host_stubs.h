@@ -0,0 +1,40 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        CAN log tool: host runtime
+;    Date:          18th January 2018
+;
+;    (C) 2018       Mark Webb-Johnson
+;
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __HOST_STUBS_H__
+#define __HOST_STUBS_H__
+
+#include "esp_log.h"
+
+// The CAN log formatters are built from the firmware sources
+// (components/can/src) on the host runtime (tools/host). The stubs
+// provide the parts of the framework they reference: the CAN bus
+// registry and power control. Bus objects are placeholders carrying the
+// bus number only, as that is all the formatters and canfilter need
+// from a frame origin.
+
+#endif //#ifndef __HOST_STUBS_H__
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+# Round trip regression tests of the canlogtool formats (run by ctest, see
+# tools/canlogtool/CMakeLists.txt).
+#
+# Usage: roundtrip.py <canlogtool> <test>
+#   <test> = <format>: convert a generated CRTD log to <format> and back,
+#                      compare the frames
+#            compact-script: decode canlogtool "compact" output with
+#                      scripts/canlog_compact.py
+#            lz-script: decompress canlogtool "crtd+lz" & "compact+lz"
+#                      output with scripts/canlog_lz.py
+#
+# The log is large enough to be cut into several chunks (-c 1), so the
+# parallel chunk decoding is covered as well. Frames are compared as far
+# as the format can carry them: pcap & lawicel have no bus number, gvret-a
+# has 32 bit relative timestamps, lawicel has none.
+
+import os
+import subprocess
+import sys
+import tempfile
+
+FRAMES = 200000
+SCRIPTS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "..", "scripts")
+
+# Properties preserved by a format: (bus, absolute time, relative time)
+FORMATS = {
+    "crtd":    (True,  True,  True),
+    "compact": (True,  True,  True),
+    "raw":     (True,  True,  True),
+    "pcap":    (False, True,  True),
+    "gvret-a": (True,  False, True),
+    "lawicel": (False, False, False),
+}
+
+
+def generate(path):
+    """Write FRAMES RX frames: can1/can2, standard & extended IDs, DLC 0..8"""
+    frames = []
+    time = 1700000000 * 1000000
+    rnd = 0x12345678
+    for k in range(FRAMES):
+        rnd = (rnd * 1103515245 + 12345) & 0xffffffff
+        time += 50 + (rnd >> 16) % 2000
+        bus = 1 + (k & 1)
+        ext = (k % 5 == 0)
+        msgid = (rnd >> 3) & 0x1fffffff if ext else (rnd >> 8) & 0x7ff
+        data = bytes(((rnd >> (i * 3)) + k) & 0xff for i in range(k % 9))
+        frames.append((time, bus, ext, msgid, data))
+    with open(path, "w") as f:
+        for (time, bus, ext, msgid, data) in frames:
+            f.write("%d.%06d %dR%s %X%s\n" % (time // 1000000, time % 1000000, bus,
+                    "29" if ext else "11", msgid, "".join(" %02X" % b for b in data)))
+    return frames
+
+
+def parse(path):
+    """Read the frames of a CRTD log, skip comments & status records"""
+    frames = []
+    with open(path) as f:
+        for line in f:
+            words = line.split()
+            if len(words) < 3 or words[1][1:] not in ("R11", "R29"):
+                continue
+            sec, _, usec = words[0].partition(".")
+            time = int(sec) * 1000000 + int(usec.ljust(6, "0"))
+            frames.append((time, int(words[1][0]), words[1][1:] == "R29", int(words[2], 16),
+                           bytes(int(b, 16) for b in words[3:])))
+    return frames
+
+
+def compare(name, expected, actual, bus=True, abstime=True, reltime=True):
+    if len(expected) != len(actual):
+        sys.exit("%s: %d frames expected, %d decoded" % (name, len(expected), len(actual)))
+    for k, (e, a) in enumerate(zip(expected, actual)):
+        if e[2:] != a[2:] or (bus and e[1] != a[1]) or (abstime and e[0] != a[0]) \
+                or (reltime and e[0] - expected[0][0] != a[0] - actual[0][0]):
+            sys.exit("%s: frame %d differs:\n  expected %r\n  decoded  %r" % (name, k, e, a))
+
+
+def run(cmd, **kwargs):
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, **kwargs)
+    if result.returncode != 0:
+        sys.exit("%s failed (%d):\n%s" % (" ".join(cmd), result.returncode,
+                                          result.stderr.decode(errors="replace")))
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.exit("Usage: roundtrip.py <canlogtool> <test>")
+    tool, test = argv
+    with tempfile.TemporaryDirectory() as tmp:
+        src = os.path.join(tmp, "src.crtd")
+        frames = generate(src)
+
+        if test in FORMATS:
+            conv = os.path.join(tmp, "conv." + test)
+            back = os.path.join(tmp, "back.crtd")
+            run([tool, "-t", "4", "-c", "1", "-o", test, src, conv])
+            run([tool, "-t", "4", "-c", "1", "-i", test, "-o", "crtd", conv, back])
+            bus, abstime, reltime = FORMATS[test]
+            compare(test, frames, parse(back), bus, abstime, reltime)
+
+        elif test == "compact-script":
+            conv = os.path.join(tmp, "conv.compact")
+            back = os.path.join(tmp, "back.crtd")
+            run([tool, "-t", "4", "-c", "1", "-o", "compact", src, conv])
+            run([sys.executable, os.path.join(SCRIPTS, "canlog_compact.py"), conv, back])
+            compare(test, frames, parse(back))
+
+        elif test == "lz-script":
+            for (fmt, args) in (("crtd", []), ("compact", ["--crtd"])):
+                conv = os.path.join(tmp, "conv.%s.lz" % fmt)
+                back = os.path.join(tmp, "back.%s.crtd" % fmt)
+                run([tool, "-t", "4", "-c", "1", "-o", fmt + "+lz", src, conv])
+                run([sys.executable, os.path.join(SCRIPTS, "canlog_lz.py")] + args + [conv, back])
+                compare("%s+lz" % fmt, frames, parse(back))
+
+        else:
+            sys.exit("%s: unknown test" % test)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,30 @@
+# Shared settings of the host (Linux) builds, include() from a tool's
+# CMakeLists.txt:
+#   OVMS_ROOT           repository root
+#   OVMS_HOST_INCLUDE   include path, host replacements for ESP-IDF &
+#                       FreeRTOS first
+#   OVMS_HOST_RUNTIME   FreeRTOS & ESP-IDF runtime sources
+#   OVMS_HOST_OPTIONS   compile options
+#   OVMS_CAN_SOURCES    components/can sources
+
+get_filename_component(OVMS_ROOT ${CMAKE_CURRENT_LIST_DIR}/../.. ABSOLUTE)
+set(OVMS_HOST_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+set(OVMS_HOST_INCLUDE
+  ${OVMS_HOST_DIR}/include
+  ${OVMS_ROOT}/include
+  ${OVMS_ROOT}/main
+  ${OVMS_ROOT}/components/can/src
+  ${OVMS_ROOT}/components/ovms_buffer/src
+  ${OVMS_ROOT}/components/pcp
+  ${OVMS_ROOT}/components/dbc/src
+  ${OVMS_ROOT}/components/id_filter/src)
+
+# newlib compatibility, see include/host_newlib.h
+set(OVMS_HOST_OPTIONS -include ${OVMS_HOST_DIR}/include/host_newlib.h)
+
+set(OVMS_HOST_RUNTIME
+  ${OVMS_HOST_DIR}/runtime/esp_idf.cpp
+  ${OVMS_HOST_DIR}/runtime/freertos.cpp)
+
+file(GLOB OVMS_CAN_SOURCES ${OVMS_ROOT}/components/can/src/*.cpp)
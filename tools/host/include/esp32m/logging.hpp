@@ -0,0 +1,32 @@
+// Host build: the esp32m logging front end. Loggable objects and the
+// logX() / logx() macros map to the ESP-IDF log API using the TAG of
+// the calling module.
+#pragma once
+#include "esp_log.h"
+
+namespace esp32m
+  {
+  namespace log
+    {
+    class Loggable
+      {
+      public:
+        virtual ~Loggable() {}
+        virtual const char* name() const { return ""; }
+      };
+    }
+  }
+
+#define logE(format, ...) ESP_LOGE(TAG, format, ##__VA_ARGS__)
+#define logW(format, ...) ESP_LOGW(TAG, format, ##__VA_ARGS__)
+#define logI(format, ...) ESP_LOGI(TAG, format, ##__VA_ARGS__)
+#define logD(format, ...) ESP_LOGD(TAG, format, ##__VA_ARGS__)
+#define logV(format, ...) ESP_LOGV(TAG, format, ##__VA_ARGS__)
+#define loge(format, ...) ESP_LOGE(TAG, format, ##__VA_ARGS__)
+#define logw(format, ...) ESP_LOGW(TAG, format, ##__VA_ARGS__)
+#define logi(format, ...) ESP_LOGI(TAG, format, ##__VA_ARGS__)
+#define logd(format, ...) ESP_LOGD(TAG, format, ##__VA_ARGS__)
+#define logv(format, ...) ESP_LOGV(TAG, format, ##__VA_ARGS__)
+
+// Arduino core time base (milliseconds since start)
+extern "C" unsigned long millis();
@@ -0,0 +1,10 @@
+// Host build: the esp32m network layer is not part of the host build
+#pragma once
+#include "esp_err.h"
+namespace esp32m
+  {
+  namespace net
+    {
+    inline esp_err_t useEventLoop() { return ESP_OK; }
+    }
+  }
@@ -0,0 +1,11 @@
+// Host build: Ethernet event identifiers (no Ethernet driver on the host)
+#pragma once
+#include "esp_event.h"
+ESP_EVENT_DECLARE_BASE(ETH_EVENT);
+typedef enum
+  {
+  ETHERNET_EVENT_START = 0,
+  ETHERNET_EVENT_STOP,
+  ETHERNET_EVENT_CONNECTED,
+  ETHERNET_EVENT_DISCONNECTED,
+  } eth_event_t;
@@ -0,0 +1,21 @@
+// Host build: there are no system (WiFi/IP/Ethernet) events, handlers
+// can be registered but are never called (runtime/esp_idf.cpp).
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+typedef const char* esp_event_base_t;
+typedef void* esp_event_handler_instance_t;
+typedef void* esp_event_loop_handle_t;
+typedef void (*esp_event_handler_t)(void* arg, esp_event_base_t base, int32_t id, void* data);
+#define ESP_EVENT_DECLARE_BASE(id) extern "C" esp_event_base_t const id
+#define ESP_EVENT_ANY_BASE      NULL
+#define ESP_EVENT_ANY_ID        -1
+extern "C" {
+esp_err_t esp_event_loop_create_default();
+esp_err_t esp_event_loop_delete_default();
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void* arg, esp_event_handler_instance_t* instance);
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t base, int32_t id,
+                                                esp_event_handler_instance_t instance);
+}
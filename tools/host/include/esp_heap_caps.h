@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_8BIT         (1<<2)
+#define MALLOC_CAP_SPIRAM       (1<<10)
+#define MALLOC_CAP_INTERNAL     (1<<11)
+#define MALLOC_CAP_DEFAULT      (1<<12)
+extern "C" {
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+}
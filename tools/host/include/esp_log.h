@@ -0,0 +1,33 @@
+// Host build: log output goes to stderr, filtered by tag & level
+// (runtime/esp_idf.cpp)
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+typedef enum
+  {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+  } esp_log_level_t;
+
+extern "C" void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+  __attribute__((format(printf, 3, 4)));
+extern "C" uint32_t esp_log_timestamp();
+extern "C" void esp_log_level_set(const char* tag, esp_log_level_t level);
+extern "C" esp_log_level_t esp_log_level_get(const char* tag);
+extern "C" void esp_log_buffer_hexdump_internal(const char* tag, const void* buffer, uint16_t length,
+                                                esp_log_level_t level);
+
+#define LOG_FORMAT(letter, format) #letter " (%" PRIu32 ") %s: " format "\n"
+#define ESP_LOG_LEVEL(level, letter, tag, format, ...) \
+  esp_log_write(level, tag, LOG_FORMAT(letter, format), esp_log_timestamp(), tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
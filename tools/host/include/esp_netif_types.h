@@ -0,0 +1,22 @@
+// Host build: IP event identifiers & payloads (no esp_netif on the host)
+#pragma once
+#include <stdint.h>
+#include "esp_event.h"
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+typedef enum
+  {
+  IP_EVENT_STA_GOT_IP = 0,
+  IP_EVENT_STA_LOST_IP,
+  IP_EVENT_AP_STAIPASSIGNED,
+  IP_EVENT_GOT_IP6,
+  IP_EVENT_ETH_GOT_IP,
+  IP_EVENT_ETH_LOST_IP,
+  IP_EVENT_PPP_GOT_IP,
+  IP_EVENT_PPP_LOST_IP,
+  } ip_event_t;
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+typedef struct { uint32_t addr[4]; uint8_t zone; } esp_ip6_addr_t;
+typedef struct { esp_ip4_addr_t ip; esp_ip4_addr_t netmask; esp_ip4_addr_t gw; } esp_netif_ip_info_t;
+typedef struct { esp_ip6_addr_t ip; } esp_netif_ip6_info_t;
+typedef struct { void* esp_netif; esp_netif_ip_info_t ip_info; bool ip_changed; } ip_event_got_ip_t;
+typedef struct { void* esp_netif; esp_netif_ip6_info_t ip6_info; int ip_index; } ip_event_got_ip6_t;
@@ -0,0 +1,8 @@
+// Host build: no flash partitions
+#pragma once
+typedef enum
+  {
+  ESP_PARTITION_SUBTYPE_APP_FACTORY = 0x00,
+  ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+  ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+  } esp_partition_subtype_t;
@@ -0,0 +1,7 @@
+// Host build: no task watchdog
+#pragma once
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+inline esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_delete(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_reset() { return ESP_OK; }
@@ -0,0 +1,20 @@
+// Host build: no FAT partitions, files live in the host file system.
+// The config store is the directory host_config_path (see ovms_host.h),
+// mounting it is a no-op.
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "wear_levelling.h"
+#include "ovms_host.h"
+typedef struct
+  {
+  bool format_if_mount_failed;
+  int max_files;
+  size_t allocation_unit_size;
+  } esp_vfs_fat_mount_config_t;
+typedef esp_vfs_fat_mount_config_t esp_vfs_fat_sdmmc_mount_config_t;
+
+esp_err_t esp_vfs_fat_spiflash_mount(const char* base_path, const char* partition_label,
+                                     const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle);
+esp_err_t esp_vfs_fat_spiflash_unmount(const char* base_path, wl_handle_t wl_handle);
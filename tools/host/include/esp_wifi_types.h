@@ -0,0 +1,34 @@
+// Host build: WiFi event identifiers & payloads (no WiFi on the host)
+#pragma once
+#include <stdint.h>
+#include "esp_event.h"
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+typedef enum
+  {
+  WIFI_EVENT_WIFI_READY = 0,
+  WIFI_EVENT_SCAN_DONE,
+  WIFI_EVENT_STA_START,
+  WIFI_EVENT_STA_STOP,
+  WIFI_EVENT_STA_CONNECTED,
+  WIFI_EVENT_STA_DISCONNECTED,
+  WIFI_EVENT_STA_AUTHMODE_CHANGE,
+  WIFI_EVENT_STA_WPS_ER_SUCCESS,
+  WIFI_EVENT_STA_WPS_ER_FAILED,
+  WIFI_EVENT_STA_WPS_ER_TIMEOUT,
+  WIFI_EVENT_STA_WPS_ER_PIN,
+  WIFI_EVENT_STA_WPS_ER_PBC_OVERLAP,
+  WIFI_EVENT_AP_START,
+  WIFI_EVENT_AP_STOP,
+  WIFI_EVENT_AP_STACONNECTED,
+  WIFI_EVENT_AP_STADISCONNECTED,
+  WIFI_EVENT_AP_PROBEREQRECVED,
+  } wifi_event_t;
+typedef enum { WPS_FAIL_REASON_NORMAL = 0, WPS_FAIL_REASON_RECV_M2D, WPS_FAIL_REASON_MAX } wifi_event_sta_wps_fail_reason_t;
+typedef struct { uint32_t status; uint8_t number; uint8_t scan_id; } wifi_event_sta_scan_done_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; int authmode; uint16_t aid; } wifi_event_sta_connected_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; int8_t rssi; } wifi_event_sta_disconnected_t;
+typedef struct { int old_mode; int new_mode; } wifi_event_sta_authmode_change_t;
+typedef struct { uint8_t pin_code[8]; } wifi_event_sta_wps_er_pin_t;
+typedef struct { uint8_t mac[6]; uint8_t aid; bool is_mesh_child; } wifi_event_ap_staconnected_t;
+typedef struct { uint8_t mac[6]; uint8_t aid; bool is_mesh_child; uint8_t reason; } wifi_event_ap_stadisconnected_t;
+typedef struct { int rssi; uint8_t mac[6]; } wifi_event_ap_probe_req_rx_t;
@@ -0,0 +1,160 @@
+// Host build: FreeRTOS API on POSIX threads (runtime/freertos.cpp).
+// Tasks are std::threads, queues & semaphores are condition variable
+// based, software timers run on a timer service thread. Priorities and
+// core affinities are accepted but not applied; the tick rate is 1 kHz.
+#pragma once
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+typedef uint32_t TickType_t;
+typedef TickType_t portTickType;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+
+typedef struct host_queue* QueueHandle_t;
+typedef struct host_task* TaskHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct host_timer* TimerHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+typedef struct { int owner; int count; } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  { 0, 0 }
+#define portMAX_DELAY                 ((TickType_t)0xffffffffUL)
+#define pdTRUE                        1
+#define pdFALSE                       0
+#define pdPASS                        1
+#define pdFAIL                        0
+#define errQUEUE_FULL                 0
+#define configTICK_RATE_HZ            1000
+#define portTICK_PERIOD_MS            (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS              portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)             ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define configMAX_PRIORITIES          25
+#define configMAX_TASK_NAME_LEN       16
+#define portNUM_PROCESSORS            2
+#define tskNO_AFFINITY                0x7fffffff
+#define tskIDLE_PRIORITY              0
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
+#define RTC_NOINIT_ATTR
+#define BIT(n)                        (1UL << (n))
+
+// Critical sections: one process wide recursive lock, the mux argument
+// only serves to keep the device code unchanged.
+#define portENTER_CRITICAL(mux)       vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)        vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)   vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)    vPortExitCritical(mux)
+#define taskENTER_CRITICAL(mux)       vPortEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux)        vPortExitCritical(mux)
+#define portYIELD_FROM_ISR()          do {} while (0)
+#define portYIELD()                   taskYIELD()
+
+typedef enum { eNoAction = 0, eSetBits, eIncrement, eSetValueWithOverwrite, eSetValueWithoutOverwrite } eNotifyAction;
+typedef enum { eRunning = 0, eReady, eBlocked, eSuspended, eDeleted, eInvalid } eTaskState;
+
+typedef struct
+  {
+  TaskHandle_t xHandle;
+  const char* pcTaskName;
+  UBaseType_t xTaskNumber;
+  eTaskState eCurrentState;
+  UBaseType_t uxCurrentPriority;
+  UBaseType_t uxBasePriority;
+  uint32_t ulRunTimeCounter;
+  StackType_t* pxStackBase;
+  uint32_t usStackHighWaterMark;
+  BaseType_t xCoreID;
+  } TaskStatus_t;
+
+extern "C" {
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+void* pvPortMalloc(size_t size);
+void vPortFree(void* ptr);
+BaseType_t xPortGetCoreID();
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemsize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t wait, BaseType_t front);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+void taskYIELD();
+TickType_t xTaskGetTickCount();
+TickType_t xTaskGetTickCountFromISR();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+TaskHandle_t xTaskGetHandle(const char* name);
+char* pcTaskGetName(TaskHandle_t task);
+#define pcTaskGetTaskName pcTaskGetName
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+UBaseType_t uxTaskGetNumberOfTasks();
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* runtime);
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t* previous);
+BaseType_t xTaskNotifyWait(uint32_t clearonentry, uint32_t clearonexit, uint32_t* value, TickType_t wait);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem);
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t autoreload, void* id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+TickType_t xTimerGetPeriod(TimerHandle_t timer);
+void* pvTimerGetTimerID(TimerHandle_t timer);
+void vTimerSetTimerID(TimerHandle_t timer, void* id);
+const char* pcTimerGetName(TimerHandle_t timer);
+}
+
+// ISR variants: there are no interrupts on the host, "ISR" code runs
+// in a task (e.g. the esp_timer thread) and may use the task API.
+#define xQueueSend(q, item, wait)                 xQueueGenericSend(q, item, wait, pdFALSE)
+#define xQueueSendToBack(q, item, wait)           xQueueGenericSend(q, item, wait, pdFALSE)
+#define xQueueSendToFront(q, item, wait)          xQueueGenericSend(q, item, wait, pdTRUE)
+#define xQueueSendFromISR(q, item, woken)         xQueueGenericSend(q, item, 0, pdFALSE)
+#define xQueueSendToBackFromISR(q, item, woken)   xQueueGenericSend(q, item, 0, pdFALSE)
+#define xQueueSendToFrontFromISR(q, item, woken)  xQueueGenericSend(q, item, 0, pdTRUE)
+#define xQueueReceiveFromISR(q, item, woken)      xQueueReceive(q, item, 0)
+#define xTaskCreate(fn, name, stack, param, prio, handle) \
+  xTaskCreatePinnedToCore(fn, name, stack, param, prio, handle, tskNO_AFFINITY)
+#define xTaskNotify(task, value, action)          xTaskGenericNotify(task, value, action, NULL)
+#define xTaskNotifyFromISR(task, value, action, woken) xTaskGenericNotify(task, value, action, NULL)
+#define xTaskNotifyGive(task)                     xTaskGenericNotify(task, 0, eIncrement, NULL)
+#define vTaskNotifyGiveFromISR(task, woken)       xTaskGenericNotify(task, 0, eIncrement, NULL)
+#define xSemaphoreGiveFromISR(sem, woken)         xSemaphoreGive(sem)
+#define xSemaphoreTakeFromISR(sem, woken)         xSemaphoreTake(sem, 0)
+#define xTimerStartFromISR(timer, woken)          xTimerStart(timer, 0)
+#define xTimerStopFromISR(timer, woken)           xTimerStop(timer, 0)
+#define xTimerResetFromISR(timer, woken)          xTimerReset(timer, 0)
@@ -0,0 +1,49 @@
+// Host build: ESP-IDF newlib compatibility, included ahead of every
+// source (see host.cmake). The firmware sources rely on declarations
+// the newlib & toolchain headers make visible implicitly.
+#pragma once
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef __cplusplus
+#include <cmath>
+#endif
+
+#if !defined(__GLIBC__) || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+static inline size_t strlcpy(char* dst, const char* src, size_t size)
+  {
+  size_t len = strlen(src);
+  if (size)
+    {
+    size_t n = (len >= size) ? size - 1 : len;
+    memcpy(dst, src, n);
+    dst[n] = 0;
+    }
+  return len;
+  }
+#endif
+
+static inline char* itoa(int value, char* str, int base)
+  {
+  char* p = str;
+  unsigned int v = (value < 0 && base == 10) ? -(unsigned int)value : (unsigned int)value;
+  do
+    {
+    int digit = v % base;
+    *p++ = (digit < 10) ? '0' + digit : 'a' + digit - 10;
+    v /= base;
+    } while (v);
+  if (value < 0 && base == 10) *p++ = '-';
+  *p = 0;
+  for (char *a = str, *b = p - 1; a < b; a++, b--)
+    {
+    char c = *a;
+    *a = *b;
+    *b = c;
+    }
+  return str;
+  }
@@ -0,0 +1,4 @@
+// Host build: the boot & crash handling framework (include/ovms_boot.h)
+// needs the ESP32 ROM & RTC, it is not part of the host build.
+#pragma once
+#include "ovms_events.h"
@@ -0,0 +1,2 @@
+// Host build: no scripting support
+#pragma once
@@ -0,0 +1,10 @@
+// Host build: the VFS shell commands (main/ovms_vfs.cpp) are not part of
+// the host build, files are accessed through the host file system.
+#pragma once
+#include "esp32m/logging.hpp"
+
+class VfsInit
+  {
+    public:
+      VfsInit() {}
+  };
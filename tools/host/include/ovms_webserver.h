@@ -0,0 +1,2 @@
+// Host build: no web server (CONFIG_OVMS_COMP_WEBSERVER is not set)
+#pragma once
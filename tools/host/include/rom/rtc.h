@@ -0,0 +1,3 @@
+// Host build: no RTC memory, RTC_NOINIT_ATTR data is plain (zeroed) RAM
+#pragma once
+#include "freertos/FreeRTOS.h"
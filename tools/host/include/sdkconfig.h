@@ -0,0 +1,21 @@
+// Host build configuration (see tools/host/CMakeLists.txt): the settings
+// referenced by the framework, CAN, DBC & vehicle sources. Components
+// needing the ESP32 hardware or network stack are not enabled; the CAN
+// buses are the virtual CAN (vcan) and the optional SocketCAN driver.
+#pragma once
+#define CONFIG_OVMS 1
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_OVMS_COMP_VCAN 1
+#define CONFIG_OVMS_HW_EVENT_QUEUE_SIZE 40
+#define CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE 30
+#define CONFIG_OVMS_HW_CAN_TX_QUEUE_SIZE 20
+#define CONFIG_OVMS_HW_CAN_RING_SIZE 128
+#define CONFIG_OVMS_HW_CAN_TRAFFIC_IDS 256
+#define CONFIG_OVMS_HW_CAN_CACHE_IDS 256
+#define CONFIG_OVMS_VEHICLE_RXTASK_STACK 6144
+#define CONFIG_OVMS_LOGFILE_QUEUE_SIZE 100
+#define CONFIG_OVMS_LOGFILE_TASK_PRIORITY 2
+#define CONFIG_OVMS_SYS_COMMAND_STACK_SIZE 6144
+#define CONFIG_OVMS_SYS_COMMAND_PRIORITY 5
+#define CONFIG_OVMS_SC_JAVASCRIPT_NONE 1
@@ -0,0 +1,6 @@
+// Host build: no SPI bus (components/spi needs the ESP32 SPI master
+// driver); the type is kept for the Peripherals class.
+#pragma once
+#include "pcp.h"
+
+class spi;
@@ -0,0 +1,5 @@
+// Host build: no wear levelling layer
+#pragma once
+#include <stdint.h>
+typedef int32_t wl_handle_t;
+#define WL_INVALID_HANDLE -1
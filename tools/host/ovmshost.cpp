@@ -0,0 +1,353 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        Host build: framework, CAN & vehicle on Linux
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "ovmshost";
+
+// Usage:
+//   ovmshost [-v <level>] [-d <store>] [-s <bus>=<ifname>]... [-c <command>]...
+//
+// Runs the command framework, config, events, metrics, CAN, DBC & vehicle
+// modules as a Linux process. Buses can1..can4 are virtual CAN nodes on
+// one shared wire (components/vcan), -s replaces a bus by a SocketCAN
+// interface. Commands are read from stdin line by line, or taken from
+// the -c options (the tool exits after the last one).
+//
+// Config params are stored in <store>/ovms_config (default ./store), the
+// same file format as /store/ovms_config on the module.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "global.h"
+#include "ovms_host.h"
+#include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
+#include "ovms_metrics.h"
+#include "metrics_standard.h"
+#include "ovms_version.h"
+#include "ovms_module.h"
+#include "can.h"
+#include "dbc_app.h"
+#include "vcan.h"
+#include "socketcan.h"
+#include "vehicle.h"
+
+uint32_t monotonictime = 0;
+std::string host_config_path;
+const char *appName = "RetroVMS";
+const char *appVersion = "host";
+
+////////////////////////////////////////////////////////////////////////
+// Version
+
+std::string GetOVMSVersion()
+  {
+  return std::string("host");
+  }
+
+std::string GetOVMSBuild()
+  {
+  return std::string(__DATE__ " " __TIME__);
+  }
+
+std::string GetOVMSProduct()
+  {
+  return std::string("ovmshost");
+  }
+
+std::string GetOVMSHardware()
+  {
+  return std::string("host");
+  }
+
+std::string GetOVMSPartitionVersion(esp_partition_subtype_t t)
+  {
+  return std::string("");
+  }
+
+// Task memory tracking (main/ovms_module.cpp) needs the ESP32 heap tracer
+void AddTaskToMap(TaskHandle_t task)
+  {
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Console: command output to stdout
+
+class hostconsole : public OvmsWriter
+  {
+  public:
+    hostconsole() { SetSecure(true); }
+
+  public:
+    int puts(const char* s)
+      {
+      fputs(s, stdout);
+      fputc('\n', stdout);
+      fflush(stdout);
+      return 0;
+      }
+    int printf(const char* fmt, ...)
+      {
+      va_list args;
+      va_start(args, fmt);
+      int ret = vfprintf(stdout, fmt, args);
+      va_end(args);
+      fflush(stdout);
+      return ret;
+      }
+    ssize_t write(const void *buf, size_t nbyte)
+      {
+      size_t ret = fwrite(buf, 1, nbyte, stdout);
+      fflush(stdout);
+      return ret;
+      }
+    bool IsInteractive() { return isatty(fileno(stdin)); }
+    void Exit() {}
+  };
+
+static void ExecuteLine(OvmsWriter* writer, const std::string& line)
+  {
+  // Split into words, double quotes group words:
+  std::vector<std::string> words;
+  std::string word;
+  bool quoted = false, inword = false;
+  for (char c : line)
+    {
+    if (c == '"')
+      { quoted = !quoted; inword = true; }
+    else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+      {
+      if (inword) words.push_back(word);
+      word.clear();
+      inword = false;
+      }
+    else
+      { word += c; inword = true; }
+    }
+  if (inword) words.push_back(word);
+  if (words.empty() || words[0][0] == '#') return;
+
+  std::vector<const char*> argv;
+  for (const std::string& w : words)
+    argv.push_back(w.c_str());
+  OvmsCommandApp::instance(TAG).Execute(COMMAND_RESULT_VERBOSE, writer, argv.size(), argv.data());
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Housekeeping ticker (see main/ovms_housekeeping.cpp)
+
+static void HostTicker1(TimerHandle_t timer)
+  {
+  static unsigned int tick = 0;
+  monotonictime++;
+
+  MetricsStandard::instance(TAG).ms_m_monotonic->SetValue((int)monotonictime);
+  MetricsStandard::instance().ms_m_timeutc->SetValue((int)time(NULL));
+
+  OvmsEvents::instance(TAG).SignalEvent("ticker.1", NULL);
+
+  tick++;
+  if ((tick % 10)==0) OvmsEvents::instance(TAG).SignalEvent("ticker.10", NULL);
+  if ((tick % 60)==0) OvmsEvents::instance(TAG).SignalEvent("ticker.60", NULL);
+  if ((tick % 300)==0) OvmsEvents::instance(TAG).SignalEvent("ticker.300", NULL);
+  if ((tick % 600)==0) OvmsEvents::instance(TAG).SignalEvent("ticker.600", NULL);
+  if ((tick % 3600)==0)
+    {
+    tick = 0;
+    OvmsEvents::instance(TAG).SignalEvent("ticker.3600", NULL);
+    }
+
+  time_t rawtime;
+  time ( &rawtime );
+  struct tm* tmu = localtime(&rawtime);
+  if (tmu->tm_sec == 0)
+    {
+    char tev[16];
+    sprintf(tev,"clock.%02d%02d",tmu->tm_hour,tmu->tm_min);
+    OvmsEvents::instance(TAG).SignalEvent(tev, NULL);
+    if ((tmu->tm_hour==0)&&(tmu->tm_min==0))
+      {
+      sprintf(tev,"clock.day%1d",tmu->tm_wday);
+      OvmsEvents::instance(TAG).SignalEvent(tev, NULL);
+      }
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Main
+
+static void usage()
+  {
+  fprintf(stderr,
+    "Usage: ovmshost [-v <level>] [-d <store>] [-s <bus>=<ifname>]... [-c <command>]...\n"
+    "  -v <level>          log level: none, error, warn, info (default), debug, verbose\n"
+    "  -d <store>          config store directory (default: store)\n"
+    "  -s <bus>=<ifname>   attach bus (can1..can4) to a SocketCAN interface\n"
+    "  -c <command>        execute command, exit after the last one\n"
+    "Without -c, commands are read from stdin.\n");
+  }
+
+static bool ParseLogLevel(const char* name, esp_log_level_t* level)
+  {
+  static const char* const names[] = { "none", "error", "warn", "info", "debug", "verbose" };
+  for (int k = 0; k < 6; k++)
+    {
+    if (strcmp(name, names[k]) == 0)
+      {
+      *level = (esp_log_level_t)k;
+      return true;
+      }
+    }
+  return false;
+  }
+
+int main(int argc, char* argv[])
+  {
+  std::string store = "store";
+  std::vector<std::string> commands;
+  std::string socketcan_if[VCAN_MAXNODES];
+
+  int opt;
+  while ((opt = getopt(argc, argv, "v:d:s:c:h")) != -1)
+    {
+    switch (opt)
+      {
+      case 'v':
+        {
+        esp_log_level_t level;
+        if (!ParseLogLevel(optarg, &level))
+          {
+          usage();
+          return 1;
+          }
+        esp_log_level_set("*", level);
+        break;
+        }
+      case 'd':
+        store = optarg;
+        break;
+      case 's':
+        {
+        const char* eq = strchr(optarg, '=');
+        if (!eq || eq - optarg != 4 || strncmp(optarg, "can", 3) != 0 ||
+            eq[-1] < '1' || eq[-1] >= '1' + VCAN_MAXNODES || eq[1] == 0)
+          {
+          usage();
+          return 1;
+          }
+        socketcan_if[eq[-1] - '1'] = eq + 1;
+        break;
+        }
+      case 'c':
+        commands.push_back(optarg);
+        break;
+      default:
+        usage();
+        return 1;
+      }
+    }
+
+  // Config store:
+  host_config_path = store + "/ovms_config";
+  mkdir(store.c_str(), 0755);
+  mkdir(host_config_path.c_str(), 0755);
+  OvmsConfig::instance(TAG).mount();
+  if (!OvmsConfig::instance(TAG).ismounted())
+    {
+    fprintf(stderr, "ovmshost: cannot open config store '%s'\n", host_config_path.c_str());
+    return 1;
+    }
+  OvmsCommandApp::instance(TAG).ConfigureLogging();
+  OvmsConfig::instance(TAG).RegisterParam("vehicle", "Vehicle", true, true);
+
+  // Frameworks:
+  OvmsEvents::instance(TAG);
+  OvmsMetrics::instance(TAG);
+  MetricsStandard::instance(TAG);
+  can::instance(TAG);
+  dbc::instance(TAG);
+  OvmsVehicleFactory::instance(TAG);
+
+  // CAN buses:
+  // (device names are kept by reference, see pcp)
+  static const char* const busname[VCAN_MAXNODES] = { "can1", "can2", "can3", "can4" };
+  vcanwire* wire = new vcanwire();
+  for (int k = 0; k < VCAN_MAXNODES; k++)
+    {
+    const char* name = busname[k];
+    if (socketcan_if[k].empty())
+      new vcan(name, wire);
+    else
+      {
+      ESP_LOGI(TAG, "%s: SocketCAN interface %s", name, socketcan_if[k].c_str());
+      new socketcan(name, socketcan_if[k].c_str());
+      }
+    }
+
+  TimerHandle_t ticker = xTimerCreate("Housekeep ticker", 1000 / portTICK_PERIOD_MS, pdTRUE, NULL, HostTicker1);
+  xTimerStart(ticker, 0);
+
+  OvmsVehicleFactory::instance(TAG).AutoInit();
+
+  hostconsole console;
+  if (!commands.empty())
+    {
+    for (const std::string& command : commands)
+      ExecuteLine(&console, command);
+    }
+  else
+    {
+    char* line = NULL;
+    size_t size = 0;
+    bool prompt = isatty(fileno(stdin));
+    for (;;)
+      {
+      if (prompt)
+        {
+        fputs("OVMS# ", stdout);
+        fflush(stdout);
+        }
+      if (getline(&line, &size, stdin) < 0) break;
+      ExecuteLine(&console, line);
+      }
+    free(line);
+    }
+
+  // Tasks & timers are still running, skip the static destructors:
+  fflush(stdout);
+  fflush(stderr);
+  _exit(0);
+  }
@@ -0,0 +1,341 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        Host runtime: ESP-IDF logging, timer, heap, events & FAT
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <map>
+#include <string>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_event.h"
+#include "esp_wifi_types.h"
+#include "esp_netif_types.h"
+#include "esp_eth_com.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+
+////////////////////////////////////////////////////////////////////////
+// Logging
+////////////////////////////////////////////////////////////////////////
+
+static std::mutex host_logmutex;
+static esp_log_level_t host_loglevel = (esp_log_level_t)CONFIG_LOG_DEFAULT_LEVEL;
+static std::map<std::string, esp_log_level_t> host_taglevels;
+
+extern "C" void esp_log_level_set(const char* tag, esp_log_level_t level)
+  {
+  std::lock_guard<std::mutex> lock(host_logmutex);
+  if (strcmp(tag, "*") == 0)
+    {
+    host_loglevel = level;
+    host_taglevels.clear();
+    }
+  else
+    host_taglevels[tag] = level;
+  }
+
+extern "C" esp_log_level_t esp_log_level_get(const char* tag)
+  {
+  std::lock_guard<std::mutex> lock(host_logmutex);
+  auto it = host_taglevels.find(tag);
+  return (it != host_taglevels.end()) ? it->second : host_loglevel;
+  }
+
+extern "C" void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+  {
+  if (level > esp_log_level_get(tag)) return;
+  std::lock_guard<std::mutex> lock(host_logmutex);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  }
+
+extern "C" void esp_log_buffer_hexdump_internal(const char* tag, const void* buffer, uint16_t length,
+                                                esp_log_level_t level)
+  {
+  if (level > esp_log_level_get(tag)) return;
+  const uint8_t* p = (const uint8_t*)buffer;
+  std::lock_guard<std::mutex> lock(host_logmutex);
+  for (uint16_t k = 0; k < length; k += 16)
+    {
+    fprintf(stderr, "%s: %p ", tag, p + k);
+    for (uint16_t i = k; i < k + 16 && i < length; i++)
+      fprintf(stderr, " %02x", p[i]);
+    fputc('\n', stderr);
+    }
+  }
+
+extern "C" uint32_t esp_log_timestamp()
+  {
+  return xTaskGetTickCount();
+  }
+
+extern "C" unsigned long millis()
+  {
+  return xTaskGetTickCount();
+  }
+
+extern "C" const char* esp_err_to_name(esp_err_t code)
+  {
+  switch (code)
+    {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_INVALID_MAC:       return "ESP_ERR_INVALID_MAC";
+    case ESP_ERR_NOT_FINISHED:      return "ESP_ERR_NOT_FINISHED";
+    default:                        return "UNKNOWN ERROR";
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Heap
+////////////////////////////////////////////////////////////////////////
+
+extern "C" void* heap_caps_malloc(size_t size, uint32_t caps)
+  {
+  return malloc(size);
+  }
+
+extern "C" void* heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+  {
+  return calloc(n, size);
+  }
+
+extern "C" void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps)
+  {
+  return realloc(ptr, size);
+  }
+
+extern "C" void heap_caps_free(void* ptr)
+  {
+  free(ptr);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// High resolution timer
+////////////////////////////////////////////////////////////////////////
+
+// As on the device, callbacks are dispatched by one timer task in
+// expiry order and should be short: a callback delays all others.
+
+struct esp_timer
+  {
+  esp_timer_cb_t callback;
+  void* arg;
+  const char* name;
+  int64_t expiry;
+  uint64_t period;
+  bool active;
+  };
+
+static std::mutex host_timer_mutex;
+static std::condition_variable host_timer_cv;
+static std::multimap<int64_t, esp_timer*> host_timer_list;
+
+extern "C" int64_t esp_timer_get_time()
+  {
+  static const int64_t start = []
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }();
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - start;
+  }
+
+static void host_timer_remove(esp_timer* timer)
+  {
+  for (auto it = host_timer_list.begin(); it != host_timer_list.end(); ++it)
+    {
+    if (it->second == timer)
+      {
+      host_timer_list.erase(it);
+      break;
+      }
+    }
+  timer->active = false;
+  }
+
+static void host_timer_insert(esp_timer* timer, int64_t expiry)
+  {
+  timer->expiry = expiry;
+  timer->active = true;
+  bool first = host_timer_list.empty() || expiry < host_timer_list.begin()->first;
+  host_timer_list.insert(std::make_pair(expiry, timer));
+  if (first) host_timer_cv.notify_all();
+  }
+
+static void host_timer_thread()
+  {
+  std::unique_lock<std::mutex> lock(host_timer_mutex);
+  for (;;)
+    {
+    if (host_timer_list.empty())
+      {
+      host_timer_cv.wait(lock);
+      continue;
+      }
+    auto next = host_timer_list.begin();
+    int64_t now = esp_timer_get_time();
+    if (next->first > now)
+      {
+      host_timer_cv.wait_for(lock, std::chrono::microseconds(next->first - now));
+      continue;
+      }
+    esp_timer* timer = next->second;
+    host_timer_list.erase(next);
+    timer->active = false;
+    if (timer->period)
+      host_timer_insert(timer, timer->expiry + timer->period);
+    esp_timer_cb_t callback = timer->callback;
+    void* arg = timer->arg;
+    lock.unlock();
+    callback(arg);
+    lock.lock();
+    }
+  }
+
+extern "C" esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+  {
+  static std::once_flag started;
+  std::call_once(started, [] { std::thread(host_timer_thread).detach(); });
+  if (args == NULL || args->callback == NULL || handle == NULL)
+    return ESP_ERR_INVALID_ARG;
+  esp_timer* timer = new esp_timer;
+  timer->callback = args->callback;
+  timer->arg = args->arg;
+  timer->name = args->name;
+  timer->expiry = 0;
+  timer->period = 0;
+  timer->active = false;
+  *handle = timer;
+  return ESP_OK;
+  }
+
+static esp_err_t host_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+  {
+  std::lock_guard<std::mutex> lock(host_timer_mutex);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  timer->period = period;
+  host_timer_insert(timer, esp_timer_get_time() + timeout_us);
+  return ESP_OK;
+  }
+
+extern "C" esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+  {
+  return host_timer_start(timer, timeout_us, 0);
+  }
+
+extern "C" esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+  {
+  return host_timer_start(timer, period, period);
+  }
+
+extern "C" esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+  {
+  std::lock_guard<std::mutex> lock(host_timer_mutex);
+  if (!timer->active) return ESP_ERR_INVALID_STATE;
+  host_timer_remove(timer);
+  return ESP_OK;
+  }
+
+extern "C" esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+  {
+  if (timer == NULL) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(host_timer_mutex);
+  if (timer->active) return ESP_ERR_INVALID_STATE;
+  delete timer;
+  return ESP_OK;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// System events
+////////////////////////////////////////////////////////////////////////
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+esp_event_base_t const ETH_EVENT = "ETH_EVENT";
+
+extern "C" esp_err_t esp_event_loop_create_default()
+  {
+  return ESP_OK;
+  }
+
+extern "C" esp_err_t esp_event_loop_delete_default()
+  {
+  return ESP_OK;
+  }
+
+extern "C" esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id,
+                                                         esp_event_handler_t handler, void* arg,
+                                                         esp_event_handler_instance_t* instance)
+  {
+  if (instance) *instance = (void*)handler;
+  return ESP_OK;
+  }
+
+extern "C" esp_err_t esp_event_handler_instance_unregister(esp_event_base_t base, int32_t id,
+                                                           esp_event_handler_instance_t instance)
+  {
+  return ESP_OK;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// FAT file system
+////////////////////////////////////////////////////////////////////////
+
+esp_err_t esp_vfs_fat_spiflash_mount(const char* base_path, const char* partition_label,
+                                     const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle)
+  {
+  if (wl_handle) *wl_handle = 0;
+  return ESP_OK;
+  }
+
+esp_err_t esp_vfs_fat_spiflash_unmount(const char* base_path, wl_handle_t wl_handle)
+  {
+  return ESP_OK;
+  }
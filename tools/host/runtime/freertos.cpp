@@ -0,0 +1,787 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        Host runtime: FreeRTOS API on POSIX threads
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// All kernel objects are guarded by one lock (host_kernel), blocking calls
+// wait on a condition variable of the object. A task waiting in any
+// blocking call can be deleted by another task: vTaskDelete() wakes it
+// up, the call unwinds the task's thread (host_task_exit) and the deleter
+// returns once the thread has left the kernel, so objects the task was
+// blocked on may be freed right away (as on the device).
+
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+typedef std::chrono::steady_clock host_clock;
+
+struct host_task
+  {
+  std::string name;
+  TaskFunction_t function;
+  void* param;
+  UBaseType_t priority;
+  uint32_t stack;
+  uint32_t notify_value;
+  bool notify_pending;
+  bool deleted;               // vTaskDelete() requested
+  bool finished;              // thread has left the task function
+  bool reaped;                // the deleter frees the task
+  bool adopted;               // thread not created by xTaskCreate…()
+  std::condition_variable* waiting;
+  std::condition_variable notify_cv;
+  std::condition_variable finished_cv;
+  };
+
+struct host_queue
+  {
+  enum { Queue, Mutex, RecursiveMutex, Binary, Counting } type;
+  uint8_t* storage;
+  UBaseType_t length;
+  UBaseType_t itemsize;
+  UBaseType_t head;
+  UBaseType_t count;
+  TaskHandle_t owner;         // mutex holder
+  UBaseType_t recursion;
+  std::condition_variable cv;
+  };
+
+struct host_timer
+  {
+  std::string name;
+  TickType_t period;
+  bool autoreload;
+  void* id;
+  TimerCallbackFunction_t callback;
+  bool active;
+  bool deleted;
+  host_clock::time_point expiry;
+  };
+
+struct host_task_exit
+  {
+  };
+
+static std::mutex host_kernel;
+static std::recursive_mutex host_critical;
+static std::list<host_task*> host_tasks;
+static thread_local host_task* host_current = NULL;
+static const host_clock::time_point host_start = host_clock::now();
+
+////////////////////////////////////////////////////////////////////////
+// Tasks
+////////////////////////////////////////////////////////////////////////
+
+// Threads not started by xTaskCreate…() (main, esp_timer, drivers) are
+// adopted as tasks on their first kernel call, so they can block,
+// receive notifications and hold mutexes.
+struct host_adoption
+  {
+  host_task* task = NULL;
+  ~host_adoption()
+    {
+    if (!task) return;
+    std::lock_guard<std::mutex> lock(host_kernel);
+    host_tasks.remove(task);
+    delete task;
+    }
+  };
+static thread_local host_adoption host_adopted;
+
+static host_task* host_newtask(const char* name)
+  {
+  host_task* task = new host_task;
+  task->name = name ? name : "";
+  task->function = NULL;
+  task->param = NULL;
+  task->priority = 1;
+  task->stack = 0;
+  task->notify_value = 0;
+  task->notify_pending = false;
+  task->deleted = false;
+  task->finished = false;
+  task->reaped = false;
+  task->adopted = false;
+  task->waiting = NULL;
+  return task;
+  }
+
+// Call with host_kernel locked
+static host_task* host_self()
+  {
+  if (host_current == NULL)
+    {
+    host_current = host_newtask("main");
+    if (!host_tasks.empty())
+      {
+      char name[configMAX_TASK_NAME_LEN];
+      snprintf(name, sizeof(name), "thread-%u", (unsigned)host_tasks.size());
+      host_current->name = name;
+      }
+    host_current->adopted = true;
+    host_adopted.task = host_current;
+    host_tasks.push_back(host_current);
+    }
+  return host_current;
+  }
+
+// Wait for pred() on cv, up to wait ticks. Call with host_kernel locked.
+template <typename Pred>
+static bool host_wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv,
+                      TickType_t wait, Pred pred)
+  {
+  host_task* self = host_self();
+  if (pred()) return true;
+  if (wait == 0) return false;
+  host_clock::time_point deadline = host_clock::now() + std::chrono::milliseconds(wait);
+  self->waiting = &cv;
+  while (!pred())
+    {
+    if (self->deleted)
+      {
+      self->waiting = NULL;
+      throw host_task_exit();
+      }
+    if (wait == portMAX_DELAY)
+      cv.wait(lock);
+    else if (cv.wait_until(lock, deadline) == std::cv_status::timeout)
+      break;
+    }
+  self->waiting = NULL;
+  if (self->deleted) throw host_task_exit();
+  return pred();
+  }
+
+static void host_taskentry(host_task* task)
+  {
+  host_current = task;
+  try
+    {
+    task->function(task->param);
+    }
+  catch (host_task_exit&)
+    {
+    }
+  std::lock_guard<std::mutex> lock(host_kernel);
+  host_tasks.remove(task);
+  task->finished = true;
+  if (task->reaped)
+    task->finished_cv.notify_all();
+  else
+    delete task;
+  }
+
+extern "C" BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack,
+                                              void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                              BaseType_t core)
+  {
+  host_task* task = host_newtask(name);
+  task->function = fn;
+  task->param = param;
+  task->priority = priority;
+  task->stack = stack;
+    {
+    std::lock_guard<std::mutex> lock(host_kernel);
+    host_tasks.push_back(task);
+    // Set the handle before the task runs, tasks commonly use it at once
+    if (handle) *handle = task;
+    }
+  std::thread(host_taskentry, task).detach();
+  return pdPASS;
+  }
+
+extern "C" void vTaskDelete(TaskHandle_t task)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  host_task* self = host_self();
+  if (task == NULL || task == self)
+    {
+    if (self->adopted)
+      {
+      // An adopted thread (e.g. main) cannot be removed, just stop it:
+      lock.unlock();
+      for (;;) std::this_thread::sleep_for(std::chrono::hours(1));
+      }
+    self->deleted = true;
+    throw host_task_exit();
+    }
+  if (task->finished || task->deleted) return;
+  task->deleted = true;
+  task->reaped = true;
+  if (task->waiting) task->waiting->notify_all();
+  // A running (not blocked) task exits on its next kernel call
+  task->finished_cv.wait(lock, [task] { return task->finished; });
+  delete task;
+  }
+
+extern "C" void vTaskDelay(TickType_t ticks)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  std::condition_variable cv;
+  host_wait(lock, cv, (ticks == 0) ? 1 : ticks, [] { return false; });
+  }
+
+extern "C" void vTaskSuspend(TaskHandle_t task)
+  {
+  if (task == NULL) vTaskDelay(portMAX_DELAY);
+  }
+
+extern "C" void vTaskResume(TaskHandle_t task)
+  {
+  }
+
+extern "C" void taskYIELD()
+  {
+  std::this_thread::yield();
+  }
+
+extern "C" TickType_t xTaskGetTickCount()
+  {
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    host_clock::now() - host_start).count();
+  }
+
+extern "C" TickType_t xTaskGetTickCountFromISR()
+  {
+  return xTaskGetTickCount();
+  }
+
+extern "C" TaskHandle_t xTaskGetCurrentTaskHandle()
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return host_self();
+  }
+
+extern "C" TaskHandle_t xTaskGetHandle(const char* name)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  for (host_task* task : host_tasks)
+    {
+    if (task->name == name) return task;
+    }
+  return NULL;
+  }
+
+extern "C" char* pcTaskGetName(TaskHandle_t task)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (task == NULL) task = host_self();
+  return (char*)task->name.c_str();
+  }
+
+extern "C" UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (task == NULL) task = host_self();
+  return task->priority;
+  }
+
+extern "C" void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (task == NULL) task = host_self();
+  task->priority = priority;
+  }
+
+extern "C" UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+  {
+  // Host threads have large stacks, report the configured size as free
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (task == NULL) task = host_self();
+  return task->stack;
+  }
+
+extern "C" UBaseType_t uxTaskGetNumberOfTasks()
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return host_tasks.size();
+  }
+
+extern "C" UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* runtime)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  host_task* self = host_self();
+  UBaseType_t count = 0;
+  for (host_task* task : host_tasks)
+    {
+    if (count >= size) break;
+    TaskStatus_t* st = &status[count];
+    memset(st, 0, sizeof(*st));
+    st->xHandle = task;
+    st->pcTaskName = task->name.c_str();
+    st->xTaskNumber = ++count;
+    st->eCurrentState = (task == self) ? eRunning : (task->waiting ? eBlocked : eReady);
+    st->uxCurrentPriority = task->priority;
+    st->uxBasePriority = task->priority;
+    st->usStackHighWaterMark = task->stack;
+    st->xCoreID = tskNO_AFFINITY;
+    }
+  if (runtime) *runtime = 0;
+  return count;
+  }
+
+extern "C" BaseType_t xPortGetCoreID()
+  {
+  return 0;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Task notifications
+////////////////////////////////////////////////////////////////////////
+
+extern "C" BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                                         uint32_t* previous)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (previous) *previous = task->notify_value;
+  switch (action)
+    {
+    case eSetBits:                  task->notify_value |= value; break;
+    case eIncrement:                task->notify_value++; break;
+    case eSetValueWithOverwrite:    task->notify_value = value; break;
+    case eSetValueWithoutOverwrite:
+      if (task->notify_pending) return pdFAIL;
+      task->notify_value = value;
+      break;
+    default:
+      break;
+    }
+  task->notify_pending = true;
+  task->notify_cv.notify_all();
+  return pdPASS;
+  }
+
+extern "C" BaseType_t xTaskNotifyWait(uint32_t clearonentry, uint32_t clearonexit, uint32_t* value,
+                                      TickType_t wait)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  host_task* self = host_self();
+  if (!self->notify_pending)
+    self->notify_value &= ~clearonentry;
+  bool ok = host_wait(lock, self->notify_cv, wait, [self] { return self->notify_pending; });
+  if (value) *value = self->notify_value;
+  if (!ok) return pdFALSE;
+  self->notify_value &= ~clearonexit;
+  self->notify_pending = false;
+  return pdTRUE;
+  }
+
+extern "C" uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  host_task* self = host_self();
+  host_wait(lock, self->notify_cv, wait, [self] { return self->notify_value != 0; });
+  uint32_t value = self->notify_value;
+  if (value != 0)
+    self->notify_value = clear ? 0 : value - 1;
+  self->notify_pending = false;
+  return value;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Queues
+////////////////////////////////////////////////////////////////////////
+
+static host_queue* host_newqueue(UBaseType_t length, UBaseType_t itemsize)
+  {
+  host_queue* queue = new host_queue;
+  queue->type = host_queue::Queue;
+  queue->storage = (itemsize > 0) ? new uint8_t[length * itemsize] : NULL;
+  queue->length = length;
+  queue->itemsize = itemsize;
+  queue->head = 0;
+  queue->count = 0;
+  queue->owner = NULL;
+  queue->recursion = 0;
+  return queue;
+  }
+
+extern "C" QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemsize)
+  {
+  if (length == 0) return NULL;
+  return host_newqueue(length, itemsize);
+  }
+
+extern "C" void vQueueDelete(QueueHandle_t queue)
+  {
+  if (queue == NULL) return;
+  delete [] queue->storage;
+  delete queue;
+  }
+
+extern "C" BaseType_t xQueueGenericSend(QueueHandle_t queue, const void* item, TickType_t wait,
+                                        BaseType_t front)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  if (!host_wait(lock, queue->cv, wait, [queue] { return queue->count < queue->length; }))
+    return errQUEUE_FULL;
+  UBaseType_t slot;
+  if (front)
+    {
+    queue->head = (queue->head + queue->length - 1) % queue->length;
+    slot = queue->head;
+    }
+  else
+    slot = (queue->head + queue->count) % queue->length;
+  if (queue->itemsize)
+    memcpy(queue->storage + slot * queue->itemsize, item, queue->itemsize);
+  queue->count++;
+  queue->cv.notify_all();
+  return pdPASS;
+  }
+
+static BaseType_t host_queuereceive(QueueHandle_t queue, void* item, TickType_t wait, bool peek)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  if (!host_wait(lock, queue->cv, wait, [queue] { return queue->count > 0; }))
+    return pdFALSE;
+  if (queue->itemsize)
+    memcpy(item, queue->storage + queue->head * queue->itemsize, queue->itemsize);
+  if (!peek)
+    {
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->cv.notify_all();
+    }
+  return pdTRUE;
+  }
+
+extern "C" BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait)
+  {
+  return host_queuereceive(queue, item, wait, false);
+  }
+
+extern "C" BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait)
+  {
+  return host_queuereceive(queue, item, wait, true);
+  }
+
+extern "C" BaseType_t xQueueReset(QueueHandle_t queue)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  queue->head = 0;
+  queue->count = 0;
+  queue->cv.notify_all();
+  return pdPASS;
+  }
+
+extern "C" UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return queue->count;
+  }
+
+extern "C" UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return queue->length - queue->count;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Semaphores & mutexes
+////////////////////////////////////////////////////////////////////////
+
+// Semaphores are counting queues without storage (as in FreeRTOS), the
+// count is the number of available tokens.
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateMutex()
+  {
+  host_queue* sem = host_newqueue(1, 0);
+  sem->type = host_queue::Mutex;
+  sem->count = 1;
+  return sem;
+  }
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateRecursiveMutex()
+  {
+  host_queue* sem = host_newqueue(1, 0);
+  sem->type = host_queue::RecursiveMutex;
+  sem->count = 1;
+  return sem;
+  }
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateBinary()
+  {
+  host_queue* sem = host_newqueue(1, 0);
+  sem->type = host_queue::Binary;
+  return sem;
+  }
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+  {
+  host_queue* sem = host_newqueue(max, 0);
+  sem->type = host_queue::Counting;
+  sem->count = initial;
+  return sem;
+  }
+
+extern "C" BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  host_task* self = host_self();
+  if (sem->type == host_queue::RecursiveMutex && sem->owner == self)
+    {
+    sem->recursion++;
+    return pdTRUE;
+    }
+  if (!host_wait(lock, sem->cv, wait, [sem] { return sem->count > 0; }))
+    return pdFALSE;
+  sem->count--;
+  if (sem->type == host_queue::Mutex || sem->type == host_queue::RecursiveMutex)
+    {
+    sem->owner = self;
+    sem->recursion = 1;
+    }
+  return pdTRUE;
+  }
+
+extern "C" BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  if (sem->type == host_queue::Mutex || sem->type == host_queue::RecursiveMutex)
+    {
+    if (sem->owner != host_self()) return pdFALSE;
+    if (--sem->recursion > 0) return pdTRUE;
+    sem->owner = NULL;
+    }
+  else if (sem->count >= sem->length)
+    return pdFALSE;
+  sem->count++;
+  sem->cv.notify_all();
+  return pdTRUE;
+  }
+
+extern "C" BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait)
+  {
+  return xSemaphoreTake(sem, wait);
+  }
+
+extern "C" BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+  {
+  return xSemaphoreGive(sem);
+  }
+
+extern "C" UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return sem->count;
+  }
+
+extern "C" TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return sem->owner;
+  }
+
+extern "C" void vSemaphoreDelete(SemaphoreHandle_t sem)
+  {
+  vQueueDelete(sem);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Software timers
+////////////////////////////////////////////////////////////////////////
+
+// The timer service task runs the callbacks in expiry order, like the
+// FreeRTOS daemon task. It is started on the first timer creation.
+
+static std::condition_variable host_timer_cv;
+static std::multimap<host_clock::time_point, host_timer*> host_timer_schedule;
+static host_timer* host_timer_running = NULL;
+
+static void host_timer_unschedule(host_timer* timer)
+  {
+  for (auto it = host_timer_schedule.begin(); it != host_timer_schedule.end(); ++it)
+    {
+    if (it->second == timer)
+      {
+      host_timer_schedule.erase(it);
+      break;
+      }
+    }
+  timer->active = false;
+  }
+
+static void host_timer_schedule_at(host_timer* timer, host_clock::time_point expiry)
+  {
+  host_timer_unschedule(timer);
+  timer->expiry = expiry;
+  timer->active = true;
+  host_timer_schedule.insert(std::make_pair(expiry, timer));
+  host_timer_cv.notify_all();
+  }
+
+static void host_timer_task(void* param)
+  {
+  std::unique_lock<std::mutex> lock(host_kernel);
+  host_self();
+  for (;;)
+    {
+    if (host_timer_schedule.empty())
+      {
+      host_timer_cv.wait(lock);
+      continue;
+      }
+    auto next = host_timer_schedule.begin();
+    if (next->first > host_clock::now())
+      {
+      host_timer_cv.wait_until(lock, next->first);
+      continue;
+      }
+    host_timer* timer = next->second;
+    host_timer_schedule.erase(next);
+    timer->active = false;
+    if (timer->autoreload)
+      {
+      timer->expiry += std::chrono::milliseconds(timer->period);
+      timer->active = true;
+      host_timer_schedule.insert(std::make_pair(timer->expiry, timer));
+      }
+    host_timer_running = timer;
+    lock.unlock();
+    timer->callback(timer);
+    lock.lock();
+    host_timer_running = NULL;
+    if (timer->deleted)
+      delete timer;
+    }
+  }
+
+extern "C" TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t autoreload,
+                                      void* id, TimerCallbackFunction_t callback)
+  {
+  static std::once_flag started;
+  std::call_once(started, [] {
+    xTaskCreatePinnedToCore(host_timer_task, "Tmr Svc", 4096, NULL, configMAX_PRIORITIES-1, NULL, 0);
+    });
+  if (period == 0) return NULL;
+  host_timer* timer = new host_timer;
+  timer->name = name ? name : "";
+  timer->period = period;
+  timer->autoreload = autoreload;
+  timer->id = id;
+  timer->callback = callback;
+  timer->active = false;
+  timer->deleted = false;
+  return timer;
+  }
+
+extern "C" BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  host_timer_schedule_at(timer, host_clock::now() + std::chrono::milliseconds(timer->period));
+  return pdPASS;
+  }
+
+extern "C" BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+  {
+  return xTimerStart(timer, wait);
+  }
+
+extern "C" BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  host_timer_unschedule(timer);
+  return pdPASS;
+  }
+
+extern "C" BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+  {
+  if (period == 0) return pdFAIL;
+  std::lock_guard<std::mutex> lock(host_kernel);
+  timer->period = period;
+  host_timer_schedule_at(timer, host_clock::now() + std::chrono::milliseconds(period));
+  return pdPASS;
+  }
+
+extern "C" BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  host_timer_unschedule(timer);
+  if (timer == host_timer_running)
+    timer->deleted = true;
+  else
+    delete timer;
+  return pdPASS;
+  }
+
+extern "C" BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return timer->active ? pdTRUE : pdFALSE;
+  }
+
+extern "C" TickType_t xTimerGetPeriod(TimerHandle_t timer)
+  {
+  return timer->period;
+  }
+
+extern "C" void* pvTimerGetTimerID(TimerHandle_t timer)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  return timer->id;
+  }
+
+extern "C" void vTimerSetTimerID(TimerHandle_t timer, void* id)
+  {
+  std::lock_guard<std::mutex> lock(host_kernel);
+  timer->id = id;
+  }
+
+extern "C" const char* pcTimerGetName(TimerHandle_t timer)
+  {
+  return timer->name.c_str();
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Critical sections & heap
+////////////////////////////////////////////////////////////////////////
+
+extern "C" void vPortEnterCritical(portMUX_TYPE* mux)
+  {
+  host_critical.lock();
+  }
+
+extern "C" void vPortExitCritical(portMUX_TYPE* mux)
+  {
+  host_critical.unlock();
+  }
+
+extern "C" void* pvPortMalloc(size_t size)
+  {
+  return malloc(size);
+  }
+
+extern "C" void vPortFree(void* ptr)
+  {
+  free(ptr);
+  }
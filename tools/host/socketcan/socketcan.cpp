@@ -0,0 +1,311 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        Host build: Linux SocketCAN driver
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "socketcan";
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include <sstream>
+#include <iomanip>
+#include "global.h"
+#include "socketcan.h"
+
+socketcan::socketcan(const char* name, const char* ifname)
+  : canbus(name)
+  {
+  m_ifname = ifname;
+  m_socket = -1;
+  m_task = NULL;
+  m_powermode = Off;
+  ClearStatus();
+  }
+
+socketcan::~socketcan()
+  {
+  if (m_socket >= 0) Stop();
+  }
+
+esp_err_t socketcan::Start(CAN_mode_t mode, CAN_speed_t speed)
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  if (m_socket >= 0)
+    {
+    ESP_LOGE(TAG, "%s: already started", m_name);
+    return ESP_ERR_INVALID_STATE;
+    }
+
+  int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (fd < 0)
+    {
+    ESP_LOGE(TAG, "%s: socket: %s", m_name, strerror(errno));
+    return ESP_FAIL;
+    }
+
+  struct ifreq ifr = {};
+  strncpy(ifr.ifr_name, m_ifname.c_str(), IFNAMSIZ-1);
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+    ESP_LOGE(TAG, "%s: interface '%s': %s", m_name, m_ifname.c_str(), strerror(errno));
+    close(fd);
+    return ESP_ERR_NOT_FOUND;
+    }
+
+  // Receive own frames as TX confirmations, and controller errors:
+  int on = 1;
+  can_err_mask_t errmask = CAN_ERR_MASK;
+  setsockopt(fd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &on, sizeof(on));
+  setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errmask, sizeof(errmask));
+
+  struct sockaddr_can addr = {};
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+    ESP_LOGE(TAG, "%s: bind '%s': %s", m_name, m_ifname.c_str(), strerror(errno));
+    close(fd);
+    return ESP_FAIL;
+    }
+
+  canbus::Start(mode, speed);
+
+  m_mode = mode;
+  m_speed = speed;
+  m_socket = fd;
+  m_txinflight = 0;
+  ClearStatus();
+
+  // And record that we are powered on
+  pcp::SetPowerMode(On);
+
+  xTaskCreatePinnedToCore(RxTask, "OVMS SocketCAN", 4096, (void*)this, 23, &m_task, CORE(0));
+
+  return ESP_OK;
+  }
+
+esp_err_t socketcan::Stop()
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  canbus::Stop();
+
+  // Clear TX queue
+  m_txqueue.Clear();
+
+  if (m_socket >= 0)
+    {
+    // The RX task polls with a timeout and exits when the socket is gone:
+    int fd = m_socket;
+    m_socket = -1;
+    while (m_task) vTaskDelay(pdMS_TO_TICKS(10));
+    close(fd);
+    }
+
+  // And record that we are powered down
+  pcp::SetPowerMode(Off);
+
+  return ESP_OK;
+  }
+
+/**
+ * WriteFrame: hand a frame to the kernel (call with m_write_mutex held)
+ *  false = socket send buffer full, retry on the next TX confirmation
+ */
+bool socketcan::WriteFrame(const CAN_frame_t* p_frame)
+  {
+  struct can_frame frame = {};
+  frame.can_id = p_frame->MsgID;
+  if (p_frame->FIR.B.FF == CAN_frame_ext) frame.can_id |= CAN_EFF_FLAG;
+  if (p_frame->FIR.B.RTR == CAN_RTR) frame.can_id |= CAN_RTR_FLAG;
+  frame.can_dlc = (p_frame->FIR.B.DLC > 8) ? 8 : p_frame->FIR.B.DLC;
+  memcpy(frame.data, p_frame->data.u8, frame.can_dlc);
+  if (write(m_socket, &frame, sizeof(frame)) != sizeof(frame))
+    {
+    if (errno != ENOBUFS && errno != EAGAIN)
+      {
+      ESP_LOGW(TAG, "%s: write: %s", m_name, strerror(errno));
+      m_status.tx_fails++;
+      }
+    return false;
+    }
+  m_txinflight++;
+  return true;
+  }
+
+esp_err_t socketcan::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+  {
+  OvmsMutexLock lock(&m_write_mutex);
+
+  if (m_powermode != On || m_mode != CAN_MODE_ACTIVE)
+    {
+    ESP_LOGW(TAG,"Cannot write %s when not in ACTIVE mode",m_name);
+    return ESP_FAIL;
+    }
+
+  // if there are frames waiting in the TX queue, add the new one there as well:
+  if (m_txqueue.Pending())
+    {
+    return QueueWrite(p_frame, maxqueuewait);
+    }
+
+  // try to deliver the frame to the kernel:
+  if (!WriteFrame(p_frame))
+    {
+    return QueueWrite(p_frame, maxqueuewait);
+    }
+
+  // stats & logging:
+  canbus::Write(p_frame, maxqueuewait);
+
+  return ESP_OK;
+  }
+
+void socketcan::TxCallback(CAN_frame_t* p_frame, bool success)
+  {
+  // Application callbacks & logging:
+  canbus::TxCallback(p_frame, success);
+
+  // Socket buffer space has become available; send next queued frame (if any):
+  OvmsMutexLock lock(&m_write_mutex);
+  CAN_frame_t frame;
+  if (m_powermode == On && m_txqueue.Pop(&frame))
+    {
+    if (!WriteFrame(&frame))
+      {
+      // The confirmation freed buffer space, so this should not happen:
+      ESP_LOGE(TAG, "%s: TxCallback: socket send buffer full", m_name);
+      CAN_queue_msg_t msg;
+      msg.type = CAN_txfailedcallback;
+      msg.body.frame = frame;
+      msg.body.bus = this;
+      xQueueSend(m_rxqueue, &msg, 0);
+      }
+    else
+      canbus::Write(&frame, 0);
+    }
+  }
+
+void socketcan::RxTask(void* pvParameters)
+  {
+  socketcan* me = (socketcan*)pvParameters;
+  me->RxTask();
+  }
+
+void socketcan::RxTask()
+  {
+  struct can_frame frame;
+  struct sockaddr_can addr;
+  struct iovec iov = { &frame, sizeof(frame) };
+  struct msghdr hdr = {};
+  hdr.msg_name = &addr;
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+
+  int fd;
+  while ((fd = m_socket) >= 0)
+    {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 100) <= 0) continue;
+
+    hdr.msg_namelen = sizeof(addr);
+    hdr.msg_flags = 0;
+    if (recvmsg(fd, &hdr, 0) != sizeof(frame)) continue;
+    int64_t time = esp_timer_get_time();
+
+    CAN_queue_msg_t msg = {};
+    if (frame.can_id & CAN_ERR_FLAG)
+      {
+      // Controller error: counters are in data[6] (TX) & data[7] (RX)
+      m_errorframes++;
+      m_status.error_flags = frame.can_id & CAN_ERR_MASK;
+      if (frame.can_id & CAN_ERR_CRTL)
+        {
+        m_status.errors_tx = frame.data[6];
+        m_status.errors_rx = frame.data[7];
+        if (frame.data[1] & (CAN_ERR_CRTL_RX_OVERFLOW))
+          m_status.rxbuf_overflow++;
+        }
+      m_status.error_time = monotonictime;
+      msg.type = CAN_logerror;
+      msg.body.bus = this;
+      xQueueSend(m_rxqueue, &msg, 0);
+      continue;
+      }
+
+    msg.body.frame.origin = this;
+    msg.body.frame.callback = NULL;
+    msg.body.frame.FIR.B.FF = (frame.can_id & CAN_EFF_FLAG) ? CAN_frame_ext : CAN_frame_std;
+    msg.body.frame.FIR.B.RTR = (frame.can_id & CAN_RTR_FLAG) ? CAN_RTR : CAN_no_RTR;
+    msg.body.frame.FIR.B.DLC = frame.can_dlc;
+    msg.body.frame.MsgID = frame.can_id & ((frame.can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+    memcpy(msg.body.frame.data.u8, frame.data, (frame.can_dlc > 8) ? 8 : frame.can_dlc);
+
+    if (hdr.msg_flags & MSG_CONFIRM)
+      {
+      // Own frame sent
+      if (m_txinflight) m_txinflight--;
+      msg.type = CAN_txcallback;
+      msg.body.bus = this;
+      xQueueSend(m_rxqueue, &msg, 0);
+      }
+    else
+      {
+      msg.type = CAN_frame;
+      msg.time = (uint32_t)time;
+      if (xQueueSend(m_rxqueue, &msg, 0) != pdTRUE)
+        m_status.rxbuf_overflow++;
+      }
+    }
+
+  m_task = NULL;
+  vTaskDelete(NULL);
+  }
+
+void socketcan::ClearStatus()
+  {
+  canbus::ClearStatus();
+  m_errorframes = 0;
+  }
+
+std::string socketcan::GetDriverStatus()
+  {
+  std::ostringstream buf;
+
+  buf << "Interface: " << std::setw(20) << m_ifname << "\n";
+  buf << "TX in flight:" << std::setw(18) << m_txinflight << "\n";
+  buf << "Error frames:" << std::setw(18) << m_errorframes << "\n";
+
+  return buf.str();
+  }
@@ -0,0 +1,77 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Module:        Host build: Linux SocketCAN driver
+;    Date:          16th October 2026
+;
+;    (C) 2026       Mark Webb-Johnson
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __SOCKETCAN_H__
+#define __SOCKETCAN_H__
+
+#include <stdint.h>
+#include <string>
+#include "can.h"
+#include "ovms_mutex.h"
+
+// SocketCAN bus (Linux host build)
+// Binds a canbus to a Linux CAN network interface, e.g. a USB adapter
+// (can0) or a kernel virtual bus (vcan0) shared with can-utils. The bit
+// rate & controller mode are interface settings ("ip link set can0 type
+// can bitrate 500000 [listen-only on]"), the speed passed to Start() is
+// used for the bus statistics only.
+//
+// Frames are written to the socket non-blocking. Own frames are received
+// back once sent (CAN_RAW_RECV_OWN_MSGS), these confirmations drive the
+// TX callbacks and the software TX queue like the TX interrupt of a
+// hardware driver.
+
+class socketcan : public canbus
+  {
+  public:
+    socketcan(const char* name, const char* ifname);
+    ~socketcan();
+
+  public:
+    esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
+    esp_err_t Stop();
+
+  public:
+    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+    void TxCallback(CAN_frame_t* p_frame, bool success);
+    void ClearStatus();
+    std::string GetDriverStatus();
+
+  protected:
+    static void RxTask(void* pvParameters);
+    void RxTask();
+    bool WriteFrame(const CAN_frame_t* p_frame);
+
+  public:
+    std::string m_ifname;
+    int m_socket;
+    TaskHandle_t m_task;
+    OvmsMutex m_write_mutex;
+    uint32_t m_txinflight;            // frames written, not yet confirmed
+    uint32_t m_errorframes;           // error frames received
+  };
+
+#endif //#ifndef __SOCKETCAN_H__